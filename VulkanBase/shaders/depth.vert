@@ -0,0 +1,29 @@
+#version 450
+
+// Depth prepass, position stream only and no fragment stage
+// main pass tests with EQUAL, so position must be computed exactly like in shader.vert
+
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 viewMat;
+    mat4 projMat;
+};
+
+struct ObjectData {
+    mat4 modelMat;
+    mat4 prevModelMat;
+    mat3 normalMat;
+    uint materialIndex;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main() {
+    mat4 modelMat = objects[gl_InstanceIndex].modelMat;
+    gl_Position = projMat * viewMat * modelMat * vec4(inPosition, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 450
+
+// Cheap shader used while real pipeline of material is compiled on worker threads
+// Uses only inputs from shader.vert, so it works with the same pipeline layout
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 worldPos;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec3 N = normalize(fragNormal);
+    vec3 L = normalize(vec3(2.0, 3.0, 1.0));
+
+    float diffuse = max(0.0, dot(N, L) * 0.5 + 0.5);
+    outColor = vec4(vec3(0.5) * diffuse, 1.0);
+}
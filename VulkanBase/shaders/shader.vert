@@ -5,8 +5,16 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 projMat;
 };
 
-layout(push_constant) uniform pc {
+struct ObjectData {
     mat4 modelMat;
+    mat4 prevModelMat;
+    mat3 normalMat;     // inverse transpose of model, computed on cpu
+    uint materialIndex;
+};
+
+// one entry per object, firstInstance of the draw points at its first object
+layout(std430, set = 0, binding = 1) readonly buffer Objects {
+    ObjectData objects[];
 };
 
 layout(location = 0) in vec3 inPosition;
@@ -17,9 +25,14 @@ layout(location = 0) out vec3 fragNormal;
 layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out vec3 worldPos;
 
+// same depth as depth.vert, main pass tests against prepass depth with EQUAL
+invariant gl_Position;
+
 void main() {
+    mat4 modelMat = objects[gl_InstanceIndex].modelMat;
+
     // interpolation
-    fragNormal = (transpose(inverse(modelMat)) * vec4(inNormal, 0.0)).xyz;
+    fragNormal = objects[gl_InstanceIndex].normalMat * inNormal;
     fragTexCoord = inTexCoord;
 
     // space transformations
@@ -0,0 +1,590 @@
+#include "benchmark.h"
+
+using namespace vu;
+
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// 1, 2, 4 .. up to core count (core count itself is always included)
+static std::vector<uint32_t> benchmarkThreadCounts() {
+	std::vector<uint32_t> counts;
+	uint32_t cores = JobSystem::GetCoreCount();
+	for (uint32_t count = 1; count < cores; count *= 2) {
+		counts.push_back(count);
+	}
+	counts.push_back(cores);
+	return counts;
+}
+
+
+void vu::runBenchmarks() {
+	runJobSystemBenchmarks();
+	runSceneBenchmarks();
+	runTransformBenchmarks();
+	runSoftwareOcclusionBenchmarks();
+	runBvhBenchmarks();
+}
+
+
+void vu::runJobSystemBenchmarks() {
+	const uint32_t EMPTY_JOBS     = 200000;
+	const uint32_t FOR_ITEMS      = 1 << 24;
+	const uint32_t CHAIN_STAGES   = 2000;
+	const uint32_t JOBS_PER_STAGE = 16;
+
+	std::cout << "job system benchmark (" << JobSystem::GetCoreCount() << " cores)\n";
+	std::cout << std::fixed << std::setprecision(3);
+
+	std::vector<float> data(FOR_ITEMS);
+	for (uint32_t i = 0; i < FOR_ITEMS; i++) {
+		data[i] = static_cast<float>(i % 1024) * 0.01f;
+	}
+
+	double singleThreadForMs = 0.0;
+
+	for (uint32_t threads : benchmarkThreadCounts()) {
+		JobSystem jobs;
+		jobs.Initialize(threads);
+
+		// cost of Run + execute + Wait for jobs that do nothing
+		JobCounter emptyCounter;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < EMPTY_JOBS; i++) {
+			jobs.Run([] {}, &emptyCounter);
+		}
+		jobs.Wait(emptyCounter);
+		double emptyNs = elapsedMs(start) * 1.0e6 / EMPTY_JOBS;
+
+		// compute bound parallel for
+		std::atomic<uint64_t> sink{0};
+		start = std::chrono::high_resolution_clock::now();
+		jobs.ParallelFor(FOR_ITEMS, threads == 1 ? FOR_ITEMS : 0, [&data, &sink](uint32_t first, uint32_t count) {
+			float sum = 0.0f;
+			for (uint32_t i = first; i < first + count; i++) {
+				sum += std::sqrt(data[i]) * std::sin(data[i]);
+			}
+			sink += static_cast<uint64_t>(sum);
+		});
+		double forMs = elapsedMs(start);
+		if (threads == 1) {
+			singleThreadForMs = forMs;
+		}
+
+		// stages of jobs where every stage waits for the previous one
+		std::vector<std::unique_ptr<JobCounter>> stages;
+		for (uint32_t i = 0; i < CHAIN_STAGES; i++) {
+			stages.push_back(std::make_unique<JobCounter>());
+		}
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t stage = 0; stage < CHAIN_STAGES; stage++) {
+			for (uint32_t i = 0; i < JOBS_PER_STAGE; i++) {
+				if (stage == 0) {
+					jobs.Run([] {}, stages[stage].get());
+				} else {
+					jobs.RunAfter(*stages[stage - 1], [] {}, stages[stage].get());
+				}
+			}
+		}
+		jobs.Wait(*stages.back());
+		double chainUs = elapsedMs(start) * 1.0e3 / CHAIN_STAGES;
+
+		JobSystemStats stats = jobs.GetStats();
+		jobs.Destroy();
+
+		std::cout << "\t" << threads << " threads:"
+		          << " empty job " << emptyNs << " ns,"
+		          << " parallel for " << forMs << " ms (speedup " << singleThreadForMs / forMs << "x),"
+		          << " dependent stage " << chainUs << " us,"
+		          << " stolen " << 100.0 * stats.stolen / std::max<uint64_t>(stats.executed, 1) << "%\n";
+	}
+
+	std::cout << "\n";
+}
+
+
+void vu::runSceneBenchmarks() {
+	const uint32_t ROOTS            = 1024;
+	const uint32_t GROUPS_PER_ROOT  = 8;
+	const uint32_t LEAVES_PER_GROUP = 16;
+	const uint32_t UPDATES          = 64;
+
+	// roots -> groups -> leaves, 3 levels like objects attached to moving parents
+	Scene scene;
+	scene.Reserve(ROOTS * (1 + GROUPS_PER_ROOT * (1 + LEAVES_PER_GROUP)));
+
+	std::vector<Entity> roots;
+	std::vector<Entity> leaves;
+	for (uint32_t root = 0; root < ROOTS; root++) {
+		Entity rootEntity = scene.CreateEntity(glm::vec3(static_cast<float>(root), 0.0f, 0.0f));
+		roots.push_back(rootEntity);
+
+		for (uint32_t group = 0; group < GROUPS_PER_ROOT; group++) {
+			Entity groupEntity = scene.CreateEntity(glm::vec3(0.0f, static_cast<float>(group), 0.0f), rootEntity);
+			for (uint32_t leaf = 0; leaf < LEAVES_PER_GROUP; leaf++) {
+				leaves.push_back(scene.CreateEntity(glm::vec3(0.0f, 0.0f, static_cast<float>(leaf)), groupEntity));
+			}
+		}
+	}
+
+	std::cout << "scene benchmark (" << scene.GetEntityCount() << " entities)\n";
+	std::cout << std::fixed << std::setprecision(3);
+
+	auto measure = [&scene](const char *name, auto &&dirty) {
+		double totalMs = 0.0;
+		uint32_t updated = 0;
+		for (uint32_t i = 0; i < UPDATES; i++) {
+			dirty(i);
+			auto start = std::chrono::high_resolution_clock::now();
+			scene.Update();
+			totalMs += elapsedMs(start);
+			updated = scene.GetStats().updatedEntities;
+		}
+		std::cout << "\t" << name << ": " << totalMs / UPDATES << " ms (" << updated << " world matrices)\n";
+	};
+
+	measure("all roots dirty", [&](uint32_t frame) {
+		for (Entity root : roots) {
+			scene.SetRotation(root, glm::vec3(0.0f, frame * 0.01f, 0.0f));
+		}
+	});
+	measure("1% of roots dirty", [&](uint32_t frame) {
+		for (uint32_t i = 0; i < ROOTS; i += 100) {
+			scene.SetRotation(roots[i], glm::vec3(0.0f, frame * 0.01f, 0.0f));
+		}
+	});
+	measure("one leaf dirty", [&](uint32_t frame) {
+		scene.SetScale(leaves[frame % leaves.size()], glm::vec3(1.0f + frame * 0.01f));
+	});
+	measure("nothing dirty", [](uint32_t) {});
+
+	// every even root moves under next odd root created after it, next update has to sort the hierarchy
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = 1; i < ROOTS; i += 2) {
+		scene.SetParent(roots[i - 1], roots[i]);
+	}
+	scene.Update();
+	std::cout << "\t" << "reparent " << ROOTS / 2 << " roots + sort: " << elapsedMs(start) << " ms\n\n";
+}
+
+
+void vu::runTransformBenchmarks() {
+	const uint32_t TRANSFORMS = 16384;
+	const uint32_t REPEATS    = 64;
+
+	std::cout << "transform benchmark (" << TRANSFORMS << " transforms, best simd: " << simdLevelName(getSimdLevel()) << ")\n";
+	std::cout << std::fixed << std::setprecision(3);
+
+	// same transforms as euler angles and as packed streams
+	std::vector<glm::vec3> positions(TRANSFORMS), eulers(TRANSFORMS), scales(TRANSFORMS);
+	std::vector<float> streams[10];
+	for (std::vector<float> &stream : streams) {
+		stream.resize(TRANSFORMS);
+	}
+
+	for (uint32_t i = 0; i < TRANSFORMS; i++) {
+		float f = static_cast<float>(i);
+		positions[i] = glm::vec3(f * 0.1f, std::sin(f), std::cos(f));
+		eulers[i] = glm::vec3(f * 0.01f, f * 0.02f, f * 0.03f);
+		scales[i] = glm::vec3(1.0f + std::fmod(f, 3.0f), 1.0f, 2.0f);
+
+		glm::quat rotation = glm::angleAxis(eulers[i].x, glm::vec3(1.0f, 0.0f, 0.0f)) *
+		                     glm::angleAxis(eulers[i].y, glm::vec3(0.0f, 1.0f, 0.0f)) *
+		                     glm::angleAxis(eulers[i].z, glm::vec3(0.0f, 0.0f, 1.0f));
+		float values[10] = {positions[i].x, positions[i].y, positions[i].z, rotation.x, rotation.y, rotation.z, rotation.w, scales[i].x, scales[i].y, scales[i].z};
+		for (uint32_t stream = 0; stream < 10; stream++) {
+			streams[stream][i] = values[stream];
+		}
+	}
+
+	TransformStreams transforms{
+		streams[0].data(), streams[1].data(), streams[2].data(),
+		streams[3].data(), streams[4].data(), streams[5].data(), streams[6].data(),
+		streams[7].data(), streams[8].data(), streams[9].data(),
+		TRANSFORMS
+	};
+
+	std::vector<glm::mat4> models(TRANSFORMS), referenceModels(TRANSFORMS);
+	std::vector<glm::mat3x4> normals(TRANSFORMS);
+	std::vector<glm::mat3> referenceNormals(TRANSFORMS);
+
+	auto report = [](const char *name, double totalMs) {
+		std::cout << "\t" << name << ": " << totalMs * 1.0e6 / (static_cast<double>(REPEATS) * TRANSFORMS) << " ns per transform\n";
+	};
+
+	// what Transform::GetModelMatrix did before, normal matrix like shader.vert computes it per vertex
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t repeat = 0; repeat < REPEATS; repeat++) {
+		for (uint32_t i = 0; i < TRANSFORMS; i++) {
+			glm::mat4 T = glm::translate(glm::mat4(1.0f), positions[i]);
+			glm::mat4 R = glm::rotate(glm::mat4(1.0), eulers[i].x, glm::vec3(1.0f, 0.0f, 0.0f));
+			R = glm::rotate(R, eulers[i].y, glm::vec3(0.0f, 1.0f, 0.0f));
+			R = glm::rotate(R, eulers[i].z, glm::vec3(0.0f, 0.0f, 1.0f));
+			glm::mat4 S = glm::scale(glm::mat4(1.0), scales[i]);
+			referenceModels[i] = T * R * S;
+			referenceNormals[i] = glm::mat3(glm::transpose(glm::inverse(referenceModels[i])));
+		}
+	}
+	report("glm euler + inverse", elapsedMs(start));
+
+	start = std::chrono::high_resolution_clock::now();
+	for (uint32_t repeat = 0; repeat < REPEATS; repeat++) {
+		for (uint32_t i = 0; i < TRANSFORMS; i++) {
+			Transform transform(positions[i], glm::quat(streams[6][i], streams[3][i], streams[4][i], streams[5][i]), scales[i]);
+			models[i] = transform.GetModelMatrix();
+		}
+	}
+	report("vu::Transform (quaternion)", elapsedMs(start));
+
+	std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+	if (getSimdLevel() >= SimdLevel::Sse2) {
+		levels.push_back(SimdLevel::Sse2);
+	}
+	if (getSimdLevel() >= SimdLevel::Avx2) {
+		levels.push_back(SimdLevel::Avx2);
+	}
+
+	for (SimdLevel level : levels) {
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t repeat = 0; repeat < REPEATS; repeat++) {
+			computeTransformMatrices(transforms, models.data(), normals.data(), level);
+		}
+		double totalMs = elapsedMs(start);
+
+		// largest difference to glm, models and normals
+		float error = 0.0f;
+		for (uint32_t i = 0; i < TRANSFORMS; i++) {
+			for (int column = 0; column < 4; column++) {
+				glm::vec4 difference = glm::abs(models[i][column] - referenceModels[i][column]);
+				error = std::max(error, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+			}
+			for (int column = 0; column < 3; column++) {
+				glm::vec3 difference = glm::abs(glm::vec3(normals[i][column]) - referenceNormals[i][column]);
+				error = std::max(error, std::max(std::max(difference.x, difference.y), difference.z));
+			}
+		}
+
+		std::string name = std::string("batch ") + simdLevelName(level) + " + normals";
+		report(name.c_str(), totalMs);
+		std::cout << "\t\t" << "max error: " << std::scientific << error << std::fixed << "\n";
+	}
+
+	std::cout << "\n";
+}
+
+
+// n x n quads in [-1, 1] on z = 0 plane
+static void makeGridMesh(uint32_t n, std::vector<glm::vec3> &positions, std::vector<uint32_t> &indices) {
+	for (uint32_t y = 0; y <= n; y++) {
+		for (uint32_t x = 0; x <= n; x++) {
+			positions.push_back(glm::vec3(2.0f * x / n - 1.0f, 2.0f * y / n - 1.0f, 0.0f));
+		}
+	}
+	for (uint32_t y = 0; y < n; y++) {
+		for (uint32_t x = 0; x < n; x++) {
+			uint32_t i = y * (n + 1) + x;
+			indices.insert(indices.end(), {i, i + 1, i + n + 2, i, i + n + 2, i + n + 1});
+		}
+	}
+}
+
+
+void vu::runSoftwareOcclusionBenchmarks() {
+	const uint32_t GRID      = 64;     // quads per side of one wall, 8192 triangles
+	const uint32_t WALLS     = 4;
+	const uint32_t OBJECTS   = 20000;
+	const uint32_t REPEATS   = 64;
+	const uint32_t REFERENCE = 8;      // reference resolution multiplier
+
+	std::cout << "software occlusion benchmark (" << WALLS << " walls of " << GRID * GRID * 2 << " triangles, " << OBJECTS
+	          << " boxes, best simd: " << simdLevelName(getSimdLevel()) << ")\n";
+	std::cout << std::fixed << std::setprecision(3);
+
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+	makeGridMesh(GRID, positions, indices);
+
+	// camera at origin looking down -z, walls side by side with gaps between them
+	glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+	proj[1][1] *= -1;
+	glm::mat4 viewProj = proj * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	std::vector<OccluderInstance> occluders;
+	for (uint32_t i = 0; i < WALLS; i++) {
+		glm::vec3 center(-7.5f + 5.0f * i, 0.0f, -10.0f - 2.0f * i);
+		occluders.push_back({0, glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(2.0f, 4.0f, 1.0f))});
+	}
+
+	// small boxes in front of and behind the walls
+	std::vector<OcclusionQuery> queries(OBJECTS);
+	uint32_t seed = 12345;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+	};
+	for (OcclusionQuery &query : queries) {
+		glm::vec3 position(-20.0f + 40.0f * random(), -6.0f + 12.0f * random(), -2.0f - 40.0f * random());
+		query.boundsMin = glm::vec3(-0.5f);
+		query.boundsMax = glm::vec3(0.5f);
+		query.model = glm::scale(glm::translate(glm::mat4(1.0f), position), glm::vec3(0.2f + random()));
+	}
+
+	std::vector<SimdLevel> levels = {SimdLevel::Scalar};
+	if (getSimdLevel() >= SimdLevel::Avx2) {
+		levels.push_back(SimdLevel::Avx2);
+	}
+
+	std::vector<uint8_t> occluded(OBJECTS);
+	for (uint32_t threads : benchmarkThreadCounts()) {
+		JobSystem jobs;
+		jobs.Initialize(threads);
+
+		for (SimdLevel level : levels) {
+			SoftwareOcclusion occlusion;
+			occlusion.Initialize(&jobs, 320, 192, level);
+			occlusion.AddMesh(positions, indices);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (uint32_t repeat = 0; repeat < REPEATS; repeat++) {
+				occlusion.Render(viewProj, occluders);
+			}
+			double renderMs = elapsedMs(start) / REPEATS;
+
+			start = std::chrono::high_resolution_clock::now();
+			for (uint32_t repeat = 0; repeat < REPEATS; repeat++) {
+				occlusion.Test(queries.data(), OBJECTS, occluded.data());
+			}
+			double testMs = elapsedMs(start) / REPEATS;
+
+			const SoftwareOcclusionStats &stats = occlusion.GetStats();
+			std::cout << "\t" << threads << " threads, " << simdLevelName(level) << ": render " << renderMs << " ms ("
+			          << stats.triangles / renderMs * 1.0e-3 << " M triangles/s), test " << testMs << " ms, culled "
+			          << stats.culled << " of " << stats.tested << "\n";
+		}
+
+		jobs.Destroy();
+	}
+
+	// low resolution misses gaps narrower than a pixel (wrongly culled) and culls less near occluder edges (missed)
+	SoftwareOcclusion occlusion;
+	occlusion.Initialize(nullptr, 320, 192);
+	occlusion.AddMesh(positions, indices);
+	occlusion.Render(viewProj, occluders);
+	occlusion.Test(queries.data(), OBJECTS, occluded.data());
+
+	SoftwareOcclusion reference;
+	reference.Initialize(nullptr, 320 * REFERENCE, 192 * REFERENCE, SimdLevel::Scalar);
+	reference.AddMesh(positions, indices);
+	reference.Render(viewProj, occluders);
+	std::vector<uint8_t> referenceOccluded(OBJECTS);
+	reference.Test(queries.data(), OBJECTS, referenceOccluded.data());
+
+	uint32_t wronglyCulled = 0;
+	uint32_t missed = 0;
+	for (uint32_t i = 0; i < OBJECTS; i++) {
+		wronglyCulled += occluded[i] && !referenceOccluded[i] ? 1 : 0;
+		missed += !occluded[i] && referenceOccluded[i] ? 1 : 0;
+	}
+
+	std::cout << "\t" << "accuracy against " << reference.GetWidth() << "x" << reference.GetHeight() << ": culled " << occlusion.GetStats().culled
+	          << " (reference " << reference.GetStats().culled << "), wrongly culled " << wronglyCulled << ", missed " << missed << "\n\n";
+}
+
+
+static bool boxInFrustum(const glm::vec4 planes[6], const Aabb &bounds) {
+	for (int p = 0; p < 6; p++) {
+		glm::vec3 front(planes[p].x >= 0.0f ? bounds.max.x : bounds.min.x, planes[p].y >= 0.0f ? bounds.max.y : bounds.min.y,
+		                planes[p].z >= 0.0f ? bounds.max.z : bounds.min.z);
+		if (glm::dot(glm::vec3(planes[p]), front) + planes[p].w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static float rayBoxDistance(const glm::vec3 &origin, const glm::vec3 &direction, const Aabb &bounds) {
+	float enter = 0.0f;
+	float exit = std::numeric_limits<float>::max();
+	for (int i = 0; i < 3; i++) {
+		float t0 = (bounds.min[i] - origin[i]) / direction[i];
+		float t1 = (bounds.max[i] - origin[i]) / direction[i];
+		enter = std::max(enter, std::min(t0, t1));
+		exit = std::min(exit, std::max(t0, t1));
+	}
+	return enter <= exit ? enter : std::numeric_limits<float>::max();
+}
+
+
+void vu::runBvhBenchmarks() {
+	const uint32_t COUNTS[]      = {10000, 100000, 1000000};
+	const uint32_t REPEATS       = 16;
+	const uint32_t QUERIES       = 1000;  // rays and spheres
+	const uint32_t BRUTE_QUERIES = 50;    // brute force is too slow for all of them at 1M
+	const float    MOVED         = 0.01f; // fraction of items moved before refit
+
+	std::cout << "bvh benchmark (binned sah build, refit, frustum / ray / sphere queries against brute force)\n";
+	std::cout << std::fixed << std::setprecision(3);
+
+	uint32_t seed = 12345;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24);
+	};
+
+	for (uint32_t count : COUNTS) {
+		// same density for every count: boxes 0.2 - 1.2 wide in cube around origin
+		float side = 4.0f * std::cbrt(static_cast<float>(count));
+		std::vector<Aabb> bounds(count);
+		for (Aabb &box : bounds) {
+			glm::vec3 center = (glm::vec3(random(), random(), random()) - glm::vec3(0.5f)) * side;
+			glm::vec3 extent = glm::vec3(0.1f + 0.5f * random());
+			box = {center - extent, center + extent};
+		}
+
+		Bvh bvh;
+		auto start = std::chrono::high_resolution_clock::now();
+		bvh.Build(bounds.data(), count);
+		double buildMs = elapsedMs(start);
+
+		// camera in the middle of the cube
+		glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, side * 0.5f);
+		proj[1][1] *= -1;
+		glm::vec4 planes[6];
+		extractFrustumPlanes(proj * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)), planes);
+
+		std::vector<glm::vec3> origins(QUERIES);
+		std::vector<glm::vec3> directions(QUERIES);
+		std::vector<float>     radii(QUERIES);
+		for (uint32_t i = 0; i < QUERIES; i++) {
+			origins[i] = (glm::vec3(random(), random(), random()) - glm::vec3(0.5f)) * side;
+			directions[i] = glm::normalize(glm::vec3(random(), random(), random()) - glm::vec3(0.5f));
+			radii[i] = 1.0f + 4.0f * random();
+		}
+
+		std::vector<uint32_t> items;
+		std::vector<uint32_t> bruteItems;
+		bool match = true;
+		auto sameItems = [&items, &bruteItems]() {
+			std::sort(items.begin(), items.end());
+			std::sort(bruteItems.begin(), bruteItems.end());
+			return items == bruteItems;
+		};
+
+		// frustum
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t repeat = 0; repeat < REPEATS; repeat++) {
+			items.clear();
+			bvh.QueryFrustum(planes, items);
+		}
+		double frustumMs = elapsedMs(start) / REPEATS;
+
+		start = std::chrono::high_resolution_clock::now();
+		bruteItems.clear();
+		for (uint32_t i = 0; i < count; i++) {
+			if (boxInFrustum(planes, bounds[i])) {
+				bruteItems.push_back(i);
+			}
+		}
+		double bruteFrustumMs = elapsedMs(start);
+		size_t visible = items.size();
+		match = match && sameItems();
+
+		// rays
+		start = std::chrono::high_resolution_clock::now();
+		uint32_t hits = 0;
+		for (uint32_t i = 0; i < QUERIES; i++) {
+			hits += bvh.Raycast(origins[i], directions[i]).item != BVH_NO_ITEM ? 1 : 0;
+		}
+		double rayUs = elapsedMs(start) * 1000.0 / QUERIES;
+
+		start = std::chrono::high_resolution_clock::now();
+		std::vector<float> bruteDistances(BRUTE_QUERIES, std::numeric_limits<float>::max());
+		for (uint32_t i = 0; i < BRUTE_QUERIES; i++) {
+			for (uint32_t item = 0; item < count; item++) {
+				bruteDistances[i] = std::min(bruteDistances[i], rayBoxDistance(origins[i], directions[i], bounds[item]));
+			}
+		}
+		double bruteRayUs = elapsedMs(start) * 1000.0 / BRUTE_QUERIES;
+		for (uint32_t i = 0; i < BRUTE_QUERIES; i++) {
+			BvhRayHit hit = bvh.Raycast(origins[i], directions[i]);
+			match = match && std::abs(hit.distance - bruteDistances[i]) <= 1.0e-4f * std::max(1.0f, bruteDistances[i]);
+		}
+
+		// spheres
+		start = std::chrono::high_resolution_clock::now();
+		size_t found = 0;
+		for (uint32_t i = 0; i < QUERIES; i++) {
+			items.clear();
+			bvh.QuerySphere(origins[i], radii[i], items);
+			found += items.size();
+		}
+		double sphereUs = elapsedMs(start) * 1000.0 / QUERIES;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < BRUTE_QUERIES; i++) {
+			bruteItems.clear();
+			for (uint32_t item = 0; item < count; item++) {
+				glm::vec3 offset = glm::max(bounds[item].min, glm::min(origins[i], bounds[item].max)) - origins[i];
+				if (glm::dot(offset, offset) <= radii[i] * radii[i]) {
+					bruteItems.push_back(item);
+				}
+			}
+		}
+		double bruteSphereUs = elapsedMs(start) * 1000.0 / BRUTE_QUERIES;
+		items.clear();
+		bvh.QuerySphere(origins[BRUTE_QUERIES - 1], radii[BRUTE_QUERIES - 1], items);
+		match = match && sameItems();
+
+		// some items move a little, tree is refitted, then built again
+		uint32_t moved = static_cast<uint32_t>(count * MOVED);
+		std::vector<uint32_t> movedItems(moved);
+		for (uint32_t i = 0; i < moved; i++) {
+			movedItems[i] = static_cast<uint32_t>(random() * count) % count;
+			glm::vec3 offset = (glm::vec3(random(), random(), random()) - glm::vec3(0.5f)) * 8.0f;
+			bounds[movedItems[i]].min += offset;
+			bounds[movedItems[i]].max += offset;
+		}
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t item : movedItems) {
+			bvh.Update(item, bounds[item]);
+		}
+		double refitMs = elapsedMs(start);
+		float refitCost = bvh.GetCost();
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t repeat = 0; repeat < REPEATS; repeat++) {
+			items.clear();
+			bvh.QueryFrustum(planes, items);
+		}
+		double refitFrustumMs = elapsedMs(start) / REPEATS;
+		bruteItems.clear();
+		for (uint32_t i = 0; i < count; i++) {
+			if (boxInFrustum(planes, bounds[i])) {
+				bruteItems.push_back(i);
+			}
+		}
+		match = match && sameItems();
+
+		float builtCost = bvh.GetStats().builtCost;
+		start = std::chrono::high_resolution_clock::now();
+		bvh.Build(bounds.data(), count);
+		double rebuildMs = elapsedMs(start);
+
+		const BvhStats &stats = bvh.GetStats();
+		std::cout << "\t" << count << " items: build " << buildMs << " ms (" << stats.nodes << " nodes, depth " << stats.depth
+		          << ", sah cost " << builtCost << ")\n";
+		std::cout << "\t\t" << "frustum (" << visible << " visible): bvh " << frustumMs << " ms, brute force " << bruteFrustumMs << " ms\n";
+		std::cout << "\t\t" << "ray (" << hits << " of " << QUERIES << " hit): bvh " << rayUs << " us, brute force " << bruteRayUs << " us\n";
+		std::cout << "\t\t" << "sphere (" << static_cast<double>(found) / QUERIES << " found): bvh " << sphereUs << " us, brute force "
+		          << bruteSphereUs << " us\n";
+		std::cout << "\t\t" << "refit of " << moved << " moved: " << refitMs << " ms, sah cost " << refitCost << ", frustum "
+		          << refitFrustumMs << " ms; rebuild " << rebuildMs << " ms, sah cost " << stats.builtCost << "\n";
+		std::cout << "\t\t" << (match ? "results match brute force" : "RESULTS DIFFER FROM BRUTE FORCE") << "\n";
+	}
+	std::cout << "\n";
+}
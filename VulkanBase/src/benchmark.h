@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <limits>
+
+#include "bvh.h"
+#include "frustum.h"
+#include "job_system.h"
+#include "scene.h"
+#include "software_occlusion.h"
+#include "transform.h"
+
+namespace vu {
+
+	// microbenchmarks of engine systems, started with --benchmark instead of opening a window
+	void runBenchmarks();
+
+	// scheduling overhead, parallel for scaling and dependency chains for 1, 2, 4 .. core count threads
+	void runJobSystemBenchmarks();
+
+	// hierarchy update of 100k+ entities: everything dirty, some subtrees dirty, one leaf dirty
+	void runSceneBenchmarks();
+
+	// model and normal matrices: old euler glm path, quaternion glm path and batch kernels for every supported simd level
+	void runTransformBenchmarks();
+
+	// cpu occlusion rasterizer: triangles per second for every simd level and thread count, culling of boxes
+	// behind walls compared to a reference rendered at 8x resolution
+	void runSoftwareOcclusionBenchmarks();
+
+	// bvh over 10k, 100k and 1M boxes: build, refit after some boxes moved, frustum, ray and sphere queries
+	// against testing every box
+	void runBvhBenchmarks();
+
+}
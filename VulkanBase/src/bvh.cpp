@@ -0,0 +1,420 @@
+#include "bvh.h"
+
+using namespace vu;
+
+
+Aabb vu::transformBounds(const Aabb &bounds, const glm::mat4 &model) {
+	glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+	glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+	glm::vec3 worldCenter = glm::vec3(model * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent;
+	for (int i = 0; i < 3; i++) {
+		worldExtent[i] = std::abs(model[0][i]) * extent.x + std::abs(model[1][i]) * extent.y + std::abs(model[2][i]) * extent.z;
+	}
+
+	return {worldCenter - worldExtent, worldCenter + worldExtent};
+}
+
+
+void Bvh::Build(const Aabb *bounds, uint32_t count) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	m_bounds.assign(bounds, bounds + count);
+	m_centroids.resize(count);
+	m_items.resize(count);
+	m_itemLeaves.assign(count, 0);
+	for (uint32_t i = 0; i < count; i++) {
+		m_centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+		m_items[i] = i;
+	}
+
+	m_nodes.clear();
+	m_ranges.clear();
+	m_parents.clear();
+	m_depths.clear();
+	m_stats = {};
+	m_stats.items = count;
+	if (count == 0) {
+		return;
+	}
+
+	m_nodes.push_back({});
+	m_ranges.push_back({0, count});
+	m_parents.push_back(NO_NODE);
+	m_depths.push_back(0);
+
+	// depth first, children are created next to each other when their parent is split
+	std::vector<uint32_t> stack = {0};
+	while (!stack.empty()) {
+		uint32_t node = stack.back();
+		stack.pop_back();
+		SplitNode(node, stack);
+	}
+
+	for (uint32_t node = 0; node < m_nodes.size(); node++) {
+		m_stats.depth = std::max(m_stats.depth, m_depths[node] + 1);
+		if (m_nodes[node].count == 0) {
+			continue;
+		}
+		m_stats.leaves++;
+		for (uint32_t i = m_nodes[node].first; i < m_nodes[node].first + m_nodes[node].count; i++) {
+			m_itemLeaves[m_items[i]] = node;
+		}
+	}
+	m_stats.nodes = static_cast<uint32_t>(m_nodes.size());
+	m_stats.builtCost = GetCost();
+	m_stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+
+void Bvh::SplitNode(uint32_t node, std::vector<uint32_t> &stack) {
+	ItemRange range = m_ranges[node];
+
+	Aabb bounds;
+	Aabb centroidBounds;
+	for (uint32_t i = range.first; i < range.first + range.count; i++) {
+		bounds.Grow(m_bounds[m_items[i]]);
+		centroidBounds.Grow(m_centroids[m_items[i]]);
+	}
+	SetNodeBounds(node, bounds);
+	m_nodes[node].first = range.first;
+	m_nodes[node].count = range.count;
+
+	if (range.count <= 1 || m_depths[node] + 1 >= MAX_DEPTH) {
+		return;
+	}
+
+	// binned sah: items go to bins by centroid (all axes in one pass), every border between bins is a candidate split
+	glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+	glm::vec3 scale;
+	for (int axis = 0; axis < 3; axis++) {
+		scale[axis] = extent[axis] > 0.0f ? BINS / extent[axis] : 0.0f;
+	}
+
+	Aabb     binBounds[3][BINS];
+	uint32_t binCounts[3][BINS] = {};
+	for (uint32_t i = range.first; i < range.first + range.count; i++) {
+		const glm::vec3 &centroid = m_centroids[m_items[i]];
+		const Aabb      &itemBounds = m_bounds[m_items[i]];
+		for (int axis = 0; axis < 3; axis++) {
+			uint32_t bin = std::min(static_cast<uint32_t>((centroid[axis] - centroidBounds.min[axis]) * scale[axis]), BINS - 1);
+			binCounts[axis][bin]++;
+			binBounds[axis][bin].Grow(itemBounds);
+		}
+	}
+
+	float    bestCost = std::numeric_limits<float>::max();
+	int      bestAxis = -1;
+	uint32_t bestBin = 0;  // first bin of right child
+	for (int axis = 0; axis < 3; axis++) {
+		if (extent[axis] <= 0.0f) {
+			continue;
+		}
+
+		float    rightCosts[BINS];
+		Aabb     right;
+		uint32_t rightCount = 0;
+		for (uint32_t bin = BINS - 1; bin > 0; bin--) {
+			right.Grow(binBounds[axis][bin]);
+			rightCount += binCounts[axis][bin];
+			rightCosts[bin] = right.HalfArea() * rightCount;
+		}
+
+		Aabb     left;
+		uint32_t leftCount = 0;
+		for (uint32_t bin = 0; bin < BINS - 1; bin++) {
+			left.Grow(binBounds[axis][bin]);
+			leftCount += binCounts[axis][bin];
+			float cost = left.HalfArea() * leftCount + rightCosts[bin + 1];
+			if (leftCount > 0 && leftCount < range.count && cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = bin + 1;
+			}
+		}
+	}
+
+	uint32_t middle;
+	if (bestAxis < 0) {
+		// all centroids in one point, nothing to choose from
+		if (range.count <= MAX_LEAF_ITEMS) {
+			return;
+		}
+		middle = range.first + range.count / 2;
+	} else {
+		float splitCost = TRAVERSAL_COST + bestCost / std::max(bounds.HalfArea(), std::numeric_limits<float>::min());
+		if (splitCost >= static_cast<float>(range.count) && range.count <= MAX_LEAF_ITEMS) {
+			return;
+		}
+
+		auto split = std::partition(m_items.begin() + range.first, m_items.begin() + range.first + range.count, [&](uint32_t item) {
+			return std::min(static_cast<uint32_t>((m_centroids[item][bestAxis] - centroidBounds.min[bestAxis]) * scale[bestAxis]), BINS - 1) < bestBin;
+		});
+		middle = static_cast<uint32_t>(split - m_items.begin());
+	}
+
+	uint32_t left = static_cast<uint32_t>(m_nodes.size());
+	m_nodes.push_back({});
+	m_nodes.push_back({});
+	m_ranges.push_back({range.first, middle - range.first});
+	m_ranges.push_back({middle, range.first + range.count - middle});
+	m_parents.push_back(node);
+	m_parents.push_back(node);
+	m_depths.push_back(m_depths[node] + 1);
+	m_depths.push_back(m_depths[node] + 1);
+
+	m_nodes[node].first = left;
+	m_nodes[node].count = 0;
+
+	stack.push_back(left + 1);
+	stack.push_back(left);
+}
+
+
+void Bvh::Update(uint32_t item, const Aabb &bounds) {
+	m_bounds[item] = bounds;
+	m_stats.updates++;
+
+	uint32_t node = m_itemLeaves[item];
+	while (node != NO_NODE) {
+		Aabb nodeBounds = ComputeNodeBounds(node);
+		if (nodeBounds == GetNodeBounds(node)) {
+			break;
+		}
+		SetNodeBounds(node, nodeBounds);
+		m_stats.refitNodes++;
+		node = m_parents[node];
+	}
+}
+
+
+float Bvh::GetCost() const {
+	if (m_nodes.empty()) {
+		return 0.0f;
+	}
+
+	float cost = 0.0f;
+	for (const Node &node : m_nodes) {
+		float area = Aabb{node.min, node.max}.HalfArea();
+		cost += node.count == 0 ? TRAVERSAL_COST * area : node.count * area;
+	}
+	return cost / std::max(GetNodeBounds(0).HalfArea(), std::numeric_limits<float>::min());
+}
+
+
+void Bvh::SetNodeBounds(uint32_t node, const Aabb &bounds) {
+	m_nodes[node].min = bounds.min;
+	m_nodes[node].max = bounds.max;
+}
+
+
+Aabb Bvh::ComputeNodeBounds(uint32_t node) const {
+	const Node &n = m_nodes[node];
+	Aabb bounds;
+	if (n.count == 0) {
+		bounds.Grow(GetNodeBounds(n.first));
+		bounds.Grow(GetNodeBounds(n.first + 1));
+	} else {
+		for (uint32_t i = n.first; i < n.first + n.count; i++) {
+			bounds.Grow(m_bounds[m_items[i]]);
+		}
+	}
+	return bounds;
+}
+
+
+void Bvh::AppendRange(uint32_t node, std::vector<uint32_t> &items) const {
+	const ItemRange &range = m_ranges[node];
+	items.insert(items.end(), m_items.begin() + range.first, m_items.begin() + range.first + range.count);
+}
+
+
+// clears bits of planes the box is completely in front of, false - box is behind one of planes
+static bool testPlanes(const glm::vec4 planes[6], const glm::vec3 &min, const glm::vec3 &max, uint32_t &mask) {
+	for (int p = 0; p < 6; p++) {
+		if ((mask & (1u << p)) == 0) {
+			continue;
+		}
+
+		const glm::vec4 &plane = planes[p];
+		glm::vec3 normal(plane.x, plane.y, plane.z);
+		glm::vec3 front(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+		glm::vec3 back(plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y, plane.z >= 0.0f ? min.z : max.z);
+		if (glm::dot(normal, front) + plane.w < 0.0f) {
+			return false;
+		}
+		if (glm::dot(normal, back) + plane.w >= 0.0f) {
+			mask &= ~(1u << p);
+		}
+	}
+	return true;
+}
+
+
+void Bvh::QueryFrustum(const glm::vec4 planes[6], std::vector<uint32_t> &items) const {
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	// every entry keeps planes its node still crosses, children skip the rest
+	struct Entry {
+		uint32_t node;
+		uint32_t mask;
+	};
+	Entry    stack[MAX_DEPTH + 1];
+	uint32_t size = 0;
+	stack[size++] = {0, 0x3f};
+
+	while (size > 0) {
+		Entry       entry = stack[--size];
+		const Node &node = m_nodes[entry.node];
+		if (!testPlanes(planes, node.min, node.max, entry.mask)) {
+			continue;
+		}
+		if (entry.mask == 0) {
+			AppendRange(entry.node, items);
+			continue;
+		}
+
+		if (node.count == 0) {
+			stack[size++] = {node.first + 1, entry.mask};
+			stack[size++] = {node.first, entry.mask};
+			continue;
+		}
+		for (uint32_t i = node.first; i < node.first + node.count; i++) {
+			uint32_t    mask = entry.mask;
+			const Aabb &bounds = m_bounds[m_items[i]];
+			if (testPlanes(planes, bounds.min, bounds.max, mask)) {
+				items.push_back(m_items[i]);
+			}
+		}
+	}
+}
+
+
+void Bvh::QuerySphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &items) const {
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	float    radiusSquared = radius * radius;
+	uint32_t stack[MAX_DEPTH + 1];
+	uint32_t size = 0;
+	stack[size++] = 0;
+
+	while (size > 0) {
+		uint32_t    index = stack[--size];
+		const Node &node = m_nodes[index];
+
+		// closest point of box
+		glm::vec3 offset = glm::max(node.min, glm::min(center, node.max)) - center;
+		if (glm::dot(offset, offset) > radiusSquared) {
+			continue;
+		}
+		// farthest corner inside - whole subtree
+		glm::vec3 far = glm::max(center - node.min, node.max - center);
+		if (glm::dot(far, far) <= radiusSquared) {
+			AppendRange(index, items);
+			continue;
+		}
+
+		if (node.count == 0) {
+			stack[size++] = node.first + 1;
+			stack[size++] = node.first;
+			continue;
+		}
+		for (uint32_t i = node.first; i < node.first + node.count; i++) {
+			const Aabb &bounds = m_bounds[m_items[i]];
+			glm::vec3   itemOffset = glm::max(bounds.min, glm::min(center, bounds.max)) - center;
+			if (glm::dot(itemOffset, itemOffset) <= radiusSquared) {
+				items.push_back(m_items[i]);
+			}
+		}
+	}
+}
+
+
+// distance where ray enters box (0 when it starts inside), max float - no hit before maxDistance
+static float intersectRay(const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance, const glm::vec3 &min, const glm::vec3 &max) {
+	glm::vec3 t0 = (min - origin) * inverseDirection;
+	glm::vec3 t1 = (max - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit ? enter : std::numeric_limits<float>::max();
+}
+
+
+BvhRayHit Bvh::Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) const {
+	BvhRayHit hit;
+	if (m_nodes.empty()) {
+		return hit;
+	}
+
+	glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	float     nearest = maxDistance;
+
+	// nodes are pushed with their entry distance, nearer child is visited first
+	struct Entry {
+		uint32_t node;
+		float    distance;
+	};
+	Entry    stack[MAX_DEPTH + 1];
+	uint32_t size = 0;
+
+	float rootDistance = intersectRay(origin, inverseDirection, nearest, m_nodes[0].min, m_nodes[0].max);
+	if (rootDistance == std::numeric_limits<float>::max()) {
+		return hit;
+	}
+	stack[size++] = {0, rootDistance};
+
+	while (size > 0) {
+		Entry entry = stack[--size];
+		if (entry.distance > nearest) {
+			continue;
+		}
+
+		const Node &node = m_nodes[entry.node];
+		if (node.count > 0) {
+			for (uint32_t i = node.first; i < node.first + node.count; i++) {
+				const Aabb &bounds = m_bounds[m_items[i]];
+				float distance = intersectRay(origin, inverseDirection, nearest, bounds.min, bounds.max);
+				if (distance <= nearest && distance != std::numeric_limits<float>::max()) {
+					nearest = distance;
+					hit = {m_items[i], distance};
+				}
+			}
+			continue;
+		}
+
+		const Node &left = m_nodes[node.first];
+		const Node &right = m_nodes[node.first + 1];
+		float leftDistance = intersectRay(origin, inverseDirection, nearest, left.min, left.max);
+		float rightDistance = intersectRay(origin, inverseDirection, nearest, right.min, right.max);
+		Entry nearer = {node.first, leftDistance};
+		Entry farther = {node.first + 1, rightDistance};
+		if (rightDistance < leftDistance) {
+			std::swap(nearer, farther);
+		}
+		if (farther.distance != std::numeric_limits<float>::max()) {
+			stack[size++] = farther;
+		}
+		if (nearer.distance != std::numeric_limits<float>::max()) {
+			stack[size++] = nearer;
+		}
+	}
+
+	return hit;
+}
+
+
+void Bvh::PrintStats() const {
+	std::cout << "bvh:\n";
+	std::cout << "\t" << m_stats.items << " items, " << m_stats.nodes << " nodes, " << m_stats.leaves << " leaves, depth "
+	          << m_stats.depth << ", built in " << m_stats.buildMs << " ms\n";
+	std::cout << "\t" << "sah cost " << GetCost() << " (" << m_stats.builtCost << " after build), " << m_stats.updates
+	          << " updates refitted " << m_stats.refitNodes << " nodes\n\n";
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vu {
+
+	struct Aabb {
+		glm::vec3 min{std::numeric_limits<float>::max()};
+		glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+		void  Grow(const Aabb &other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+		void  Grow(const glm::vec3 &point) { min = glm::min(min, point); max = glm::max(max, point); }
+		float HalfArea() const { glm::vec3 size = glm::max(max - min, glm::vec3(0.0f)); return size.x * size.y + size.y * size.z + size.z * size.x; }
+		bool  operator==(const Aabb &other) const { return min == other.min && max == other.max; }
+	};
+
+	// box around transformed box (center moves, extent goes through absolute 3x3 part)
+	Aabb transformBounds(const Aabb &bounds, const glm::mat4 &model);
+
+	const uint32_t BVH_NO_ITEM = std::numeric_limits<uint32_t>::max();
+
+	struct BvhRayHit {
+		uint32_t item = BVH_NO_ITEM;  // closest item box the ray enters
+		float    distance = std::numeric_limits<float>::max();
+	};
+
+	struct BvhStats {
+		uint32_t items       = 0;
+		uint32_t nodes       = 0;
+		uint32_t leaves      = 0;
+		uint32_t depth       = 0;
+		uint32_t updates     = 0;    // Update calls since build
+		uint32_t refitNodes  = 0;    // nodes whose bounds changed since build
+		double   buildMs     = 0.0;
+		float    builtCost   = 0.0f; // sah cost right after build
+	};
+
+	// Bounding volume hierarchy of item boxes
+	// Build splits items with binned surface area heuristic, nodes are stored in one array with siblings next to
+	// each other (interior node keeps index of first child only), 32 bytes per node
+	// Moving items refit their ancestors only, refitted tree keeps its topology and gets worse over time, GetCost
+	// compared to cost after build tells when to build again
+	// Every node covers a contiguous range of items, so nodes completely inside a query return their range at once
+	class Bvh {
+	public:
+		// item ids are indices into bounds
+		void Build(const Aabb *bounds, uint32_t count);
+
+		// new bounds of one item, ancestors are refitted until a node doesn't change
+		void Update(uint32_t item, const Aabb &bounds);
+
+		// sah cost of current tree, in units of one item test
+		float GetCost() const;
+		bool  NeedsRebuild(float factor = 2.0f) const { return GetCost() > m_stats.builtCost * factor; }
+
+		// queries append ids of items whose boxes may intersect
+		// planes like vu::extractFrustumPlanes (xyz - normal pointing inside, w - distance)
+		void QueryFrustum(const glm::vec4 planes[6], std::vector<uint32_t> &items) const;
+		void QuerySphere(const glm::vec3 &center, float radius, std::vector<uint32_t> &items) const;
+		BvhRayHit Raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance = std::numeric_limits<float>::max()) const;
+
+		uint32_t    GetItemCount() const { return static_cast<uint32_t>(m_bounds.size()); }
+		const Aabb &GetBounds(uint32_t item) const { return m_bounds[item]; }
+		Aabb        GetRootBounds() const { return m_nodes.empty() ? Aabb{} : GetNodeBounds(0); }
+
+		const BvhStats &GetStats() const { return m_stats; }
+		void PrintStats() const;
+
+		static constexpr uint32_t MAX_LEAF_ITEMS = 8;
+		static constexpr uint32_t MAX_DEPTH = 64;  // traversal stacks are fixed arrays
+		static constexpr uint32_t BINS = 16;
+		static constexpr float TRAVERSAL_COST = 1.0f;  // of visiting interior node, relative to testing one item
+
+	private:
+		static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+		// count 0 - interior node, children are first and first + 1
+		// count > 0 - leaf, items are m_items[first, first + count)
+		struct Node {
+			glm::vec3 min;
+			uint32_t  first;
+			glm::vec3 max;
+			uint32_t  count;
+		};
+
+		// items of whole subtree, read only when a node is completely inside a query
+		struct ItemRange {
+			uint32_t first;
+			uint32_t count;
+		};
+
+		void SplitNode(uint32_t node, std::vector<uint32_t> &stack);
+		void SetNodeBounds(uint32_t node, const Aabb &bounds);
+		Aabb GetNodeBounds(uint32_t node) const { return {m_nodes[node].min, m_nodes[node].max}; }
+		Aabb ComputeNodeBounds(uint32_t node) const;
+		void AppendRange(uint32_t node, std::vector<uint32_t> &items) const;
+
+		std::vector<Node>      m_nodes;
+		std::vector<ItemRange> m_ranges;      // per node
+		std::vector<uint32_t>  m_parents;     // per node, NO_NODE for root
+		std::vector<uint32_t>  m_depths;      // per node, used while building
+		std::vector<uint32_t>  m_items;       // item ids in leaf order
+		std::vector<uint32_t>  m_itemLeaves;  // leaf of every item
+		std::vector<Aabb>      m_bounds;      // per item
+		std::vector<glm::vec3> m_centroids;   // per item, used while building
+
+		BvhStats m_stats;
+	};
+
+}
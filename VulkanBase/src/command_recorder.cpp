@@ -0,0 +1,174 @@
+#include "command_recorder.h"
+
+using namespace vu;
+
+
+void CommandRecorder::Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, JobSystem &jobs) {
+	m_rendererInfo = rendererInfo;
+	m_jobs = &jobs;
+
+	// one recording slot per thread that can execute jobs
+	uint32_t threadCount = m_jobs->GetThreadCount();
+	m_threadCount = threadCount;
+
+	// secondary buffers are never reset one by one, whole pool is reset at the start of the frame
+	vu::QueueFamilyIndices queueFamilyIndices = vu::findQueueFamilies(m_rendererInfo.physicalDevice, m_rendererInfo.surface);
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+	m_frames.resize(framesInFlight);
+	for (std::vector<ThreadFrame> &frame : m_frames) {
+		frame.resize(threadCount);
+		for (ThreadFrame &threadFrame : frame) {
+			if (vkCreateCommandPool(m_rendererInfo.device, &poolInfo, nullptr, &threadFrame.pool) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create recording thread command pool!");
+			}
+		}
+	}
+
+	m_recorded.resize(threadCount, VK_NULL_HANDLE);
+}
+
+
+void CommandRecorder::Destroy() {
+	for (std::vector<ThreadFrame> &frame : m_frames) {
+		for (ThreadFrame &threadFrame : frame) {
+			vkDestroyCommandPool(m_rendererInfo.device, threadFrame.pool, nullptr);  // destroys command buffers as well
+		}
+	}
+	m_frames.clear();
+}
+
+
+void CommandRecorder::BeginFrame(uint32_t frameIndex) {
+	m_frameIndex = frameIndex;
+
+	for (ThreadFrame &threadFrame : m_frames[m_frameIndex]) {
+		vkResetCommandPool(m_rendererInfo.device, threadFrame.pool, 0);
+		threadFrame.used = 0;
+	}
+}
+
+
+void CommandRecorder::SetThreadCount(uint32_t threadCount) {
+	m_threadCount = std::clamp(threadCount, 1u, GetMaxThreadCount());
+}
+
+
+VkCommandBuffer CommandRecorder::AcquireSecondary(uint32_t slot) {
+	ThreadFrame &threadFrame = m_frames[m_frameIndex][slot];
+
+	if (threadFrame.used == threadFrame.buffers.size()) {
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = threadFrame.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_rendererInfo.device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate secondary command buffer!");
+		}
+		threadFrame.buffers.push_back(commandBuffer);
+	}
+
+	return threadFrame.buffers[threadFrame.used++];
+}
+
+
+void CommandRecorder::RecordChunk(uint32_t slot) {
+	uint32_t perThread = (m_itemCount + m_activeThreads - 1) / m_activeThreads;
+	uint32_t first = slot * perThread;
+	if (first >= m_itemCount) {
+		return;
+	}
+	uint32_t count = std::min(perThread, m_itemCount - first);
+
+	VkCommandBuffer commandBuffer = AcquireSecondary(slot);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = &m_inheritanceInfo;
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording secondary command buffer!");
+	}
+
+	(*m_record)(commandBuffer, first, count);
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record secondary command buffer!");
+	}
+
+	m_recorded[slot] = commandBuffer;
+}
+
+
+void CommandRecorder::Record(VkCommandBuffer primary, const SecondaryInheritance &inheritance, uint32_t itemCount, const RecordFunction &record) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// secondary buffers must know attachments of the rendering they continue
+	m_colorFormat = inheritance.colorFormat;
+
+	m_inheritanceRendering = {};
+	m_inheritanceRendering.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+	m_inheritanceRendering.colorAttachmentCount = m_colorFormat != VK_FORMAT_UNDEFINED ? 1 : 0;
+	m_inheritanceRendering.pColorAttachmentFormats = &m_colorFormat;
+	m_inheritanceRendering.depthAttachmentFormat = inheritance.depthFormat;
+	m_inheritanceRendering.rasterizationSamples = inheritance.samples;
+
+	m_inheritanceInfo = {};
+	m_inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	m_inheritanceInfo.pNext = &m_inheritanceRendering;
+	m_inheritanceInfo.pipelineStatistics = inheritance.pipelineStatistics;
+
+	uint32_t threads = std::clamp(itemCount / MIN_ITEMS_PER_THREAD, 1u, m_threadCount);
+
+	m_record = &record;
+	m_itemCount = itemCount;
+	m_activeThreads = threads;
+	m_error = nullptr;
+	std::fill(m_recorded.begin(), m_recorded.end(), VK_NULL_HANDLE);
+
+	// one job per slot, calling thread records too while it waits
+	m_jobs->ParallelFor(threads, 1, [this](uint32_t first, uint32_t count) {
+		for (uint32_t slot = first; slot < first + count; slot++) {
+			try {
+				RecordChunk(slot);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(m_errorMutex);
+				m_error = std::current_exception();
+			}
+		}
+	});
+	m_record = nullptr;
+
+	if (m_error) {
+		std::rethrow_exception(m_error);
+	}
+
+	// execute in slot order, so draw order is the same as with one thread
+	ScratchScope scratch;
+	ArenaVector<VkCommandBuffer> secondaries(scratch.Allocator<VkCommandBuffer>());
+	secondaries.reserve(threads);
+	for (uint32_t i = 0; i < threads; i++) {
+		if (m_recorded[i] != VK_NULL_HANDLE) {
+			secondaries.push_back(m_recorded[i]);
+		}
+	}
+
+	if (!secondaries.empty()) {
+		vkCmdExecuteCommands(primary, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	m_stats.threads = threads;
+	m_stats.itemCount = itemCount;
+	m_stats.commandBuffers = static_cast<uint32_t>(secondaries.size());
+	m_stats.recordMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
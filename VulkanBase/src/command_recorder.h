@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <exception>
+
+#include <vulkan/vulkan.h>
+
+#include "job_system.h"
+#include "memory_arena.h"
+#include "vu.h"
+
+namespace vu {
+
+	// attachments of the rendering that secondary command buffers continue
+	struct SecondaryInheritance {
+		VkFormat              colorFormat = VK_FORMAT_UNDEFINED;
+		VkFormat              depthFormat = VK_FORMAT_UNDEFINED;
+		VkSampleCountFlagBits samples     = VK_SAMPLE_COUNT_1_BIT;
+
+		VkQueryPipelineStatisticFlags pipelineStatistics = 0;  // of query active in primary while secondaries execute
+	};
+
+	struct CommandRecorderStats {
+		uint32_t threads        = 0;    // recording jobs of last Record call
+		uint32_t itemCount      = 0;
+		uint32_t commandBuffers = 0;    // secondary command buffers executed last Record call
+		double   recordMs       = 0.0;  // wall time of last Record call (split + record + execute)
+	};
+
+	// Records one list of draws on several threads
+	// List is split into one range per recording slot, every slot is recorded by one job with its own command pool
+	// per frame in flight, so threads never share a pool and pools are reset as a whole once the frame is finished
+	class CommandRecorder {
+	public:
+		// record items [first, first + count) into commandBuffer (called on any thread)
+		using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)>;
+
+		void Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, JobSystem &jobs);
+		void Destroy();
+
+		// resets command pools of this frame, gpu must be done with previous use of this frame slot
+		void BeginFrame(uint32_t frameIndex);
+
+		// splits items between threads, records them into secondary command buffers and executes them in primary
+		// primary must be inside rendering started with VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT
+		void Record(VkCommandBuffer primary, const SecondaryInheritance &inheritance, uint32_t itemCount, const RecordFunction &record);
+
+		void     SetThreadCount(uint32_t threadCount);
+		uint32_t GetThreadCount()    const { return m_threadCount; }
+		uint32_t GetMaxThreadCount() const { return m_jobs->GetThreadCount(); }
+
+		const CommandRecorderStats &GetStats() const { return m_stats; }
+
+	private:
+		struct ThreadFrame {
+			VkCommandPool                pool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> buffers;   // allocated once, reused after pool reset
+			uint32_t                     used = 0;
+		};
+
+		VkCommandBuffer AcquireSecondary(uint32_t slot);
+		void RecordChunk(uint32_t slot);
+
+		// draws below this count are not worth waking another thread for
+		static const uint32_t MIN_ITEMS_PER_THREAD = 32;
+
+		RendererInfo m_rendererInfo;
+		JobSystem   *m_jobs = nullptr;
+		uint32_t     m_threadCount = 1;
+		uint32_t     m_frameIndex  = 0;
+
+		std::vector<std::vector<ThreadFrame>> m_frames;  // [frame][slot]
+
+		// current Record call, read by workers
+		const RecordFunction          *m_record = nullptr;
+		VkCommandBufferInheritanceInfo m_inheritanceInfo{};
+		VkCommandBufferInheritanceRenderingInfo m_inheritanceRendering{};
+		VkFormat                       m_colorFormat = VK_FORMAT_UNDEFINED;
+		uint32_t                       m_itemCount   = 0;
+		uint32_t                       m_activeThreads = 0;
+		std::vector<VkCommandBuffer>   m_recorded;     // one per active slot, VK_NULL_HANDLE if slot got no items
+
+		std::mutex         m_errorMutex;
+		std::exception_ptr m_error;
+
+		CommandRecorderStats m_stats;
+	};
+
+}
@@ -0,0 +1,366 @@
+#include "defragmenter.h"
+#include "image.h"
+
+using namespace vu;
+
+// passes in a row where vma offered only allocations that can't move
+static const uint32_t MAX_EMPTY_PASSES = 4;
+
+
+void Defragmenter::Initialize(const RendererInfo &rendererInfo, VkDeviceSize bytesPerFrame, double budgetMs) {
+	m_rendererInfo = rendererInfo;
+	m_bytesPerFrame = bytesPerFrame;
+	m_budgetMs = budgetMs;
+	m_frame = 0;
+	m_stats = DefragmentationStats{};
+}
+
+
+void Defragmenter::Destroy() {
+	if (m_passPending) {
+		m_rendererInfo.transferTimeline->Wait(m_passValue);
+		EndPass();
+	}
+	if (IsRunning()) {
+		Finish();
+	}
+	m_resources.clear();
+}
+
+
+void Defragmenter::RegisterBuffer(VmaAllocation allocation, VkBuffer *buffer, VkDeviceSize size, VkBufferUsageFlags usage) {
+	// same sharing as vu::createBuffer, so new buffer works on the same queues
+	Resource resource{};
+	resource.buffer = buffer;
+	resource.bufferInfo = vu::makeBufferCreateInfo(m_rendererInfo.physicalDevice, m_rendererInfo.surface, size, usage, m_queueFamilyIndices);
+	m_resources[allocation] = resource;
+}
+
+
+void Defragmenter::RegisterImage(VmaAllocation allocation, VkImage *image, VkImageView *view, const VkImageCreateInfo &imageInfo, VkImageAspectFlags aspect) {
+	Resource resource{};
+	resource.image = image;
+	resource.view = view;
+	resource.imageInfo = imageInfo;
+	resource.imageInfo.pNext = nullptr;
+	resource.imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resource.aspect = aspect;
+	m_resources[allocation] = resource;
+}
+
+
+void Defragmenter::Unregister(VmaAllocation allocation) {
+	m_resources.erase(allocation);
+}
+
+
+void Defragmenter::Start() {
+	if (IsRunning() || m_bytesPerFrame == 0) {
+		return;
+	}
+
+	m_stats.fragmentationBefore = CalculateFragmentation();
+
+	// vma never offers more than one frame worth of bytes in a pass
+	VmaDefragmentationInfo info{};
+	info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+	info.maxBytesPerPass = m_bytesPerFrame;
+
+	if (vmaBeginDefragmentation(m_rendererInfo.allocator, &info, &m_context) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin defragmentation!");
+	}
+
+	m_emptyPasses = 0;
+	m_runMs = 0.0;
+
+	std::cout << "defragmentation started (fragmentation: " << m_stats.fragmentationBefore * 100.0f << "%)\n\n";
+}
+
+
+void Defragmenter::Update() {
+	m_frame++;
+
+	if (!IsRunning()) {
+		// statistics walk all blocks, so fragmentation is checked only every few seconds
+		if (m_checkInterval > 0 && m_frame % m_checkInterval == 0 && !m_resources.empty() &&
+		    CalculateFragmentation() > m_startFragmentation) {
+			Start();
+		}
+		return;
+	}
+
+	// copies of last pass are still running, frame goes on with new resources
+	if (m_passPending) {
+		if (m_rendererInfo.transferTimeline->IsComplete(m_passValue)) {
+			EndPass();
+		}
+		return;
+	}
+
+	BeginPass();
+}
+
+
+void Defragmenter::BeginPass() {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkResult result = vmaBeginDefragmentationPass(m_rendererInfo.allocator, m_context, &m_pass);
+	if (result == VK_SUCCESS) {
+		// nothing left to move
+		Finish();
+		return;
+	}
+	if (result != VK_INCOMPLETE) {
+		throw std::runtime_error("failed to begin defragmentation pass!");
+	}
+
+	m_passCommandBuffer = vu::beginSingleTimeCommands(m_rendererInfo.transferCommandPool, m_rendererInfo.device);
+
+	VkDeviceSize bytes = 0;
+	uint32_t moved = 0;
+	bool imageMoved = false;
+	for (uint32_t i = 0; i < m_pass.moveCount; i++) {
+		VmaDefragmentationMove &move = m_pass.pMoves[i];
+
+		VmaAllocationInfo info{};
+		vmaGetAllocationInfo(m_rendererInfo.allocator, move.srcAllocation, &info);
+
+		// at least one move per pass, so a big resource still moves when it is larger than the budget
+		double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		bool overBudget = moved > 0 && (bytes + info.size > m_bytesPerFrame || elapsedMs > m_budgetMs);
+
+		auto it = m_resources.find(move.srcAllocation);
+		if (it == m_resources.end() || overBudget) {
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+			continue;
+		}
+
+		Retired retired{};
+		if (it->second.buffer != nullptr) {
+			RecordBufferMove(m_passCommandBuffer, it->second, move.dstTmpAllocation, retired);
+		} else {
+			RecordImageMove(m_passCommandBuffer, it->second, move.dstTmpAllocation, retired);
+			imageMoved = true;
+		}
+		m_retired.push_back(retired);
+
+		bytes += info.size;
+		moved++;
+	}
+
+	vkEndCommandBuffer(m_passCommandBuffer);
+
+	if (moved == 0) {
+		vkFreeCommandBuffers(m_rendererInfo.device, m_rendererInfo.transferCommandPool, 1, &m_passCommandBuffer);
+		m_passCommandBuffer = VK_NULL_HANDLE;
+		m_emptyPasses++;
+		EndPass();
+		return;
+	}
+	m_emptyPasses = 0;
+
+	// copies read old resources, so they wait for every frame that was submitted with them
+	// frames submitted from now on wait for last transfer value, so they see new resources filled
+	uint64_t waitValue = m_rendererInfo.graphicsTimeline->GetLastSubmitted();
+	m_passValue = m_rendererInfo.transferTimeline->Next();
+
+	VkSemaphore waitSemaphore = m_rendererInfo.graphicsTimeline->GetSemaphore();
+	VkSemaphore signalSemaphore = m_rendererInfo.transferTimeline->GetSemaphore();
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = 1;
+	timelineInfo.pWaitSemaphoreValues = &waitValue;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &m_passValue;
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &waitSemaphore;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &m_passCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &signalSemaphore;
+
+	if (vkQueueSubmit(m_rendererInfo.transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit defragmentation copies!");
+	}
+
+	if (imageMoved) {
+		m_imageGeneration++;
+	}
+	m_passPending = true;
+
+	double passMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	m_stats.maxPassMs = std::max(m_stats.maxPassMs, passMs);
+	m_runMs += passMs;
+}
+
+
+void Defragmenter::EndPass() {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// copy finished and every frame that used old resources finished before it
+	for (const Retired &retired : m_retired) {
+		if (retired.view != VK_NULL_HANDLE) {
+			vkDestroyImageView(m_rendererInfo.device, retired.view, nullptr);
+		}
+		if (retired.image != VK_NULL_HANDLE) {
+			vkDestroyImage(m_rendererInfo.device, retired.image, nullptr);
+		}
+		if (retired.buffer != VK_NULL_HANDLE) {
+			vkDestroyBuffer(m_rendererInfo.device, retired.buffer, nullptr);
+		}
+	}
+	m_retired.clear();
+
+	if (m_passCommandBuffer != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(m_rendererInfo.device, m_rendererInfo.transferCommandPool, 1, &m_passCommandBuffer);
+		m_passCommandBuffer = VK_NULL_HANDLE;
+	}
+	m_passPending = false;
+
+	// moved allocations now point at their new place, old places are free
+	VkResult result = vmaEndDefragmentationPass(m_rendererInfo.allocator, m_context, &m_pass);
+	m_stats.passes++;
+	m_runMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if (result == VK_SUCCESS || m_emptyPasses >= MAX_EMPTY_PASSES) {
+		Finish();
+	}
+}
+
+
+void Defragmenter::Finish() {
+	VmaDefragmentationStats stats{};
+	vmaEndDefragmentation(m_rendererInfo.allocator, m_context, &stats);
+	m_context = VK_NULL_HANDLE;
+
+	m_stats.runs++;
+	m_stats.allocationsMoved += stats.allocationsMoved;
+	m_stats.bytesMoved += stats.bytesMoved;
+	m_stats.bytesFreed += stats.bytesFreed;
+	m_stats.blocksFreed += stats.deviceMemoryBlocksFreed;
+	m_stats.fragmentationAfter = CalculateFragmentation();
+	m_stats.totalMs += m_runMs;
+
+	const double MB = 1024.0 * 1024.0;
+	std::cout << "defragmentation finished: moved " << stats.bytesMoved / MB << " MB in " << stats.allocationsMoved << " allocations, "
+	          << "freed " << stats.bytesFreed / MB << " MB (" << stats.deviceMemoryBlocksFreed << " blocks), "
+	          << "fragmentation " << m_stats.fragmentationBefore * 100.0f << "% -> " << m_stats.fragmentationAfter * 100.0f << "%, "
+	          << "cpu: " << m_runMs << " ms\n\n";
+}
+
+
+float Defragmenter::CalculateFragmentation() const {
+	VmaTotalStatistics total{};
+	vmaCalculateStatistics(m_rendererInfo.allocator, &total);
+	return vu::calculateFragmentation(total.total);
+}
+
+
+void Defragmenter::RecordBufferMove(VkCommandBuffer commandBuffer, Resource &resource, VmaAllocation destination, Retired &retired) {
+	VkBuffer buffer;
+	if (vkCreateBuffer(m_rendererInfo.device, &resource.bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create defragmentation buffer!");
+	}
+	if (vmaBindBufferMemory(m_rendererInfo.allocator, destination, buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to bind defragmentation buffer!");
+	}
+
+	VkBufferCopy region{};
+	region.size = resource.bufferInfo.size;
+	vkCmdCopyBuffer(commandBuffer, *resource.buffer, buffer, 1, &region);
+
+	// owner records with new buffer from now on
+	retired.buffer = *resource.buffer;
+	*resource.buffer = buffer;
+}
+
+
+void Defragmenter::RecordImageMove(VkCommandBuffer commandBuffer, Resource &resource, VmaAllocation destination, Retired &retired) {
+	const VkImageCreateInfo &info = resource.imageInfo;
+
+	VkImage image;
+	if (vkCreateImage(m_rendererInfo.device, &info, nullptr, &image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create defragmentation image!");
+	}
+	if (vmaBindImageMemory(m_rendererInfo.allocator, destination, image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to bind defragmentation image!");
+	}
+
+	// semaphore wait already ordered copy after graphics frames, barriers only change layouts
+	VkImageMemoryBarrier barriers[2]{};
+	for (VkImageMemoryBarrier &barrier : barriers) {
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = resource.aspect;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = info.mipLevels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = info.arrayLayers;
+	}
+	barriers[0].image = *resource.image;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[1].image = image;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	// every mip level
+	std::vector<VkImageCopy> regions(info.mipLevels);
+	for (uint32_t mip = 0; mip < info.mipLevels; mip++) {
+		VkImageCopy &region = regions[mip];
+		region.srcSubresource.aspectMask = resource.aspect;
+		region.srcSubresource.mipLevel = mip;
+		region.srcSubresource.baseArrayLayer = 0;
+		region.srcSubresource.layerCount = info.arrayLayers;
+		region.dstSubresource = region.srcSubresource;
+		region.extent.width = std::max(info.extent.width >> mip, 1u);
+		region.extent.height = std::max(info.extent.height >> mip, 1u);
+		region.extent.depth = std::max(info.extent.depth >> mip, 1u);
+	}
+	vkCmdCopyImage(commandBuffer, *resource.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(regions.size()), regions.data());
+
+	// frames wait for transfer timeline before shaders read it
+	VkImageMemoryBarrier toShader = barriers[1];
+	toShader.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	toShader.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	toShader.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	toShader.dstAccessMask = 0;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &toShader);
+
+	VkImageView view;
+	vu::Image::CreateImageView(m_rendererInfo, image, info.format, resource.aspect, info.mipLevels, view);
+
+	// descriptors are rewritten per frame slot when image generation changes
+	retired.image = *resource.image;
+	retired.view = *resource.view;
+	*resource.image = image;
+	*resource.view = view;
+}
+
+
+void Defragmenter::PrintStats() const {
+	const double MB = 1024.0 * 1024.0;
+
+	std::cout << "defragmentation:\n";
+	std::cout << "\t" << "budget: " << m_bytesPerFrame / MB << " MB and " << m_budgetMs << " ms per frame\n";
+	std::cout << "\t" << "runs: " << m_stats.runs << ", passes: " << m_stats.passes << "\n";
+	std::cout << "\t" << "moved: " << m_stats.bytesMoved / MB << " MB in " << m_stats.allocationsMoved << " allocations\n";
+	std::cout << "\t" << "freed: " << m_stats.bytesFreed / MB << " MB (" << m_stats.blocksFreed << " blocks)\n";
+	if (m_stats.runs > 0) {
+		std::cout << "\t" << "fragmentation of last run: " << m_stats.fragmentationBefore * 100.0f << "% -> " << m_stats.fragmentationAfter * 100.0f << "%\n";
+	}
+	std::cout << "\t" << "cpu: " << m_stats.totalMs << " ms total, slowest pass " << m_stats.maxPassMs << " ms\n\n";
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+#include <VMA/vk_mem_alloc.h>
+
+#include "memory_stats.h"
+#include "vu.h"
+
+namespace vu {
+
+	struct DefragmentationStats {
+		uint32_t     runs                = 0;     // finished defragmentations
+		uint32_t     passes              = 0;
+		uint32_t     allocationsMoved    = 0;
+		VkDeviceSize bytesMoved          = 0;
+		VkDeviceSize bytesFreed          = 0;     // device memory blocks released back to driver
+		uint32_t     blocksFreed         = 0;
+		float        fragmentationBefore = 0.0f;  // of last run, all heaps
+		float        fragmentationAfter  = 0.0f;
+		double       maxPassMs           = 0.0;   // cpu time of the slowest pass
+		double       totalMs             = 0.0;
+	};
+
+	// Moves registered buffers and images to compact vma blocks, one bounded pass per frame
+	// A pass creates new resources at places vma picked, copies old ones on transfer queue and switches owners
+	// to the new handles right away. Copy waits for every graphics frame submitted before it (they read old
+	// resources) and every later frame waits for the copy, so nothing stalls. Old resources are destroyed and
+	// pass is ended once transfer timeline reaches the copy
+	// Allocations that are not registered (mapped, aliased, per frame) are never moved
+	class Defragmenter {
+	public:
+		// bytesPerFrame and budgetMs bound the work of one pass, pass ends early when either is reached
+		void Initialize(const RendererInfo &rendererInfo, VkDeviceSize bytesPerFrame, double budgetMs);
+		void Destroy();  // finishes running defragmentation, gpu must be idle
+
+		// buffer must be usable as transfer source and destination, owner reads *buffer every time it uses it
+		void RegisterBuffer(VmaAllocation allocation, VkBuffer *buffer, VkDeviceSize size, VkBufferUsageFlags usage);
+
+		// image is in SHADER_READ_ONLY_OPTIMAL and usable as transfer source and destination, view covers all mips
+		void RegisterImage(VmaAllocation allocation, VkImage *image, VkImageView *view, const VkImageCreateInfo &imageInfo, VkImageAspectFlags aspect);
+
+		void Unregister(VmaAllocation allocation);
+
+		// starts defragmentation of default pools, does nothing when one is running
+		void Start();
+
+		// once per frame before recording, advances running defragmentation and starts one when memory is fragmented
+		void Update();
+
+		bool IsRunning() const { return m_context != VK_NULL_HANDLE; }
+
+		// changes on every image move, descriptors that point at views must be rewritten when it changes
+		uint64_t GetImageGeneration() const { return m_imageGeneration; }
+
+		void SetBudget(VkDeviceSize bytesPerFrame, double budgetMs) { m_bytesPerFrame = bytesPerFrame; m_budgetMs = budgetMs; }
+		void SetAutoStart(float fragmentation, uint32_t checkInterval) { m_startFragmentation = fragmentation; m_checkInterval = checkInterval; }
+
+		DefragmentationStats GetStats() const { return m_stats; }
+		void PrintStats() const;
+
+	private:
+		struct Resource {
+			VkBuffer          *buffer = nullptr;
+			VkBufferCreateInfo bufferInfo{};
+			VkImage           *image = nullptr;
+			VkImageView       *view = nullptr;
+			VkImageCreateInfo  imageInfo{};
+			VkImageAspectFlags aspect = 0;
+		};
+
+		// resource replaced in current pass, old handles live until copy finishes
+		struct Retired {
+			VkBuffer    buffer = VK_NULL_HANDLE;
+			VkImage     image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+		};
+
+		void  BeginPass();
+		void  EndPass();
+		void  Finish();
+		float CalculateFragmentation() const;
+
+		void RecordBufferMove(VkCommandBuffer commandBuffer, Resource &resource, VmaAllocation destination, Retired &retired);
+		void RecordImageMove(VkCommandBuffer commandBuffer, Resource &resource, VmaAllocation destination, Retired &retired);
+
+		RendererInfo m_rendererInfo;
+
+		std::unordered_map<VmaAllocation, Resource> m_resources;
+		uint32_t                                    m_queueFamilyIndices[2] = {};
+
+		VmaDefragmentationContext      m_context = VK_NULL_HANDLE;
+		VmaDefragmentationPassMoveInfo m_pass{};
+		bool                           m_passPending = false;
+		uint64_t                       m_passValue = 0;      // transfer timeline value of copies
+		VkCommandBuffer                m_passCommandBuffer = VK_NULL_HANDLE;
+		std::vector<Retired>           m_retired;
+		uint32_t                       m_emptyPasses = 0;    // passes where nothing registered could move
+
+		VkDeviceSize m_bytesPerFrame = 0;
+		double       m_budgetMs = 0.0;
+		float        m_startFragmentation = 0.3f;
+		uint32_t     m_checkInterval = 600;  // frames between fragmentation checks, 0 - only manual start
+		uint32_t     m_frame = 0;
+		uint64_t     m_imageGeneration = 0;
+
+		DefragmentationStats m_stats;
+		double               m_runMs = 0.0;
+	};
+
+}
@@ -0,0 +1,142 @@
+#include "deletion_queue.h"
+
+using namespace vu;
+
+
+void DeletionQueue::Initialize(const RendererInfo &rendererInfo) {
+	m_rendererInfo = rendererInfo;
+	m_stats = DeletionQueueStats{};
+}
+
+
+void DeletionQueue::Destroy() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (Entry &entry : m_entries) {
+		Release(entry);
+	}
+	m_stats.destroyed += m_entries.size();
+	m_stats.pending = 0;
+	m_entries.clear();
+}
+
+
+void DeletionQueue::Push(Entry &entry, Timeline &timeline, uint64_t value) {
+	entry.timeline = &timeline;
+	entry.value = value;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.push_back(entry);
+
+	m_stats.enqueued++;
+	m_stats.pending = static_cast<uint32_t>(m_entries.size());
+	m_stats.maxPending = std::max(m_stats.maxPending, m_stats.pending);
+}
+
+
+void DeletionQueue::DestroyBuffer(VkBuffer buffer, VmaAllocation allocation, Timeline &timeline, uint64_t value) {
+	Entry entry{};
+	entry.buffer = buffer;
+	entry.allocation = allocation;
+	Push(entry, timeline, value);
+}
+
+
+void DeletionQueue::DestroyImage(VkImage image, VmaAllocation allocation, Timeline &timeline, uint64_t value) {
+	Entry entry{};
+	entry.image = image;
+	entry.allocation = allocation;
+	Push(entry, timeline, value);
+}
+
+
+void DeletionQueue::DestroyImageView(VkImageView view, Timeline &timeline, uint64_t value) {
+	Entry entry{};
+	entry.view = view;
+	Push(entry, timeline, value);
+}
+
+
+void DeletionQueue::DestroyPipeline(VkPipeline pipeline, Timeline &timeline, uint64_t value) {
+	Entry entry{};
+	entry.pipeline = pipeline;
+	Push(entry, timeline, value);
+}
+
+
+void DeletionQueue::DestroyDescriptorPool(VkDescriptorPool pool, Timeline &timeline, uint64_t value) {
+	Entry entry{};
+	entry.descriptorPool = pool;
+	Push(entry, timeline, value);
+}
+
+
+void DeletionQueue::DestroySwapChain(VkSwapchainKHR swapChain, Timeline &timeline, uint64_t value) {
+	Entry entry{};
+	entry.swapChain = swapChain;
+	Push(entry, timeline, value);
+}
+
+
+void DeletionQueue::FreeMemory(VmaAllocation allocation, Timeline &timeline, uint64_t value) {
+	Entry entry{};
+	entry.allocation = allocation;
+	Push(entry, timeline, value);
+}
+
+
+void DeletionQueue::Update() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// finished entries are destroyed, the rest moves to the front keeping its order
+	size_t kept = 0;
+	for (size_t i = 0; i < m_entries.size(); i++) {
+		Entry &entry = m_entries[i];
+		if (entry.timeline->IsComplete(entry.value)) {
+			Release(entry);
+			m_stats.destroyed++;
+		} else {
+			m_entries[kept++] = entry;
+		}
+	}
+	m_entries.resize(kept);
+	m_stats.pending = static_cast<uint32_t>(kept);
+}
+
+
+void DeletionQueue::Release(Entry &entry) {
+	VkDevice device = m_rendererInfo.device;
+	VmaAllocator allocator = m_rendererInfo.allocator;
+
+	if (entry.buffer != VK_NULL_HANDLE) {
+		vu::destroyBuffer(allocator, entry.buffer, entry.allocation);
+		return;
+	}
+
+	if (entry.image != VK_NULL_HANDLE) {
+		if (entry.allocation != VK_NULL_HANDLE) {
+			vu::untagAllocation(allocator, entry.allocation);
+			vmaDestroyImage(allocator, entry.image, entry.allocation);
+		} else {
+			vkDestroyImage(device, entry.image, nullptr);
+		}
+		return;
+	}
+
+	if (entry.allocation != VK_NULL_HANDLE) {
+		vu::untagAllocation(allocator, entry.allocation);
+		vmaFreeMemory(allocator, entry.allocation);
+	}
+
+	vkDestroyImageView(device, entry.view, nullptr);
+	vkDestroyPipeline(device, entry.pipeline, nullptr);
+	vkDestroyDescriptorPool(device, entry.descriptorPool, nullptr);
+	vkDestroySwapchainKHR(device, entry.swapChain, nullptr);
+}
+
+
+void DeletionQueue::PrintStats() const {
+	std::cout << "deletion queue:\n";
+	std::cout << "\tenqueued: " << m_stats.enqueued << "\n";
+	std::cout << "\tdestroyed: " << m_stats.destroyed << "\n";
+	std::cout << "\tmax pending: " << m_stats.maxPending << "\n\n";
+}
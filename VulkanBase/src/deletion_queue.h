@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+
+#include <vulkan/vulkan.h>
+#include <VMA/vk_mem_alloc.h>
+
+#include "timeline.h"
+#include "vu.h"
+
+namespace vu {
+
+	struct DeletionQueueStats {
+		uint64_t enqueued   = 0;
+		uint64_t destroyed  = 0;
+		uint32_t pending    = 0;
+		uint32_t maxPending = 0;
+	};
+
+	// Vulkan objects that gpu may still use, destroyed once timeline passes the value of their last use
+	// Replaces waiting for idle device: resize, streaming and hot reload hand old objects here and go on
+	// Objects enqueued with the same value are destroyed in enqueue order (views before their images)
+	class DeletionQueue {
+	public:
+		void Initialize(const RendererInfo &rendererInfo);
+		void Destroy();  // destroys everything, gpu must be idle
+
+		// value - on timeline of the queue that used object last (graphics frame value, transfer upload value)
+		// allocations are untagged from memory statistics and freed with their object
+		void DestroyBuffer(VkBuffer buffer, VmaAllocation allocation, Timeline &timeline, uint64_t value);
+		void DestroyImage(VkImage image, VmaAllocation allocation, Timeline &timeline, uint64_t value);  // allocation can be null (memory owned elsewhere)
+		void DestroyImageView(VkImageView view, Timeline &timeline, uint64_t value);
+		void DestroyPipeline(VkPipeline pipeline, Timeline &timeline, uint64_t value);
+		void DestroyDescriptorPool(VkDescriptorPool pool, Timeline &timeline, uint64_t value);
+		void DestroySwapChain(VkSwapchainKHR swapChain, Timeline &timeline, uint64_t value);
+		void FreeMemory(VmaAllocation allocation, Timeline &timeline, uint64_t value);
+
+		// once per frame, destroys objects gpu is done with
+		void Update();
+
+		const DeletionQueueStats &GetStats() const { return m_stats; }
+		void PrintStats() const;
+
+	private:
+		// one object, only one handle is set (allocation can come with buffer or image)
+		struct Entry {
+			Timeline        *timeline = nullptr;
+			uint64_t         value = 0;
+			VkBuffer         buffer = VK_NULL_HANDLE;
+			VkImage          image = VK_NULL_HANDLE;
+			VkImageView      view = VK_NULL_HANDLE;
+			VkPipeline       pipeline = VK_NULL_HANDLE;
+			VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+			VkSwapchainKHR   swapChain = VK_NULL_HANDLE;
+			VmaAllocation    allocation = VK_NULL_HANDLE;
+		};
+
+		void Push(Entry &entry, Timeline &timeline, uint64_t value);
+		void Release(Entry &entry);
+
+		RendererInfo m_rendererInfo;
+
+		std::mutex         m_mutex;    // objects can be handed over from jobs
+		std::vector<Entry> m_entries;  // capacity is kept, enqueueing doesn't allocate after warm up
+
+		DeletionQueueStats m_stats;
+	};
+
+}
@@ -0,0 +1,362 @@
+#include "depth_pyramid.h"
+
+using namespace vu;
+
+
+void DepthPyramid::Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, VkFormat depthFormat, VkShaderModule reduceShader, VkShaderModule reduceMsaaShader) {
+	m_rendererInfo = rendererInfo;
+	m_framesInFlight = framesInFlight;
+	m_depthFormat = depthFormat;
+
+	// depth formats don't have to support sampling, multisampled depth has its own limit
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(m_rendererInfo.physicalDevice, m_depthFormat, &formatProperties);
+	m_depthSampleable = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(m_rendererInfo.physicalDevice, &properties);
+	m_depthSampleCounts = properties.limits.sampledImageDepthSampleCounts;
+
+	CreatePipelines(reduceShader, reduceMsaaShader);
+	CreateSampler();
+}
+
+
+void DepthPyramid::Destroy() {
+	DestroyPyramid();
+
+	vkDestroySampler(m_rendererInfo.device, m_sampler, nullptr);
+	vkDestroyPipeline(m_rendererInfo.device, m_reducePipeline, nullptr);
+	vkDestroyPipeline(m_rendererInfo.device, m_reduceMsaaPipeline, nullptr);
+	vkDestroyPipelineLayout(m_rendererInfo.device, m_pipelineLayout, nullptr);
+	vkDestroyDescriptorSetLayout(m_rendererInfo.device, m_descriptorSetLayout, nullptr);
+}
+
+
+bool DepthPyramid::IsSupported(VkSampleCountFlagBits samples) const {
+	return m_depthSampleable && (m_depthSampleCounts & samples) != 0;
+}
+
+
+void DepthPyramid::CreatePipelines(VkShaderModule reduceShader, VkShaderModule reduceMsaaShader) {
+	// source (depth buffer or level below), destination level
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_rendererInfo.device, &layoutInfo, nullptr, &m_descriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid descriptor set layout!");
+	}
+
+	VkPushConstantRange pushConstants{};
+	pushConstants.offset = 0;
+	pushConstants.size = sizeof(ReducePushConstants);
+	pushConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstants;
+
+	if (vkCreatePipelineLayout(m_rendererInfo.device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+	}
+
+	std::array<VkComputePipelineCreateInfo, 2> pipelineInfos{};
+	std::array<VkShaderModule, 2> shaders = {reduceShader, reduceMsaaShader};
+	for (uint32_t i = 0; i < pipelineInfos.size(); i++) {
+		pipelineInfos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfos[i].stage.module = shaders[i];
+		pipelineInfos[i].stage.pName = "main";
+		pipelineInfos[i].layout = m_pipelineLayout;
+	}
+
+	std::array<VkPipeline, 2> pipelines{};
+	if (vkCreateComputePipelines(m_rendererInfo.device, VK_NULL_HANDLE, static_cast<uint32_t>(pipelineInfos.size()), pipelineInfos.data(), nullptr, pipelines.data()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid pipelines!");
+	}
+	m_reducePipeline = pipelines[0];
+	m_reduceMsaaPipeline = pipelines[1];
+}
+
+
+void DepthPyramid::CreateSampler() {
+	// levels are read with texelFetch, sampler only has to exist
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(m_rendererInfo.device, &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid sampler!");
+	}
+}
+
+
+void DepthPyramid::CreatePyramid(VkExtent2D depthExtent) {
+	Pyramid &pyramid = m_pyramid;
+	pyramid.depthExtent = depthExtent;
+	pyramid.extent = HalfExtent(depthExtent);
+
+	// down to 1x1
+	pyramid.levels = 1;
+	for (VkExtent2D extent = pyramid.extent; extent.width > 1 || extent.height > 1; extent = HalfExtent(extent)) {
+		pyramid.levels++;
+	}
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R32_SFLOAT;
+	imageInfo.extent = {pyramid.extent.width, pyramid.extent.height, 1};
+	imageInfo.mipLevels = pyramid.levels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+
+	if (vmaCreateImage(m_rendererInfo.allocator, &imageInfo, &allocInfo, &pyramid.image, &pyramid.allocation, nullptr) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid image!");
+	}
+	vu::tagAllocation(m_rendererInfo.allocator, pyramid.allocation, MemoryCategory::Attachment);
+
+	// whole chain for culling, one view per level for reduction
+	VkImageViewCreateInfo viewInfo{};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = pyramid.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = VK_FORMAT_R32_SFLOAT;
+	viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levels, 0, 1};
+
+	if (vkCreateImageView(m_rendererInfo.device, &viewInfo, nullptr, &pyramid.view) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid view!");
+	}
+
+	pyramid.levelViews.resize(pyramid.levels);
+	for (uint32_t level = 0; level < pyramid.levels; level++) {
+		viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+		if (vkCreateImageView(m_rendererInfo.device, &viewInfo, nullptr, &pyramid.levelViews[level]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid level view!");
+		}
+	}
+
+	// sets live in their own pool, so a retired pyramid takes its sets with it
+	uint32_t setCount = pyramid.levels + m_framesInFlight;
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount};
+	poolSizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount};
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = setCount;
+
+	if (vkCreateDescriptorPool(m_rendererInfo.device, &poolInfo, nullptr, &pyramid.descriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create depth pyramid descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(setCount, m_descriptorSetLayout);
+	std::vector<VkDescriptorSet> sets(setCount);
+
+	VkDescriptorSetAllocateInfo setInfo{};
+	setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setInfo.descriptorPool = pyramid.descriptorPool;
+	setInfo.descriptorSetCount = setCount;
+	setInfo.pSetLayouts = layouts.data();
+
+	if (vkAllocateDescriptorSets(m_rendererInfo.device, &setInfo, sets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate depth pyramid descriptor sets!");
+	}
+
+	// level n reads level n - 1, depth sets get their source every frame
+	pyramid.levelSets.assign(sets.begin(), sets.begin() + pyramid.levels);
+	pyramid.depthSets.assign(sets.begin() + pyramid.levels, sets.end());
+	for (uint32_t level = 1; level < pyramid.levels; level++) {
+		WriteSet(pyramid.levelSets[level], pyramid.levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL, pyramid.levelViews[level]);
+	}
+
+	m_generation++;
+}
+
+
+void DepthPyramid::DestroyPyramid() {
+	if (m_pyramid.image == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkDestroyDescriptorPool(m_rendererInfo.device, m_pyramid.descriptorPool, nullptr);
+	for (VkImageView view : m_pyramid.levelViews) {
+		vkDestroyImageView(m_rendererInfo.device, view, nullptr);
+	}
+	vkDestroyImageView(m_rendererInfo.device, m_pyramid.view, nullptr);
+	vu::untagAllocation(m_rendererInfo.allocator, m_pyramid.allocation);
+	vmaDestroyImage(m_rendererInfo.allocator, m_pyramid.image, m_pyramid.allocation);
+	m_pyramid = Pyramid{};
+}
+
+
+void DepthPyramid::RetirePyramid() {
+	if (m_pyramid.image == VK_NULL_HANDLE) {
+		return;
+	}
+
+	// last used by previous frame (its build and the culling before it)
+	Timeline &timeline = *m_rendererInfo.graphicsTimeline;
+	uint64_t lastUse = timeline.GetLastSubmitted();
+
+	DeletionQueue &deletionQueue = *m_rendererInfo.deletionQueue;
+	deletionQueue.DestroyDescriptorPool(m_pyramid.descriptorPool, timeline, lastUse);
+	for (VkImageView view : m_pyramid.levelViews) {
+		deletionQueue.DestroyImageView(view, timeline, lastUse);
+	}
+	deletionQueue.DestroyImageView(m_pyramid.view, timeline, lastUse);
+	deletionQueue.DestroyImage(m_pyramid.image, m_pyramid.allocation, timeline, lastUse);
+	m_pyramid = Pyramid{};
+}
+
+
+void DepthPyramid::WriteSet(VkDescriptorSet set, VkImageView source, VkImageLayout sourceLayout, VkImageView destination) {
+	VkDescriptorImageInfo sourceInfo{};
+	sourceInfo.sampler = m_sampler;
+	sourceInfo.imageView = source;
+	sourceInfo.imageLayout = sourceLayout;
+
+	VkDescriptorImageInfo destinationInfo{};
+	destinationInfo.imageView = destination;
+	destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	std::array<VkWriteDescriptorSet, 2> writes{};
+	for (uint32_t i = 0; i < writes.size(); i++) {
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = set;
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+	}
+	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes[0].pImageInfo = &sourceInfo;
+	writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	writes[1].pImageInfo = &destinationInfo;
+
+	vkUpdateDescriptorSets(m_rendererInfo.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+
+void DepthPyramid::Barrier(VkCommandBuffer commandBuffer, uint32_t firstLevel, uint32_t levelCount, VkImageLayout oldLayout,
+                           VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_pyramid.image;
+	barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, firstLevel, levelCount, 0, 1};
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+
+void DepthPyramid::BeginFrame(uint32_t frameIndex) {
+	m_frameIndex = frameIndex;
+}
+
+
+void DepthPyramid::Prepare(VkCommandBuffer commandBuffer, VkExtent2D depthExtent) {
+	// only a pyramid of last frame is worth testing against
+	m_valid = m_built;
+	m_built = false;
+
+	if (m_pyramid.image != VK_NULL_HANDLE && m_pyramid.depthExtent.width == depthExtent.width && m_pyramid.depthExtent.height == depthExtent.height) {
+		return;
+	}
+
+	RetirePyramid();
+	CreatePyramid(depthExtent);
+	m_valid = false;
+
+	// far depth hides nothing, so culling against new pyramid keeps every object
+	Barrier(commandBuffer, 0, m_pyramid.levels, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	VkClearColorValue far = {{1.0f, 1.0f, 1.0f, 1.0f}};
+	VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_pyramid.levels, 0, 1};
+	vkCmdClearColorImage(commandBuffer, m_pyramid.image, VK_IMAGE_LAYOUT_GENERAL, &far, 1, &range);
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = m_pyramid.image;
+	barrier.subresourceRange = range;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+
+void DepthPyramid::Build(VkCommandBuffer commandBuffer, VkImageView depthView, VkSampleCountFlagBits samples, const glm::mat4 &viewProj) {
+	Pyramid &pyramid = m_pyramid;
+
+	// level 0 reads depth of this frame, set of this slot is not used by gpu anymore
+	VkDescriptorSet depthSet = pyramid.depthSets[m_frameIndex];
+	WriteSet(depthSet, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, pyramid.levelViews[0]);
+
+	// culling of this frame read the whole pyramid, writes wait for it
+	Barrier(commandBuffer, 0, pyramid.levels, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	VkExtent2D sourceExtent = pyramid.depthExtent;
+	VkExtent2D extent = pyramid.extent;
+	for (uint32_t level = 0; level < pyramid.levels; level++) {
+		bool msaa = level == 0 && samples != VK_SAMPLE_COUNT_1_BIT;
+		VkDescriptorSet set = level == 0 ? depthSet : pyramid.levelSets[level];
+
+		ReducePushConstants pushConstants{};
+		pushConstants.sourceSize = glm::ivec2(sourceExtent.width, sourceExtent.height);
+		pushConstants.destinationSize = glm::ivec2(extent.width, extent.height);
+		pushConstants.samples = level == 0 ? static_cast<int32_t>(samples) : 1;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, msaa ? m_reduceMsaaPipeline : m_reducePipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (extent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (extent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+		// next level and culling of next frame read it
+		Barrier(commandBuffer, level, 1, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+		sourceExtent = extent;
+		extent = HalfExtent(extent);
+	}
+
+	m_viewProj = viewProj;
+	m_built = true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+#include <VMA/vk_mem_alloc.h>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "deletion_queue.h"
+#include "vu.h"
+
+namespace vu {
+
+	// Hierarchical depth (Hi-Z) for occlusion culling
+	// Texel of level 0 keeps the farthest depth of 2x2 depth buffer pixels (all samples), every next level the farthest of
+	// 2x2 texels below it, so one texel of level n covers 2^(n+1) pixels in both directions
+	// Built by compute passes at the end of a frame, next frame culls against it with the view projection it was built with
+	// (objects that become visible only because camera moved show up one frame late)
+	// Pyramid always exists once Prepare was called (cleared to far depth), so culling descriptors stay valid without it
+	class DepthPyramid {
+	public:
+		// reduceMsaaShader reads every sample of multisampled depth into level 0
+		void Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, VkFormat depthFormat, VkShaderModule reduceShader, VkShaderModule reduceMsaaShader);
+		void Destroy();
+
+		// depth format can't be sampled with this sample count, nothing is built and IsValid stays false
+		bool IsSupported(VkSampleCountFlagBits samples) const;
+
+		// level 0 source set of this slot can be rewritten, gpu must be done with previous use of the slot
+		void BeginFrame(uint32_t frameIndex);
+
+		// before culling, outside of rendering
+		// recreates pyramid when depth extent changes (old one goes to deletion queue, new one is cleared to far depth)
+		void Prepare(VkCommandBuffer commandBuffer, VkExtent2D depthExtent);
+
+		// compute work after last depth write of the frame, depth must be in shader read only layout
+		void Build(VkCommandBuffer commandBuffer, VkImageView depthView, VkSampleCountFlagBits samples, const glm::mat4 &viewProj);
+
+		// previous frame built the pyramid, culling of this frame can test against it
+		bool IsValid() const { return m_valid; }
+
+		// whole mip chain in general layout, sample with texelFetch
+		VkImageView GetView()       const { return m_pyramid.view; }
+		VkSampler   GetSampler()    const { return m_sampler; }
+		VkExtent2D  GetExtent()     const { return m_pyramid.extent; }       // level 0
+		VkExtent2D  GetDepthExtent() const { return m_pyramid.depthExtent; }
+		uint32_t    GetLevelCount() const { return m_pyramid.levels; }
+		uint64_t    GetGeneration() const { return m_generation; }          // changes whenever view changes
+		const glm::mat4 &GetViewProj() const { return m_viewProj; }          // camera depth was rendered with
+
+	private:
+		struct ReducePushConstants {
+			glm::ivec2 sourceSize;
+			glm::ivec2 destinationSize;
+			int32_t    samples;
+		};
+
+		// everything that depends on extent, replaced as a whole
+		struct Pyramid {
+			VkImage                      image = VK_NULL_HANDLE;
+			VmaAllocation                allocation = VK_NULL_HANDLE;
+			VkImageView                  view = VK_NULL_HANDLE;
+			std::vector<VkImageView>     levelViews;
+			VkDescriptorPool             descriptorPool = VK_NULL_HANDLE;
+			std::vector<VkDescriptorSet> levelSets;  // level n reads level n - 1 (index 0 unused)
+			std::vector<VkDescriptorSet> depthSets;  // level 0 reads depth buffer, one per frame slot
+			VkExtent2D                   extent = {0, 0};
+			VkExtent2D                   depthExtent = {0, 0};
+			uint32_t                     levels = 0;
+		};
+
+		static const uint32_t WORKGROUP_SIZE = 8;
+
+		void CreatePipelines(VkShaderModule reduceShader, VkShaderModule reduceMsaaShader);
+		void CreateSampler();
+		void CreatePyramid(VkExtent2D depthExtent);
+		void DestroyPyramid();
+		void RetirePyramid();
+		void WriteSet(VkDescriptorSet set, VkImageView source, VkImageLayout sourceLayout, VkImageView destination);
+		void Barrier(VkCommandBuffer commandBuffer, uint32_t firstLevel, uint32_t levelCount, VkImageLayout oldLayout,
+		             VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkAccessFlags dstAccess);
+		static VkExtent2D HalfExtent(VkExtent2D extent) { return {std::max((extent.width + 1) / 2, 1u), std::max((extent.height + 1) / 2, 1u)}; }
+
+		RendererInfo m_rendererInfo;
+		uint32_t     m_framesInFlight = 0;
+		uint32_t     m_frameIndex = 0;
+		VkFormat     m_depthFormat = VK_FORMAT_UNDEFINED;
+
+		VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout      m_pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline            m_reducePipeline = VK_NULL_HANDLE;
+		VkPipeline            m_reduceMsaaPipeline = VK_NULL_HANDLE;
+		VkSampler             m_sampler = VK_NULL_HANDLE;
+
+		bool                  m_depthSampleable = false;
+		VkSampleCountFlags    m_depthSampleCounts = 0;  // sample counts depth can be sampled with
+
+		Pyramid   m_pyramid;
+		bool      m_valid = false;        // built by previous frame
+		bool      m_built = false;        // built by current frame
+		uint64_t  m_generation = 0;
+		glm::mat4 m_viewProj{1.0f};
+	};
+
+}
@@ -0,0 +1,175 @@
+#include "frame_pacer.h"
+
+using namespace vu;
+
+
+static double toMs(std::chrono::steady_clock::duration duration) {
+	return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static std::chrono::steady_clock::duration fromMs(double ms) {
+	return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(ms));
+}
+
+
+void FramePacer::Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight) {
+	m_rendererInfo = rendererInfo;
+	m_written.assign(framesInFlight, false);
+
+	// timestamps are written by graphics queue, not every family supports them
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(m_rendererInfo.physicalDevice, &properties);
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_rendererInfo.physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_rendererInfo.physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	vu::QueueFamilyIndices indices = vu::findQueueFamilies(m_rendererInfo.physicalDevice, m_rendererInfo.surface);
+	uint32_t validBits = queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+
+	m_timestampsSupported = validBits > 0 && properties.limits.timestampPeriod > 0.0f;
+	if (!m_timestampsSupported) {
+		std::cout << "graphics queue has no timestamps, low latency pacing falls back to throughput\n\n";
+		return;
+	}
+	m_timestampPeriod = properties.limits.timestampPeriod;
+	m_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = framesInFlight * 2;
+
+	if (vkCreateQueryPool(m_rendererInfo.device, &poolInfo, nullptr, &m_queryPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create timestamp query pool!");
+	}
+}
+
+
+void FramePacer::Destroy() {
+	if (m_queryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(m_rendererInfo.device, m_queryPool, nullptr);
+		m_queryPool = VK_NULL_HANDLE;
+	}
+}
+
+
+void FramePacer::BeginFrame(uint32_t frameIndex) {
+	m_frameIndex = frameIndex;
+
+	if (!m_timestampsSupported || !m_written[m_frameIndex]) {
+		return;
+	}
+	m_written[m_frameIndex] = false;
+
+	// no wait flag, frame slot was already waited on its timeline value
+	uint64_t timestamps[2] = {};
+	VkResult result = vkGetQueryPoolResults(m_rendererInfo.device, m_queryPool, m_frameIndex * 2, 2,
+		sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS) {
+		return;
+	}
+
+	double gpuMs = static_cast<double>((timestamps[1] - timestamps[0]) & m_timestampMask) * m_timestampPeriod / 1e6;
+	m_gpuMs = m_gpuFrames == 0 ? gpuMs : m_gpuMs + (gpuMs - m_gpuMs) * SMOOTHING;
+	m_totalGpuMs += gpuMs;
+	m_gpuFrames++;
+}
+
+
+void FramePacer::WaitForInput() {
+	Clock::time_point now = Clock::now();
+	Clock::time_point target = now;
+
+	// be ready with submission slightly before gpu finishes frames that are already queued
+	if (m_mode == PacingMode::LowLatency && m_gpuFrames > 0) {
+		target = std::max(target, m_gpuFreeTime - fromMs(m_cpuMs + SAFETY_MARGIN_MS));
+	}
+
+	if (m_frameLimit > 0.0f && m_started) {
+		target = std::max(target, m_frameStartTime + fromMs(1000.0 / m_frameLimit));
+	}
+
+	if (target > now) {
+		SleepUntil(target);
+	}
+
+	m_frameStartTime = Clock::now();
+	m_totalSleepMs += toMs(m_frameStartTime - now);
+	m_started = true;
+}
+
+
+void FramePacer::SleepUntil(Clock::time_point time) {
+	Clock::duration remaining = time - Clock::now();
+	if (remaining > fromMs(SPIN_MS)) {
+		std::this_thread::sleep_for(remaining - fromMs(SPIN_MS));
+	}
+
+	while (Clock::now() < time) {
+		std::this_thread::yield();
+	}
+}
+
+
+void FramePacer::WriteBeginTimestamp(VkCommandBuffer commandBuffer) {
+	if (!m_timestampsSupported) {
+		return;
+	}
+
+	vkCmdResetQueryPool(commandBuffer, m_queryPool, m_frameIndex * 2, 2);
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, m_frameIndex * 2);
+}
+
+
+void FramePacer::WriteEndTimestamp(VkCommandBuffer commandBuffer) {
+	if (!m_timestampsSupported) {
+		return;
+	}
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, m_frameIndex * 2 + 1);
+	m_written[m_frameIndex] = true;
+}
+
+
+void FramePacer::EndFrame() {
+	Clock::time_point now = Clock::now();
+
+	double cpuMs = toMs(now - m_frameStartTime);
+	m_cpuMs = m_frames == 0 ? cpuMs : m_cpuMs + (cpuMs - m_cpuMs) * SMOOTHING;
+
+	// gpu starts this frame once it is done with earlier ones
+	m_gpuFreeTime = std::max(now, m_gpuFreeTime) + fromMs(m_gpuMs);
+
+	m_totalCpuMs += cpuMs;
+	m_totalLatencyMs += toMs(m_gpuFreeTime - m_frameStartTime);
+	m_frames++;
+}
+
+
+FramePacerStats FramePacer::GetStats() const {
+	FramePacerStats stats{};
+	stats.frames = m_frames;
+	if (m_frames > 0) {
+		stats.cpuMs = m_totalCpuMs / m_frames;
+		stats.sleepMs = m_totalSleepMs / m_frames;
+		stats.latencyMs = m_totalLatencyMs / m_frames;
+	}
+	if (m_gpuFrames > 0) {
+		stats.gpuMs = m_totalGpuMs / m_gpuFrames;
+	}
+	return stats;
+}
+
+
+void FramePacer::PrintStats() const {
+	FramePacerStats stats = GetStats();
+
+	std::cout << "frame pacing:\n";
+	std::cout << "\t" << "mode: " << (m_mode == PacingMode::LowLatency ? "low latency" : "throughput")
+	          << ", frame limit: " << (m_frameLimit > 0.0f ? std::to_string(m_frameLimit) + " fps" : std::string("off")) << "\n";
+	std::cout << "\t" << "frames: " << stats.frames << "\n";
+	std::cout << "\t" << "gpu: " << stats.gpuMs << " ms, cpu (input to submit): " << stats.cpuMs << " ms, slept: " << stats.sleepMs << " ms\n";
+	std::cout << "\t" << "predicted input to gpu finish: " << stats.latencyMs << " ms\n\n";
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+#include "vu.h"
+
+namespace vu {
+
+	enum class PacingMode {
+		Throughput,  // start next frame as soon as a frame slot is free (cpu runs up to frames in flight ahead)
+		LowLatency   // start next frame so it is submitted right when gpu runs out of work
+	};
+
+	struct FramePacerStats {
+		uint64_t frames    = 0;
+		double   gpuMs     = 0.0;  // average gpu time of a frame (timestamps of graphics command buffer)
+		double   cpuMs     = 0.0;  // average time from input sampling to submission
+		double   sleepMs   = 0.0;  // average time slept before input sampling
+		double   latencyMs = 0.0;  // average predicted time from input sampling to gpu finishing the frame
+	};
+
+	// Measures gpu time of every frame with timestamp queries and decides when next frame starts
+	// In low latency mode cpu sleeps until predicted gpu finish of last submitted frame minus cpu time of a frame,
+	// so input is sampled as late as possible and frame does not wait in the queue after submission
+	// Frame limiter works in both modes
+	class FramePacer {
+	public:
+		void Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight);
+		void Destroy();
+
+		void       SetMode(PacingMode mode) { m_mode = mode; }
+		PacingMode GetMode() const { return m_mode; }
+		void       SetFrameLimit(float fps) { m_frameLimit = std::max(fps, 0.0f); }  // 0 - no limit
+
+		// reads timestamps of previous use of this frame slot, gpu must be done with it
+		void BeginFrame(uint32_t frameIndex);
+
+		// sleeps before input is sampled (low latency mode and frame limiter)
+		void WaitForInput();
+
+		// around all gpu work of the frame, outside of rendering
+		void WriteBeginTimestamp(VkCommandBuffer commandBuffer);
+		void WriteEndTimestamp(VkCommandBuffer commandBuffer);
+
+		// call right after frame submission
+		void EndFrame();
+
+		FramePacerStats GetStats() const;
+		void PrintStats() const;
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		void SleepUntil(Clock::time_point time);
+
+		// newest measurement weight of running averages used for prediction
+		static constexpr double SMOOTHING = 0.1;
+
+		// started earlier than predicted, prediction error costs gpu idle time
+		static constexpr double SAFETY_MARGIN_MS = 1.0;
+
+		// sleep_for oversleeps, last part of the wait is spent yielding
+		static constexpr double SPIN_MS = 1.0;
+
+		RendererInfo m_rendererInfo;
+
+		VkQueryPool       m_queryPool = VK_NULL_HANDLE;  // two timestamps per frame slot
+		std::vector<bool> m_written;                      // slot has timestamps that were not read yet
+		bool              m_timestampsSupported = false;
+		double            m_timestampPeriod = 1.0;        // ns per tick
+		uint64_t          m_timestampMask = ~0ull;
+		uint32_t          m_frameIndex = 0;
+
+		PacingMode m_mode = PacingMode::Throughput;
+		float      m_frameLimit = 0.0f;
+
+		double            m_gpuMs = 0.0;               // running averages
+		double            m_cpuMs = 0.0;
+		Clock::time_point m_gpuFreeTime;               // predicted finish of all submitted frames
+		Clock::time_point m_frameStartTime;            // last time input was sampled
+		bool              m_started = false;
+
+		uint64_t m_frames = 0;
+		uint64_t m_gpuFrames = 0;
+		double   m_totalGpuMs = 0.0;
+		double   m_totalCpuMs = 0.0;
+		double   m_totalSleepMs = 0.0;
+		double   m_totalLatencyMs = 0.0;
+	};
+
+}
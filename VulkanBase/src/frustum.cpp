@@ -0,0 +1,122 @@
+#include "frustum.h"
+
+using namespace vu;
+
+
+void vu::extractFrustumPlanes(const glm::mat4 &viewProj, glm::vec4 planes[6]) {
+	// rows of clip matrix, glm is column major
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];  // left
+	planes[1] = rows[3] - rows[0];  // right
+	planes[2] = rows[3] + rows[1];  // bottom
+	planes[3] = rows[3] - rows[1];  // top
+	planes[4] = rows[2];            // near (depth is 0..1)
+	planes[5] = rows[3] - rows[2];  // far
+
+	for (int i = 0; i < 6; i++) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+
+static uint32_t cullSpheresScalar(const glm::vec4 planes[6], const SphereStreams &s, uint32_t first, uint8_t *visible) {
+	uint32_t visibleCount = 0;
+	for (uint32_t i = first; i < s.count; i++) {
+		bool inside = true;
+		for (int p = 0; p < 6; p++) {
+			inside = inside && planes[p].x * s.centerX[i] + planes[p].y * s.centerY[i] + planes[p].z * s.centerZ[i] + planes[p].w > -s.radius[i];
+		}
+		visible[i] = inside ? 1 : 0;
+		visibleCount += visible[i];
+	}
+	return visibleCount;
+}
+
+
+#if VU_SIMD_X86
+
+// 4 spheres per iteration, every plane is broadcast once
+static uint32_t cullSpheresSse2(const glm::vec4 planes[6], const SphereStreams &s, uint8_t *visible, uint32_t &visibleCount) {
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm_set1_ps(planes[p].x);
+		planeY[p] = _mm_set1_ps(planes[p].y);
+		planeZ[p] = _mm_set1_ps(planes[p].z);
+		planeW[p] = _mm_set1_ps(planes[p].w);
+	}
+
+	uint32_t count = s.count & ~3u;
+	for (uint32_t i = 0; i < count; i += 4) {
+		__m128 x = _mm_loadu_ps(s.centerX + i);
+		__m128 y = _mm_loadu_ps(s.centerY + i);
+		__m128 z = _mm_loadu_ps(s.centerZ + i);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(s.radius + i));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+			inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+	return count;
+}
+
+
+// 8 spheres per iteration, same test as sse2 version
+VU_TARGET_AVX2 static uint32_t cullSpheresAvx2(const glm::vec4 planes[6], const SphereStreams &s, uint8_t *visible, uint32_t &visibleCount) {
+	__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; p++) {
+		planeX[p] = _mm256_set1_ps(planes[p].x);
+		planeY[p] = _mm256_set1_ps(planes[p].y);
+		planeZ[p] = _mm256_set1_ps(planes[p].z);
+		planeW[p] = _mm256_set1_ps(planes[p].w);
+	}
+
+	uint32_t count = s.count & ~7u;
+	for (uint32_t i = 0; i < count; i += 8) {
+		__m256 x = _mm256_loadu_ps(s.centerX + i);
+		__m256 y = _mm256_loadu_ps(s.centerY + i);
+		__m256 z = _mm256_loadu_ps(s.centerZ + i);
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(s.radius + i));
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m256 distance = _mm256_fmadd_ps(planeX[p], x, _mm256_fmadd_ps(planeY[p], y, _mm256_fmadd_ps(planeZ[p], z, planeW[p])));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GT_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 8; lane++) {
+			visible[i + lane] = (mask >> lane) & 1;
+			visibleCount += (mask >> lane) & 1;
+		}
+	}
+	return count;
+}
+
+#endif
+
+
+uint32_t vu::cullSpheres(const glm::vec4 planes[6], const SphereStreams &spheres, uint8_t *visible, SimdLevel level) {
+	// wide kernels stop at multiple of their width, the rest is done by scalar code
+	uint32_t done = 0;
+	uint32_t visibleCount = 0;
+#if VU_SIMD_X86
+	if (level == SimdLevel::Avx2) {
+		done = cullSpheresAvx2(planes, spheres, visible, visibleCount);
+	} else if (level == SimdLevel::Sse2) {
+		done = cullSpheresSse2(planes, spheres, visible, visibleCount);
+	}
+#endif
+	return visibleCount + cullSpheresScalar(planes, spheres, done, visible);
+}
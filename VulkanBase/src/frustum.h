@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "simd.h"
+
+namespace vu {
+
+	// world space bounding spheres as separate float arrays, one element per object in every array
+	struct SphereStreams {
+		const float *centerX;
+		const float *centerY;
+		const float *centerZ;
+		const float *radius;
+		uint32_t     count;
+	};
+
+	// left, right, bottom, top, near, far planes of clip matrix (depth 0..1)
+	// xyz - unit normal pointing inside, w - distance, point p is inside when dot(xyz, p) + w > 0
+	void extractFrustumPlanes(const glm::mat4 &viewProj, glm::vec4 planes[6]);
+
+	// visible[i] is 1 when sphere i is not completely outside of some plane, returns visible count
+	// 8 (avx2) or 4 (sse2) spheres at a time against all planes
+	uint32_t cullSpheres(const glm::vec4 planes[6], const SphereStreams &spheres, uint8_t *visible, SimdLevel level = getSimdLevel());
+
+}
@@ -0,0 +1,420 @@
+#include "gpu_scene.h"
+
+using namespace vu;
+
+
+void GpuScene::Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, VkShaderModule cullShader, bool drawIndirectCount) {
+	m_rendererInfo = rendererInfo;
+	m_framesInFlight = framesInFlight;
+	m_drawIndirectCount = drawIndirectCount;
+	m_frames.resize(m_framesInFlight);
+
+	CreatePipeline(cullShader);
+	CreateDescriptors();
+	CreateParamBuffers();
+}
+
+
+void GpuScene::Destroy() {
+	DestroyBuffers();
+	for (Frame &frame : m_frames) {
+		DestroyBuffer(frame.params);
+	}
+
+	vkDestroyDescriptorPool(m_rendererInfo.device, m_descriptorPool, nullptr);  // destroys descriptor sets as well
+	vkDestroyDescriptorSetLayout(m_rendererInfo.device, m_descriptorSetLayout, nullptr);
+	vkDestroyPipeline(m_rendererInfo.device, m_pipeline, nullptr);
+	vkDestroyPipelineLayout(m_rendererInfo.device, m_pipelineLayout, nullptr);
+	m_frames.clear();
+}
+
+
+void GpuScene::CreatePipeline(VkShaderModule cullShader) {
+	// objects, bounds, batches, commands, counts, params, depth pyramid
+	std::array<VkDescriptorSetLayoutBinding, 7> bindings{};
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[6].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(m_rendererInfo.device, &layoutInfo, nullptr, &m_descriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor set layout!");
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+
+	if (vkCreatePipelineLayout(m_rendererInfo.device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline layout!");
+	}
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = cullShader;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = m_pipelineLayout;
+
+	if (vkCreateComputePipelines(m_rendererInfo.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling pipeline!");
+	}
+}
+
+
+void GpuScene::CreateDescriptors() {
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
+	poolSizes[0] = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_framesInFlight * 5};
+	poolSizes[1] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, m_framesInFlight};
+	poolSizes[2] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_framesInFlight};
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = m_framesInFlight;
+
+	if (vkCreateDescriptorPool(m_rendererInfo.device, &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create culling descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(m_framesInFlight, m_descriptorSetLayout);
+	std::vector<VkDescriptorSet> sets(m_framesInFlight);
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = m_framesInFlight;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (vkAllocateDescriptorSets(m_rendererInfo.device, &allocInfo, sets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate culling descriptor sets!");
+	}
+
+	for (uint32_t i = 0; i < m_framesInFlight; i++) {
+		m_frames[i].descriptorSet = sets[i];
+	}
+}
+
+
+void GpuScene::CreateParamBuffers() {
+	for (Frame &frame : m_frames) {
+		vu::createBuffer(m_rendererInfo.physicalDevice, m_rendererInfo.allocator, m_rendererInfo.surface,
+			sizeof(CullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			frame.params.buffer, frame.params.allocation, frame.params.allocationInfo, MemoryCategory::Scene);
+
+		// params buffer never changes, pyramid is written by Cull when it changes
+		VkDescriptorBufferInfo bufferInfo = {frame.params.buffer, 0, sizeof(CullParams)};
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = frame.descriptorSet;
+		write.dstBinding = 5;
+		write.dstArrayElement = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		write.descriptorCount = 1;
+		write.pBufferInfo = &bufferInfo;
+
+		vkUpdateDescriptorSets(m_rendererInfo.device, 1, &write, 0, nullptr);
+	}
+}
+
+
+void GpuScene::Build(const vu::Scene &scene, const std::vector<const vu::Mesh *> &batchMeshes, const std::vector<GpuSceneObject> &objects) {
+	DestroyBuffers();
+
+	m_scene = &scene;
+	m_batchMeshes = batchMeshes;
+	m_objects = objects;
+
+	// command ranges of batches follow each other, every batch has room for all of its objects
+	std::vector<ObjectBounds> bounds(m_objects.size());
+	m_batchObjectCounts.assign(m_batchMeshes.size(), 0);
+	m_dynamicObjects.clear();
+
+	for (uint32_t i = 0; i < m_objects.size(); i++) {
+		const GpuSceneObject &object = m_objects[i];
+		bounds[i] = {};
+		bounds[i].sphere = m_batchMeshes[object.batch]->GetBoundingSphere();
+		bounds[i].batch = object.batch;
+		bounds[i].indexInBatch = m_batchObjectCounts[object.batch]++;
+
+		if (object.dynamic) {
+			m_dynamicObjects.push_back(i);
+		}
+	}
+
+	m_batches.assign(m_batchMeshes.size(), Batch{});
+	uint32_t firstCommand = 0;
+	for (uint32_t i = 0; i < m_batches.size(); i++) {
+		const std::vector<MeshLod> &lods = m_batchMeshes[i]->GetLods();
+
+		m_batches[i].firstCommand = firstCommand;
+		m_batches[i].lodCount = std::min(static_cast<uint32_t>(lods.size()), MAX_LODS);
+		for (uint32_t lod = 0; lod < m_batches[i].lodCount; lod++) {
+			m_batches[i].lods[lod].indexCount = lods[lod].indexCount;
+			m_batches[i].lods[lod].firstIndex = lods[lod].firstIndex;
+			m_batches[i].lods[lod].maxDistance = lods[lod].maxDistance;
+		}
+		firstCommand += m_batchObjectCounts[i];
+	}
+
+	CreateBuffers();
+	UploadStatic(m_bounds, bounds.data(), bounds.size() * sizeof(ObjectBounds));
+	UploadStatic(m_batchBuffer, m_batches.data(), m_batches.size() * sizeof(Batch));
+
+	// every frame slot starts with all objects, later only dynamic ones are rewritten
+	for (Frame &frame : m_frames) {
+		vu::ObjectData *objectData = static_cast<vu::ObjectData *>(frame.objects.allocationInfo.pMappedData);
+		for (uint32_t i = 0; i < m_objects.size(); i++) {
+			WriteObject(objectData[i], m_objects[i]);
+		}
+	}
+
+	// buffers never change until next Build, so sets are written once
+	for (Frame &frame : m_frames) {
+		std::array<VkDescriptorBufferInfo, 5> bufferInfos{};
+		bufferInfos[0] = {frame.objects.buffer, 0, VK_WHOLE_SIZE};
+		bufferInfos[1] = {m_bounds.buffer, 0, VK_WHOLE_SIZE};
+		bufferInfos[2] = {m_batchBuffer.buffer, 0, VK_WHOLE_SIZE};
+		bufferInfos[3] = {frame.commands.buffer, 0, VK_WHOLE_SIZE};
+		bufferInfos[4] = {frame.counts.buffer, 0, VK_WHOLE_SIZE};
+
+		std::array<VkWriteDescriptorSet, 5> writes{};
+		for (uint32_t i = 0; i < writes.size(); i++) {
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = frame.descriptorSet;
+			writes[i].dstBinding = i;
+			writes[i].dstArrayElement = 0;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].descriptorCount = 1;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		vkUpdateDescriptorSets(m_rendererInfo.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+
+void GpuScene::CreateBuffers() {
+	// empty buffers are not allowed
+	VkDeviceSize objectCount = std::max<VkDeviceSize>(m_objects.size(), 1);
+	VkDeviceSize batchCount = std::max<VkDeviceSize>(m_batches.size(), 1);
+
+	vu::createBuffer(m_rendererInfo.physicalDevice, m_rendererInfo.allocator, m_rendererInfo.surface,
+		objectCount * sizeof(ObjectBounds), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_AUTO, 0,
+		m_bounds.buffer, m_bounds.allocation, m_bounds.allocationInfo, MemoryCategory::Scene);
+
+	vu::createBuffer(m_rendererInfo.physicalDevice, m_rendererInfo.allocator, m_rendererInfo.surface,
+		batchCount * sizeof(Batch), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VMA_MEMORY_USAGE_AUTO, 0,
+		m_batchBuffer.buffer, m_batchBuffer.allocation, m_batchBuffer.allocationInfo, MemoryCategory::Scene);
+
+	for (Frame &frame : m_frames) {
+		// read by cull pass and vertex shader
+		vu::createBuffer(m_rendererInfo.physicalDevice, m_rendererInfo.allocator, m_rendererInfo.surface,
+			objectCount * sizeof(vu::ObjectData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			frame.objects.buffer, frame.objects.allocation, frame.objects.allocationInfo, MemoryCategory::Scene);
+
+		vu::createBuffer(m_rendererInfo.physicalDevice, m_rendererInfo.allocator, m_rendererInfo.surface,
+			objectCount * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VMA_MEMORY_USAGE_AUTO, 0,
+			frame.commands.buffer, frame.commands.allocation, frame.commands.allocationInfo, MemoryCategory::Scene);
+
+		// few bytes, read back by cpu for statistics, two culled counters after batch counts
+		vu::createBuffer(m_rendererInfo.physicalDevice, m_rendererInfo.allocator, m_rendererInfo.surface,
+			(batchCount + 2) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			frame.counts.buffer, frame.counts.allocation, frame.counts.allocationInfo, MemoryCategory::Scene);
+
+		frame.culled = false;
+	}
+}
+
+
+void GpuScene::UploadStatic(Buffer &buffer, const void *data, VkDeviceSize size) {
+	if (size == 0) {
+		return;
+	}
+
+	VkBuffer stagingBuffer;
+	VmaAllocation stagingAllocation;
+	VmaAllocationInfo stagingAllocationInfo;
+
+	vu::createBuffer(m_rendererInfo.physicalDevice, m_rendererInfo.allocator, m_rendererInfo.surface,
+		size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+		stagingBuffer, stagingAllocation, stagingAllocationInfo, MemoryCategory::Staging);
+
+	vmaCopyMemoryToAllocation(m_rendererInfo.allocator, data, stagingAllocation, 0, size);
+	vu::copyBuffer(stagingBuffer, buffer.buffer, size, m_rendererInfo.device, m_rendererInfo.transferCommandPool, m_rendererInfo.transferQueue, *m_rendererInfo.transferTimeline);
+
+	vu::destroyBuffer(m_rendererInfo.allocator, stagingBuffer, stagingAllocation);
+}
+
+
+void GpuScene::DestroyBuffer(Buffer &buffer) {
+	// rebuild can happen while frames in flight still cull and draw from old buffers
+	if (buffer.buffer != VK_NULL_HANDLE) {
+		Timeline &timeline = *m_rendererInfo.graphicsTimeline;
+		m_rendererInfo.deletionQueue->DestroyBuffer(buffer.buffer, buffer.allocation, timeline, timeline.GetLastSubmitted());
+	}
+	buffer = Buffer{};
+}
+
+
+void GpuScene::DestroyBuffers() {
+	DestroyBuffer(m_bounds);
+	DestroyBuffer(m_batchBuffer);
+	for (Frame &frame : m_frames) {
+		DestroyBuffer(frame.objects);
+		DestroyBuffer(frame.commands);
+		DestroyBuffer(frame.counts);
+	}
+}
+
+
+void GpuScene::BeginFrame(uint32_t frameIndex) {
+	m_frameIndex = frameIndex;
+	Frame &frame = m_frames[m_frameIndex];
+
+	// counts of last cull pass that used this slot, it is finished
+	if (frame.culled) {
+		vmaInvalidateAllocation(m_rendererInfo.allocator, frame.counts.allocation, 0, VK_WHOLE_SIZE);
+
+		const uint32_t *counts = static_cast<const uint32_t *>(frame.counts.allocationInfo.pMappedData);
+		m_visibleObjects = 0;
+		for (uint32_t i = 0; i < m_batches.size(); i++) {
+			m_visibleObjects += counts[i];
+		}
+		m_frustumCulled = counts[m_batches.size()];
+		m_occlusionCulled = counts[m_batches.size() + 1];
+	}
+
+	vu::ObjectData *objectData = static_cast<vu::ObjectData *>(frame.objects.allocationInfo.pMappedData);
+	for (uint32_t objectIndex : m_dynamicObjects) {
+		WriteObject(objectData[objectIndex], m_objects[objectIndex]);
+	}
+}
+
+
+void GpuScene::WriteObject(vu::ObjectData &data, const GpuSceneObject &object) const {
+	data.model = m_scene->GetWorldMatrix(object.entity);
+	data.prevModel = m_scene->GetPrevWorldMatrix(object.entity);
+	data.normal = glm::mat3x4(m_scene->GetNormalMatrix(object.entity));
+	data.materialIndex = object.materialIndex;
+}
+
+
+void GpuScene::Cull(VkCommandBuffer commandBuffer, const glm::mat4 &viewProj, const glm::vec3 &cameraPos, const DepthPyramid &pyramid, bool occlusion) {
+	Frame &frame = m_frames[m_frameIndex];
+
+	// resize replaces the pyramid, gpu is done with previous use of this set
+	if (frame.pyramidGeneration != pyramid.GetGeneration()) {
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.sampler = pyramid.GetSampler();
+		imageInfo.imageView = pyramid.GetView();
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = frame.descriptorSet;
+		write.dstBinding = 6;
+		write.dstArrayElement = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets(m_rendererInfo.device, 1, &write, 0, nullptr);
+		frame.pyramidGeneration = pyramid.GetGeneration();
+	}
+
+	CullParams &params = *static_cast<CullParams *>(frame.params.allocationInfo.pMappedData);
+	vu::extractFrustumPlanes(viewProj, params.frustumPlanes);
+	params.cameraPos = glm::vec4(cameraPos, 1.0f);
+	params.occlusionViewProj = pyramid.GetViewProj();
+	params.depthSize = glm::ivec2(pyramid.GetDepthExtent().width, pyramid.GetDepthExtent().height);
+	params.levelCount = pyramid.GetLevelCount();
+	params.objectCount = static_cast<uint32_t>(m_objects.size());
+	params.batchCount = static_cast<uint32_t>(m_batches.size());
+	params.compact = m_drawIndirectCount ? 1 : 0;
+	params.occlusion = occlusion && pyramid.IsValid() ? 1 : 0;
+	vmaFlushAllocation(m_rendererInfo.allocator, frame.params.allocation, 0, VK_WHOLE_SIZE);
+
+	// counts start from zero every frame
+	vkCmdFillBuffer(commandBuffer, frame.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+
+	VkMemoryBarrier clearBarrier{};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+	vkCmdDispatch(commandBuffer, (params.objectCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	// commands and counts are read by indirect draws, counts also by host after the frame
+	VkMemoryBarrier cullBarrier{};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+
+	frame.culled = true;
+}
+
+
+void GpuScene::DrawBatch(VkCommandBuffer commandBuffer, uint32_t batch) const {
+	const Frame &frame = m_frames[m_frameIndex];
+	uint32_t maxDrawCount = m_batchObjectCounts[batch];
+	if (maxDrawCount == 0) {
+		return;
+	}
+
+	VkDeviceSize commandOffset = m_batches[batch].firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+
+	if (m_drawIndirectCount) {
+		vkCmdDrawIndexedIndirectCount(commandBuffer, frame.commands.buffer, commandOffset, frame.counts.buffer, batch * sizeof(uint32_t),
+			maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+	} else {
+		vkCmdDrawIndexedIndirect(commandBuffer, frame.commands.buffer, commandOffset, maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+
+GpuSceneStats GpuScene::GetStats() const {
+	GpuSceneStats stats{};
+	stats.objects = static_cast<uint32_t>(m_objects.size());
+	stats.dynamicObjects = static_cast<uint32_t>(m_dynamicObjects.size());
+	stats.batches = static_cast<uint32_t>(m_batches.size());
+	stats.visibleObjects = m_visibleObjects;
+	stats.frustumCulled = m_frustumCulled;
+	stats.occlusionCulled = m_occlusionCulled;
+	return stats;
+}
+
+
+void GpuScene::PrintStats() const {
+	GpuSceneStats stats = GetStats();
+
+	std::cout << "gpu driven scene:\n";
+	std::cout << "\t" << "objects: " << stats.objects << " (dynamic: " << stats.dynamicObjects << "), batches: " << stats.batches << "\n";
+	std::cout << "\t" << "visible last frame: " << stats.visibleObjects << "\n";
+	std::cout << "\t" << "culled last frame: " << stats.frustumCulled << " (frustum), " << stats.occlusionCulled << " (occlusion)\n";
+	std::cout << "\t" << "draw path: " << (m_drawIndirectCount ? "indexed indirect count" : "indexed indirect (culled commands draw 0 instances)") << "\n\n";
+}
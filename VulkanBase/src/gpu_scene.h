@@ -0,0 +1,163 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+#include <VMA/vk_mem_alloc.h>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "depth_pyramid.h"
+#include "frustum.h"
+#include "mesh.h"
+#include "scene.h"
+#include "vu.h"
+
+namespace vu {
+
+	// object of gpu driven scene
+	struct GpuSceneObject {
+		vu::Entity entity;
+		uint32_t   batch;            // index into batch meshes given to Build
+		uint32_t   materialIndex;
+		bool       dynamic = false;  // object data is uploaded every frame
+	};
+
+	struct GpuSceneStats {
+		uint32_t objects        = 0;
+		uint32_t dynamicObjects = 0;
+		uint32_t batches        = 0;
+		uint32_t visibleObjects = 0;  // after culling, last finished use of current frame slot
+		uint32_t frustumCulled  = 0;
+		uint32_t occlusionCulled = 0;  // inside frustum, hidden behind depth of previous frame
+	};
+
+	// Gpu driven drawing
+	// Model matrices and bounds of all objects live in storage buffers, a compute pass culls every object against
+	// the frustum (and depth pyramid of previous frame when occlusion is on), picks its lod and writes one indexed
+	// indirect command per visible object
+	// Commands of one batch (mesh + material) are drawn with one vkCmdDrawIndexedIndirectCount, without count support
+	// every object keeps its command and culled ones draw zero instances
+	// Cpu only uploads dynamic objects and records one draw per batch, so its cost doesn't grow with object count
+	class GpuScene {
+	public:
+		void Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, VkShaderModule cullShader, bool drawIndirectCount);
+		void Destroy();
+
+		// scene must stay alive, world matrices of static objects are uploaded only here
+		void Build(const vu::Scene &scene, const std::vector<const vu::Mesh *> &batchMeshes, const std::vector<GpuSceneObject> &objects);
+
+		// reads visible counts of previous use of the slot and uploads dynamic objects, gpu must be done with the slot
+		void BeginFrame(uint32_t frameIndex);
+
+		// compute pass, must be recorded outside of rendering
+		// pyramid must be prepared, objects are tested against it only when occlusion is on and previous frame built it
+		void Cull(VkCommandBuffer commandBuffer, const glm::mat4 &viewProj, const glm::vec3 &cameraPos, const DepthPyramid &pyramid, bool occlusion);
+
+		// object data read by vertex shader, firstInstance of every command is object index
+		VkBuffer     GetObjectBuffer(uint32_t frameIndex) const { return m_frames[frameIndex].objects.buffer; }
+		VkDeviceSize GetObjectBufferSize() const { return std::max<VkDeviceSize>(m_objects.size(), 1) * sizeof(vu::ObjectData); }
+		void DrawBatch(VkCommandBuffer commandBuffer, uint32_t batch) const;
+
+		uint32_t      GetBatchCount() const { return static_cast<uint32_t>(m_batches.size()); }
+		GpuSceneStats GetStats() const;
+		void PrintStats() const;
+
+	private:
+		static const uint32_t MAX_LODS = 4;
+		static const uint32_t WORKGROUP_SIZE = 64;
+
+		// layouts below match cull.comp (std430)
+		struct ObjectBounds {
+			glm::vec4 sphere;
+			uint32_t  batch;
+			uint32_t  indexInBatch;
+			uint32_t  pad[2];
+		};
+
+		struct Lod {
+			uint32_t indexCount;
+			uint32_t firstIndex;
+			float    maxDistance;
+			uint32_t pad;
+		};
+
+		struct Batch {
+			uint32_t firstCommand;
+			uint32_t lodCount;
+			uint32_t pad[2];
+			Lod      lods[MAX_LODS];
+		};
+
+		// uniform buffer (std140), doesn't fit into push constants with occlusion camera
+		struct CullParams {
+			glm::vec4  frustumPlanes[6];
+			glm::vec4  cameraPos;
+			glm::mat4  occlusionViewProj;
+			glm::ivec2 depthSize;
+			uint32_t   levelCount;
+			uint32_t   objectCount;
+			uint32_t   batchCount;
+			uint32_t   compact;
+			uint32_t   occlusion;
+			uint32_t   pad;
+		};
+
+		struct Buffer {
+			VkBuffer          buffer = VK_NULL_HANDLE;
+			VmaAllocation     allocation = VK_NULL_HANDLE;
+			VmaAllocationInfo allocationInfo{};
+		};
+
+		// storage buffers that gpu reads or writes while frame is in flight
+		struct Frame {
+			Buffer          objects;   // host visible, static objects written once
+			Buffer          commands;  // written by cull pass
+			Buffer          counts;    // one per batch + frustum and occlusion culled, host visible for statistics
+			Buffer          params;    // host visible, written every frame
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			uint64_t        pyramidGeneration = 0;  // depth pyramid the set points to
+			bool            culled = false;  // counts hold results of a finished cull pass
+		};
+
+		void CreatePipeline(VkShaderModule cullShader);
+		void CreateDescriptors();
+		void CreateParamBuffers();
+		void CreateBuffers();
+		void DestroyBuffers();
+		void UploadStatic(Buffer &buffer, const void *data, VkDeviceSize size);
+		void WriteObject(vu::ObjectData &data, const GpuSceneObject &object) const;
+		void DestroyBuffer(Buffer &buffer);
+
+		RendererInfo m_rendererInfo;
+		uint32_t     m_framesInFlight = 0;
+		bool         m_drawIndirectCount = false;
+
+		VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorPool      m_descriptorPool = VK_NULL_HANDLE;
+		VkPipelineLayout      m_pipelineLayout = VK_NULL_HANDLE;
+		VkPipeline            m_pipeline = VK_NULL_HANDLE;
+
+		const vu::Scene               *m_scene = nullptr;
+		std::vector<const vu::Mesh *>  m_batchMeshes;
+		std::vector<Batch>             m_batches;
+		std::vector<uint32_t>          m_batchObjectCounts;
+		std::vector<GpuSceneObject>    m_objects;
+		std::vector<uint32_t>          m_dynamicObjects;
+
+		Buffer             m_bounds;         // device local, static
+		Buffer             m_batchBuffer;    // device local, static
+		std::vector<Frame> m_frames;
+		uint32_t           m_frameIndex = 0;
+		uint32_t           m_visibleObjects = 0;
+		uint32_t           m_frustumCulled = 0;
+		uint32_t           m_occlusionCulled = 0;
+	};
+
+}
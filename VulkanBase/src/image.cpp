@@ -1,4 +1,5 @@
 #include "image.h"
+#include "defragmenter.h"
 
 
 using namespace vu;
@@ -29,7 +30,8 @@ void Image::CreateTextureImage(const vu::RendererInfo &renderInfo) {
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 		VMA_MEMORY_USAGE_AUTO,
 		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-		stagingBuffer, stagingAllocation, stagingAllocationInfo
+		stagingBuffer, stagingAllocation, stagingAllocationInfo,
+		MemoryCategory::Staging
 	);
 
 	// copy pixels to staging buffer
@@ -59,6 +61,12 @@ void Image::CreateTextureImage(const vu::RendererInfo &renderInfo) {
 	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
 
 	vmaCreateImage(renderInfo.allocator, &imageInfo, &allocInfo, &m_image, &m_ImageAllocation, &m_ImageAllocationInfo);
+	vu::tagAllocation(renderInfo.allocator, m_ImageAllocation, MemoryCategory::Texture);
+
+	// view is created right after this, defragmenter only keeps pointer to it
+	if (renderInfo.defragmenter != nullptr) {
+		renderInfo.defragmenter->RegisterImage(m_ImageAllocation, &m_image, &m_imageView, imageInfo, m_aspectFlags);
+	}
 
 	// copy staging buffer to image
 
@@ -75,7 +83,7 @@ void Image::CreateTextureImage(const vu::RendererInfo &renderInfo) {
 	
 
 	// destroy staging buffer
-	vmaDestroyBuffer(renderInfo.allocator, stagingBuffer, stagingAllocation);
+	vu::destroyBuffer(renderInfo.allocator, stagingBuffer, stagingAllocation);
 }
 
 
@@ -97,7 +105,7 @@ void Image::CopyBufferToImage(const vu::RendererInfo &renderInfo, VkBuffer buffe
 
 	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-	vu::endSingleTimeCommands(commandBuffer, renderInfo.transferCommandPool, renderInfo.device, renderInfo.transferQueue);
+	vu::endSingleTimeCommands(commandBuffer, renderInfo.transferCommandPool, renderInfo.device, renderInfo.transferQueue, *renderInfo.transferTimeline);
 }
 
 
@@ -158,7 +166,7 @@ void Image::TransitionImageLayout(const vu::RendererInfo &renderInfo, VkImage im
 							0, nullptr,
 							1, &barrier);
 
-	vu::endSingleTimeCommands(commandBuffer, renderInfo.transferCommandPool, renderInfo.device, renderInfo.transferQueue);
+	vu::endSingleTimeCommands(commandBuffer, renderInfo.transferCommandPool, renderInfo.device, renderInfo.transferQueue, *renderInfo.transferTimeline);
 }
 
 
@@ -262,7 +270,7 @@ void Image::GenerateMipmaps(const vu::RendererInfo &renderInfo, int32_t texWidth
 		1, &barrier
 	);
 
-	vu::endSingleTimeCommands(commandBufferGraphics, renderInfo.graphicsCommandPool, renderInfo.device, renderInfo.transferQueue);
+	vu::endSingleTimeCommands(commandBufferGraphics, renderInfo.graphicsCommandPool, renderInfo.device, renderInfo.transferQueue, *renderInfo.transferTimeline);
 }
 
 void Image::CreateImageView(const vu::RendererInfo &rendererInfo, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, VkImageView &imageView) {
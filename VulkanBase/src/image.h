@@ -2,6 +2,7 @@
 
 #include <stb/stb_image.h>
 
+#include "defragmenter.h"
 #include "vu.h"
 
 
@@ -23,6 +24,10 @@ namespace vu {
 
 		void Destroy(const vu::RendererInfo &rendererInfo) {
 			vkDestroyImageView(rendererInfo.device, m_imageView, nullptr);
+			if (rendererInfo.defragmenter != nullptr) {
+				rendererInfo.defragmenter->Unregister(m_ImageAllocation);
+			}
+			vu::untagAllocation(rendererInfo.allocator, m_ImageAllocation);
 			vmaDestroyImage(rendererInfo.allocator, m_image, m_ImageAllocation);
 		};
 
@@ -0,0 +1,269 @@
+#include "job_system.h"
+
+#include <iostream>
+
+using namespace vu;
+
+
+// which queue belongs to current thread (only valid for threads started by that job system)
+static thread_local const JobSystem *t_jobSystem = nullptr;
+static thread_local uint32_t         t_queueIndex = 0;
+
+
+uint32_t JobSystem::GetCoreCount() {
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+
+void JobSystem::Initialize(uint32_t threadCount) {
+	if (threadCount == 0) {
+		threadCount = GetCoreCount();
+	}
+	uint32_t workerCount = threadCount - 1;
+
+	m_queues.clear();
+	for (uint32_t i = 0; i < workerCount + 1; i++) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+
+	m_stopWorkers = false;
+	for (uint32_t i = 1; i <= workerCount; i++) {
+		m_workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+
+void JobSystem::Destroy() {
+	m_stopWorkers = true;
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+	}
+	m_wakeCondition.notify_all();
+
+	for (std::thread &worker : m_workers) {
+		worker.join();
+	}
+	m_workers.clear();
+
+	// nobody waits for leftovers, but their counters still have to reach zero
+	while (!m_queues.empty() && TryRunOne(0)) {}
+
+	m_queues.clear();
+}
+
+
+uint32_t JobSystem::GetQueueIndex() const {
+	return t_jobSystem == this ? t_queueIndex : 0;
+}
+
+
+void JobSystem::Queue::PushBack(Job &&job) {
+	uint32_t size = static_cast<uint32_t>(ring.size());
+	if (count == size) {
+		std::vector<Job> grown(size > 0 ? size * 2 : INITIAL_QUEUE_SIZE);
+		for (uint32_t i = 0; i < count; i++) {
+			grown[i] = std::move(ring[(first + i) & (size - 1)]);
+		}
+		ring.swap(grown);
+		first = 0;
+		size = static_cast<uint32_t>(ring.size());
+	}
+
+	ring[(first + count) & (size - 1)] = std::move(job);
+	count++;
+}
+
+
+void JobSystem::Queue::PopBack(Job &job) {
+	count--;
+	job = std::move(ring[(first + count) & (ring.size() - 1)]);
+}
+
+
+void JobSystem::Queue::PopFront(Job &job) {
+	job = std::move(ring[first]);
+	first = (first + 1) & static_cast<uint32_t>(ring.size() - 1);
+	count--;
+}
+
+
+void JobSystem::Push(Job &&job) {
+	Queue &queue = *m_queues[GetQueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.PushBack(std::move(job));
+	}
+	m_queuedJobs++;
+
+	// sleeping worker checks m_queuedJobs under m_sleepMutex, so taking it here can't miss a sleeper
+	if (m_sleepingWorkers.load() > 0) {
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_wakeCondition.notify_one();
+	}
+}
+
+
+bool JobSystem::PopOrSteal(uint32_t queueIndex, Job &job) {
+	// own queue, newest job first
+	{
+		Queue &queue = *m_queues[queueIndex];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count > 0) {
+			queue.PopBack(job);
+			m_queuedJobs--;
+			return true;
+		}
+	}
+
+	// steal oldest job of another thread
+	uint32_t queueCount = static_cast<uint32_t>(m_queues.size());
+	for (uint32_t i = 1; i < queueCount; i++) {
+		Queue &queue = *m_queues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.count > 0) {
+			queue.PopFront(job);
+			m_queuedJobs--;
+			m_stolen++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+bool JobSystem::TryRunOne(uint32_t queueIndex) {
+	Job job;
+	if (!PopOrSteal(queueIndex, job)) {
+		return false;
+	}
+
+	try {
+		job.function();
+	} catch (const std::exception &e) {
+		std::cerr << "job: " << e.what() << "\n\n";
+	}
+	job.function = nullptr;
+	m_executed++;
+
+	Finish(job.counter);
+	return true;
+}
+
+
+void JobSystem::Finish(JobCounter *counter) {
+	if (counter == nullptr) {
+		return;
+	}
+
+	// decrement under the lock, so RunAfter never adds continuation to counter that already reached zero
+	// continuations are pushed under the lock, their vector keeps its memory for the next use of counter
+	std::lock_guard<std::mutex> lock(counter->m_mutex);
+	if (--counter->m_count == 0) {
+		for (Job &continuation : counter->m_continuations) {
+			Push(std::move(continuation));
+		}
+		counter->m_continuations.clear();
+	}
+}
+
+
+void JobSystem::Run(JobFunction job, JobCounter *counter) {
+	if (counter != nullptr) {
+		counter->m_count++;
+	}
+
+	Push({std::move(job), counter});
+}
+
+
+void JobSystem::RunAfter(JobCounter &dependency, JobFunction job, JobCounter *counter) {
+	if (counter != nullptr) {
+		counter->m_count++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(dependency.m_mutex);
+		if (dependency.m_count.load() > 0) {
+			dependency.m_continuations.push_back({std::move(job), counter});
+			return;
+		}
+	}
+
+	Push({std::move(job), counter});
+}
+
+
+void JobSystem::Wait(JobCounter &counter) {
+	uint32_t queueIndex = GetQueueIndex();
+
+	while (!counter.IsDone()) {
+		if (!TryRunOne(queueIndex)) {
+			std::this_thread::yield();
+		}
+	}
+
+	// thread that finished last job can still hold the lock, counter may be destroyed right after we return
+	std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t grainSize, const RangeFunction &function) {
+	if (count == 0) {
+		return;
+	}
+
+	// few ranges per thread, so threads that finish early can steal the rest
+	if (grainSize == 0) {
+		grainSize = std::max(count / (GetThreadCount() * 4), 1u);
+	}
+
+	JobCounter counter;
+	for (uint32_t first = grainSize; first < count; first += grainSize) {
+		uint32_t rangeCount = std::min(grainSize, count - first);
+		Run([&function, first, rangeCount] { function(first, rangeCount); }, &counter);
+	}
+
+	// calling thread takes first range itself, jobs reference function and counter so wait even if it throws
+	try {
+		function(0, std::min(grainSize, count));
+	} catch (...) {
+		Wait(counter);
+		throw;
+	}
+
+	Wait(counter);
+}
+
+
+JobSystemStats JobSystem::GetStats() const {
+	JobSystemStats stats{};
+	stats.executed = m_executed.load();
+	stats.stolen = m_stolen.load();
+	return stats;
+}
+
+
+void JobSystem::WorkerLoop(uint32_t queueIndex) {
+	t_jobSystem = this;
+	t_queueIndex = queueIndex;
+
+	uint32_t idleSpins = 0;
+	while (!m_stopWorkers) {
+		if (TryRunOne(queueIndex)) {
+			idleSpins = 0;
+			continue;
+		}
+
+		if (++idleSpins < SPIN_COUNT) {
+			std::this_thread::yield();
+			continue;
+		}
+		idleSpins = 0;
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_sleepingWorkers++;
+		m_wakeCondition.wait(lock, [this] { return m_stopWorkers || m_queuedJobs.load() > 0; });
+		m_sleepingWorkers--;
+	}
+}
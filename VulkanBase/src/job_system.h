@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+namespace vu {
+
+	class JobSystem;
+	class JobCounter;
+
+	// queued job, counter is finished after function returns
+	struct Job {
+		std::function<void()> function;
+		JobCounter           *counter = nullptr;
+	};
+
+	// Number of unfinished jobs
+	// Jobs started with a counter increment it, finished jobs decrement it,
+	// jobs started with RunAfter wait until it reaches zero
+	class JobCounter {
+	public:
+		bool IsDone() const { return m_count.load() == 0; }
+
+	private:
+		friend class JobSystem;
+
+		std::atomic<uint32_t> m_count{0};
+		std::mutex            m_mutex;          // guards continuations
+		std::vector<Job>      m_continuations;  // jobs waiting for this counter
+	};
+
+	struct JobSystemStats {
+		uint64_t executed = 0;  // jobs finished
+		uint64_t stolen   = 0;  // jobs taken from another thread's deque
+	};
+
+	// Work stealing job scheduler
+	// Every worker owns a deque: it pushes and pops new jobs at the back (newest first, warm caches),
+	// idle workers steal from the front of other deques (oldest first, usually the biggest piece of work)
+	// Threads that are not workers push to a shared deque and execute jobs while they wait
+	class JobSystem {
+	public:
+		using JobFunction = std::function<void()>;
+		using RangeFunction = std::function<void(uint32_t first, uint32_t count)>;
+
+		void Initialize(uint32_t threadCount = 0);  // including calling thread, 0 - one thread per core
+		void Destroy();
+
+		// counter (optional) reaches zero when job is finished
+		void Run(JobFunction job, JobCounter *counter = nullptr);
+
+		// job starts only after dependency reaches zero
+		void RunAfter(JobCounter &dependency, JobFunction job, JobCounter *counter = nullptr);
+
+		// executes other jobs until counter reaches zero
+		void Wait(JobCounter &counter);
+
+		// splits [0, count) into ranges of grainSize items (0 - pick from thread count) and waits for all of them
+		void ParallelFor(uint32_t count, uint32_t grainSize, const RangeFunction &function);
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_workers.size()) + 1; }  // workers + calling thread
+		JobSystemStats GetStats() const;
+
+		static uint32_t GetCoreCount();
+
+	private:
+		// deque in a ring buffer that only grows, so pushing and popping jobs doesn't allocate after warm up
+		struct Queue {
+			std::mutex       mutex;
+			std::vector<Job> ring;       // size is power of two
+			uint32_t         first = 0;  // oldest job
+			uint32_t         count = 0;
+
+			void PushBack(Job &&job);
+			void PopBack(Job &job);
+			void PopFront(Job &job);
+		};
+
+		uint32_t GetQueueIndex() const;
+		bool PopOrSteal(uint32_t queueIndex, Job &job);
+		bool TryRunOne(uint32_t queueIndex);
+		void Push(Job &&job);
+		void Finish(JobCounter *counter);
+		void WorkerLoop(uint32_t queueIndex);
+
+		// spins before a worker goes to sleep, waking up a thread costs more than a few failed steals
+		static const uint32_t SPIN_COUNT = 64;
+
+		static const uint32_t INITIAL_QUEUE_SIZE = 256;
+
+		// queue 0 is shared by all non worker threads, queue i belongs to worker i
+		std::vector<std::unique_ptr<Queue>> m_queues;
+		std::vector<std::thread>            m_workers;
+
+		std::atomic<uint32_t> m_queuedJobs{0};
+		std::atomic<uint32_t> m_sleepingWorkers{0};
+		std::atomic<bool>     m_stopWorkers{false};
+		std::mutex            m_sleepMutex;
+		std::condition_variable m_wakeCondition;
+
+		std::atomic<uint64_t> m_executed{0};
+		std::atomic<uint64_t> m_stolen{0};
+	};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "renderer.h"
+#include "benchmark.h"
 
 #define VMA_IMPLEMENTATION
 #include <VMA/vk_mem_alloc.h>
@@ -11,9 +12,114 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tinyobjloader/tiny_obj_loader.h>
 
-int main() {
+int main(int argc, char **argv) {
 	vu::Renderer app;
 
+	// numeric values go through std::sto*, which throws on values that aren't numbers or don't fit
+	bool benchmark = false;
+	int  i = 1;
+	try {
+		for (; i < argc; i++) {
+			// --stress <n> renders n x n grid of extra objects and logs recording time per thread count
+			if (std::string(argv[i]) == "--stress" && i + 1 < argc) {
+				app.SetStressGridSize(static_cast<uint32_t>(std::stoul(argv[++i])));
+			}
+
+			// --frames <n> frames in flight (1 - lowest latency, cpu and gpu don't overlap)
+			if (std::string(argv[i]) == "--frames" && i + 1 < argc) {
+				app.SetFramesInFlight(static_cast<uint32_t>(std::stoul(argv[++i])));
+			}
+
+			// --present <fifo|relaxed|mailbox|immediate> preferred present mode, fifo if surface doesn't support it
+			if (std::string(argv[i]) == "--present" && i + 1 < argc) {
+				std::string mode = argv[++i];
+				if (mode == "fifo") {
+					app.SetPresentMode(VK_PRESENT_MODE_FIFO_KHR);
+				} else if (mode == "relaxed") {
+					app.SetPresentMode(VK_PRESENT_MODE_FIFO_RELAXED_KHR);
+				} else if (mode == "mailbox") {
+					app.SetPresentMode(VK_PRESENT_MODE_MAILBOX_KHR);
+				} else if (mode == "immediate") {
+					app.SetPresentMode(VK_PRESENT_MODE_IMMEDIATE_KHR);
+				} else {
+					std::cerr << "unknown present mode " << mode << ", expected fifo, relaxed, mailbox or immediate" << std::endl;
+					return EXIT_FAILURE;
+				}
+			}
+
+			// --low-latency delays input sampling and uniform updates until gpu is about to need the frame
+			if (std::string(argv[i]) == "--low-latency") {
+				app.SetPacingMode(vu::PacingMode::LowLatency);
+			}
+
+			// --fps-limit <fps> caps frame rate, works with every present mode
+			if (std::string(argv[i]) == "--fps-limit" && i + 1 < argc) {
+				app.SetFrameLimit(std::stof(argv[++i]));
+			}
+
+			// --msaa <samples> caps sample count of main pass (1 turns msaa off)
+			if (std::string(argv[i]) == "--msaa" && i + 1 < argc) {
+				app.SetMsaaSamples(static_cast<uint32_t>(std::stoul(argv[++i])));
+			}
+
+			// --depth-prepass starts with depth prepass on (P toggles it at runtime)
+			if (std::string(argv[i]) == "--depth-prepass") {
+				app.SetDepthPrepass(true);
+			}
+
+			// --occlusion gpu driven culling against depth of previous frame (O toggles it at runtime)
+			if (std::string(argv[i]) == "--occlusion") {
+				app.SetGpuDriven(true);
+				app.SetOcclusionCulling(true);
+			}
+
+			// --cpu-occlusion cpu draws skip objects behind occluders rasterized on the cpu
+			if (std::string(argv[i]) == "--cpu-occlusion") {
+				app.SetSoftwareOcclusion(true);
+			}
+
+			// --gpu-driven culls objects and writes draws in compute shader
+			if (std::string(argv[i]) == "--gpu-driven") {
+				app.SetGpuDriven(true);
+			}
+
+			// --gpu-stress gpu driven scene with ~100k objects (317 x 317 grid)
+			if (std::string(argv[i]) == "--gpu-stress") {
+				app.SetGpuDriven(true);
+				app.SetStressGridSize(317);
+			}
+
+			// --memory-log <n> prints usage, budget and fragmentation of memory heaps every n frames
+			if (std::string(argv[i]) == "--memory-log" && i + 1 < argc) {
+				app.SetMemoryLogInterval(static_cast<uint32_t>(std::stoul(argv[++i])));
+			}
+
+			// --memory-json <path> writes vma statistics (every allocation with its category) at exit
+			if (std::string(argv[i]) == "--memory-json" && i + 1 < argc) {
+				app.SetMemoryJsonPath(argv[++i]);
+			}
+
+			// --defrag-budget <ms> cpu time defragmentation may take per frame, 0 turns it off
+			if (std::string(argv[i]) == "--defrag-budget" && i + 1 < argc) {
+				app.SetDefragmentationBudget(std::stod(argv[++i]));
+			}
+
+			// --benchmark runs microbenchmarks and exits without opening a window
+			if (std::string(argv[i]) == "--benchmark") {
+				benchmark = true;
+			}
+		}
+	} catch (const std::logic_error &) {
+		// std::invalid_argument or std::out_of_range, i is at the value and option is right before it
+		std::cerr << "invalid value " << argv[i] << " for " << argv[i - 1] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (benchmark) {
+		vu::runBenchmarks();
+		return EXIT_SUCCESS;
+	}
+
 	try {
 		app.Run();
 	} catch (const std::exception& e) {
@@ -0,0 +1,329 @@
+#include "memory_arena.h"
+
+#include <cstdlib>
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+using namespace vu;
+
+
+static std::atomic<uint64_t> s_heapAllocations{0};
+static thread_local uint64_t t_heapAllocations = 0;
+
+// big enough for command lists and barrier arrays of a frame, grows on demand
+static const size_t SCRATCH_BLOCK_SIZE = 256 * 1024;
+
+
+LinearArena::~LinearArena() {
+	FreeBlocks();
+}
+
+
+void LinearArena::FreeBlocks() {
+	for (Block &block : m_blocks) {
+		::operator delete(block.data);
+	}
+	m_blocks.clear();
+}
+
+
+void *LinearArena::Allocate(size_t size, size_t alignment) {
+	while (true) {
+		if (m_block < m_blocks.size()) {
+			Block &block = m_blocks[m_block];
+
+			uintptr_t start = reinterpret_cast<uintptr_t>(block.data);
+			uintptr_t address = (start + m_offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+			size_t    offset = static_cast<size_t>(address - start);
+
+			if (offset + size <= block.size) {
+				m_used += offset + size - m_offset;
+				m_offset = offset + size;
+				m_peakBytes = std::max(m_peakBytes, m_used);
+				return block.data + offset;
+			}
+
+			// later block left from a bigger frame
+			if (m_block + 1 < m_blocks.size()) {
+				m_block++;
+				m_offset = 0;
+				continue;
+			}
+		}
+
+		// arena is full, add block (merged with others on next Reset)
+		if (!m_blocks.empty()) {
+			m_overflows++;
+		}
+		size_t blockSize = std::max(m_blockSize, size + alignment);
+		m_blocks.push_back({static_cast<uint8_t*>(::operator new(blockSize)), blockSize});
+		m_block = static_cast<uint32_t>(m_blocks.size() - 1);
+		m_offset = 0;
+	}
+}
+
+
+void LinearArena::Rewind(const Marker &marker) {
+	m_block = marker.block;
+	m_offset = marker.offset;
+	m_used = marker.used;
+
+	// one block that fits everything, so the same amount of work doesn't overflow again
+	if (marker.block == 0 && marker.offset == 0 && m_blocks.size() > 1) {
+		size_t capacity = GetCapacity();
+		FreeBlocks();
+		m_blocks.push_back({static_cast<uint8_t*>(::operator new(capacity)), capacity});
+		m_blockSize = capacity;
+	}
+}
+
+
+size_t LinearArena::GetCapacity() const {
+	size_t capacity = 0;
+	for (const Block &block : m_blocks) {
+		capacity += block.size;
+	}
+	return capacity;
+}
+
+
+void FrameArenas::Initialize(uint32_t framesInFlight, size_t blockSize) {
+	m_arenas.clear();
+	for (uint32_t i = 0; i < framesInFlight; i++) {
+		m_arenas.push_back(std::make_unique<LinearArena>(blockSize));
+	}
+	m_frameIndex = 0;
+}
+
+
+void FrameArenas::Destroy() {
+	m_arenas.clear();
+}
+
+
+void FrameArenas::BeginFrame(uint32_t frameIndex) {
+	m_frameIndex = frameIndex;
+	m_arenas[m_frameIndex]->Reset();
+}
+
+
+void FrameArenas::PrintStats() const {
+	std::cout << "frame arenas:\n";
+	for (size_t i = 0; i < m_arenas.size(); i++) {
+		const LinearArena &arena = *m_arenas[i];
+		std::cout << "\tframe " << i << ": peak " << arena.GetPeakBytes() / 1024 << " KB"
+		          << ", capacity " << arena.GetCapacity() / 1024 << " KB"
+		          << ", overflows " << arena.GetOverflows() << "\n";
+	}
+	const LinearArena &scratch = threadScratchArena();
+	std::cout << "\tscratch (main thread): peak " << scratch.GetPeakBytes() / 1024 << " KB"
+	          << ", capacity " << scratch.GetCapacity() / 1024 << " KB"
+	          << ", overflows " << scratch.GetOverflows() << "\n\n";
+}
+
+
+LinearArena &vu::threadScratchArena() {
+	static thread_local LinearArena arena(SCRATCH_BLOCK_SIZE);
+	return arena;
+}
+
+
+uint64_t vu::getHeapAllocationCount() {
+	return s_heapAllocations.load(std::memory_order_relaxed);
+}
+
+
+uint64_t vu::getThreadHeapAllocationCount() {
+	return t_heapAllocations;
+}
+
+
+void HeapAllocationTracker::EndFrame() {
+	uint64_t allocations = getHeapAllocationCount() - m_frameStart;
+
+	m_stats.frames++;
+	m_stats.lastFrame = allocations;
+	if (m_warmupLeft > 0) {
+		m_warmupLeft--;
+		return;
+	}
+
+	m_stats.steadyFrames++;
+	m_stats.allocations += allocations;
+	m_stats.maxFrame = std::max(m_stats.maxFrame, allocations);
+	if (allocations > 0) {
+		m_stats.framesWithAllocations++;
+	}
+}
+
+
+void HeapAllocationTracker::PrintStats() const {
+	std::cout << "heap allocations:\n";
+#ifdef VU_NO_ALLOCATION_HOOK
+	std::cout << "\tnot counted (VU_NO_ALLOCATION_HOOK)\n\n";
+#else
+	std::cout << "\ttotal: " << getHeapAllocationCount() << "\n";
+	std::cout << "\tsteady frames: " << m_stats.steadyFrames << " of " << m_stats.frames << "\n";
+	std::cout << "\tframes with allocations: " << m_stats.framesWithAllocations << "\n";
+	if (m_stats.steadyFrames > 0) {
+		std::cout << "\tper frame: " << static_cast<double>(m_stats.allocations) / m_stats.steadyFrames
+		          << " average, " << m_stats.maxFrame << " max\n";
+	}
+	std::cout << "\n";
+#endif
+}
+
+
+#ifndef VU_NO_ALLOCATION_HOOK
+
+// replaced global operators, count every heap allocation of the program (including std containers)
+// every overload is replaced: msvc crt doesn't route aligned or nothrow variants through operator new(size_t)
+
+static void *countedAllocate(size_t size) {
+	s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	t_heapAllocations++;
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+
+// over-aligned types (alignas above __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+static void *countedAllocateAligned(size_t size, std::align_val_t alignment) {
+	s_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	t_heapAllocations++;
+	size_t align = static_cast<size_t>(alignment);
+#ifdef _MSC_VER
+	return _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+	// aligned_alloc wants size to be multiple of alignment
+	return std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align);
+#endif
+}
+
+
+static void freeAligned(void *pointer) {
+#ifdef _MSC_VER
+	_aligned_free(pointer);
+#else
+	std::free(pointer);
+#endif
+}
+
+
+void *operator new(size_t size) {
+	void *pointer = countedAllocate(size);
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+
+void *operator new[](size_t size) {
+	void *pointer = countedAllocate(size);
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	return countedAllocate(size);
+}
+
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return countedAllocate(size);
+}
+
+
+void operator delete(void *pointer) noexcept {
+	std::free(pointer);
+}
+
+
+void operator delete[](void *pointer) noexcept {
+	std::free(pointer);
+}
+
+
+void operator delete(void *pointer, size_t) noexcept {
+	std::free(pointer);
+}
+
+
+void operator delete[](void *pointer, size_t) noexcept {
+	std::free(pointer);
+}
+
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+	std::free(pointer);
+}
+
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+	std::free(pointer);
+}
+
+
+void *operator new(size_t size, std::align_val_t alignment) {
+	void *pointer = countedAllocateAligned(size, alignment);
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+	void *pointer = countedAllocateAligned(size, alignment);
+	if (pointer == nullptr) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return countedAllocateAligned(size, alignment);
+}
+
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return countedAllocateAligned(size, alignment);
+}
+
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+	freeAligned(pointer);
+}
+
+
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+	freeAligned(pointer);
+}
+
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+	freeAligned(pointer);
+}
+
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept {
+	freeAligned(pointer);
+}
+
+
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept {
+	freeAligned(pointer);
+}
+
+
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept {
+	freeAligned(pointer);
+}
+
+#endif
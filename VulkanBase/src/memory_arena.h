@@ -0,0 +1,189 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <iostream>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+namespace vu {
+
+	// Bump allocator, everything allocated after a marker is released at once with Rewind (Reset - everything)
+	// Allocation that doesn't fit goes to a new block, blocks are merged into one when arena is rewound to
+	// its start, so next frame of the same size doesn't touch the heap at all
+	// Not thread safe, every thread and every frame has its own arena
+	class LinearArena {
+	public:
+		struct Marker {
+			uint32_t block  = 0;
+			size_t   offset = 0;
+			size_t   used   = 0;
+		};
+
+		explicit LinearArena(size_t blockSize = 64 * 1024) : m_blockSize(blockSize) {};
+		~LinearArena();
+
+		LinearArena(const LinearArena &) = delete;
+		LinearArena &operator=(const LinearArena &) = delete;
+
+		void *Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+		// uninitialized, T must not need destructor (arena never calls it)
+		template<typename T>
+		T *Allocate(size_t count) {
+			static_assert(std::is_trivially_destructible<T>::value, "arena never calls destructors!");
+			return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+		}
+
+		Marker GetMarker() const { return {m_block, m_offset, m_used}; }
+		void   Rewind(const Marker &marker);
+		void   Reset() { Rewind(Marker{}); }
+
+		size_t   GetUsedBytes() const { return m_used; }
+		size_t   GetPeakBytes() const { return m_peakBytes; }
+		size_t   GetCapacity()  const;
+		uint32_t GetOverflows() const { return m_overflows; }  // times a block was added because arena was full
+
+	private:
+		struct Block {
+			uint8_t *data;
+			size_t   size;
+		};
+
+		void FreeBlocks();
+
+		std::vector<Block> m_blocks;
+		uint32_t           m_block = 0;   // block allocations come from
+		size_t             m_offset = 0;  // in current block
+		size_t             m_used = 0;    // bytes handed out since start, with alignment padding
+		size_t             m_peakBytes = 0;
+		size_t             m_blockSize;
+		uint32_t           m_overflows = 0;
+	};
+
+	// STL allocator on top of an arena, deallocate does nothing (memory comes back when arena is rewound)
+	// default constructed allocator uses global heap, so containers can be declared before arena is known
+	template<typename T>
+	class ArenaAllocator {
+	public:
+		using value_type = T;
+		using propagate_on_container_copy_assignment = std::true_type;
+		using propagate_on_container_move_assignment = std::true_type;
+		using propagate_on_container_swap = std::true_type;
+
+		ArenaAllocator(LinearArena *arena = nullptr) noexcept : m_arena(arena) {};
+
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U> &other) noexcept : m_arena(other.GetArena()) {};
+
+		T *allocate(size_t count) {
+			if (m_arena != nullptr) {
+				return static_cast<T*>(m_arena->Allocate(sizeof(T) * count, alignof(T)));
+			}
+			return static_cast<T*>(::operator new(sizeof(T) * count));
+		}
+
+		void deallocate(T *pointer, size_t) noexcept {
+			if (m_arena == nullptr) {
+				::operator delete(pointer);
+			}
+		}
+
+		LinearArena *GetArena() const { return m_arena; }
+
+		template<typename U>
+		bool operator==(const ArenaAllocator<U> &other) const { return m_arena == other.GetArena(); }
+
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U> &other) const { return m_arena != other.GetArena(); }
+
+	private:
+		LinearArena *m_arena;
+	};
+
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+	// Arena per frame in flight, data allocated during a frame stays valid until its frame slot starts again
+	// (later frames can still read it, e.g. jobs that finish after next frame started)
+	class FrameArenas {
+	public:
+		void Initialize(uint32_t framesInFlight, size_t blockSize);
+		void Destroy();
+
+		// gpu and cpu are done with previous use of this slot
+		void BeginFrame(uint32_t frameIndex);
+
+		LinearArena &Get() { return *m_arenas[m_frameIndex]; }
+
+		template<typename T>
+		ArenaAllocator<T> Allocator() { return ArenaAllocator<T>(&Get()); }
+
+		void PrintStats() const;
+
+	private:
+		std::vector<std::unique_ptr<LinearArena>> m_arenas;
+		uint32_t                                  m_frameIndex = 0;
+	};
+
+	// arena of calling thread for temporary arrays, created on first use
+	LinearArena &threadScratchArena();
+
+	// Scratch memory of one scope, everything allocated from it is released when scope ends
+	// scopes nest, inner scope must end first
+	class ScratchScope {
+	public:
+		ScratchScope() : m_arena(threadScratchArena()), m_marker(m_arena.GetMarker()) {};
+		~ScratchScope() { m_arena.Rewind(m_marker); }
+
+		ScratchScope(const ScratchScope &) = delete;
+		ScratchScope &operator=(const ScratchScope &) = delete;
+
+		template<typename T>
+		ArenaAllocator<T> Allocator() { return ArenaAllocator<T>(&m_arena); }
+
+		template<typename T>
+		T *Allocate(size_t count) { return m_arena.Allocate<T>(count); }
+
+	private:
+		LinearArena        &m_arena;
+		LinearArena::Marker m_marker;
+	};
+
+	// every global operator new of the program, counted by replacement operators in memory_arena.cpp
+	// (define VU_NO_ALLOCATION_HOOK to keep default operators, counters stay 0)
+	uint64_t getHeapAllocationCount();        // all threads
+	uint64_t getThreadHeapAllocationCount();  // calling thread
+
+	struct HeapAllocationStats {
+		uint64_t frames                = 0;
+		uint64_t steadyFrames          = 0;  // frames after warm up
+		uint64_t framesWithAllocations = 0;  // steady frames that allocated anything
+		uint64_t allocations           = 0;  // in steady frames, all threads
+		uint64_t lastFrame             = 0;
+		uint64_t maxFrame              = 0;  // most allocations of one steady frame
+	};
+
+	// Counts heap allocations between BeginFrame and EndFrame on all threads
+	// first frames after Restart are warm up (caches, pools and arenas grow to their working size)
+	class HeapAllocationTracker {
+	public:
+		void Restart(uint32_t warmupFrames) { m_warmupLeft = warmupFrames; }
+
+		void BeginFrame() { m_frameStart = getHeapAllocationCount(); }
+		void EndFrame();
+
+		const HeapAllocationStats &GetStats() const { return m_stats; }
+		void PrintStats() const;
+
+	private:
+		uint64_t            m_frameStart = 0;
+		uint32_t            m_warmupLeft = 0;
+		HeapAllocationStats m_stats;
+	};
+
+}
@@ -0,0 +1,189 @@
+#include "memory_stats.h"
+#include "vu.h"
+
+using namespace vu;
+
+static const size_t CATEGORY_COUNT = static_cast<size_t>(MemoryCategory::Count);
+
+// allocations are created and freed from loader jobs too
+static std::array<std::atomic<uint64_t>, CATEGORY_COUNT> categoryBytes{};
+static std::array<std::atomic<uint32_t>, CATEGORY_COUNT> categoryAllocations{};
+
+
+const char *vu::memoryCategoryName(MemoryCategory category) {
+	switch (category) {
+		case MemoryCategory::Mesh:       return "mesh";
+		case MemoryCategory::Texture:    return "texture";
+		case MemoryCategory::Attachment: return "attachment";
+		case MemoryCategory::Staging:    return "staging";
+		case MemoryCategory::Uniform:    return "uniform";
+		case MemoryCategory::Scene:      return "scene";
+		default:                         return "unknown";
+	}
+}
+
+
+void vu::tagAllocation(VmaAllocator allocator, VmaAllocation allocation, MemoryCategory category) {
+	// category + 1 in user data, so untagged allocations (null) are recognized
+	size_t index = static_cast<size_t>(category);
+	vmaSetAllocationUserData(allocator, allocation, reinterpret_cast<void*>(index + 1));
+	vmaSetAllocationName(allocator, allocation, memoryCategoryName(category));
+
+	VmaAllocationInfo info{};
+	vmaGetAllocationInfo(allocator, allocation, &info);
+	categoryBytes[index] += info.size;
+	categoryAllocations[index]++;
+}
+
+
+void vu::untagAllocation(VmaAllocator allocator, VmaAllocation allocation) {
+	if (allocation == VK_NULL_HANDLE) {
+		return;
+	}
+
+	VmaAllocationInfo info{};
+	vmaGetAllocationInfo(allocator, allocation, &info);
+
+	size_t tag = reinterpret_cast<size_t>(info.pUserData);
+	if (tag == 0 || tag > CATEGORY_COUNT) {
+		return;
+	}
+
+	categoryBytes[tag - 1] -= info.size;
+	categoryAllocations[tag - 1]--;
+	vmaSetAllocationUserData(allocator, allocation, nullptr);
+}
+
+
+float vu::calculateFragmentation(const VmaDetailedStatistics &stats) {
+	VkDeviceSize freeBytes = stats.statistics.blockBytes - stats.statistics.allocationBytes;
+	if (freeBytes == 0) {
+		return 0.0f;
+	}
+	return 1.0f - static_cast<float>(static_cast<double>(stats.unusedRangeSizeMax) / static_cast<double>(freeBytes));
+}
+
+
+void MemoryStats::Initialize(const RendererInfo &rendererInfo, bool budgetExtension, uint32_t logInterval) {
+	m_allocator = rendererInfo.allocator;
+	m_budgetExtension = budgetExtension;
+	m_logInterval = logInterval;
+	m_frame = 0;
+	m_peakUsage = 0;
+}
+
+
+void MemoryStats::Update() {
+	// vma refreshes cached budget of the extension when frame index changes
+	m_frame++;
+	vmaSetCurrentFrameIndex(m_allocator, m_frame);
+
+	// peak from budgets on stack, heap list is only built for log frames
+	const VkPhysicalDeviceMemoryProperties *properties = nullptr;
+	vmaGetMemoryProperties(m_allocator, &properties);
+
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS]{};
+	vmaGetHeapBudgets(m_allocator, budgets);
+	for (uint32_t i = 0; i < properties->memoryHeapCount; i++) {
+		if ((properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0) {
+			m_peakUsage = std::max(m_peakUsage, budgets[i].usage);
+		}
+	}
+
+	if (m_logInterval == 0 || m_frame % m_logInterval != 0) {
+		return;
+	}
+
+	std::cout << "memory (frame " << m_frame << "):\n";
+	PrintHeaps(GetHeapStats(true));
+	std::cout << "\n";
+}
+
+
+std::vector<MemoryHeapStats> MemoryStats::GetHeapStats(bool fragmentation) const {
+	const VkPhysicalDeviceMemoryProperties *properties = nullptr;
+	vmaGetMemoryProperties(m_allocator, &properties);
+
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS]{};
+	vmaGetHeapBudgets(m_allocator, budgets);
+
+	// walks every block, only when asked for
+	VmaTotalStatistics total{};
+	if (fragmentation) {
+		vmaCalculateStatistics(m_allocator, &total);
+	}
+
+	std::vector<MemoryHeapStats> heaps(properties->memoryHeapCount);
+	for (uint32_t i = 0; i < properties->memoryHeapCount; i++) {
+		MemoryHeapStats &heap = heaps[i];
+		heap.heapIndex = i;
+		heap.deviceLocal = (properties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		heap.size = properties->memoryHeaps[i].size;
+		heap.usage = budgets[i].usage;
+		heap.budget = budgets[i].budget;
+		heap.blockBytes = budgets[i].statistics.blockBytes;
+		heap.allocationBytes = budgets[i].statistics.allocationBytes;
+		heap.fragmentation = fragmentation ? vu::calculateFragmentation(total.memoryHeap[i]) : 0.0f;
+	}
+
+	return heaps;
+}
+
+
+MemoryCategoryStats MemoryStats::GetCategoryStats(MemoryCategory category) const {
+	size_t index = static_cast<size_t>(category);
+
+	MemoryCategoryStats stats{};
+	stats.bytes = categoryBytes[index].load();
+	stats.allocations = categoryAllocations[index].load();
+	return stats;
+}
+
+
+std::string MemoryStats::BuildJson() const {
+	char *statsString = nullptr;
+	vmaBuildStatsString(m_allocator, &statsString, VK_TRUE);
+
+	std::string json(statsString);
+	vmaFreeStatsString(m_allocator, statsString);
+	return json;
+}
+
+
+void MemoryStats::WriteJson(const std::string &path) const {
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open memory statistics file!");
+	}
+
+	file << BuildJson();
+}
+
+
+void MemoryStats::PrintHeaps(const std::vector<MemoryHeapStats> &heaps) const {
+	const double MB = 1024.0 * 1024.0;
+
+	for (const MemoryHeapStats &heap : heaps) {
+		double budgetUsed = heap.budget > 0 ? 100.0 * heap.usage / heap.budget : 0.0;
+
+		std::cout << "\t" << "heap " << heap.heapIndex << (heap.deviceLocal ? " (device local)" : "") << ": "
+		          << heap.usage / MB << " / " << heap.budget / MB << " MB budget (" << budgetUsed << "%), "
+		          << "blocks: " << heap.blockBytes / MB << " MB, allocated: " << heap.allocationBytes / MB << " MB, "
+		          << "fragmentation: " << heap.fragmentation * 100.0f << "%\n";
+	}
+}
+
+
+void MemoryStats::PrintStats() const {
+	const double MB = 1024.0 * 1024.0;
+
+	std::cout << "memory:\n";
+	std::cout << "\t" << "budget: " << (m_budgetExtension ? "VK_EXT_memory_budget" : "estimated") << "\n";
+	PrintHeaps(GetHeapStats(true));
+	for (size_t i = 0; i < CATEGORY_COUNT; i++) {
+		MemoryCategoryStats stats = GetCategoryStats(static_cast<MemoryCategory>(i));
+		std::cout << "\t" << memoryCategoryName(static_cast<MemoryCategory>(i)) << ": "
+		          << stats.bytes / MB << " MB in " << stats.allocations << " allocations\n";
+	}
+	std::cout << "\t" << "peak device local usage: " << m_peakUsage / MB << " MB\n\n";
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+#include <VMA/vk_mem_alloc.h>
+
+namespace vu {
+
+	struct RendererInfo;
+
+	// What an allocation is used for, every allocation of the renderer has one
+	enum class MemoryCategory {
+		Mesh = 0,    // vertex and index buffers
+		Texture,     // sampled images
+		Attachment,  // render graph images
+		Staging,     // upload buffers, freed after copy
+		Uniform,     // per frame buffers written by cpu
+		Scene,       // gpu driven scene buffers
+		Count
+	};
+
+	const char *memoryCategoryName(MemoryCategory category);
+
+	// Names allocation in vma (visible in json dump) and adds its size to counters of category
+	// allocations must be untagged before they are freed
+	void tagAllocation(VmaAllocator allocator, VmaAllocation allocation, MemoryCategory category);
+	void untagAllocation(VmaAllocator allocator, VmaAllocation allocation);
+
+	// 1 - largest free range / all free bytes of blocks, 0 when free space is one range
+	float calculateFragmentation(const VmaDetailedStatistics &stats);
+
+	struct MemoryCategoryStats {
+		uint64_t bytes       = 0;
+		uint32_t allocations = 0;
+	};
+
+	struct MemoryHeapStats {
+		uint32_t     heapIndex       = 0;
+		bool         deviceLocal     = false;
+		VkDeviceSize size            = 0;  // whole heap
+		VkDeviceSize usage           = 0;  // used by this process (from VK_EXT_memory_budget when enabled)
+		VkDeviceSize budget          = 0;  // how much this process can use before allocations start failing or paging
+		VkDeviceSize blockBytes      = 0;  // vkAllocateMemory blocks of vma
+		VkDeviceSize allocationBytes = 0;  // parts of blocks that are handed out
+		float        fragmentation   = 0.0f;  // see calculateFragmentation
+	};
+
+	// Per heap usage, budget and fragmentation of vma allocator and bytes of every category
+	// Budget comes from the driver when VK_EXT_memory_budget is enabled, otherwise vma estimates it (80% of heap)
+	class MemoryStats {
+	public:
+		// logInterval - frames between log lines, 0 - only on PrintStats
+		void Initialize(const RendererInfo &rendererInfo, bool budgetExtension, uint32_t logInterval);
+
+		// once per frame, lets vma refresh budget and prints heaps every logInterval frames
+		void Update();
+
+		// heap usage and budget are cheap, fragmentation walks all blocks
+		std::vector<MemoryHeapStats> GetHeapStats(bool fragmentation = true) const;
+		MemoryCategoryStats          GetCategoryStats(MemoryCategory category) const;
+
+		// vmaBuildStatsString with detailed map, every allocation with its category name
+		std::string BuildJson() const;
+		void        WriteJson(const std::string &path) const;
+
+		void PrintStats() const;
+
+	private:
+		void PrintHeaps(const std::vector<MemoryHeapStats> &heaps) const;
+
+		VmaAllocator m_allocator = VK_NULL_HANDLE;
+		bool         m_budgetExtension = false;
+		uint32_t     m_logInterval = 0;
+		uint32_t     m_frame = 0;
+		VkDeviceSize m_peakUsage = 0;  // device local heaps
+	};
+
+}
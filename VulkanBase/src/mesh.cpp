@@ -1,13 +1,20 @@
 #include "mesh.h"
+#include "defragmenter.h"
 
 using namespace vu;
 
 void Mesh::Destroy(const RendererInfo &rendererInfo) {
-	vmaDestroyBuffer(rendererInfo.allocator, m_vertexBuffer, m_vertexAllocation);
-	vmaDestroyBuffer(rendererInfo.allocator, m_indexBuffer, m_indexAllocation);
+	if (rendererInfo.defragmenter != nullptr) {
+		rendererInfo.defragmenter->Unregister(m_vertexAllocation);
+		rendererInfo.defragmenter->Unregister(m_positionAllocation);
+		rendererInfo.defragmenter->Unregister(m_indexAllocation);
+	}
+	vu::destroyBuffer(rendererInfo.allocator, m_vertexBuffer, m_vertexAllocation);
+	vu::destroyBuffer(rendererInfo.allocator, m_positionBuffer, m_positionAllocation);
+	vu::destroyBuffer(rendererInfo.allocator, m_indexBuffer, m_indexAllocation);
 }
 
-void Mesh::BindAndRender(VkCommandBuffer commandBuffer) {
+void Mesh::Bind(VkCommandBuffer commandBuffer) const {
 	// bind vertex buffer
 	VkBuffer vertexBuffers[] = {m_vertexBuffer};
 	VkDeviceSize offsets[] = {0};
@@ -15,61 +22,59 @@ void Mesh::BindAndRender(VkCommandBuffer commandBuffer) {
 
 	// bind index buffer
 	vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
 
-	// draw
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_indices.size()), 1, 0, 0, 0);
+
+void Mesh::BindPositions(VkCommandBuffer commandBuffer) const {
+	VkBuffer vertexBuffers[] = {m_positionBuffer};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+
+	vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 }
 
 
-void Mesh::CreateVertexBuffer(const RendererInfo &rendererInfo) {
-	VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
+void Mesh::Render(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) const {
+	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_indices.size()), instanceCount, 0, 0, firstInstance);
+}
 
-	// staging buffer that is visible to cpu
-	VkBuffer stagingBuffer;
-	VmaAllocation stagingAllocation;
-	VmaAllocationInfo stagingAllocationInfo;
 
-	vu::createBuffer (
-		rendererInfo.physicalDevice,
-		rendererInfo.allocator,
-		rendererInfo.surface,
-		bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VMA_MEMORY_USAGE_AUTO,
-		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-		stagingBuffer, stagingAllocation, stagingAllocationInfo
-	);
+void Mesh::BindAndRender(VkCommandBuffer commandBuffer, uint32_t instanceCount, uint32_t firstInstance) {
+	Bind(commandBuffer);
+	Render(commandBuffer, instanceCount, firstInstance);
+}
 
-	// map gpu memory to cpu memory (can access gpu memory like normal)
-	vmaCopyMemoryToAllocation(rendererInfo.allocator, m_vertices.data(), stagingAllocation, 0, bufferSize);
 
-	// vertex buffer that is not visible to cpu (faster local gpu memory)
-	vu::createBuffer (
-		rendererInfo.physicalDevice,
-		rendererInfo.allocator,
-		rendererInfo.surface,
-		bufferSize,
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-		VMA_MEMORY_USAGE_AUTO,
-		0,
-		m_vertexBuffer, m_vertexAllocation, m_vertexAllocationInfo
-	);
+void Mesh::CreateVertexBuffer(const RendererInfo &rendererInfo) {
+	VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
+	CreateDeviceBuffer(rendererInfo, m_vertices.data(), bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_vertexBuffer, m_vertexAllocation, m_vertexAllocationInfo);
+}
 
-	// move data from staging buffer to high performance vertex buffer
-	vu::copyBuffer(stagingBuffer, m_vertexBuffer, bufferSize, rendererInfo.device, rendererInfo.transferCommandPool, rendererInfo.transferQueue);
 
-	// free staging buffer
-	vmaDestroyBuffer(rendererInfo.allocator, stagingBuffer, stagingAllocation);
+void Mesh::CreatePositionBuffer(const RendererInfo &rendererInfo) {
+	std::vector<glm::vec3> positions(m_vertices.size());
+	for (size_t i = 0; i < m_vertices.size(); i++) {
+		positions[i] = m_vertices[i].pos;
+	}
+
+	VkDeviceSize bufferSize = sizeof(positions[0]) * positions.size();
+	CreateDeviceBuffer(rendererInfo, positions.data(), bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_positionBuffer, m_positionAllocation, m_positionAllocationInfo);
 }
 
 
 void Mesh::CreateIndexBuffer(const RendererInfo &rendererInfo) {
 	VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
+	CreateDeviceBuffer(rendererInfo, m_indices.data(), bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexBuffer, m_indexAllocation, m_indexAllocationInfo);
+}
 
+
+void Mesh::CreateDeviceBuffer(const RendererInfo &rendererInfo, const void *data, VkDeviceSize bufferSize, VkBufferUsageFlags usage,
+                              VkBuffer &buffer, VmaAllocation &allocation, VmaAllocationInfo &allocationInfo) {
 	// staging buffer that is visible to cpu
 	VkBuffer stagingBuffer;
 	VmaAllocation stagingAllocation;
 	VmaAllocationInfo stagingAllocationInfo;
+
 	vu::createBuffer (
 		rendererInfo.physicalDevice,
 		rendererInfo.allocator,
@@ -78,29 +83,36 @@ void Mesh::CreateIndexBuffer(const RendererInfo &rendererInfo) {
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 		VMA_MEMORY_USAGE_AUTO,
 		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-		stagingBuffer, stagingAllocation, stagingAllocationInfo
+		stagingBuffer, stagingAllocation, stagingAllocationInfo,
+		MemoryCategory::Staging
 	);
 
 	// map gpu memory to cpu memory (can access gpu memory like normal)
-	vmaCopyMemoryToAllocation(rendererInfo.allocator, m_indices.data(), stagingAllocation, 0, bufferSize);
+	vmaCopyMemoryToAllocation(rendererInfo.allocator, data, stagingAllocation, 0, bufferSize);
 
-	// index buffer that is not visible to cpu (faster local gpu memory)
+	// buffer that is not visible to cpu (faster local gpu memory), transfer source when defragmentation moves it
+	usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 	vu::createBuffer (
 		rendererInfo.physicalDevice,
 		rendererInfo.allocator,
 		rendererInfo.surface,
 		bufferSize,
-		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		usage,
 		VMA_MEMORY_USAGE_AUTO,
 		0,
-		m_indexBuffer, m_indexAllocation, m_indexAllocationInfo
+		buffer, allocation, allocationInfo,
+		MemoryCategory::Mesh
 	);
 
-	// move data from staging buffer to high performance index buffer
-	vu::copyBuffer(stagingBuffer, m_indexBuffer, bufferSize, rendererInfo.device, rendererInfo.transferCommandPool, rendererInfo.transferQueue);
+	if (rendererInfo.defragmenter != nullptr) {
+		rendererInfo.defragmenter->RegisterBuffer(allocation, &buffer, bufferSize, usage);
+	}
+
+	// move data from staging buffer to high performance buffer
+	vu::copyBuffer(stagingBuffer, buffer, bufferSize, rendererInfo.device, rendererInfo.transferCommandPool, rendererInfo.transferQueue, *rendererInfo.transferTimeline);
 
 	// free staging buffer
-	vmaDestroyBuffer(rendererInfo.allocator, stagingBuffer, stagingAllocation);
+	vu::destroyBuffer(rendererInfo.allocator, stagingBuffer, stagingAllocation);
 }
 
 
@@ -145,4 +157,29 @@ void Mesh::LoadModel() {
 			m_indices.push_back(uniqueVertices[vertex]);
 		}
 	}
+
+	ComputeBounds();
+	m_lods = {{0, static_cast<uint32_t>(m_indices.size()), std::numeric_limits<float>::max()}};
+}
+
+
+void Mesh::ComputeBounds() {
+	if (m_vertices.empty()) {
+		return;
+	}
+
+	m_boundsMin = m_vertices[0].pos;
+	m_boundsMax = m_vertices[0].pos;
+	for (const vu::Vertex &vertex : m_vertices) {
+		m_boundsMin = glm::min(m_boundsMin, vertex.pos);
+		m_boundsMax = glm::max(m_boundsMax, vertex.pos);
+	}
+
+	// sphere around box center, a bit larger than optimal, second pass because center comes from the box
+	glm::vec3 center = (m_boundsMin + m_boundsMax) * 0.5f;
+	float radius = 0.0f;
+	for (const vu::Vertex &vertex : m_vertices) {
+		radius = std::max(radius, glm::length(vertex.pos - center));
+	}
+	m_boundingSphere = glm::vec4(center, radius);
 }
\ No newline at end of file
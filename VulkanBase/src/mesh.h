@@ -3,6 +3,8 @@
 #include <vector>
 #include <array>
 #include <unordered_map>
+#include <limits>
+#include <algorithm>
 
 #include <tinyobjloader/tiny_obj_loader.h>
 #include <vulkan/vulkan.h>
@@ -14,33 +16,67 @@ namespace vu {
 
 	class Renderer;
 
+	// index range drawn up to maxDistance from camera
+	struct MeshLod {
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		float    maxDistance;
+	};
+
 	class Mesh {
 	public:
 		Mesh(const RendererInfo &rendererInfo, const std::string &modelPath) : m_modelPath(modelPath) {
 			LoadModel();
 			CreateVertexBuffer(rendererInfo);
+			CreatePositionBuffer(rendererInfo);
 			CreateIndexBuffer(rendererInfo);
 		};
 
 		void Destroy(const RendererInfo &rendererInfo);
 
-		void BindAndRender(VkCommandBuffer commandBuffer);
+		// vertex and index buffers, per object data comes from storage buffer
+		void Bind(VkCommandBuffer commandBuffer) const;
+		void BindPositions(VkCommandBuffer commandBuffer) const;  // position only stream + indices (depth only passes)
+		void Render(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const;  // mesh must be bound
+		void BindAndRender(VkCommandBuffer commandBuffer, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
 
 		Vertex   *GetVertices() { return m_vertices.data(); }
 		uint32_t *GetIndices()  { return m_indices.data(); }
+		uint32_t  GetIndexCount() const { return static_cast<uint32_t>(m_indices.size()); }
+		uint32_t  GetVertexCount() const { return static_cast<uint32_t>(m_vertices.size()); }
+
+		// object space bounds
+		glm::vec3 GetBoundsMin()      const { return m_boundsMin; }
+		glm::vec3 GetBoundsMax()      const { return m_boundsMax; }
+		glm::vec4 GetBoundingSphere() const { return m_boundingSphere; }  // xyz - center, w - radius
+
+		// sorted by distance, loaded models have only full detail level
+		const std::vector<MeshLod> &GetLods() const { return m_lods; }
 
 	private:
 		void LoadModel();
 		void CreateVertexBuffer(const RendererInfo &rendererInfo);
+		void CreatePositionBuffer(const RendererInfo &rendererInfo);
 		void CreateIndexBuffer(const RendererInfo &rendererInfo);
+		void CreateDeviceBuffer(const RendererInfo &rendererInfo, const void *data, VkDeviceSize bufferSize, VkBufferUsageFlags usage,
+		                        VkBuffer &buffer, VmaAllocation &allocation, VmaAllocationInfo &allocationInfo);
+		void ComputeBounds();
 
 		std::string             m_modelPath;
 		std::vector<Vertex> m_vertices;
 		std::vector<uint32_t>   m_indices;
+		std::vector<MeshLod>    m_lods;
+
+		glm::vec3 m_boundsMin{0.0f};
+		glm::vec3 m_boundsMax{0.0f};
+		glm::vec4 m_boundingSphere{0.0f};
 
 		VkBuffer          m_vertexBuffer;
 		VmaAllocation     m_vertexAllocation;
 		VmaAllocationInfo m_vertexAllocationInfo;
+		VkBuffer          m_positionBuffer;
+		VmaAllocation     m_positionAllocation;
+		VmaAllocationInfo m_positionAllocationInfo;
 		VkBuffer          m_indexBuffer;
 		VmaAllocation     m_indexAllocation;
 		VmaAllocationInfo m_indexAllocationInfo;
@@ -0,0 +1,409 @@
+#include "pipeline.h"
+
+using namespace vu;
+
+
+uint64_t PipelineDesc::Hash() const {
+	uint64_t hash = vu::HASH_SEED;
+	vu::hashValue(hash, vertShader);
+	vu::hashValue(hash, fragShader);
+	vu::hashValue(hash, layout);
+	vu::hashValue(hash, vertexLayout);
+	vu::hashValue(hash, colorFormat);
+	vu::hashValue(hash, depthFormat);
+	vu::hashValue(hash, topology);
+	vu::hashValue(hash, polygonMode);
+	vu::hashValue(hash, cullMode);
+	vu::hashValue(hash, frontFace);
+	vu::hashValue(hash, blendMode);
+	vu::hashValue(hash, depthTest);
+	vu::hashValue(hash, depthWrite);
+	vu::hashValue(hash, depthCompareOp);
+	vu::hashValue(hash, msaaSamples);
+	vu::hashValue(hash, minSampleShading);
+	return hash;
+}
+
+
+bool PipelineDesc::operator==(const PipelineDesc &other) const {
+	return vertShader       == other.vertShader &&
+	       fragShader       == other.fragShader &&
+	       layout           == other.layout &&
+	       vertexLayout     == other.vertexLayout &&
+	       colorFormat      == other.colorFormat &&
+	       depthFormat      == other.depthFormat &&
+	       topology         == other.topology &&
+	       polygonMode      == other.polygonMode &&
+	       cullMode         == other.cullMode &&
+	       frontFace        == other.frontFace &&
+	       blendMode        == other.blendMode &&
+	       depthTest        == other.depthTest &&
+	       depthWrite       == other.depthWrite &&
+	       depthCompareOp   == other.depthCompareOp &&
+	       msaaSamples      == other.msaaSamples &&
+	       minSampleShading == other.minSampleShading;
+}
+
+
+void PipelineCache::Initialize(VkDevice device, JobSystem &jobs) {
+	m_device = device;
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = 0;
+	cacheInfo.pInitialData = nullptr;
+
+	if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_vkCache) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+
+	m_jobs = &jobs;
+}
+
+
+void PipelineCache::Destroy() {
+	// compile jobs write into m_completed
+	m_jobs->Wait(m_compileJobs);
+
+	for (auto &[desc, pipeline] : m_completed) {
+		vkDestroyPipeline(m_device, pipeline, nullptr);
+	}
+	for (auto &[desc, pipeline] : m_pipelines) {
+		vkDestroyPipeline(m_device, pipeline, nullptr);
+	}
+	m_completed.clear();
+	m_pipelines.clear();
+	m_pending.clear();
+	m_asyncQueue.clear();
+	m_compiling.clear();
+
+	vkDestroyPipelineCache(m_device, m_vkCache, nullptr);
+}
+
+
+VkPipeline PipelineCache::Request(const PipelineDesc &desc) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats.requests++;
+
+	auto it = m_pipelines.find(desc);
+	if (it != m_pipelines.end()) {
+		m_stats.hits++;
+		return it->second;
+	}
+
+	// do not queue same description twice
+	if (std::find(m_pending.begin(), m_pending.end(), desc) == m_pending.end()) {
+		m_stats.misses++;
+		m_pending.push_back(desc);
+	}
+
+	return VK_NULL_HANDLE;
+}
+
+
+void PipelineCache::Flush() {
+	std::vector<PipelineDesc> descs;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		descs.swap(m_pending);
+	}
+
+	if (descs.empty()) {
+		return;
+	}
+
+	double timeMs = 0.0;
+	std::vector<VkPipeline> pipelines;
+	VkResult result = CreatePipelines(descs, pipelines, timeMs);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint32_t created = 0;
+	for (size_t i = 0; i < descs.size(); i++) {
+		// pipelines that were created are kept even when others in the batch failed
+		if (pipelines[i] != VK_NULL_HANDLE) {
+			m_pipelines[descs[i]] = pipelines[i];
+			created++;
+		}
+	}
+
+	m_stats.lastBatchMs = timeMs;
+	m_stats.totalCreateMs += timeMs;
+	m_stats.pipelinesCreated += created;
+	m_stats.batches++;
+
+	if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+}
+
+
+VkPipeline PipelineCache::Get(const PipelineDesc &desc) {
+	VkPipeline pipeline = Request(desc);
+	if (pipeline != VK_NULL_HANDLE) {
+		return pipeline;
+	}
+
+	Flush();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pipelines.at(desc);
+}
+
+
+VkPipeline PipelineCache::Resolve(const PipelineDesc &desc, VkPipeline fallback) {
+	bool scheduleJob = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.requests++;
+
+		auto it = m_pipelines.find(desc);
+		if (it != m_pipelines.end()) {
+			m_stats.hits++;
+			return it->second;
+		}
+
+		// first time we see this description, hand it to job system
+		// one job takes the whole queue, so a new job is needed only when queue was empty
+		if (m_compiling.insert(desc).second) {
+			m_stats.misses++;
+			scheduleJob = m_asyncQueue.empty();
+			m_asyncQueue.push_back(desc);
+		}
+
+		m_stats.fallbackUses++;
+	}
+
+	if (scheduleJob) {
+		m_jobs->Run([this] { CompileAsyncQueue(); }, &m_compileJobs);
+	}
+	return fallback;
+}
+
+
+void PipelineCache::BeginFrame() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto &[desc, pipeline] : m_completed) {
+		// pipeline could be created by Get() while worker was compiling it, keep the first one
+		if (!m_pipelines.emplace(desc, pipeline).second) {
+			vkDestroyPipeline(m_device, pipeline, nullptr);
+		}
+		m_compiling.erase(desc);
+	}
+	m_completed.clear();
+}
+
+
+void PipelineCache::CompileAsyncQueue() {
+	std::vector<PipelineDesc> descs;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// take everything that is queued, so requests of one frame end up in one batch
+		descs.swap(m_asyncQueue);
+	}
+
+	if (descs.empty()) {
+		return;
+	}
+
+	double timeMs = 0.0;
+	std::vector<VkPipeline> pipelines;
+	CreatePipelines(descs, pipelines, timeMs);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint32_t created = 0;
+	for (size_t i = 0; i < descs.size(); i++) {
+		if (pipelines[i] != VK_NULL_HANDLE) {
+			m_completed.emplace_back(descs[i], pipelines[i]);
+			created++;
+			continue;
+		}
+
+		// only failed description stays in m_compiling, its draws keep using fallback instead of retrying every frame
+		std::cerr << "pipeline compile job: failed to create graphics pipeline " << std::hex << descs[i].Hash()
+		          << " (vertex shader " << descs[i].vertShader << ", fragment shader " << descs[i].fragShader << ")" << std::dec << "\n\n";
+	}
+
+	m_stats.lastBatchMs = timeMs;
+	m_stats.totalCreateMs += timeMs;
+	m_stats.pipelinesCreated += created;
+	m_stats.asyncCompiled += created;
+	m_stats.batches++;
+}
+
+
+VkResult PipelineCache::CreatePipelines(const std::vector<PipelineDesc> &descs, std::vector<VkPipeline> &pipelines, double &timeMs) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// states are sized up front so create infos can point into them
+	std::vector<PipelineState> states(descs.size());
+	std::vector<VkGraphicsPipelineCreateInfo> createInfos(descs.size());
+	pipelines.assign(descs.size(), VK_NULL_HANDLE);
+
+	for (size_t i = 0; i < descs.size(); i++) {
+		FillPipelineState(descs[i], states[i], createInfos[i]);
+	}
+
+	// a failed batch still creates the other pipelines, failed entries are set to VK_NULL_HANDLE by driver
+	VkResult result = vkCreateGraphicsPipelines(m_device, m_vkCache, static_cast<uint32_t>(createInfos.size()), createInfos.data(), nullptr, pipelines.data());
+
+	auto endTime = std::chrono::high_resolution_clock::now();
+	timeMs = std::chrono::duration<double, std::chrono::milliseconds::period>(endTime - startTime).count();
+
+	return result;
+}
+
+
+size_t PipelineCache::GetPipelineCount() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pipelines.size();
+}
+
+
+PipelineCacheStats PipelineCache::GetStats() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+
+void PipelineCache::PrintStats() const {
+	PipelineCacheStats stats = GetStats();
+	double hitRate = stats.requests > 0 ? 100.0 * stats.hits / stats.requests : 0.0;
+
+	std::cout << "pipeline cache:\n";
+	std::cout << "\t" << "pipelines: " << GetPipelineCount() << "\n";
+	std::cout << "\t" << "requests: " << stats.requests << " (hits: " << stats.hits << ", misses: " << stats.misses << ", hit rate: " << hitRate << "%)\n";
+	std::cout << "\t" << "batches: " << stats.batches << ", created: " << stats.pipelinesCreated << " (in jobs: " << stats.asyncCompiled << ")\n";
+	std::cout << "\t" << "fallback uses: " << stats.fallbackUses << "\n";
+	std::cout << "\t" << "creation time: " << stats.totalCreateMs << " ms total, " << stats.lastBatchMs << " ms last batch\n\n";
+}
+
+
+void PipelineCache::FillPipelineState(const PipelineDesc &desc, PipelineState &state, VkGraphicsPipelineCreateInfo &createInfo) {
+	// shaders
+	state.stages[0] = {};
+	state.stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	state.stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	state.stages[0].module = desc.vertShader;
+	state.stages[0].pName = "main";
+
+	state.stages[1] = {};
+	state.stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	state.stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	state.stages[1].module = desc.fragShader;
+	state.stages[1].pName = "main";
+
+	// these values can be changed at runtime without recreating pipeline
+	state.dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+	state.dynamicState = {};
+	state.dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	state.dynamicState.dynamicStateCount = static_cast<uint32_t>(state.dynamicStates.size());
+	state.dynamicState.pDynamicStates = state.dynamicStates.data();
+
+	// vertex input
+	uint32_t attributeCount = static_cast<uint32_t>(state.attributes.size());
+	if (desc.vertexLayout == VertexLayout::PositionOnly) {
+		state.bindings[0] = vu::Vertex::getPositionBindingDescription();
+		state.attributes[0] = vu::Vertex::getPositionAttributeDescription();
+		attributeCount = 1;
+	} else {
+		state.bindings[0] = vu::Vertex::getBindingDescription();
+		state.attributes = vu::Vertex::getAttributeDescriptions();
+	}
+
+	state.vertexInput = {};
+	state.vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	state.vertexInput.vertexBindingDescriptionCount = static_cast<uint32_t>(state.bindings.size());
+	state.vertexInput.pVertexBindingDescriptions = state.bindings.data();
+	state.vertexInput.vertexAttributeDescriptionCount = attributeCount;
+	state.vertexInput.pVertexAttributeDescriptions = state.attributes.data();
+
+	// what type of geometry will be drawn
+	state.inputAssembly = {};
+	state.inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	state.inputAssembly.topology = desc.topology;
+	state.inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// viewport and scissor are dynamic, only their count is needed here
+	state.viewportState = {};
+	state.viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	state.viewportState.viewportCount = 1;
+	state.viewportState.scissorCount = 1;
+
+	// setup resterizer
+	state.rasterizer = {};
+	state.rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	state.rasterizer.depthClampEnable = VK_FALSE;
+	state.rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	state.rasterizer.polygonMode = desc.polygonMode;  // lines or points require gpu feature
+	state.rasterizer.lineWidth = 1.0f;
+	state.rasterizer.cullMode = desc.cullMode;
+	state.rasterizer.frontFace = desc.frontFace;
+	state.rasterizer.depthBiasEnable = VK_FALSE;
+
+	// multisampling
+	state.multisampling = {};
+	state.multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	state.multisampling.sampleShadingEnable = desc.minSampleShading > 0.0f ? VK_TRUE : VK_FALSE;
+	state.multisampling.minSampleShading = desc.minSampleShading;
+	state.multisampling.rasterizationSamples = desc.msaaSamples;
+
+	// color blending per framebuffer
+	state.colorBlendAttachment = {};
+	state.colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	state.colorBlendAttachment.blendEnable = desc.blendMode != BlendMode::Opaque ? VK_TRUE : VK_FALSE;
+	state.colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	state.colorBlendAttachment.dstColorBlendFactor = desc.blendMode == BlendMode::Additive ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	state.colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	state.colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	state.colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	state.colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	// color blending global
+	state.colorBlending = {};
+	state.colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	state.colorBlending.logicOpEnable = VK_FALSE;
+	state.colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	state.colorBlending.attachmentCount = desc.colorFormat != VK_FORMAT_UNDEFINED ? 1 : 0;
+	state.colorBlending.pAttachments = &state.colorBlendAttachment;
+
+	// depth testing
+	state.depthStencil = {};
+	state.depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	state.depthStencil.depthTestEnable = desc.depthTest;
+	state.depthStencil.depthWriteEnable = desc.depthWrite;
+	state.depthStencil.depthCompareOp = desc.depthCompareOp;
+	state.depthStencil.depthBoundsTestEnable = VK_FALSE;
+	state.depthStencil.stencilTestEnable = VK_FALSE;
+
+	// attachment formats (pipelines are used with dynamic rendering, no render pass objects)
+	state.colorFormat = desc.colorFormat;
+	state.rendering = {};
+	state.rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	state.rendering.colorAttachmentCount = desc.colorFormat != VK_FORMAT_UNDEFINED ? 1 : 0;
+	state.rendering.pColorAttachmentFormats = &state.colorFormat;
+	state.rendering.depthAttachmentFormat = desc.depthFormat;
+	state.rendering.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+
+	// create pipeline
+	createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	createInfo.pNext = &state.rendering;
+	createInfo.stageCount = desc.fragShader != VK_NULL_HANDLE ? 2 : 1;
+	createInfo.pStages = state.stages.data();
+	createInfo.pVertexInputState = &state.vertexInput;
+	createInfo.pInputAssemblyState = &state.inputAssembly;
+	createInfo.pViewportState = &state.viewportState;
+	createInfo.pRasterizationState = &state.rasterizer;
+	createInfo.pMultisampleState = &state.multisampling;
+	createInfo.pDepthStencilState = &state.depthStencil;
+	createInfo.pColorBlendState = &state.colorBlending;
+	createInfo.pDynamicState = &state.dynamicState;
+	createInfo.layout = desc.layout;
+	createInfo.renderPass = VK_NULL_HANDLE;
+	createInfo.subpass = 0;
+	createInfo.basePipelineHandle = VK_NULL_HANDLE;
+	createInfo.basePipelineIndex = -1;
+}
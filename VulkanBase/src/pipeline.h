@@ -0,0 +1,145 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+
+#include <vulkan/vulkan.h>
+
+#include "job_system.h"
+#include "vu.h"
+
+namespace vu {
+
+	enum class BlendMode : uint32_t {
+		Opaque,      // blending disabled
+		AlphaBlend,  // src * a + dst * (1 - a)
+		Additive     // src * a + dst
+	};
+
+	enum class VertexLayout : uint32_t {
+		Full,         // vu::Vertex (position, normal, uv)
+		PositionOnly  // position stream of mesh (depth only passes)
+	};
+
+	// Everything that makes one graphics pipeline different from another
+	// Pipelines are cached by hash of this struct, so two equal descriptions share one VkPipeline
+	struct PipelineDesc {
+		VkShaderModule        vertShader       = VK_NULL_HANDLE;
+		VkShaderModule        fragShader       = VK_NULL_HANDLE;  // VK_NULL_HANDLE - no fragment stage (depth only)
+		VkPipelineLayout      layout           = VK_NULL_HANDLE;
+		VertexLayout          vertexLayout     = VertexLayout::Full;
+		VkFormat              colorFormat      = VK_FORMAT_UNDEFINED;  // UNDEFINED - no color attachment
+		VkFormat              depthFormat      = VK_FORMAT_UNDEFINED;  // UNDEFINED - no depth attachment
+		VkPrimitiveTopology   topology         = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkPolygonMode         polygonMode      = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags       cullMode         = VK_CULL_MODE_FRONT_BIT;
+		VkFrontFace           frontFace        = VK_FRONT_FACE_CLOCKWISE;
+		BlendMode             blendMode        = BlendMode::AlphaBlend;
+		VkBool32              depthTest        = VK_TRUE;
+		VkBool32              depthWrite       = VK_TRUE;
+		VkCompareOp           depthCompareOp   = VK_COMPARE_OP_LESS;
+		VkSampleCountFlagBits msaaSamples      = VK_SAMPLE_COUNT_1_BIT;
+		float                 minSampleShading = 0.0f;  // 0 - sample shading disabled
+
+		// stable hash (FNV-1a over every field)
+		uint64_t Hash() const;
+
+		bool operator==(const PipelineDesc &other) const;
+	};
+
+	struct PipelineDescHasher {
+		size_t operator()(const PipelineDesc &desc) const { return static_cast<size_t>(desc.Hash()); }
+	};
+
+	struct PipelineCacheStats {
+		uint64_t requests         = 0;  // calls to Request / Get
+		uint64_t hits             = 0;  // pipeline already existed
+		uint64_t misses           = 0;  // pipeline had to be created
+		uint64_t pipelinesCreated = 0;
+		uint64_t batches          = 0;  // vkCreateGraphicsPipelines calls
+		uint64_t asyncCompiled    = 0;  // pipelines created by compile jobs
+		uint64_t fallbackUses     = 0;  // Resolve calls answered with fallback pipeline
+		double   totalCreateMs    = 0.0;
+		double   lastBatchMs      = 0.0;
+	};
+
+	// Owns every graphics pipeline of the renderer
+	// Request() only queues missing pipelines, Flush() creates all of them with one vkCreateGraphicsPipelines call
+	// Resolve() compiles missing pipelines in job system and returns fallback pipeline until they are ready
+	// All public functions are thread safe
+	class PipelineCache {
+	public:
+		void Initialize(VkDevice device, JobSystem &jobs);
+		void Destroy();
+
+		// returns cached pipeline or VK_NULL_HANDLE (description is queued for next Flush)
+		VkPipeline Request(const PipelineDesc &desc);
+
+		// create all queued pipelines in one batch
+		void Flush();
+
+		// Request + Flush, always returns valid pipeline
+		VkPipeline Get(const PipelineDesc &desc);
+
+		// returns cached pipeline or sends description to compile job and returns fallback
+		VkPipeline Resolve(const PipelineDesc &desc, VkPipeline fallback);
+
+		// swap point: pipelines finished by compile jobs become visible to Request/Resolve only here
+		// call once per frame before recording, so one frame never mixes old and new results
+		void BeginFrame();
+
+		size_t GetPipelineCount() const;
+		PipelineCacheStats GetStats() const;
+		void PrintStats() const;
+
+	private:
+		// create info references these structs, so they must live until vkCreateGraphicsPipelines returns
+		struct PipelineState {
+			std::array<VkPipelineShaderStageCreateInfo, 2> stages;      // fragment stage is optional
+			std::array<VkDynamicState, 2>                  dynamicStates;
+			std::array<VkVertexInputBindingDescription, 1>   bindings;    // per vertex, objects come from storage buffer
+			std::array<VkVertexInputAttributeDescription, 3> attributes;
+			VkPipelineDynamicStateCreateInfo       dynamicState;
+			VkPipelineVertexInputStateCreateInfo   vertexInput;
+			VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+			VkPipelineViewportStateCreateInfo      viewportState;
+			VkPipelineRasterizationStateCreateInfo rasterizer;
+			VkPipelineMultisampleStateCreateInfo   multisampling;
+			VkPipelineColorBlendAttachmentState    colorBlendAttachment;
+			VkPipelineColorBlendStateCreateInfo    colorBlending;
+			VkPipelineDepthStencilStateCreateInfo  depthStencil;
+			VkFormat                               colorFormat;
+			VkPipelineRenderingCreateInfo          rendering;
+		};
+
+		static void FillPipelineState(const PipelineDesc &desc, PipelineState &state, VkGraphicsPipelineCreateInfo &createInfo);
+
+		// creates pipelines for descs in one vkCreateGraphicsPipelines call (does not touch shared state)
+		// on error pipelines that failed are VK_NULL_HANDLE, the rest are valid and owned by caller
+		VkResult CreatePipelines(const std::vector<PipelineDesc> &descs, std::vector<VkPipeline> &pipelines, double &timeMs);
+		void CompileAsyncQueue();
+
+		VkDevice        m_device  = VK_NULL_HANDLE;
+		VkPipelineCache m_vkCache = VK_NULL_HANDLE;  // driver side cache (internally synchronized, shared by all threads)
+
+		mutable std::mutex m_mutex;
+		std::unordered_map<PipelineDesc, VkPipeline, PipelineDescHasher> m_pipelines;  // visible pipelines
+		std::vector<PipelineDesc> m_pending;                                          // waiting for Flush
+
+		// async compilation
+		JobSystem                *m_jobs = nullptr;
+		JobCounter                m_compileJobs;                                      // compile jobs in flight
+		std::vector<PipelineDesc> m_asyncQueue;                                       // waiting for compile job
+		std::unordered_set<PipelineDesc, PipelineDescHasher> m_compiling;             // queued or being compiled
+		std::vector<std::pair<PipelineDesc, VkPipeline>> m_completed;                 // waiting for BeginFrame
+
+		PipelineCacheStats m_stats;
+	};
+
+}
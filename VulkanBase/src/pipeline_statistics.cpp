@@ -0,0 +1,98 @@
+#include "pipeline_statistics.h"
+
+using namespace vu;
+
+
+void PipelineStatistics::Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, bool supported, const std::vector<std::string> &variantNames) {
+	m_rendererInfo = rendererInfo;
+	m_slotVariants.assign(framesInFlight, NO_VARIANT);
+
+	m_variants.clear();
+	for (const std::string &name : variantNames) {
+		m_variants.push_back({name});
+	}
+
+	if (!supported) {
+		std::cout << "device has no pipeline statistics queries, fragment invocations are not counted\n\n";
+		return;
+	}
+
+	VkQueryPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	poolInfo.queryCount = framesInFlight;
+	poolInfo.pipelineStatistics = STATISTICS;
+
+	if (vkCreateQueryPool(m_rendererInfo.device, &poolInfo, nullptr, &m_queryPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline statistics query pool!");
+	}
+}
+
+
+void PipelineStatistics::Destroy() {
+	if (m_queryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(m_rendererInfo.device, m_queryPool, nullptr);
+		m_queryPool = VK_NULL_HANDLE;
+	}
+}
+
+
+void PipelineStatistics::BeginFrame(uint32_t frameIndex) {
+	m_frameIndex = frameIndex;
+
+	uint32_t variant = m_slotVariants[m_frameIndex];
+	if (m_queryPool == VK_NULL_HANDLE || variant == NO_VARIANT) {
+		return;
+	}
+	m_slotVariants[m_frameIndex] = NO_VARIANT;
+
+	// no wait flag, frame slot was already waited on its timeline value
+	uint64_t fragments = 0;
+	VkResult result = vkGetQueryPoolResults(m_rendererInfo.device, m_queryPool, m_frameIndex, 1,
+		sizeof(fragments), &fragments, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS) {
+		return;
+	}
+
+	PipelineStatisticsVariant &stats = m_variants[variant];
+	stats.frames++;
+	stats.fragments += fragments;
+	stats.lastFrame = fragments;
+}
+
+
+void PipelineStatistics::BeginQuery(VkCommandBuffer commandBuffer, uint32_t variant) {
+	if (m_queryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkCmdResetQueryPool(commandBuffer, m_queryPool, m_frameIndex, 1);
+	vkCmdBeginQuery(commandBuffer, m_queryPool, m_frameIndex, 0);
+	m_slotVariants[m_frameIndex] = variant;
+}
+
+
+void PipelineStatistics::EndQuery(VkCommandBuffer commandBuffer) {
+	if (m_queryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkCmdEndQuery(commandBuffer, m_queryPool, m_frameIndex);
+}
+
+
+void PipelineStatistics::PrintStats() const {
+	if (m_queryPool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	std::cout << "fragment shader invocations:\n";
+	for (const PipelineStatisticsVariant &variant : m_variants) {
+		if (variant.frames == 0) {
+			std::cout << "\t" << variant.name << ": no frames\n";
+			continue;
+		}
+		std::cout << "\t" << variant.name << ": " << variant.fragments / variant.frames << " per frame (" << variant.frames << " frames, last: " << variant.lastFrame << ")\n";
+	}
+	std::cout << "\n";
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+
+#include "vu.h"
+
+namespace vu {
+
+	struct PipelineStatisticsVariant {
+		std::string name;
+		uint64_t    frames    = 0;
+		uint64_t    fragments = 0;  // fragment shader invocations of all its frames
+		uint64_t    lastFrame = 0;
+	};
+
+	// Counts fragment shader invocations of every frame with a pipeline statistics query
+	// Frames are grouped into variants (e.g. with and without depth prepass), so averages of both can be compared
+	// Needs pipelineStatisticsQuery and inheritedQueries (query is active while secondary command buffers execute)
+	class PipelineStatistics {
+	public:
+		void Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, bool supported, const std::vector<std::string> &variantNames);
+		void Destroy();
+
+		// reads result of previous use of this frame slot, gpu must be done with it
+		void BeginFrame(uint32_t frameIndex);
+
+		// around all draws of the frame, outside of rendering
+		void BeginQuery(VkCommandBuffer commandBuffer, uint32_t variant);
+		void EndQuery(VkCommandBuffer commandBuffer);
+
+		// secondary command buffers executed inside the query must declare statistics they inherit
+		VkQueryPipelineStatisticFlags GetInheritedStatistics() const { return m_queryPool != VK_NULL_HANDLE ? STATISTICS : 0; }
+
+		bool IsSupported() const { return m_queryPool != VK_NULL_HANDLE; }
+		const std::vector<PipelineStatisticsVariant> &GetVariants() const { return m_variants; }
+		void PrintStats() const;
+
+	private:
+		static constexpr VkQueryPipelineStatisticFlags STATISTICS = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+		static constexpr uint32_t NO_VARIANT = UINT32_MAX;
+
+		RendererInfo m_rendererInfo;
+
+		VkQueryPool           m_queryPool = VK_NULL_HANDLE;  // one query per frame slot
+		std::vector<uint32_t> m_slotVariants;                 // variant of query written into each slot, NO_VARIANT - nothing to read
+		uint32_t              m_frameIndex = 0;
+
+		std::vector<PipelineStatisticsVariant> m_variants;
+	};
+
+}
@@ -0,0 +1,986 @@
+#include "render_graph.h"
+
+using namespace vu;
+
+
+static bool IsDepthFormat(VkFormat format) {
+	return format == VK_FORMAT_D16_UNORM ||
+	       format == VK_FORMAT_D32_SFLOAT ||
+	       format == VK_FORMAT_D16_UNORM_S8_UINT ||
+	       format == VK_FORMAT_D24_UNORM_S8_UINT ||
+	       format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+static bool LifetimesOverlap(int firstA, int lastA, int firstB, int lastB) {
+	return !(lastA < firstB || lastB < firstA);
+}
+
+static uint32_t GetFormatSize(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+		return 2;
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+		return 3;
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return 5;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return 8;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return 16;
+	default:
+		return 4;  // 8 bit rgba / bgra, D32, D24S8
+	}
+}
+
+
+// === PASS BUILDER ===
+
+RGPassBuilder &RGPassBuilder::Color(RGResource resource, VkAttachmentLoadOp loadOp, VkClearColorValue clear, RGResource resolveTarget) {
+	RenderGraph::Pass &pass = m_graph->m_passes[m_pass];
+
+	RenderGraph::Attachment attachment{};
+	attachment.resource = resource;
+	attachment.resolveTarget = resolveTarget;
+	attachment.loadOp = loadOp;
+	attachment.clear.color = clear;
+	pass.colorAttachments.push_back(attachment);
+
+	pass.usages.push_back({resource, RGUsage::ColorAttachment, loadOp});
+	if (resolveTarget != RG_NONE) {
+		pass.usages.push_back({resolveTarget, RGUsage::ResolveTarget, VK_ATTACHMENT_LOAD_OP_DONT_CARE});
+	}
+
+	return *this;
+}
+
+RGPassBuilder &RGPassBuilder::Depth(RGResource resource, VkAttachmentLoadOp loadOp, float clearDepth, bool write) {
+	RenderGraph::Pass &pass = m_graph->m_passes[m_pass];
+
+	pass.hasDepth = true;
+	pass.depthWrite = write;
+	pass.depthAttachment = {};
+	pass.depthAttachment.resource = resource;
+	pass.depthAttachment.loadOp = loadOp;
+	pass.depthAttachment.clear.depthStencil = {clearDepth, 0};
+
+	pass.usages.push_back({resource, write ? RGUsage::DepthAttachment : RGUsage::DepthReadOnly, loadOp});
+
+	return *this;
+}
+
+RGPassBuilder &RGPassBuilder::Read(RGResource resource, RGUsage usage) {
+	m_graph->m_passes[m_pass].usages.push_back({resource, usage});
+	return *this;
+}
+
+RGPassBuilder &RGPassBuilder::Write(RGResource resource, RGUsage usage) {
+	m_graph->m_passes[m_pass].usages.push_back({resource, usage});
+	return *this;
+}
+
+RGPassBuilder &RGPassBuilder::SideEffects() {
+	m_graph->m_passes[m_pass].sideEffects = true;
+	return *this;
+}
+
+RGPassBuilder &RGPassBuilder::SecondaryCommandBuffers() {
+	m_graph->m_passes[m_pass].secondary = true;
+	return *this;
+}
+
+
+// === GRAPH ===
+
+void RenderGraph::Initialize(const RendererInfo &rendererInfo) {
+	m_rendererInfo = rendererInfo;
+
+	// tilers have memory that is committed only when a pass can't keep attachment in tile memory
+	const VkPhysicalDeviceMemoryProperties *properties = nullptr;
+	vmaGetMemoryProperties(m_rendererInfo.allocator, &properties);
+
+	m_lazyMemory = false;
+	for (uint32_t i = 0; i < properties->memoryTypeCount; i++) {
+		if ((properties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0) {
+			m_lazyMemory = true;
+		}
+	}
+}
+
+
+void RenderGraph::Destroy() {
+	ReleaseTransients();
+}
+
+
+void RenderGraph::Reset(LinearArena &arena) {
+	m_arena = &arena;
+
+	m_resources.clear();
+	m_passes.clear();
+}
+
+
+RGResource RenderGraph::CreateImage(const char *name, const RGImageDesc &desc) {
+	Resource resource{};
+	resource.aliasPredecessors = ArenaVector<uint32_t>(ArenaAllocator<uint32_t>(m_arena));
+	resource.name = name;
+	resource.desc = desc;
+	resource.imported = false;
+	resource.aspect = IsDepthFormat(desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	if (Image::HasStencilComponent(desc.format)) {
+		resource.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	m_resources.push_back(resource);
+	return static_cast<RGResource>(m_resources.size() - 1);
+}
+
+
+RGResource RenderGraph::ImportImage(const char *name, VkImage image, VkImageView view, const RGImageDesc &desc, VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkImageLayout finalLayout) {
+	RGResource handle = CreateImage(name, desc);
+
+	Resource &resource = m_resources[handle];
+	resource.imported = true;
+	resource.image = image;
+	resource.view = view;
+	resource.finalLayout = finalLayout;
+	resource.initialState.layout = initialLayout;
+	resource.initialState.stages = initialStage;
+	resource.initialState.access = 0;
+	resource.initialState.written = false;
+
+	return handle;
+}
+
+
+uint32_t RenderGraph::AddPass(const char *name, bool graphics, ExecuteFunction execute) {
+	Pass pass{};
+	pass.name = name;
+	pass.graphics = graphics;
+	pass.execute = std::move(execute);
+	pass.usages = ArenaVector<Usage>(ArenaAllocator<Usage>(m_arena));
+	pass.colorAttachments = ArenaVector<Attachment>(ArenaAllocator<Attachment>(m_arena));
+
+	m_passes.push_back(std::move(pass));
+	return static_cast<uint32_t>(m_passes.size() - 1);
+}
+
+RGPassBuilder RenderGraph::AddGraphicsPass(const char *name, ExecuteFunction execute) {
+	return RGPassBuilder(this, AddPass(name, true, std::move(execute)));
+}
+
+RGPassBuilder RenderGraph::AddComputePass(const char *name, ExecuteFunction execute) {
+	return RGPassBuilder(this, AddPass(name, false, std::move(execute)));
+}
+
+
+RenderGraph::ResourceState RenderGraph::GetUsageState(RGUsage usage) {
+	ResourceState state{};
+
+	switch (usage) {
+	case RGUsage::ColorAttachment:
+	case RGUsage::ResolveTarget:
+		state.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		state.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		state.access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		state.written = true;
+		break;
+	case RGUsage::DepthAttachment:
+		state.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		state.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		state.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		state.written = true;
+		break;
+	case RGUsage::DepthReadOnly:
+		state.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		state.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		state.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		state.written = false;
+		break;
+	case RGUsage::SampledGraphics:
+		state.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		state.stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		state.access = VK_ACCESS_SHADER_READ_BIT;
+		state.written = false;
+		break;
+	case RGUsage::SampledCompute:
+		state.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		state.stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		state.access = VK_ACCESS_SHADER_READ_BIT;
+		state.written = false;
+		break;
+	case RGUsage::StorageRead:
+		state.layout = VK_IMAGE_LAYOUT_GENERAL;
+		state.stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		state.access = VK_ACCESS_SHADER_READ_BIT;
+		state.written = false;
+		break;
+	case RGUsage::StorageWrite:
+		state.layout = VK_IMAGE_LAYOUT_GENERAL;
+		state.stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		state.access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		state.written = true;
+		break;
+	}
+
+	return state;
+}
+
+// does pass need previous contents of the image
+bool RenderGraph::IsRead(const Usage &usage) {
+	switch (usage.usage) {
+	case RGUsage::ColorAttachment:
+	case RGUsage::DepthAttachment:
+		return usage.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+	case RGUsage::ResolveTarget:
+		return false;
+	default:
+		return true;
+	}
+}
+
+// does pass replace all previous contents of the image
+bool RenderGraph::IsFullOverwrite(const Usage &usage) {
+	switch (usage.usage) {
+	case RGUsage::ColorAttachment:
+	case RGUsage::DepthAttachment:
+		return usage.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD;
+	case RGUsage::ResolveTarget:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+void RenderGraph::Compile() {
+	CullPasses();
+	ComputeLifetimes();
+	DeriveStoreOps();
+	MarkLazyImages();
+	ComputeAttachmentTraffic();
+
+	m_stats.passes = static_cast<uint32_t>(m_passes.size());
+	m_stats.culledPasses = 0;
+	for (const Pass &pass : m_passes) {
+		m_stats.culledPasses += pass.culled ? 1 : 0;
+	}
+
+	// transient images only have to be recreated when their descriptions or lifetimes change (resize, new pass)
+	uint64_t signature = ComputeTransientSignature();
+	if (signature != m_transientSignature) {
+		AllocateTransients();
+		m_transientSignature = signature;
+		PrintStats();
+	}
+
+	// bind physical images to this frame's resources
+	ScratchScope scratch;
+	ArenaVector<uint32_t> transientToResource(scratch.Allocator<uint32_t>());
+	transientToResource.reserve(m_resources.size());
+	for (uint32_t i = 0; i < m_resources.size(); i++) {
+		Resource &resource = m_resources[i];
+		if (resource.imported || resource.firstPass < 0) {
+			continue;
+		}
+
+		const PhysicalImage &physical = m_physicalImages[transientToResource.size()];
+		resource.physical = static_cast<uint32_t>(transientToResource.size());
+		resource.image = physical.image;
+		resource.view = physical.view;
+		transientToResource.push_back(i);
+	}
+
+	for (uint32_t index : transientToResource) {
+		Resource &resource = m_resources[index];
+		resource.aliasPredecessors.clear();
+		for (uint32_t predecessor : m_physicalImages[resource.physical].aliasPredecessors) {
+			resource.aliasPredecessors.push_back(transientToResource[predecessor]);
+		}
+	}
+}
+
+
+// walk passes from last to first and keep only passes that write something that is used later
+// (imported images are graph outputs, so they are used by definition)
+void RenderGraph::CullPasses() {
+	ScratchScope scratch;
+	ArenaVector<bool> needed(m_resources.size(), false, scratch.Allocator<bool>());
+	for (size_t i = 0; i < m_resources.size(); i++) {
+		needed[i] = m_resources[i].imported;
+	}
+
+	for (int p = static_cast<int>(m_passes.size()) - 1; p >= 0; p--) {
+		Pass &pass = m_passes[p];
+
+		bool keep = pass.sideEffects;
+		for (const Usage &usage : pass.usages) {
+			if (GetUsageState(usage.usage).written && needed[usage.resource]) {
+				keep = true;
+			}
+		}
+
+		pass.culled = !keep;
+		if (!keep) {
+			continue;
+		}
+
+		// earlier writes of fully overwritten images are dead, images this pass reads are needed
+		for (const Usage &usage : pass.usages) {
+			if (IsFullOverwrite(usage)) {
+				needed[usage.resource] = false;
+			}
+		}
+		for (const Usage &usage : pass.usages) {
+			if (IsRead(usage)) {
+				needed[usage.resource] = true;
+			}
+		}
+	}
+}
+
+
+void RenderGraph::ComputeLifetimes() {
+	for (int p = 0; p < static_cast<int>(m_passes.size()); p++) {
+		if (m_passes[p].culled) {
+			continue;
+		}
+
+		for (const Usage &usage : m_passes[p].usages) {
+			Resource &resource = m_resources[usage.resource];
+			if (resource.firstPass < 0) {
+				resource.firstPass = p;
+			}
+			resource.lastPass = p;
+
+			switch (usage.usage) {
+			case RGUsage::ColorAttachment:
+			case RGUsage::ResolveTarget:
+				resource.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+				break;
+			case RGUsage::DepthAttachment:
+			case RGUsage::DepthReadOnly:
+				resource.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+				break;
+			case RGUsage::SampledGraphics:
+			case RGUsage::SampledCompute:
+				resource.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+				break;
+			case RGUsage::StorageRead:
+			case RGUsage::StorageWrite:
+				resource.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+				break;
+			}
+		}
+	}
+}
+
+
+// attachment contents are stored only if some later pass reads them or the image leaves the graph
+void RenderGraph::DeriveStoreOps() {
+	auto findStoreOp = [this](int passIndex, RGResource resource) {
+		for (int p = passIndex + 1; p < static_cast<int>(m_passes.size()); p++) {
+			if (m_passes[p].culled) {
+				continue;
+			}
+			for (const Usage &usage : m_passes[p].usages) {
+				if (usage.resource == resource) {
+					return IsRead(usage) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+				}
+			}
+		}
+		return m_resources[resource].imported ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	};
+
+	for (int p = 0; p < static_cast<int>(m_passes.size()); p++) {
+		Pass &pass = m_passes[p];
+		if (pass.culled) {
+			continue;
+		}
+
+		for (Attachment &attachment : pass.colorAttachments) {
+			attachment.storeOp = findStoreOp(p, attachment.resource);
+		}
+
+		if (pass.hasDepth) {
+			// read only depth is never written, NONE keeps contents without a write access
+			pass.depthAttachment.storeOp = pass.depthWrite ? findStoreOp(p, pass.depthAttachment.resource) : VK_ATTACHMENT_STORE_OP_NONE;
+		}
+	}
+}
+
+
+// image that lives in one pass and is never loaded exists only in tile memory on tilers (store is DONT_CARE
+// for it already), TRANSIENT usage lets it use lazily allocated memory that is never actually committed
+void RenderGraph::MarkLazyImages() {
+	const VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+
+	for (Resource &resource : m_resources) {
+		resource.lazy = !resource.imported && resource.firstPass >= 0 && resource.firstPass == resource.lastPass &&
+		                (resource.usage & ~attachmentUsage) == 0;
+	}
+
+	for (const Pass &pass : m_passes) {
+		if (pass.culled) {
+			continue;
+		}
+		for (const Usage &usage : pass.usages) {
+			if (usage.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+				m_resources[usage.resource].lazy = false;
+			}
+		}
+	}
+
+	for (Resource &resource : m_resources) {
+		if (resource.lazy) {
+			resource.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
+	}
+}
+
+
+// every load and store moves the whole attachment between tile and main memory
+void RenderGraph::ComputeAttachmentTraffic() {
+	m_stats.attachmentLoadBytes = 0;
+	m_stats.attachmentStoreBytes = 0;
+	m_stats.attachmentSkippedBytes = 0;
+
+	auto countAttachment = [this](const Attachment &attachment) {
+		VkDeviceSize bytes = GetAttachmentBytes(m_resources[attachment.resource].desc);
+
+		if (attachment.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+			m_stats.attachmentLoadBytes += bytes;
+		} else {
+			m_stats.attachmentSkippedBytes += bytes;
+		}
+
+		if (attachment.storeOp == VK_ATTACHMENT_STORE_OP_STORE) {
+			m_stats.attachmentStoreBytes += bytes;
+		} else {
+			m_stats.attachmentSkippedBytes += bytes;
+		}
+
+		if (attachment.resolveTarget != RG_NONE) {
+			m_stats.attachmentStoreBytes += GetAttachmentBytes(m_resources[attachment.resolveTarget].desc);
+		}
+	};
+
+	for (const Pass &pass : m_passes) {
+		if (pass.culled || !pass.graphics) {
+			continue;
+		}
+		for (const Attachment &attachment : pass.colorAttachments) {
+			countAttachment(attachment);
+		}
+		if (pass.hasDepth) {
+			countAttachment(pass.depthAttachment);
+		}
+	}
+}
+
+
+VkDeviceSize RenderGraph::GetAttachmentBytes(const RGImageDesc &desc) {
+	return static_cast<VkDeviceSize>(desc.extent.width) * desc.extent.height * desc.samples * GetFormatSize(desc.format);
+}
+
+
+VkImageCreateInfo RenderGraph::MakeImageInfo(const RGImageDesc &desc, VkImageUsageFlags usage) {
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.extent.width = desc.extent.width;
+	imageInfo.extent.height = desc.extent.height;
+	imageInfo.extent.depth = 1;
+	imageInfo.mipLevels = desc.mipLevels;
+	imageInfo.arrayLayers = 1;
+	imageInfo.format = desc.format;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage = usage;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples = desc.samples;
+	imageInfo.flags = 0;
+	return imageInfo;
+}
+
+
+VkDeviceSize RenderGraph::GetImageMemorySize(const RGImageDesc &desc, VkImageUsageFlags usage) const {
+	VkImageCreateInfo imageInfo = MakeImageInfo(desc, usage);
+
+	VkDeviceImageMemoryRequirements requirementsInfo{};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+	requirementsInfo.pCreateInfo = &imageInfo;
+
+	VkMemoryRequirements2 requirements{};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	vkGetDeviceImageMemoryRequirements(m_rendererInfo.device, &requirementsInfo, &requirements);
+
+	return requirements.memoryRequirements.size;
+}
+
+
+uint64_t RenderGraph::ComputeTransientSignature() const {
+	uint64_t hash = vu::HASH_SEED;
+	for (const Resource &resource : m_resources) {
+		if (resource.imported || resource.firstPass < 0) {
+			continue;
+		}
+		vu::hashValue(hash, resource.desc.format);
+		vu::hashValue(hash, resource.desc.extent.width);
+		vu::hashValue(hash, resource.desc.extent.height);
+		vu::hashValue(hash, resource.desc.samples);
+		vu::hashValue(hash, resource.desc.mipLevels);
+		vu::hashValue(hash, resource.usage);
+		vu::hashValue(hash, resource.firstPass);
+		vu::hashValue(hash, resource.lastPass);
+	}
+	return hash;
+}
+
+
+void RenderGraph::AllocateTransients() {
+	// old images can still be used by frames in flight, current frame is not submitted yet and uses new ones
+	if (!m_physicalImages.empty() || !m_groups.empty()) {
+		Timeline &timeline = *m_rendererInfo.graphicsTimeline;
+		uint64_t lastUse = timeline.GetLastSubmitted();
+
+		for (const PhysicalImage &image : m_physicalImages) {
+			m_rendererInfo.deletionQueue->DestroyImageView(image.view, timeline, lastUse);
+			m_rendererInfo.deletionQueue->DestroyImage(image.image, VK_NULL_HANDLE, timeline, lastUse);
+		}
+		for (const AliasGroup &group : m_groups) {
+			m_rendererInfo.deletionQueue->FreeMemory(group.allocation, timeline, lastUse);
+		}
+		m_physicalImages.clear();
+		m_groups.clear();
+	}
+
+	std::vector<const Resource*> transients;
+	for (const Resource &resource : m_resources) {
+		if (!resource.imported && resource.firstPass >= 0) {
+			transients.push_back(&resource);
+		}
+	}
+
+	// create images without memory to know how much memory they need
+	m_physicalImages.resize(transients.size());
+	for (size_t i = 0; i < transients.size(); i++) {
+		VkImageCreateInfo imageInfo = MakeImageInfo(transients[i]->desc, transients[i]->usage);
+		if (vkCreateImage(m_rendererInfo.device, &imageInfo, nullptr, &m_physicalImages[i].image) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create transient image!");
+		}
+		vkGetImageMemoryRequirements(m_rendererInfo.device, m_physicalImages[i].image, &m_physicalImages[i].requirements);
+	}
+
+	// place biggest images first, each image goes to the lowest offset where it does not
+	// overlap in memory with any image that is alive at the same time
+	std::vector<size_t> order(transients.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+		return m_physicalImages[a].requirements.size > m_physicalImages[b].requirements.size;
+	});
+
+	std::vector<bool> placed(transients.size(), false);
+	for (size_t i : order) {
+		PhysicalImage &image = m_physicalImages[i];
+		const VkMemoryRequirements &requirements = image.requirements;
+
+		auto conflicts = [&](size_t other, uint32_t group) {
+			return placed[other] && m_physicalImages[other].group == group &&
+			       LifetimesOverlap(transients[i]->firstPass, transients[i]->lastPass, transients[other]->firstPass, transients[other]->lastPass);
+		};
+
+		// lazy images get their own memory, aliasing memory that is never committed saves nothing
+		bool lazy = m_lazyMemory && transients[i]->lazy;
+
+		bool found = false;
+		for (uint32_t g = 0; g < m_groups.size() && !found && !lazy; g++) {
+			if (m_groups[g].lazy || (m_groups[g].memoryTypeBits & requirements.memoryTypeBits) == 0) {
+				continue;
+			}
+
+			// candidate offsets are start of block and ends of images that are alive at the same time
+			std::vector<VkDeviceSize> candidates = {0};
+			for (size_t other = 0; other < transients.size(); other++) {
+				if (conflicts(other, g)) {
+					VkDeviceSize end = m_physicalImages[other].offset + m_physicalImages[other].requirements.size;
+					candidates.push_back((end + requirements.alignment - 1) / requirements.alignment * requirements.alignment);
+				}
+			}
+			std::sort(candidates.begin(), candidates.end());
+
+			for (VkDeviceSize offset : candidates) {
+				bool fits = true;
+				for (size_t other = 0; other < transients.size() && fits; other++) {
+					if (!conflicts(other, g)) {
+						continue;
+					}
+					VkDeviceSize otherStart = m_physicalImages[other].offset;
+					VkDeviceSize otherEnd = otherStart + m_physicalImages[other].requirements.size;
+					fits = offset + requirements.size <= otherStart || offset >= otherEnd;
+				}
+
+				if (fits) {
+					image.group = g;
+					image.offset = offset;
+					m_groups[g].memoryTypeBits &= requirements.memoryTypeBits;
+					m_groups[g].size = std::max(m_groups[g].size, offset + requirements.size);
+					m_groups[g].alignment = std::max(m_groups[g].alignment, requirements.alignment);
+					found = true;
+					break;
+				}
+			}
+		}
+
+		if (!found) {
+			AliasGroup group{};
+			group.memoryTypeBits = requirements.memoryTypeBits;
+			group.size = requirements.size;
+			group.alignment = requirements.alignment;
+			group.lazy = lazy;
+			m_groups.push_back(group);
+
+			image.group = static_cast<uint32_t>(m_groups.size() - 1);
+			image.offset = 0;
+		}
+
+		placed[i] = true;
+	}
+
+	// one allocation per group
+	for (AliasGroup &group : m_groups) {
+		VkMemoryRequirements requirements{};
+		requirements.size = group.size;
+		requirements.alignment = group.alignment;
+		requirements.memoryTypeBits = group.memoryTypeBits;
+
+		VmaAllocationCreateInfo allocInfo{};
+		allocInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		if (group.lazy) {
+			// own memory object, so its commitment can be queried
+			allocInfo.requiredFlags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+			allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+		}
+
+		VkResult result = vmaAllocateMemory(m_rendererInfo.allocator, &requirements, &allocInfo, &group.allocation, nullptr);
+		if (result != VK_SUCCESS && group.lazy) {
+			// lazily allocated type is not allowed for this format, normal memory works for every image
+			group.lazy = false;
+			allocInfo.requiredFlags = 0;
+			allocInfo.flags = 0;
+			result = vmaAllocateMemory(m_rendererInfo.allocator, &requirements, &allocInfo, &group.allocation, nullptr);
+		}
+		if (result != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate transient image memory!");
+		}
+		vu::tagAllocation(m_rendererInfo.allocator, group.allocation, MemoryCategory::Attachment);
+	}
+
+	// bind memory, create views and find which images used the same memory before
+	m_stats.transientImages = static_cast<uint32_t>(transients.size());
+	m_stats.unaliasedBytes = 0;
+	m_stats.transientBytes = 0;
+
+	for (size_t i = 0; i < transients.size(); i++) {
+		PhysicalImage &image = m_physicalImages[i];
+
+		if (vmaBindImageMemory2(m_rendererInfo.allocator, m_groups[image.group].allocation, image.offset, image.image, nullptr) != VK_SUCCESS) {
+			throw std::runtime_error("failed to bind transient image memory!");
+		}
+
+		VkImageAspectFlags viewAspect = transients[i]->aspect & ~VK_IMAGE_ASPECT_STENCIL_BIT;
+		vu::Image::CreateImageView(m_rendererInfo, image.image, transients[i]->desc.format, viewAspect, transients[i]->desc.mipLevels, image.view);
+
+		image.aliasPredecessors.clear();
+		for (size_t other = 0; other < transients.size(); other++) {
+			const PhysicalImage &otherImage = m_physicalImages[other];
+			bool sameMemory = other != i && otherImage.group == image.group &&
+			                  image.offset < otherImage.offset + otherImage.requirements.size &&
+			                  otherImage.offset < image.offset + image.requirements.size;
+
+			if (sameMemory && transients[other]->lastPass < transients[i]->firstPass) {
+				image.aliasPredecessors.push_back(static_cast<uint32_t>(other));
+			}
+		}
+
+		m_stats.unaliasedBytes += image.requirements.size;
+	}
+
+	m_stats.lazyImages = 0;
+	m_stats.lazyBytes = 0;
+	for (const AliasGroup &group : m_groups) {
+		m_stats.transientBytes += group.size;
+		if (group.lazy) {
+			m_stats.lazyImages++;
+			m_stats.lazyBytes += group.size;
+		}
+	}
+}
+
+
+void RenderGraph::DestroyPhysical(std::vector<PhysicalImage> &images, std::vector<AliasGroup> &groups) {
+	for (PhysicalImage &image : images) {
+		vkDestroyImageView(m_rendererInfo.device, image.view, nullptr);
+		vkDestroyImage(m_rendererInfo.device, image.image, nullptr);
+	}
+	for (AliasGroup &group : groups) {
+		vu::untagAllocation(m_rendererInfo.allocator, group.allocation);
+		vmaFreeMemory(m_rendererInfo.allocator, group.allocation);
+	}
+	images.clear();
+	groups.clear();
+}
+
+
+void RenderGraph::ReleaseTransients() {
+	DestroyPhysical(m_physicalImages, m_groups);
+	m_transientSignature = 0;
+	m_lastFrameStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	m_lastFrameAccess = 0;
+}
+
+
+void RenderGraph::AddBarrier(Resource &resource, const ResourceState &required, ArenaVector<VkImageMemoryBarrier> &barriers, VkPipelineStageFlags &srcStages, VkPipelineStageFlags &dstStages) {
+	ResourceState &current = resource.state;
+
+	// read after read in the same layout needs no barrier, just remember who reads
+	// so the next write waits for all of them
+	if (current.layout == required.layout && !current.written && !required.written) {
+		current.stages |= required.stages;
+		current.access |= required.access;
+		return;
+	}
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = current.layout;
+	barrier.newLayout = required.layout;
+	barrier.srcAccessMask = current.written ? current.access : 0;  // write after read only needs execution dependency
+	barrier.dstAccessMask = required.access;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = resource.image;
+	barrier.subresourceRange.aspectMask = resource.aspect;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = resource.desc.mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	barriers.push_back(barrier);
+	srcStages |= current.stages;
+	dstStages |= required.stages;
+
+	current = required;
+}
+
+
+void RenderGraph::FlushBarriers(VkCommandBuffer commandBuffer, ArenaVector<VkImageMemoryBarrier> &barriers, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages) {
+	if (barriers.empty()) {
+		return;
+	}
+
+	// all barriers of one pass go to the gpu in one call
+	vkCmdPipelineBarrier(commandBuffer,
+		srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		dstStages != 0 ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(barriers.size()), barriers.data()
+	);
+
+	m_stats.barriers += static_cast<uint32_t>(barriers.size());
+	barriers.clear();
+}
+
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer) {
+	m_stats.barriers = 0;
+
+	// contents of transient images are undefined at frame start, but last frame could still use their memory
+	for (Resource &resource : m_resources) {
+		if (resource.imported) {
+			resource.state = resource.initialState;
+		} else {
+			resource.state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			resource.state.stages = m_lastFrameStages;
+			resource.state.access = m_lastFrameAccess;
+			resource.state.written = true;
+		}
+	}
+
+	ScratchScope scratch;
+	ArenaVector<VkImageMemoryBarrier> barriers(scratch.Allocator<VkImageMemoryBarrier>());
+	ArenaVector<VkRenderingAttachmentInfo> colorInfos(scratch.Allocator<VkRenderingAttachmentInfo>());
+	barriers.reserve(m_resources.size());
+
+	for (int p = 0; p < static_cast<int>(m_passes.size()); p++) {
+		Pass &pass = m_passes[p];
+		if (pass.culled) {
+			continue;
+		}
+
+		// barriers
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+
+		for (const Usage &usage : pass.usages) {
+			Resource &resource = m_resources[usage.resource];
+
+			// memory of this image was used by other images earlier this frame, wait for them
+			if (!resource.imported && resource.firstPass == p && !resource.aliasPredecessors.empty()) {
+				resource.state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				resource.state.stages = 0;
+				resource.state.access = 0;
+				resource.state.written = true;
+				for (uint32_t predecessor : resource.aliasPredecessors) {
+					resource.state.stages |= m_resources[predecessor].state.stages;
+					resource.state.access |= m_resources[predecessor].state.access;
+				}
+			}
+
+			AddBarrier(resource, GetUsageState(usage.usage), barriers, srcStages, dstStages);
+		}
+
+		FlushBarriers(commandBuffer, barriers, srcStages, dstStages);
+
+		if (!pass.graphics) {
+			pass.execute(commandBuffer);
+			continue;
+		}
+
+		// graphics pass, attachments are described by declared writes
+		VkExtent2D extent = {0, 0};
+
+		colorInfos.clear();
+		for (const Attachment &attachment : pass.colorAttachments) {
+			const Resource &resource = m_resources[attachment.resource];
+			extent = resource.desc.extent;
+
+			VkRenderingAttachmentInfo info{};
+			info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+			info.imageView = resource.view;
+			info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			info.loadOp = attachment.loadOp;
+			info.storeOp = attachment.storeOp;
+			info.clearValue = attachment.clear;
+
+			if (attachment.resolveTarget != RG_NONE) {
+				info.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+				info.resolveImageView = m_resources[attachment.resolveTarget].view;
+				info.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			}
+
+			colorInfos.push_back(info);
+		}
+
+		VkRenderingAttachmentInfo depthInfo{};
+		if (pass.hasDepth) {
+			const Resource &resource = m_resources[pass.depthAttachment.resource];
+			extent = resource.desc.extent;
+
+			depthInfo.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+			depthInfo.imageView = resource.view;
+			depthInfo.imageLayout = pass.depthWrite ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+			depthInfo.loadOp = pass.depthAttachment.loadOp;
+			depthInfo.storeOp = pass.depthAttachment.storeOp;
+			depthInfo.clearValue = pass.depthAttachment.clear;
+		}
+
+		VkRenderingInfo renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		renderingInfo.flags = pass.secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+		renderingInfo.renderArea.offset = {0, 0};
+		renderingInfo.renderArea.extent = extent;
+		renderingInfo.layerCount = 1;
+		renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colorInfos.size());
+		renderingInfo.pColorAttachments = colorInfos.data();
+		renderingInfo.pDepthAttachment = pass.hasDepth ? &depthInfo : nullptr;
+
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
+
+		// only vkCmdExecuteCommands is allowed inside rendering with secondary contents
+		if (pass.secondary) {
+			pass.execute(commandBuffer);
+			vkCmdEndRendering(commandBuffer);
+			continue;
+		}
+
+		// update viewport
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(extent.width);
+		viewport.height = static_cast<float>(extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		// update scissor rect
+		VkRect2D scissor{};
+		scissor.offset = {0, 0};
+		scissor.extent = extent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		pass.execute(commandBuffer);
+
+		vkCmdEndRendering(commandBuffer);
+	}
+
+	// leave imported images in layouts their owners expect (present for swap chain)
+	VkPipelineStageFlags srcStages = 0;
+	VkPipelineStageFlags dstStages = 0;
+	for (Resource &resource : m_resources) {
+		if (resource.imported && resource.state.layout != resource.finalLayout) {
+			ResourceState finalState{};
+			finalState.layout = resource.finalLayout;
+			finalState.stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			finalState.access = 0;
+			finalState.written = false;
+			AddBarrier(resource, finalState, barriers, srcStages, dstStages);
+		}
+	}
+	FlushBarriers(commandBuffer, barriers, srcStages, dstStages);
+
+	// next frame reuses transient memory only after these stages are done
+	m_lastFrameStages = 0;
+	m_lastFrameAccess = 0;
+	for (const Resource &resource : m_resources) {
+		if (!resource.imported && resource.firstPass >= 0) {
+			m_lastFrameStages |= resource.state.stages;
+			m_lastFrameAccess |= resource.state.written ? resource.state.access : 0;
+		}
+	}
+	if (m_lastFrameStages == 0) {
+		m_lastFrameStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	}
+}
+
+
+void RenderGraph::PrintStats() const {
+	std::cout << "render graph:\n";
+	std::cout << "\t" << "passes: " << m_stats.passes << " (culled: " << m_stats.culledPasses << ")\n";
+	std::cout << "\t" << "transient images: " << m_stats.transientImages << "\n";
+	std::cout << "\t" << "peak transient memory: " << m_stats.transientBytes / (1024.0 * 1024.0) << " MB ("
+	          << m_stats.unaliasedBytes / (1024.0 * 1024.0) << " MB without aliasing)\n";
+
+	// driver backs lazy memory only when tile memory is not enough
+	VkDeviceSize committed = 0;
+	for (const AliasGroup &group : m_groups) {
+		if (group.lazy) {
+			VmaAllocationInfo info{};
+			vmaGetAllocationInfo(m_rendererInfo.allocator, group.allocation, &info);
+
+			VkDeviceSize groupCommitted = 0;
+			vkGetDeviceMemoryCommitment(m_rendererInfo.device, info.deviceMemory, &groupCommitted);
+			committed += groupCommitted;
+		}
+	}
+	std::cout << "\t" << "lazily allocated: " << m_stats.lazyImages << " images, " << m_stats.lazyBytes / (1024.0 * 1024.0) << " MB reserved, "
+	          << committed / (1024.0 * 1024.0) << " MB committed" << (m_lazyMemory ? "" : " (no lazy memory on this device)") << "\n";
+	std::cout << "\t" << "attachment traffic per frame: " << m_stats.attachmentLoadBytes / (1024.0 * 1024.0) << " MB loaded, "
+	          << m_stats.attachmentStoreBytes / (1024.0 * 1024.0) << " MB stored, "
+	          << m_stats.attachmentSkippedBytes / (1024.0 * 1024.0) << " MB skipped by load / store ops\n\n";
+}
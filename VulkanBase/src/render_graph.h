@@ -0,0 +1,238 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+
+#include <vulkan/vulkan.h>
+#include <VMA/vk_mem_alloc.h>
+
+#include "image.h"
+#include "deletion_queue.h"
+#include "memory_arena.h"
+#include "vu.h"
+
+namespace vu {
+
+	using RGResource = uint32_t;
+	const RGResource RG_NONE = UINT32_MAX;
+
+	struct RGImageDesc {
+		VkFormat              format    = VK_FORMAT_UNDEFINED;
+		VkExtent2D            extent    = {0, 0};
+		VkSampleCountFlagBits samples   = VK_SAMPLE_COUNT_1_BIT;
+		uint32_t              mipLevels = 1;
+	};
+
+	// how a pass uses an image, every usage maps to one layout + stage + access combination
+	enum class RGUsage : uint32_t {
+		ColorAttachment,
+		ResolveTarget,
+		DepthAttachment,
+		DepthReadOnly,     // depth test without depth writes
+		SampledGraphics,   // sampled in vertex or fragment shader
+		SampledCompute,
+		StorageRead,       // compute image load
+		StorageWrite       // compute image store (treated as read-modify-write)
+	};
+
+	struct RenderGraphStats {
+		uint32_t     passes          = 0;
+		uint32_t     culledPasses    = 0;
+		uint32_t     barriers        = 0;  // image barriers recorded last frame
+		uint32_t     transientImages = 0;
+		VkDeviceSize transientBytes  = 0;  // memory actually allocated for transient images (after aliasing)
+		VkDeviceSize unaliasedBytes  = 0;  // memory transient images would take without aliasing
+		uint32_t     lazyImages      = 0;  // transient images in lazily allocated memory
+		VkDeviceSize lazyBytes       = 0;  // reserved by them, committed only when a pass spills out of tile memory
+
+		// attachment traffic between tile and main memory per frame
+		VkDeviceSize attachmentLoadBytes    = 0;
+		VkDeviceSize attachmentStoreBytes   = 0;  // including resolves
+		VkDeviceSize attachmentSkippedBytes = 0;  // loads and stores avoided by CLEAR / DONT_CARE ops
+	};
+
+	class RenderGraph;
+
+	// returned by AddGraphicsPass / AddComputePass to declare what pass reads and writes
+	class RGPassBuilder {
+	public:
+		RGPassBuilder(RenderGraph *graph, uint32_t pass) : m_graph(graph), m_pass(pass) {};
+
+		// color attachment, multisampled attachments can resolve into resolveTarget at the end of the pass
+		RGPassBuilder &Color(RGResource resource, VkAttachmentLoadOp loadOp, VkClearColorValue clear = {}, RGResource resolveTarget = RG_NONE);
+		RGPassBuilder &Depth(RGResource resource, VkAttachmentLoadOp loadOp, float clearDepth = 1.0f, bool write = true);
+		RGPassBuilder &Read(RGResource resource, RGUsage usage);
+		RGPassBuilder &Write(RGResource resource, RGUsage usage);
+
+		// pass writes something outside of graph (buffers, queries), never cull it
+		RGPassBuilder &SideEffects();
+
+		// pass only executes secondary command buffers, they must set viewport and scissor themselves
+		RGPassBuilder &SecondaryCommandBuffers();
+
+	private:
+		RenderGraph *m_graph;
+		uint32_t     m_pass;
+	};
+
+	// Frame graph
+	// Every frame passes and resources are declared again, then Compile() culls passes whose results are never used,
+	// places transient images in shared memory when their lifetimes do not overlap and Execute() records passes
+	// with barriers derived from declared reads and writes
+	class RenderGraph {
+	public:
+		using ExecuteFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+		void Initialize(const RendererInfo &rendererInfo);
+		void Destroy();
+
+		// start declaring new frame, per pass lists of the frame are allocated from arena
+		// (arena must stay valid until next Reset)
+		void Reset(LinearArena &arena);
+
+		// image owned by graph, memory is only valid between first and last pass that uses it
+		RGResource CreateImage(const char *name, const RGImageDesc &desc);
+
+		// image owned by someone else (swap chain), finalLayout is layout image is left in after the frame
+		RGResource ImportImage(const char *name, VkImage image, VkImageView view, const RGImageDesc &desc, VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkImageLayout finalLayout);
+
+		RGPassBuilder AddGraphicsPass(const char *name, ExecuteFunction execute);
+		RGPassBuilder AddComputePass(const char *name, ExecuteFunction execute);
+
+		void Compile();
+		void Execute(VkCommandBuffer commandBuffer);
+
+		// destroy transient images right away (device must be idle)
+		void ReleaseTransients();
+
+		// device has lazily allocated memory (tilers), attachments that never leave one pass are placed there
+		bool SupportsLazyMemory() const { return m_lazyMemory; }
+
+		// memory an image of this description would take, without creating it
+		VkDeviceSize GetImageMemorySize(const RGImageDesc &desc, VkImageUsageFlags usage) const;
+
+		// bytes one full load or store of attachment moves
+		static VkDeviceSize GetAttachmentBytes(const RGImageDesc &desc);
+
+		VkImage     GetImage(RGResource resource)     const { return m_resources[resource].image; }
+		VkImageView GetImageView(RGResource resource) const { return m_resources[resource].view; }
+		const RenderGraphStats &GetStats() const { return m_stats; }
+		void PrintStats() const;
+
+	private:
+		friend class RGPassBuilder;
+
+		struct ResourceState {
+			VkImageLayout        layout  = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags stages  = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			VkAccessFlags        access  = 0;
+			bool                 written = false;
+		};
+
+		struct Resource {
+			const char        *name;
+			RGImageDesc        desc;
+			bool               imported;
+			VkImage            image = VK_NULL_HANDLE;
+			VkImageView        view  = VK_NULL_HANDLE;
+			VkImageUsageFlags  usage = 0;
+			VkImageAspectFlags aspect;
+			VkImageLayout      finalLayout;   // imported only
+			ResourceState      initialState;  // imported only
+			ResourceState      state;         // tracked while executing
+
+			// filled by Compile
+			int                   firstPass = -1;
+			int                   lastPass  = -1;
+			uint32_t              physical  = UINT32_MAX;
+			bool                  lazy      = false;  // lives in one pass, never loaded or stored
+			ArenaVector<uint32_t> aliasPredecessors;  // transient resources that used same memory earlier this frame
+		};
+
+		struct Usage {
+			RGResource         resource;
+			RGUsage            usage;
+			VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;  // attachments only
+		};
+
+		struct Attachment {
+			RGResource         resource;
+			RGResource         resolveTarget = RG_NONE;
+			VkAttachmentLoadOp loadOp;
+			VkClearValue       clear;
+			VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE;  // derived in Compile
+		};
+
+		struct Pass {
+			const char             *name;
+			bool                    graphics;
+			ExecuteFunction         execute;
+			ArenaVector<Usage>      usages;
+			ArenaVector<Attachment> colorAttachments;
+			bool                    hasDepth = false;
+			bool                    depthWrite = true;
+			Attachment              depthAttachment;
+			bool                    sideEffects = false;
+			bool                    secondary = false;
+			bool                    culled = false;
+		};
+
+		// transient image with its own memory placement
+		struct PhysicalImage {
+			VkImage              image;
+			VkImageView          view;
+			VkMemoryRequirements requirements;
+			uint32_t             group;
+			VkDeviceSize         offset;
+			std::vector<uint32_t> aliasPredecessors;  // indices of images that use same memory earlier in the frame
+		};
+
+		// images placed in one group share one allocation
+		struct AliasGroup {
+			uint32_t      memoryTypeBits;
+			VkDeviceSize  size;
+			VkDeviceSize  alignment;
+			VmaAllocation allocation;
+			bool          lazy = false;  // one lazy image in its own lazily allocated memory
+		};
+
+		static ResourceState GetUsageState(RGUsage usage);
+		static bool IsRead(const Usage &usage);
+		static bool IsFullOverwrite(const Usage &usage);
+
+		uint32_t AddPass(const char *name, bool graphics, ExecuteFunction execute);
+		void CullPasses();
+		void ComputeLifetimes();
+		void DeriveStoreOps();
+		void MarkLazyImages();
+		void ComputeAttachmentTraffic();
+		static VkImageCreateInfo MakeImageInfo(const RGImageDesc &desc, VkImageUsageFlags usage);
+		uint64_t ComputeTransientSignature() const;
+		void AllocateTransients();
+		void DestroyPhysical(std::vector<PhysicalImage> &images, std::vector<AliasGroup> &groups);
+		void AddBarrier(Resource &resource, const ResourceState &required, ArenaVector<VkImageMemoryBarrier> &barriers, VkPipelineStageFlags &srcStages, VkPipelineStageFlags &dstStages);
+		void FlushBarriers(VkCommandBuffer commandBuffer, ArenaVector<VkImageMemoryBarrier> &barriers, VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages);
+
+		RendererInfo m_rendererInfo;
+		bool         m_lazyMemory = false;
+
+		// declared this frame
+		LinearArena          *m_arena = nullptr;
+		std::vector<Resource> m_resources;
+		std::vector<Pass>     m_passes;
+
+		// transient memory, reused while declared transient resources stay the same
+		uint64_t                   m_transientSignature = 0;
+		std::vector<PhysicalImage> m_physicalImages;
+		std::vector<AliasGroup>    m_groups;
+
+		// stages and accesses of transient images at the end of last frame (next frame must wait for them before reusing memory)
+		VkPipelineStageFlags m_lastFrameStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		VkAccessFlags        m_lastFrameAccess = 0;
+
+		RenderGraphStats m_stats;
+	};
+
+}
@@ -0,0 +1,138 @@
+#include "render_queue.h"
+
+using namespace vu;
+
+
+uint64_t RenderQueue::QuantizeDepth(float depth) {
+	// bits of non negative floats grow with the value, top bits are enough to order draws
+	depth = std::max(depth, 0.0f);
+
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> (32 - DEPTH_BITS);
+}
+
+
+uint64_t RenderQueue::MakeKey(DrawLayer layer, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth) {
+	const uint64_t depthMask = (1ull << DEPTH_BITS) - 1;
+
+	uint64_t state = (static_cast<uint64_t>(pipeline & ((1u << PIPELINE_BITS) - 1)) << (MATERIAL_BITS + MESH_BITS)) |
+	                 (static_cast<uint64_t>(material & ((1u << MATERIAL_BITS) - 1)) << MESH_BITS) |
+	                  static_cast<uint64_t>(mesh & ((1u << MESH_BITS) - 1));
+	uint64_t depthBits = QuantizeDepth(depth) & depthMask;
+	uint64_t key = static_cast<uint64_t>(layer) << 62;
+
+	if (layer == DrawLayer::Transparent) {
+		// far first, state only breaks ties
+		return key | ((depthMask - depthBits) << (PIPELINE_BITS + MATERIAL_BITS + MESH_BITS)) | state;
+	}
+	return key | (state << DEPTH_BITS) | depthBits;
+}
+
+
+uint64_t RenderQueue::GetStateBits(uint64_t key) {
+	const uint32_t stateBits = PIPELINE_BITS + MATERIAL_BITS + MESH_BITS;
+	const uint64_t stateMask = (1ull << stateBits) - 1;
+
+	DrawLayer layer = static_cast<DrawLayer>(key >> 62);
+	if (layer == DrawLayer::Transparent) {
+		return (key & (3ull << 62)) | (key & stateMask);
+	}
+	return (key & (3ull << 62)) | ((key >> DEPTH_BITS) & stateMask);
+}
+
+
+void RenderQueue::Clear(LinearArena &arena) {
+	if (!m_entries.empty() || m_draws.load() > 0) {
+		m_lastFrame.items = static_cast<uint32_t>(m_entries.size());
+		m_lastFrame.draws = m_draws.exchange(0);
+		m_lastFrame.pipelineBinds = m_pipelineBinds.exchange(0);
+		m_lastFrame.descriptorBinds = m_descriptorBinds.exchange(0);
+		m_lastFrame.vertexBinds = m_vertexBinds.exchange(0);
+		m_lastFrame.sortMs = m_sortMs;
+
+		m_total.items += m_lastFrame.items;
+		m_total.draws += m_lastFrame.draws;
+		m_total.pipelineBinds += m_lastFrame.pipelineBinds;
+		m_total.descriptorBinds += m_lastFrame.descriptorBinds;
+		m_total.vertexBinds += m_lastFrame.vertexBinds;
+		m_total.sortMs += m_lastFrame.sortMs;
+		m_frames++;
+	}
+
+	m_entries = ArenaVector<Entry>(ArenaAllocator<Entry>(&arena));
+	m_scratch = ArenaVector<Entry>(ArenaAllocator<Entry>(&arena));
+	m_entries.reserve(m_lastFrame.items);
+	m_sortMs = 0.0;
+}
+
+
+void RenderQueue::Sort() {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	size_t count = m_entries.size();
+	if (count < 2) {
+		return;
+	}
+	m_scratch.resize(count);
+
+	// histograms of every digit in one pass over keys
+	std::array<std::array<uint32_t, RADIX_SIZE>, PASSES> histograms{};
+	for (const Entry &entry : m_entries) {
+		for (uint32_t pass = 0; pass < PASSES; pass++) {
+			histograms[pass][(entry.key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+		}
+	}
+
+	Entry *src = m_entries.data();
+	Entry *dst = m_scratch.data();
+	for (uint32_t pass = 0; pass < PASSES; pass++) {
+		std::array<uint32_t, RADIX_SIZE> &histogram = histograms[pass];
+		uint32_t shift = pass * RADIX_BITS;
+
+		// most passes see the same digit everywhere (unused ids, layer), order would not change
+		if (histogram[(src[0].key >> shift) & (RADIX_SIZE - 1)] == count) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t &bucket : histogram) {
+			uint32_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			dst[histogram[(src[i].key >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+		}
+		std::swap(src, dst);
+	}
+
+	if (src != m_entries.data()) {
+		m_entries.swap(m_scratch);
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_sortMs = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+
+void RenderQueue::CountStateChanges(uint32_t draws, uint32_t pipelineBinds, uint32_t descriptorBinds, uint32_t vertexBinds) {
+	m_draws += draws;
+	m_pipelineBinds += pipelineBinds;
+	m_descriptorBinds += descriptorBinds;
+	m_vertexBinds += vertexBinds;
+}
+
+
+void RenderQueue::PrintStats() const {
+	if (m_frames == 0) {
+		return;
+	}
+
+	std::cout << "render queue (average per frame):\n";
+	std::cout << "\t" << "items: " << m_total.items / m_frames << ", draws: " << m_total.draws / m_frames << "\n";
+	std::cout << "\t" << "binds: " << m_total.pipelineBinds / m_frames << " pipeline, " << m_total.descriptorBinds / m_frames << " descriptor, "
+	          << m_total.vertexBinds / m_frames << " vertex/index\n";
+	std::cout << "\t" << "sort: " << m_total.sortMs / m_frames << " ms\n\n";
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+#include "memory_arena.h"
+
+namespace vu {
+
+	// draws of one layer are sorted together, layers are drawn in this order
+	enum class DrawLayer : uint32_t {
+		Opaque      = 0,  // front to back within same state
+		Transparent = 1   // back to front
+	};
+
+	struct RenderQueueStats {
+		uint32_t items           = 0;
+		uint32_t draws           = 0;    // after merging equal state neighbours into instanced draws
+		uint32_t pipelineBinds   = 0;
+		uint32_t descriptorBinds = 0;
+		uint32_t vertexBinds     = 0;    // vertex + index buffer of a mesh
+		double   sortMs          = 0.0;
+	};
+
+	// Draws of a frame as 64 bit sort keys
+	// opaque:      | layer 2 | pipeline 10 | material 12 | mesh 12 | depth 28          |
+	// transparent: | layer 2 | inverted depth 28 | pipeline 10 | material 12 | mesh 12 |
+	// Keys are radix sorted, so neighbours share as much state as possible and binds between them can be skipped
+	class RenderQueue {
+	public:
+		struct Entry {
+			uint64_t key;
+			uint32_t item;  // index of the draw in caller's list
+		};
+
+		static const uint32_t PIPELINE_BITS = 10;
+		static const uint32_t MATERIAL_BITS = 12;
+		static const uint32_t MESH_BITS     = 12;
+		static const uint32_t DEPTH_BITS    = 28;
+
+		// depth is view space distance, ids must fit their bit ranges
+		static uint64_t MakeKey(DrawLayer layer, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+		// key without depth, equal for draws that can be merged into one instanced draw
+		static uint64_t GetStateBits(uint64_t key);
+
+		// folds counters of previous frame into statistics and starts new frame
+		// keys of the new frame live in arena, room for as many as last frame is reserved up front
+		void Clear(LinearArena &arena);
+		void Push(uint64_t key, uint32_t item) { m_entries.push_back({key, item}); }
+
+		// least significant digit radix sort, 8 bits per pass, passes where every key has the same digit are skipped
+		void Sort();
+
+		const ArenaVector<Entry> &GetEntries() const { return m_entries; }
+
+		// called by recording threads once per recorded range
+		void CountStateChanges(uint32_t draws, uint32_t pipelineBinds, uint32_t descriptorBinds, uint32_t vertexBinds);
+
+		const RenderQueueStats &GetLastFrameStats() const { return m_lastFrame; }
+		void PrintStats() const;
+
+	private:
+		static const uint32_t RADIX_BITS = 8;
+		static const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+		static const uint32_t PASSES     = 64 / RADIX_BITS;
+
+		static uint64_t QuantizeDepth(float depth);
+
+		ArenaVector<Entry> m_entries;
+		ArenaVector<Entry> m_scratch;
+		double             m_sortMs = 0.0;
+
+		std::atomic<uint32_t> m_draws{0};
+		std::atomic<uint32_t> m_pipelineBinds{0};
+		std::atomic<uint32_t> m_descriptorBinds{0};
+		std::atomic<uint32_t> m_vertexBinds{0};
+
+		RenderQueueStats m_lastFrame;
+		RenderQueueStats m_total;     // sums over all frames
+		uint64_t         m_frames = 0;
+	};
+
+}
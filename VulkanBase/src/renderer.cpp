@@ -13,28 +13,36 @@ void Renderer::Run() {
 }
 
 void Renderer::InitVulkan() {
+	// pipeline compilation and command recording run as jobs
+	m_jobSystem.Initialize();
+
 	CreateInstance();
 	SetupDebugMessenger();
 	CreateSurface();
 	PickPhysicalDevice();
 	CreateLogicalDevice();
+	CreateTimelines();
 	CreateMemoryAllocator();
 	CreateSwapChain();
 	CreateImageViews();
 	CreateCommandPool();
-	CreateRenderPass();
-	CreateDepthResources();
-	CreateColorResources();
-	CreateFrameBuffers();
 	CreateRendererInfo();
+	m_deletionQueue.Initialize(CreateRendererInfo());
+	m_memoryStats.Initialize(CreateRendererInfo(), supportsMemoryBudget, memoryLogInterval);
+	m_defragmenter.Initialize(CreateRendererInfo(), defragBudgetMs > 0.0 ? DEFRAG_BYTES_PER_FRAME : 0, defragBudgetMs);
+
+	m_depthFormat = vu::findDepthFormat(m_physicalDevice);
+	m_renderGraph.Initialize(CreateRendererInfo());
+	PrintAttachmentCosts();
+	m_frameArenas.Initialize(framesInFlight, FRAME_ARENA_BYTES);
+	m_allocationTracker.Restart(ALLOCATION_WARMUP_FRAMES);
 
 	CreateTextureImages();
 
 	CreateTextureSampler();
 	CreateShaderModules();
 
-	CreateMaterialslBuffers();
-	SetMaterialsBuffers();
+	CreateMaterials();
 
 	CreateDescriptorSetLayout();
 	CreateUniformBuffers();
@@ -46,20 +54,41 @@ void Renderer::InitVulkan() {
 	mesh1 = new Mesh(CreateRendererInfo(), std::string("models/viking_room.obj"));
 	mesh2 = new Mesh(CreateRendererInfo(), std::string("models/tree.obj"));
 
-	transform1 = vu::Transform(glm::vec3(0.0, 0.0, 0.0));
-	transform2 = vu::Transform(glm::vec3(2.0, 0.0, 0.0));
 	camTransform = vu::Transform(glm::vec3(0.0, 0.0, 0.0));
+	BuildDrawList();
+	CreateObjectBuffers();
+	CreateGpuScene();
+	CreateSoftwareOcclusion();
+	WriteObjectDescriptors();
+
 	CreateCommandBuffers();
+	m_commandRecorder.Initialize(CreateRendererInfo(), framesInFlight, m_jobSystem);
 	CreateSyncObjects();
+	m_framePacer.Initialize(CreateRendererInfo(), framesInFlight);
+	m_pipelineStatistics.Initialize(CreateRendererInfo(), framesInFlight, supportsPipelineStatistics, {"without depth prepass", "with depth prepass"});
+
+	// measure recording time from one thread up
+	if (stressGridSize > 0) {
+		m_commandRecorder.SetThreadCount(1);
+	}
 }
 
 void Renderer::MainLoop() {
 	while (!glfwWindowShouldClose(m_window)) {
+		// frame slot and swap chain image first, everything that depends on input happens after pacing sleep
+		uint32_t imageIndex;
+		if (!PrepareFrame(imageIndex)) {
+			glfwPollEvents();
+			continue;
+		}
+
+		glfwPollEvents();
 		ProcessInput();
 		UpdateTime();
 
-		glfwPollEvents();
-		DrawFrame();
+		m_allocationTracker.BeginFrame();
+		DrawFrame(imageIndex);
+		m_allocationTracker.EndFrame();
 	}
 
 	vkDeviceWaitIdle(m_device);
@@ -70,21 +99,51 @@ void Renderer::Cleanup() {
 
 	vkDestroySampler(m_device, textureSampler, nullptr);
 
+	// everything is still allocated here
+	m_memoryStats.PrintStats();
+	if (!memoryJsonPath.empty()) {
+		m_memoryStats.WriteJson(memoryJsonPath);
+		std::cout << "memory statistics written to " << memoryJsonPath << "\n\n";
+	}
+
+	// last pass must end before moved resources are destroyed
+	m_defragmenter.PrintStats();
+	m_defragmenter.Destroy();
+
 	image1->Destroy(CreateRendererInfo());
 	delete image1;
 
 	image2->Destroy(CreateRendererInfo());
 	delete image2;
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		vmaDestroyBuffer(m_allocator, uniformBuffers[i], uniformAllocations[i]);
+	m_uniformAllocator.PrintStats();
+	m_uniformAllocator.Destroy();
+	m_objectAllocator.Destroy();
+
+	if (gpuDriven) {
+		m_gpuScene.PrintStats();
+		m_gpuScene.Destroy();
+		m_depthPyramid.Destroy();
 	}
 
 	vkDestroyDescriptorPool(m_device, descriptorPool, nullptr);  // destroys descriptor sets as well
 	vkDestroyDescriptorSetLayout(m_device, descriptorSetLayoutGlobal, nullptr);
 	vkDestroyDescriptorSetLayout(m_device, descriptorSetLayoutLocal, nullptr);
 
-	vkDestroyPipeline(m_device, graphicsPipeline, nullptr);
+	m_scene.PrintStats();
+	m_renderQueue.PrintStats();
+	if (!gpuDriven) {
+		std::cout << "frustum culling:\n";
+		std::cout << "\t" << "last frame: " << m_cullingStats.visible << " of " << m_cullingStats.objects << " objects visible, "
+		          << m_cullingStats.candidates << " tested after scene bvh ("
+		          << vu::simdLevelName(vu::getSimdLevel()) << ")\n\n";
+	}
+	if (softwareOcclusion) {
+		m_softwareOcclusion.PrintStats();
+	}
+	m_sceneBvh.PrintStats();
+	m_pipelineCache.PrintStats();
+	m_pipelineCache.Destroy();
 	vkDestroyPipelineLayout(m_device, pipelineLayout, nullptr);
 		
 	destroyShaderModules();
@@ -94,17 +153,33 @@ void Renderer::Cleanup() {
 	delete mesh1;
 	delete mesh2;
 
-	vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+	m_renderGraph.PrintStats();
+	m_renderGraph.Destroy();
+
+	m_frameArenas.PrintStats();
+	m_frameArenas.Destroy();
+	m_allocationTracker.PrintStats();
+
+	m_framePacer.PrintStats();
+	m_framePacer.Destroy();
+	m_pipelineStatistics.PrintStats();
+	m_pipelineStatistics.Destroy();
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	for (uint32_t i = 0; i < framesInFlight; i++) {
 		vkDestroySemaphore(m_device, imageAvailableSemaphores[i], nullptr);
 		vkDestroySemaphore(m_device, renderFinishedSemaphores[i], nullptr);
-		vkDestroyFence(m_device, inFlightFences[i], nullptr);
 	}
+	m_graphicsTimeline.Destroy();
+	m_transferTimeline.Destroy();
 
+	m_commandRecorder.Destroy();
 	vkDestroyCommandPool(m_device, m_graphicsCommandPool, nullptr);  // destroys cammand buffers as well
 	vkDestroyCommandPool(m_device, m_transferCommandPool, nullptr);  // destroys cammand buffers as well
 
+	// gpu is idle, everything still waiting for its frame (including objects released above) goes now
+	m_deletionQueue.PrintStats();
+	m_deletionQueue.Destroy();
+
 	vmaDestroyAllocator(m_allocator);
 
 	vkDestroyDevice(m_device, nullptr);
@@ -117,6 +192,8 @@ void Renderer::Cleanup() {
 	vkDestroyInstance(m_instance, nullptr);
 	glfwDestroyWindow(m_window);
 	glfwTerminate();
+
+	m_jobSystem.Destroy();
 }
 
 void Renderer::ProcessInput() {
@@ -141,6 +218,35 @@ void Renderer::ProcessInput() {
 	if (glfwGetKey(m_window, GLFW_KEY_D) == GLFW_PRESS) {
 		camTransform.SetPosition(camTransform.GetPosition() + camTransform.GetRight() * currentCamSpeed * deltaTime);
 	}
+
+	// toggle depth prepass on key press, depth image changes so transient memory is allocated again
+	bool prepassKey = glfwGetKey(m_window, GLFW_KEY_P) == GLFW_PRESS;
+	if (prepassKey && !prepassKeyDown) {
+		depthPrepass = !depthPrepass;
+		m_allocationTracker.Restart(ALLOCATION_WARMUP_FRAMES);
+		std::cout << "depth prepass " << (depthPrepass ? "on" : "off") << "\n\n";
+	}
+	prepassKeyDown = prepassKey;
+
+	// depth is read after the frame only while occlusion culling is on, it can't stay in tile memory then
+	bool occlusionKey = glfwGetKey(m_window, GLFW_KEY_O) == GLFW_PRESS;
+	if (occlusionKey && !occlusionKeyDown && gpuDriven && m_depthPyramid.IsSupported(msaaSamples)) {
+		occlusionCulling = !occlusionCulling;
+		m_allocationTracker.Restart(ALLOCATION_WARMUP_FRAMES);
+		std::cout << "occlusion culling " << (occlusionCulling ? "on" : "off") << "\n\n";
+	}
+	occlusionKeyDown = occlusionKey;
+
+	bool pickKey = glfwGetKey(m_window, GLFW_KEY_F) == GLFW_PRESS;
+	if (pickKey && !pickKeyDown) {
+		vu::BvhRayHit hit = PickFromCamera();
+		if (hit.item == vu::BVH_NO_ITEM) {
+			std::cout << "picked nothing\n\n";
+		} else {
+			std::cout << "picked draw item " << hit.item << " (entity " << m_drawList[hit.item].entity << ") at " << hit.distance << "\n\n";
+		}
+	}
+	pickKeyDown = pickKey;
 }
 
 void Renderer::SendMouseCallbackToInstance(GLFWwindow* window, double xpos, double ypos) {
@@ -158,8 +264,12 @@ void Renderer::ProcessMouseInput(double xpos, double ypos) {
 	offsetY *= sensitivity;
 	offsetX *= sensitivity;
 
-	camTransform.RotateX(offsetY);
-	camTransform.RotateY(offsetX);
+	camYaw += offsetX;
+	camPitch = std::clamp(camPitch + offsetY, -89.0f, 89.0f);
+
+	// forward is local +X, yaw turns it towards +Z
+	camTransform.SetRotation(glm::angleAxis(glm::radians(-camYaw), glm::vec3(0.0f, 1.0f, 0.0f)) *
+	                         glm::angleAxis(glm::radians(camPitch), glm::vec3(0.0f, 0.0f, 1.0f)));
 }
 
 void Renderer::InitWindow() {
@@ -289,6 +399,9 @@ void Renderer::PickPhysicalDevice() {
 		if (IsDeviceSuitable(m_device)) {
 			m_physicalDevice = m_device;
 			msaaSamples = GetMaxUsableSampleCount();
+			while (requestedMsaaSamples > 0 && msaaSamples > requestedMsaaSamples && msaaSamples > VK_SAMPLE_COUNT_1_BIT) {
+				msaaSamples = static_cast<VkSampleCountFlagBits>(msaaSamples >> 1);
+			}
 			std::cout << "\nMSAA samples count: " << msaaSamples << "\n\n";
 			break;
 		}
@@ -316,22 +429,77 @@ void Renderer::CreateLogicalDevice() {
 	}
 		
 
+	// optional features of gpu driven drawing
+	VkPhysicalDeviceVulkan12Features supported12{};
+	supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceFeatures2 supported{};
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supported.pNext = &supported12;
+	vkGetPhysicalDeviceFeatures2(m_physicalDevice, &supported);
+
+	supportsGpuDriven = supported.features.multiDrawIndirect && supported.features.drawIndirectFirstInstance;
+	supportsDrawIndirectCount = supportsGpuDriven && supported12.drawIndirectCount;
+
+	// decided before anything is sized for one of the paths
+	if (gpuDriven && !supportsGpuDriven) {
+		std::cout << "device can't draw multiple indirect commands with first instance, using cpu draws\n\n";
+		gpuDriven = false;
+	}
+
+	// fragment invocations are counted by a query that stays active while secondary command buffers execute
+	supportsPipelineStatistics = supported.features.pipelineStatisticsQuery && supported.features.inheritedQueries;
+
+	// optional extensions, vma reads heap usage and budget from driver with memory budget
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+	supportsMemoryBudget = false;
+	for (const VkExtensionProperties &extension : availableExtensions) {
+		if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+			supportsMemoryBudget = true;
+		}
+	}
+
+	std::vector<const char*> extensions = deviceExtensions;
+	if (supportsMemoryBudget) {
+		extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+
 	VkPhysicalDeviceFeatures deviceFeatures = VkPhysicalDeviceFeatures();
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.sampleRateShading = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = supportsGpuDriven ? VK_TRUE : VK_FALSE;
+	deviceFeatures.drawIndirectFirstInstance = supportsGpuDriven ? VK_TRUE : VK_FALSE;
+	deviceFeatures.pipelineStatisticsQuery = supportsPipelineStatistics ? VK_TRUE : VK_FALSE;
+	deviceFeatures.inheritedQueries = supportsPipelineStatistics ? VK_TRUE : VK_FALSE;
+
+	// frame pacing and uploads are tracked with timeline semaphores
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.timelineSemaphore = VK_TRUE;
+	features12.drawIndirectCount = supportsDrawIndirectCount ? VK_TRUE : VK_FALSE;
+
+	// render graph begins rendering without render pass objects
+	VkPhysicalDeviceVulkan13Features features13{};
+	features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	features13.pNext = &features12;
+	features13.dynamicRendering = VK_TRUE;
 
 	// === Main info ===
 	VkDeviceCreateInfo createInfo = VkDeviceCreateInfo();
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &features13;
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());;
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	std::cout << "required logical m_device extensions:\n";
-	for (int i = 0; i < deviceExtensions.size(); i++) {
-		std::cout << '\t' << deviceExtensions[i] << "\n";
+	for (int i = 0; i < extensions.size(); i++) {
+		std::cout << '\t' << extensions[i] << "\n";
 	}
 	std::cout << "\n";
 
@@ -358,6 +526,16 @@ bool Renderer::IsDeviceSuitable(VkPhysicalDevice m_device) {
 	VkPhysicalDeviceFeatures deviceFeatures;
 	vkGetPhysicalDeviceFeatures(m_device, &deviceFeatures);
 
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceVulkan13Features features13{};
+	features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	features13.pNext = &features12;
+	VkPhysicalDeviceFeatures2 features2{};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &features13;
+	vkGetPhysicalDeviceFeatures2(m_device, &features2);
+
 	vu::QueueFamilyIndices indices = vu::findQueueFamilies(m_device, m_surface);
 	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_device);
 
@@ -365,7 +543,7 @@ bool Renderer::IsDeviceSuitable(VkPhysicalDevice m_device) {
 	bool deviceExtensionSupported = CheckDeviceExtensionSupport(m_device);
 	bool deviceSupportsSwapChain = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
 
-	bool suitable = deviceSupporstNeededQueues && deviceExtensionSupported && deviceSupportsSwapChain && deviceFeatures.samplerAnisotropy;
+	bool suitable = deviceSupporstNeededQueues && deviceExtensionSupported && deviceSupportsSwapChain && deviceFeatures.samplerAnisotropy && features13.dynamicRendering && features12.timelineSemaphore;
 
 	std::cout << "\nphysical m_device " << deviceProperties.deviceName << " is " << (suitable ? "suitable" : "NOT suitable") << "\n\n";
 
@@ -400,8 +578,11 @@ void Renderer::CreateMemoryAllocator() {
 	createInfo.physicalDevice = m_physicalDevice;
 	createInfo.device = m_device;
 	createInfo.vulkanApiVersion = VK_API_VERSION_1_3;
+	createInfo.flags = supportsMemoryBudget ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0;
 
-	vmaCreateAllocator(&createInfo, &m_allocator);
+	if (vmaCreateAllocator(&createInfo, &m_allocator) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create memory allocator!");
+	}
 }
 
 // This function returns swap chain settings that are supported by physical m_device and m_surface
@@ -429,7 +610,7 @@ SwapChainSupportDetails Renderer::QuerySwapChainSupport(VkPhysicalDevice m_devic
 	return details;
 }
 
-void Renderer::CreateSwapChain() {
+void Renderer::CreateSwapChain(VkSwapchainKHR oldSwapChain) {
 	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_physicalDevice);
 
 	VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -475,7 +656,8 @@ void Renderer::CreateSwapChain() {
 	// enable clipping with other windows in system
 	createInfo.clipped = VK_TRUE;
 
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// images of old swap chain that are not acquired yet can be handed over, presents to it still complete
+	createInfo.oldSwapchain = oldSwapChain;
 
 	if (vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapChain) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create swap chain!");
@@ -501,16 +683,25 @@ VkSurfaceFormatKHR Renderer::ChooseSwapSurfaceFormat(std::vector<VkSurfaceFormat
 	return availableFormats[0];
 }
 
-// choose best present mode among formats that are supported by physical devise and m_surface
+static const char *presentModeName(VkPresentModeKHR presentMode) {
+	switch (presentMode) {
+		case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "immediate";
+		case VK_PRESENT_MODE_MAILBOX_KHR:      return "mailbox";
+		case VK_PRESENT_MODE_FIFO_KHR:         return "fifo";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+		default:                               return "unknown";
+	}
+}
+
+// use requested present mode if surface supports it, FIFO is the only mode every surface has
 VkPresentModeKHR Renderer::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
 	for (const auto& availablePresentMode : availablePresentModes) {
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+		if (availablePresentMode == preferredPresentMode) {
 			return availablePresentMode;
 		}
 	}
-	std::cout << "unable to find needed present mode, swap chain will use regular queue\n\n";
-	//return VK_PRESENT_MODE_FIFO_KHR;    // vsync ON
-	return VK_PRESENT_MODE_IMMEDIATE_KHR; // vsync OFF
+	std::cout << "present mode " << presentModeName(preferredPresentMode) << " is not supported, swap chain will use fifo (vsync)\n\n";
+	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
 // setup swap chain images resolution
@@ -542,7 +733,6 @@ RendererInfo Renderer::CreateRendererInfo() {
 	rendererInfo.swapChainImageFormat - m_swapChainImageFormat;
 	rendererInfo.swapChainExtent = m_swapChainExtent;
 	rendererInfo.surface = m_surface;
-	rendererInfo.renderPass = m_renderPass;
 	rendererInfo.allocator = m_allocator;
 	rendererInfo.debugMessenger = m_debugMessenger;
 	rendererInfo.graphicsCommandPool = m_graphicsCommandPool;
@@ -550,6 +740,10 @@ RendererInfo Renderer::CreateRendererInfo() {
 	rendererInfo.graphicsQueue = m_graphicsQueue;
 	rendererInfo.presentQueue = m_presentQueue;
 	rendererInfo.transferQueue = m_transferQueue;
+	rendererInfo.graphicsTimeline = &m_graphicsTimeline;
+	rendererInfo.transferTimeline = &m_transferTimeline;
+	rendererInfo.defragmenter = &m_defragmenter;
+	rendererInfo.deletionQueue = &m_deletionQueue;
 	return rendererInfo;
 }
 
@@ -634,12 +828,20 @@ void Renderer::CreateDescriptorSetLayout() {
 	// view + projection matrix
 	VkDescriptorSetLayoutBinding uboLayoutBinding{};
 	uboLayoutBinding.binding = 0;
-	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBinding.descriptorCount = 1;
 	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
 
-	std::array<VkDescriptorSetLayoutBinding, 1> bindingsGlobal = {uboLayoutBinding};
+	// per object data (model, normal and previous model matrices)
+	VkDescriptorSetLayoutBinding objectLayoutBinding{};
+	objectLayoutBinding.binding = 1;
+	objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectLayoutBinding.descriptorCount = 1;
+	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	objectLayoutBinding.pImmutableSamplers = nullptr;
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindingsGlobal = {uboLayoutBinding, objectLayoutBinding};
 	VkDescriptorSetLayoutCreateInfo layoutInfoGlobal{};
 	layoutInfoGlobal.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfoGlobal.bindingCount = static_cast<uint32_t>(bindingsGlobal.size());
@@ -654,7 +856,7 @@ void Renderer::CreateDescriptorSetLayout() {
 	// material specific bindings
 	VkDescriptorSetLayoutBinding uboLayoutBindingLocal{};
 	uboLayoutBindingLocal.binding = 0;
-	uboLayoutBindingLocal.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	uboLayoutBindingLocal.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	uboLayoutBindingLocal.descriptorCount = 1;
 	uboLayoutBindingLocal.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	uboLayoutBindingLocal.pImmutableSamplers = nullptr;
@@ -693,117 +895,6 @@ void Renderer::FramebufferResizeCallback(GLFWwindow *window, int width, int heig
 	app->framebufferResized = true;
 }
 
-void Renderer::CreateRenderPass() {
-	// create attachments
-
-	// multisampled color attachment to enable msaa
-	// this attachiment cant be presented
-	VkAttachmentDescription colorAttachment{};
-	colorAttachment.format = m_swapChainImageFormat;
-	colorAttachment.samples = msaaSamples;  // for multisampling
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;  // color and depth
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;  // color and depth
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;  // stencil
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // stencil
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	// depth attachment
-	VkAttachmentDescription depthAttachment{};
-	depthAttachment.format = vu::findDepthFormat(m_physicalDevice);
-	depthAttachment.samples = msaaSamples;  // for multisampling
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;  // color and depth
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // color and depth
-	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;  // stencil
-	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // stencil
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	// color attachment that will be presented
-	// multisampled image will be resolved to this regular image
-	VkAttachmentDescription colorAttachmentResolve{};
-	colorAttachmentResolve.format = m_swapChainImageFormat;
-	colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;  // for multisampling
-	colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;  // color and depth
-	colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;  // color and depth
-	colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;  // stencil
-	colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // stencil
-	colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	// create attachments
-	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	VkAttachmentReference depthAttachmentRef{};
-	depthAttachmentRef.attachment = 1;
-	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	VkAttachmentReference colorAttachmentResolveRef{};
-	colorAttachmentResolveRef.attachment = 2;
-	colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	// create subpass
-	VkSubpassDescription subpass{};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;  // not compute subpass
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
-	subpass.pDepthStencilAttachment = &depthAttachmentRef;
-	subpass.pResolveAttachments = &colorAttachmentResolveRef;
-
-	// we need subpass dependencies to synchronize subpasses
-	// this subpass dependencie tells that we need to wait for previous render pass
-	// (wait for all of the subpasses within all of the render passes before this one)
-	VkSubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;  // index of subpass that we are dependent on
-	dependency.dstSubpass = 0;                    // index of current subpass
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;  // wait untill these stages are finished
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;  // stages that are NOT allowed to execute before srcStageMask stage is finished
-	dependency.srcAccessMask = 0;  // what types of memory access src subpass uses
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;;  // what types we will be using in current subpass
-
-	// create render pass
-	std::array< VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve};
-	VkRenderPassCreateInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-	renderPassInfo.pAttachments = attachments.data();
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
-
-	if (vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_renderPass) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create render pass!");
-	}
-}
-
-void Renderer::CreateFrameBuffers() {
-	swapChainFramebuffers.resize(swapChainImageViews.size());
-
-	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-		std::array<VkImageView, 3> attachments = {
-			colorImageView,
-			depthImageView,
-			swapChainImageViews[i]
-		};
-
-		VkFramebufferCreateInfo framebufferInfo{};
-		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferInfo.renderPass = m_renderPass;
-		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-		framebufferInfo.pAttachments = attachments.data();
-		framebufferInfo.width = m_swapChainExtent.width;
-		framebufferInfo.height = m_swapChainExtent.height;
-		framebufferInfo.layers = 1;
-
-		if (vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create framebuffer!");
-		}
-	}
-}
-
 void Renderer::CreateCommandPool() {
 	vu::QueueFamilyIndices queueFamilyIndices = vu::findQueueFamilies(m_physicalDevice, m_surface);
 
@@ -827,7 +918,7 @@ void Renderer::CreateCommandPool() {
 }
 
 void Renderer::CreateCommandBuffers() {
-	graphicsCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	graphicsCommandBuffers.resize(framesInFlight);
 
 	VkCommandBufferAllocateInfo graphicsAllocInfo{};
 	graphicsAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -840,7 +931,7 @@ void Renderer::CreateCommandBuffers() {
 	}
 
 
-	transferCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	transferCommandBuffers.resize(framesInFlight);
 
 	VkCommandBufferAllocateInfo transferAllocInfo{};
 	transferAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -854,6 +945,16 @@ void Renderer::CreateCommandBuffers() {
 }
 
 void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	// pipelines compiled by jobs since last frame become visible here
+	m_pipelineCache.BeginFrame();
+
+	// secondary command buffers of this frame are not used by gpu anymore (frame value was waited)
+	m_commandRecorder.BeginFrame(currentFrame);
+
+	// bind pipelines (fallback until compile job finishes the real one)
+	// resolved once here, recording threads only read them
+	opaquePipeline = m_pipelineCache.Resolve(depthPrepass ? opaqueEqualPipelineDesc : opaquePipelineDesc, fallbackPipeline);
+	transparentPipeline = m_pipelineCache.Resolve(transparentPipelineDesc, fallbackPipeline);
 
 	// begin recording
 	VkCommandBufferBeginInfo beginInfo{};
@@ -864,25 +965,100 @@ void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
 	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
 		throw std::runtime_error("failed to begin recording command buffer!");
 	}
+	m_framePacer.WriteBeginTimestamp(commandBuffer);
+
+	// declare frame
+	m_renderGraph.Reset(m_frameArenas.Get());
+
+	RGImageDesc backbufferDesc{};
+	backbufferDesc.format = m_swapChainImageFormat;
+	backbufferDesc.extent = m_swapChainExtent;
+	RGResource backbuffer = m_renderGraph.ImportImage("backbuffer", swapChainImages[imageIndex], swapChainImageViews[imageIndex], backbufferDesc,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+	// multisampled color can't be presented, it is resolved into backbuffer at the end of the pass
+	RGResource color = backbuffer;
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		RGImageDesc colorDesc = backbufferDesc;
+		colorDesc.samples = msaaSamples;
+		color = m_renderGraph.CreateImage("msaa color", colorDesc);
+	}
+
+	RGImageDesc depthDesc{};
+	depthDesc.format = m_depthFormat;
+	depthDesc.extent = m_swapChainExtent;
+	depthDesc.samples = msaaSamples;
+	RGResource depth = m_renderGraph.CreateImage("depth", depthDesc);
+
+	// objects are culled and draws written on gpu, main pass only reads them
+	// pyramid is prepared even without occlusion culling, culling set always points to a valid image
+	if (gpuDriven) {
+		m_renderGraph.AddComputePass("cull", [this](VkCommandBuffer commandBuffer) {
+				m_depthPyramid.Prepare(commandBuffer, m_swapChainExtent);
+				m_gpuScene.Cull(commandBuffer, viewProj, camTransform.GetPosition(), m_depthPyramid, occlusionCulling);
+			})
+			.SideEffects();
+	}
+
+	// depth of opaque draws first, opaque pass then shades only fragments that end up visible
+	if (depthPrepass) {
+		m_renderGraph.AddGraphicsPass("depth prepass", [this](VkCommandBuffer commandBuffer) { RecordDepthPrepass(commandBuffer); })
+			.Depth(depth, VK_ATTACHMENT_LOAD_OP_CLEAR, 1.0f);
+	}
+
+	// multisampled color is resolved by the last pass that draws into it
+	bool hasTransparent = m_opaqueBatchCount < m_batches.size();
+	RGResource resolveTarget = color != backbuffer ? backbuffer : RG_NONE;
+
+	// opaque draws are split between recording threads
+	// depth stays writable after prepass, only fallback pipeline writes it (real one tests EQUAL without writes)
+	m_renderGraph.AddGraphicsPass("opaque", [this](VkCommandBuffer commandBuffer) {
+			m_commandRecorder.Record(commandBuffer, GetMainInheritance(), m_opaqueBatchCount,
+				[this](VkCommandBuffer secondary, uint32_t first, uint32_t count) { RecordDraws(secondary, first, count); });
+		})
+		.Color(color, VK_ATTACHMENT_LOAD_OP_CLEAR, {{0.17f, 0.12f, 0.19f, 1.0f}}, hasTransparent ? RG_NONE : resolveTarget)
+		.Depth(depth, depthPrepass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR, 1.0f)
+		.SecondaryCommandBuffers();
+
+	// blending is limited to this pass, declared only when there is something to blend
+	if (hasTransparent) {
+		m_renderGraph.AddGraphicsPass("transparent", [this](VkCommandBuffer commandBuffer) {
+				m_commandRecorder.Record(commandBuffer, GetMainInheritance(), static_cast<uint32_t>(m_batches.size()) - m_opaqueBatchCount,
+					[this](VkCommandBuffer secondary, uint32_t first, uint32_t count) { RecordDraws(secondary, m_opaqueBatchCount + first, count); });
+			})
+			.Color(color, VK_ATTACHMENT_LOAD_OP_LOAD, {}, resolveTarget)
+			.Depth(depth, VK_ATTACHMENT_LOAD_OP_LOAD, 1.0f)
+			.SecondaryCommandBuffers();
+	}
+
+	// final depth of this frame is reduced for culling of next frame
+	if (gpuDriven && occlusionCulling) {
+		m_renderGraph.AddComputePass("depth pyramid", [this, depth](VkCommandBuffer commandBuffer) {
+				m_depthPyramid.Build(commandBuffer, m_renderGraph.GetImageView(depth), msaaSamples, viewProj);
+			})
+			.Read(depth, RGUsage::SampledCompute)
+			.SideEffects();
+	}
+
+	// barriers, render passes and transient memory come from declarations above
+	m_renderGraph.Compile();
+	m_pipelineStatistics.BeginQuery(commandBuffer, depthPrepass ? 1 : 0);
+	m_renderGraph.Execute(commandBuffer);
+	m_pipelineStatistics.EndQuery(commandBuffer);
+
+	m_framePacer.WriteEndTimestamp(commandBuffer);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
 
-	// start render pass
-	std::array<VkClearValue, 3> clearValues{};  // same as attachments order
-	clearValues[0].color = {{0.17f, 0.12f, 0.19f, 1.0f}};  // resolve image color
-	clearValues[1].depthStencil = {1.0f, 0};
-	clearValues[2].color = {{0.0f, 0.0f, 0.0f, 1.0f}};  // multisampled image
-
-	VkRenderPassBeginInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = m_renderPass;
-	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-	renderPassInfo.renderArea.offset = {0, 0};
-	renderPassInfo.renderArea.extent = m_swapChainExtent;
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
-
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	if (stressGridSize > 0) {
+		LogRecordTiming();
+	}
+}
 
-	// update viewport
+// records part of draw list, called on recording threads
+void Renderer::RecordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count) {
+	// secondary command buffers inherit only attachments, so every one sets its own state
 	VkViewport viewport{};
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
@@ -892,174 +1068,425 @@ void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t image
 	viewport.maxDepth = 1.0f;
 	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-	// update scissor rect
 	VkRect2D scissor{};
 	scissor.offset = {0, 0};
 	scissor.extent = m_swapChainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	// bind pipeline
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
 	SetGlobalPushConstants(commandBuffer);
 
-	// bind global descriptors
-	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSetsGlobal.data()[currentFrame], 0, nullptr);
+	// bind global descriptors, uniform data and object data of this frame start at dynamic offsets
+	// objects of all batches are one array, batches select their part with first instance
+	std::array<uint32_t, 2> globalOffsets = {globalUniformOffset, gpuDriven ? 0 : objectOffset};
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSetsGlobal.data()[currentFrame],
+		static_cast<uint32_t>(globalOffsets.size()), globalOffsets.data());
+
+	// batches are sorted by state, so only changes are bound
+	VkPipeline          boundPipeline = VK_NULL_HANDLE;
+	const vu::Material *boundMaterial = nullptr;
+	const vu::Mesh     *boundMesh = nullptr;
+	uint32_t pipelineBinds = 0;
+	uint32_t descriptorBinds = 0;
+	uint32_t vertexBinds = 0;
+
+	for (uint32_t i = first; i < first + count; i++) {
+		const DrawBatch &batch = m_batches[i];
+
+		VkPipeline pipeline = batch.material->transparent ? transparentPipeline : opaquePipeline;
+		if (pipeline != boundPipeline) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+			pipelineBinds++;
+		}
 
-		// bind material 1 descriptors
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &descriptorSetsMat1.data()[currentFrame], 0, nullptr);
+		if (batch.material != boundMaterial) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &batch.material->sets[currentFrame], 1, &batch.material->uniformOffset);
+			boundMaterial = batch.material;
+			descriptorBinds++;
+		}
 
-			// bind model matrix constants and render
-			transform1.BindModelMatrix(commandBuffer, pipelineLayout);
-			mesh1->BindAndRender(commandBuffer);
+		if (batch.mesh != boundMesh) {
+			batch.mesh->Bind(commandBuffer);
+			boundMesh = batch.mesh;
+			vertexBinds++;
+		}
 
+		if (gpuDriven) {
+			m_gpuScene.DrawBatch(commandBuffer, i);
+		} else {
+			batch.mesh->Render(commandBuffer, batch.instanceCount, batch.firstInstance);
+		}
+	}
 
-		// bind material 2 descriptors
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &descriptorSetsMat2.data()[currentFrame], 0, nullptr);
-			
-			// bind model matrix constants and render
-			transform2.BindModelMatrix(commandBuffer, pipelineLayout);
-			mesh2->BindAndRender(commandBuffer);
+	m_renderQueue.CountStateChanges(count, pipelineBinds, descriptorBinds, vertexBinds);
+}
 
-	// end render pass
-	vkCmdEndRenderPass(commandBuffer);
+// attachments of opaque and transparent passes
+vu::SecondaryInheritance Renderer::GetMainInheritance() const {
+	SecondaryInheritance inheritance{};
+	inheritance.colorFormat = m_swapChainImageFormat;
+	inheritance.depthFormat = m_depthFormat;
+	inheritance.samples = msaaSamples;
+	inheritance.pipelineStatistics = m_pipelineStatistics.GetInheritedStatistics();
+	return inheritance;
+}
 
-	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("failed to record command buffer!");
+// depth of opaque batches, recorded inline (one pipeline, no materials, only vertex binds change)
+void Renderer::RecordDepthPrepass(VkCommandBuffer commandBuffer) {
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrepassPipeline);
+
+	std::array<uint32_t, 2> globalOffsets = {globalUniformOffset, gpuDriven ? 0 : objectOffset};
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSetsGlobal.data()[currentFrame],
+		static_cast<uint32_t>(globalOffsets.size()), globalOffsets.data());
+
+	const vu::Mesh *boundMesh = nullptr;
+	for (uint32_t i = 0; i < m_opaqueBatchCount; i++) {
+		const DrawBatch &batch = m_batches[i];
+
+		if (batch.mesh != boundMesh) {
+			batch.mesh->BindPositions(commandBuffer);
+			boundMesh = batch.mesh;
+		}
+
+		if (gpuDriven) {
+			m_gpuScene.DrawBatch(commandBuffer, i);
+		} else {
+			batch.mesh->Render(commandBuffer, batch.instanceCount, batch.firstInstance);
+		}
 	}
 }
 
-void Renderer::CreateGraphicsPipeline() {
+void Renderer::BuildDrawList() {
+	m_scene.Reserve(3 + stressGridSize * stressGridSize);
+	entity1 = m_scene.CreateEntity(glm::vec3(0.0f, 0.0f, 0.0f));
+	entity2 = m_scene.CreateEntity(glm::vec3(2.0f, 0.0f, 0.0f));
+
+	m_drawList.clear();
+	m_drawList.push_back({mesh1, entity1, &material1, true});
+	m_drawList.back().occluder = true;  // big enough to hide trees behind it
+	m_drawList.push_back({mesh2, entity2, &material2});
+
+	// stress test grid of trees behind the scene, moving the root moves the whole grid
+	stressRoot = m_scene.CreateEntity(glm::vec3(-static_cast<float>(stressGridSize), 0.0f, -4.0f));
+	for (uint32_t x = 0; x < stressGridSize; x++) {
+		for (uint32_t z = 0; z < stressGridSize; z++) {
+			vu::Entity entity = m_scene.CreateEntity(glm::vec3(x * 2.0f, 0.0f, -(z * 2.0f)), stressRoot);
+			m_drawList.push_back({mesh2, entity, (x * stressGridSize + z) % 2 == 0 ? &material1 : &material2});
+		}
+	}
 
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main";
+	// world matrices are needed by first upload of gpu scene
+	m_scene.Update();
 
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
+	// small mesh ids for sort keys, in order of first use
+	std::unordered_map<const vu::Mesh *, uint32_t> meshIds;
+	for (DrawItem &item : m_drawList) {
+		item.meshId = meshIds.try_emplace(item.mesh, static_cast<uint32_t>(meshIds.size())).first->second;
+	}
 
-	VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+	BuildBatches();
+}
 
-	// these values can be changed at runtime without recreating pipeline
-	std::vector<VkDynamicState> dynamicStates = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR
-	};
+// sorts draw list by state and view depth, neighbours with equal state become one instanced draw
+// transparent draws keep back to front order, so only draws next to each other in that order are merged
+void Renderer::BuildRenderQueue() {
+	m_renderQueue.Clear(m_frameArenas.Get());
+	if (gpuDriven) {
+		return;  // batches of gpu scene are fixed, queue only counts binds
+	}
 
-	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
-	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-	dynamicStateCreateInfo.pDynamicStates = dynamicStates.data();
-
-	// vertex input
-	VkVertexInputBindingDescription bindingDescription = vu::Vertex::getBindingDescription();
-	std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = vu::Vertex::getAttributeDescriptions();
-
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-	vertexInputInfo.vertexAttributeDescriptionCount = attributeDescriptions.size();
-	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-	// what type of geometry will be drawn
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	// region of framebuffer to render to
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)m_swapChainExtent.width;
-	viewport.height = (float)m_swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+	glm::vec3 cameraPos = camTransform.GetPosition();
+	glm::vec3 cameraForward = camTransform.GetForward();
 
-	// discard pixels outside this area
-	VkRect2D scissor{};
-	scissor.offset = {0, 0};
-	scissor.extent = m_swapChainExtent;
+	for (uint32_t i = 0; i < m_drawList.size(); i++) {
+		const DrawItem &item = m_drawList[i];
+		if (!m_visible[i] || (softwareOcclusion && m_occluded[i])) {
+			continue;
+		}
 
-	// create viewport using viewport and scissor rect from earlier
-	// creating multiple require feature in logical m_device
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	// setup resterizer
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;                // clamp instead of discarding fragments when depth testing (need gpu feature)
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;                // disable output to future stages 
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;    // can be lines or points (require gpu feature)
-	rasterizer.lineWidth = 1.0f;                    // more that one - need wideLines gpu feature
-	rasterizer.cullMode = VK_CULL_MODE_FRONT_BIT;  // culling
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE; // triangle front direction
-	rasterizer.depthBiasEnable = VK_FALSE;                // bias for shadow mapping
-	rasterizer.depthBiasConstantFactor = 0.0f;                    // optional
-	rasterizer.depthBiasClamp = 0.0f;                    // optional
-	rasterizer.depthBiasSlopeFactor = 0.0f;                    // optional
-
-	// multisampling
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_TRUE;
-	multisampling.minSampleShading = 0.2f;
-	multisampling.rasterizationSamples = msaaSamples;
-
-	// color blending (now its alpha blending) per framebuffer
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_TRUE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-	/*
-	if (blendEnable) {
-		finalColor.rgb = (srcColorBlendFactor * newColor.rgb) <colorBlendOp> (dstColorBlendFactor * oldColor.rgb);
-		finalColor.a   = (srcAlphaBlendFactor * newColor.a)   <alphaBlendOp> (dstAlphaBlendFactor * oldColor.a);
-	} else {
-		finalColor = newColor;
-	}
-
-	finalColor = finalColor & colorWriteMask;
-	*/
-
-	// color blending global
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;         // set gloabl logical operation for blending (disables local attachments)
-	colorBlending.logicOp = VK_LOGIC_OP_COPY; // logical operation here
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f; // Optional
-	colorBlending.blendConstants[1] = 0.0f; // Optional
-	colorBlending.blendConstants[2] = 0.0f; // Optional
-	colorBlending.blendConstants[3] = 0.0f; // Optional
-
-	// push constants
-	std::array<VkPushConstantRange, 2> pushConstants{};
-	pushConstants[0].offset = 0;
-	pushConstants[0].size = 64;
-	pushConstants[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		DrawLayer layer = item.material->transparent ? DrawLayer::Transparent : DrawLayer::Opaque;
+		float depth = glm::dot(m_scene.GetWorldPosition(item.entity) - cameraPos, cameraForward);
+		uint32_t pipeline = static_cast<uint32_t>(layer);  // one pipeline per layer
+
+		m_renderQueue.Push(RenderQueue::MakeKey(layer, pipeline, item.material->id, item.meshId, depth), i);
+	}
+	m_renderQueue.Sort();
+
+	m_batches.clear();
+	m_instanceItems.clear();
+
+	uint64_t batchState = 0;
+	for (const RenderQueue::Entry &entry : m_renderQueue.GetEntries()) {
+		const DrawItem &item = m_drawList[entry.item];
+
+		uint64_t state = RenderQueue::GetStateBits(entry.key);
+		if (m_batches.empty() || state != batchState) {
+			m_batches.push_back({item.mesh, item.material, static_cast<uint32_t>(m_instanceItems.size()), 0});
+			batchState = state;
+		}
+
+		m_batches.back().instanceCount++;
+		m_instanceItems.push_back(entry.item);
+	}
+
+	// opaque layer is sorted first
+	m_opaqueBatchCount = 0;
+	while (m_opaqueBatchCount < m_batches.size() && !m_batches[m_opaqueBatchCount].material->transparent) {
+		m_opaqueBatchCount++;
+	}
+}
+
+// scene bvh against camera of current frame, then bounding spheres of items it found, only visible items reach the render queue
+void Renderer::CullFrustum() {
+	if (gpuDriven) {
+		sceneBvhStale = true;  // refitted only when picking or queries ask for it
+		return;
+	}
+
+	uint32_t count = static_cast<uint32_t>(m_drawList.size());
+	UpdateSceneBvh(!sceneBvhStale);
+	vu::extractFrustumPlanes(viewProj, m_frustumPlanes);
+
+	// whole subtrees outside frustum are skipped, only boxes reaching into it are candidates
+	m_frustumCandidates.clear();
+	m_sceneBvh.QueryFrustum(m_frustumPlanes, m_frustumCandidates);
+
+	uint32_t candidateCount = static_cast<uint32_t>(m_frustumCandidates.size());
+	m_sphereX.resize(candidateCount);
+	m_sphereY.resize(candidateCount);
+	m_sphereZ.resize(candidateCount);
+	m_sphereRadius.resize(candidateCount);
+	m_candidateVisible.resize(candidateCount);
+	m_visible.assign(count, 0);
+	m_visibleCount = 0;
+
+	// every range transforms its spheres and culls them right away, while they are in cache
+	// spheres still reject boxes that only touch frustum near its corners
+	m_jobSystem.ParallelFor(candidateCount, 0, [this](uint32_t first, uint32_t rangeCount) {
+		for (uint32_t i = first; i < first + rangeCount; i++) {
+			const DrawItem &item = m_drawList[m_frustumCandidates[i]];
+			const glm::mat4 &model = m_scene.GetWorldMatrix(item.entity);
+			glm::vec4 sphere = item.mesh->GetBoundingSphere();
+
+			// scaled by largest axis so it still contains the mesh
+			glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(sphere), 1.0f));
+			float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+			m_sphereX[i] = center.x;
+			m_sphereY[i] = center.y;
+			m_sphereZ[i] = center.z;
+			m_sphereRadius[i] = sphere.w * scale;
+		}
+
+		vu::SphereStreams spheres{m_sphereX.data() + first, m_sphereY.data() + first, m_sphereZ.data() + first, m_sphereRadius.data() + first, rangeCount};
+		m_visibleCount += vu::cullSpheres(m_frustumPlanes, spheres, m_candidateVisible.data() + first);
+		for (uint32_t i = first; i < first + rangeCount; i++) {
+			m_visible[m_frustumCandidates[i]] = m_candidateVisible[i];
+		}
+	});
+
+	m_cullingStats.objects = count;
+	m_cullingStats.candidates = candidateCount;
+	m_cullingStats.visible = m_visibleCount;
+}
+
+// changedOnly - refitted last frame, only items whose world matrix changed in this one are visited
+// otherwise boxes of all items are compared, moved ones refit the bvh
+// it's built again when draw list changes or refits made it much worse
+void Renderer::UpdateSceneBvh(bool changedOnly) {
+	uint32_t count = static_cast<uint32_t>(m_drawList.size());
+	bool rebuild = m_sceneBvh.GetItemCount() != count;
+	m_itemBounds.resize(count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		const DrawItem &item = m_drawList[i];
+		if (!rebuild && changedOnly && !m_scene.WorldChanged(item.entity)) {
+			continue;
+		}
+
+		vu::Aabb bounds = vu::transformBounds({item.mesh->GetBoundsMin(), item.mesh->GetBoundsMax()}, m_scene.GetWorldMatrix(item.entity));
+		if (!rebuild && !(bounds == m_itemBounds[i])) {
+			m_sceneBvh.Update(i, bounds);
+		}
+		m_itemBounds[i] = bounds;
+	}
+
+	// cost walks the whole tree, so it's checked only after a good part of it was refitted
+	if (!rebuild && m_sceneBvh.GetStats().refitNodes >= bvhCheckRefits) {
+		bvhCheckRefits = m_sceneBvh.GetStats().refitNodes + m_sceneBvh.GetStats().nodes / 8 + 1;
+		rebuild = m_sceneBvh.NeedsRebuild();
+	}
+	if (rebuild) {
+		m_sceneBvh.Build(m_itemBounds.data(), count);
+		bvhCheckRefits = m_sceneBvh.GetStats().nodes / 8 + 1;
+	}
+	sceneBvhStale = false;
+}
+
+const vu::Bvh &Renderer::GetSceneBvh() {
+	if (sceneBvhStale) {
+		UpdateSceneBvh(false);
+	}
+	return m_sceneBvh;
+}
 
-	pushConstants[1].offset = 64;
-	pushConstants[1].size = 64;
-	pushConstants[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+vu::BvhRayHit Renderer::PickFromCamera() {
+	return GetSceneBvh().Raycast(camTransform.GetPosition(), camTransform.GetForward());
+}
+
+void Renderer::CreateSoftwareOcclusion() {
+	if (softwareOcclusion && gpuDriven) {
+		std::cout << "gpu driven path culls on gpu, software occlusion is off\n\n";
+		softwareOcclusion = false;
+	}
+	if (!softwareOcclusion) {
+		return;
+	}
+
+	m_softwareOcclusion.Initialize(&m_jobSystem);
+
+	// every occluder mesh is copied once, only positions are needed
+	for (const DrawItem &item : m_drawList) {
+		if (!item.occluder || m_occluderMeshes.count(item.mesh) > 0) {
+			continue;
+		}
+
+		std::vector<glm::vec3> positions(item.mesh->GetVertexCount());
+		for (uint32_t i = 0; i < positions.size(); i++) {
+			positions[i] = item.mesh->GetVertices()[i].pos;
+		}
+		std::vector<uint32_t> indices(item.mesh->GetIndices(), item.mesh->GetIndices() + item.mesh->GetIndexCount());
+
+		m_occluderMeshes[item.mesh] = m_softwareOcclusion.AddMesh(positions, indices);
+	}
+
+	m_occlusionQueries.resize(m_drawList.size());
+	m_occluded.assign(m_drawList.size(), 0);
+}
+
+// occluders of current frame are rasterized with camera of current frame, then every other object is tested
+void Renderer::CullOccluded() {
+	if (!softwareOcclusion) {
+		return;
+	}
+
+	m_occluderInstances.clear();
+	for (uint32_t i = 0; i < m_drawList.size(); i++) {
+		const DrawItem &item = m_drawList[i];
+		if (item.occluder) {
+			m_occluderInstances.push_back({m_occluderMeshes[item.mesh], m_scene.GetWorldMatrix(item.entity)});
+		}
+
+		// occluder can't hide itself, its box is never behind its own surface
+		OcclusionQuery &query = m_occlusionQueries[i];
+		query.boundsMin = item.mesh->GetBoundsMin();
+		query.boundsMax = item.mesh->GetBoundsMax();
+		query.model = m_scene.GetWorldMatrix(item.entity);
+	}
+
+	m_softwareOcclusion.Render(viewProj, m_occluderInstances);
+	m_softwareOcclusion.Test(m_occlusionQueries.data(), static_cast<uint32_t>(m_occlusionQueries.size()), m_occluded.data());
+}
+
+void Renderer::BuildBatches() {
+	// batches keep order in which their first item appears in draw list, opaque batches before transparent ones
+	std::map<std::pair<const vu::Mesh *, const vu::Material *>, uint32_t> batchIndices;
+	std::vector<std::vector<uint32_t>> batchItems;
+
+	m_batches.clear();
+	for (bool transparent : {false, true}) {
+		for (uint32_t i = 0; i < m_drawList.size(); i++) {
+			const DrawItem &item = m_drawList[i];
+			if (item.material->transparent != transparent) {
+				continue;
+			}
+
+			auto [it, inserted] = batchIndices.try_emplace({item.mesh, item.material}, static_cast<uint32_t>(m_batches.size()));
+			if (inserted) {
+				m_batches.push_back({item.mesh, item.material, 0, 0});
+				batchItems.emplace_back();
+			}
+			batchItems[it->second].push_back(i);
+		}
+
+		if (!transparent) {
+			m_opaqueBatchCount = static_cast<uint32_t>(m_batches.size());
+		}
+	}
+
+	// instances of one batch are next to each other in instance data
+	m_instanceItems.clear();
+	for (uint32_t i = 0; i < m_batches.size(); i++) {
+		m_batches[i].firstInstance = static_cast<uint32_t>(m_instanceItems.size());
+		m_batches[i].instanceCount = static_cast<uint32_t>(batchItems[i].size());
+		m_instanceItems.insert(m_instanceItems.end(), batchItems[i].begin(), batchItems[i].end());
+	}
+}
+
+// memory and per frame traffic of main pass attachments at every usable sample count
+// multisampled color and depth are cleared and never stored, only resolved color leaves tile memory
+void Renderer::PrintAttachmentCosts() {
+	const VkImageUsageFlags transient = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	const double MB = 1024.0 * 1024.0;
+
+	vu::RGImageDesc resolvedDesc{};
+	resolvedDesc.format = m_swapChainImageFormat;
+	resolvedDesc.extent = m_swapChainExtent;
+	VkDeviceSize resolvedBytes = vu::RenderGraph::GetAttachmentBytes(resolvedDesc);
+
+	bool lazy = m_renderGraph.SupportsLazyMemory();
+	std::cout << "attachments (" << m_swapChainExtent.width << "x" << m_swapChainExtent.height << ", "
+	          << (lazy ? "lazily allocated memory" : "no lazily allocated memory") << "):\n";
+
+	for (uint32_t samples = VK_SAMPLE_COUNT_1_BIT; samples <= GetMaxUsableSampleCount(); samples <<= 1) {
+		vu::RGImageDesc colorDesc = resolvedDesc;
+		colorDesc.samples = static_cast<VkSampleCountFlagBits>(samples);
+
+		vu::RGImageDesc depthDesc = colorDesc;
+		depthDesc.format = m_depthFormat;
+
+		VkDeviceSize memory = m_renderGraph.GetImageMemorySize(depthDesc, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | transient);
+		VkDeviceSize storeAll = vu::RenderGraph::GetAttachmentBytes(depthDesc) + resolvedBytes;
+		if (samples > VK_SAMPLE_COUNT_1_BIT) {
+			memory += m_renderGraph.GetImageMemorySize(colorDesc, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | transient);
+			storeAll += vu::RenderGraph::GetAttachmentBytes(colorDesc);
+		}
+
+		std::cout << "\t" << samples << "x: " << memory / MB << " MB" << (lazy ? " reserved (committed only on spill)" : "")
+		          << ", stored per frame " << resolvedBytes / MB << " MB (" << storeAll / MB << " MB if every attachment was stored)"
+		          << (samples == msaaSamples ? " <- used" : "") << "\n";
+	}
+	std::cout << "\n";
+}
+
+// averages recording time over some frames, then doubles thread count until all threads are used
+void Renderer::LogRecordTiming() {
+	const CommandRecorderStats &stats = m_commandRecorder.GetStats();
+	recordTimingMs += stats.recordMs;
+	recordTimingFrames++;
+
+	if (recordTimingFrames < RECORD_TIMING_FRAMES) {
+		return;
+	}
+
+	std::cout << "recording " << stats.itemCount << " instanced draws (" << m_instanceItems.size() << " objects) on " << stats.threads << " threads ("
+	          << stats.commandBuffers << " secondary command buffers): " << recordTimingMs / recordTimingFrames << " ms\n";
+
+	recordTimingMs = 0.0;
+	recordTimingFrames = 0;
+
+	uint32_t threadCount = m_commandRecorder.GetThreadCount();
+	if (threadCount < m_commandRecorder.GetMaxThreadCount()) {
+		m_commandRecorder.SetThreadCount(threadCount * 2);
+	}
+}
+
+void Renderer::CreateGraphicsPipeline() {
+	// push constants (model matrix moved to instance data, fragment range keeps its offset)
+	std::array<VkPushConstantRange, 1> pushConstants{};
+	pushConstants[0].offset = 64;
+	pushConstants[0].size = 64;
+	pushConstants[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
 	// pipeline layout (descriptors and push constants)
 	std::array<VkDescriptorSetLayout, 2> descriptorLayouts {descriptorSetLayoutGlobal, descriptorSetLayoutLocal};
@@ -1074,255 +1501,243 @@ void Renderer::CreateGraphicsPipeline() {
 		throw std::runtime_error("failed to create pipeline layout!");
 	}
 
-	// depth testing
-	VkPipelineDepthStencilStateCreateInfo depthStencil{};
-	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-	depthStencil.depthBoundsTestEnable = VK_FALSE;  // range of depths
-	depthStencil.stencilTestEnable = VK_FALSE;
-
-	// create pipeline
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = &depthStencil;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = &dynamicStateCreateInfo;
-	pipelineInfo.layout = pipelineLayout;
-	pipelineInfo.renderPass = m_renderPass;
-	pipelineInfo.subpass = 0;
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-	pipelineInfo.basePipelineIndex = -1; // Optional
-
-	if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create graphics pipeline!");
-	}
+	// all pipelines are created and owned by pipeline cache
+	m_pipelineCache.Initialize(m_device, m_jobSystem);
+
+	// fallback is created right away, real pipelines are compiled in jobs when first drawn
+	// less or equal, so fallback draws with and without depth prepass
+	PipelineDesc fallbackDesc = CreatePipelineDesc(BlendMode::Opaque);
+	fallbackDesc.fragShader = fallbackFragShaderModule;
+	fallbackDesc.minSampleShading = 0.0f;
+	fallbackDesc.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	fallbackPipeline = m_pipelineCache.Get(fallbackDesc);
+
+	// transparent draws are sorted back to front and don't hide what is behind them
+	opaquePipelineDesc = CreatePipelineDesc(BlendMode::Opaque);
+	transparentPipelineDesc = CreatePipelineDesc(BlendMode::AlphaBlend);
+	transparentPipelineDesc.depthWrite = VK_FALSE;
+
+	// depth prepass: position stream, no fragment stage and no color attachment
+	depthPrepassPipelineDesc = CreatePipelineDesc(BlendMode::Opaque);
+	depthPrepassPipelineDesc.vertShader = depthVertShaderModule;
+	depthPrepassPipelineDesc.fragShader = VK_NULL_HANDLE;
+	depthPrepassPipelineDesc.vertexLayout = VertexLayout::PositionOnly;
+	depthPrepassPipelineDesc.colorFormat = VK_FORMAT_UNDEFINED;
+	depthPrepassPipelineDesc.minSampleShading = 0.0f;
+	depthPrepassPipeline = m_pipelineCache.Get(depthPrepassPipelineDesc);
+
+	// after prepass only the nearest surface passes the test, depth is already written
+	opaqueEqualPipelineDesc = opaquePipelineDesc;
+	opaqueEqualPipelineDesc.depthWrite = VK_FALSE;
+	opaqueEqualPipelineDesc.depthCompareOp = VK_COMPARE_OP_EQUAL;
+}
+
+// description of pipeline that renders meshes into main render pass
+// variants (blend mode, cull mode, etc.) are made by changing fields of returned struct
+PipelineDesc Renderer::CreatePipelineDesc(BlendMode blendMode) {
+	PipelineDesc desc{};
+	desc.vertShader = vertShaderModule;
+	desc.fragShader = fragShaderModule;
+	desc.layout = pipelineLayout;
+	desc.colorFormat = m_swapChainImageFormat;
+	desc.depthFormat = m_depthFormat;
+	desc.cullMode = VK_CULL_MODE_FRONT_BIT;
+	desc.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	desc.blendMode = blendMode;
+	desc.depthTest = VK_TRUE;
+	desc.depthWrite = VK_TRUE;
+	desc.depthCompareOp = VK_COMPARE_OP_LESS;
+	desc.msaaSamples = msaaSamples;
+	desc.minSampleShading = 0.2f;
+	return desc;
 }
 
 void Renderer::CreateDescriptorPool() {
-	std::array<VkDescriptorPoolSize, 2> poolSizes{};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 4);
+	std::array<VkDescriptorPoolSize, 3> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = static_cast<uint32_t>(framesInFlight * 3);
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 2);
+	poolSizes[1].descriptorCount = static_cast<uint32_t>(framesInFlight * 2);
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[2].descriptorCount = static_cast<uint32_t>(framesInFlight);
 
 	VkDescriptorPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT * 6);  // 2 global + 4 global
+	poolInfo.maxSets = static_cast<uint32_t>(framesInFlight * 3);  // 1 global + 2 materials
 
 	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create descriptor pool!");
 	}
 }
 
-void Renderer::CreateUniformBuffers() {
-	VkDeviceSize bufferSize = sizeof(vu::VPubo);
+void Renderer::CreateObjectBuffers() {
+	// data of every draw item, rewritten every frame (gpu driven scene keeps its own)
+	VkDeviceSize bufferSize = std::max<VkDeviceSize>(gpuDriven ? 1 : m_drawList.size(), 1) * sizeof(vu::ObjectData);
+	m_objectAllocator.Initialize(CreateRendererInfo(), framesInFlight, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+}
+
+void Renderer::CreateGpuScene() {
+	if (!gpuDriven) {
+		return;
+	}
 
-	uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformAllocations.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformAllocationInfos.resize(MAX_FRAMES_IN_FLIGHT);
+	m_gpuScene.Initialize(CreateRendererInfo(), framesInFlight, cullShaderModule, supportsDrawIndirectCount);
+	m_depthPyramid.Initialize(CreateRendererInfo(), framesInFlight, m_depthFormat, hizShaderModule, hizMsaaShaderModule);
+	if (occlusionCulling && !m_depthPyramid.IsSupported(msaaSamples)) {
+		std::cout << "depth format can't be sampled with " << msaaSamples << " samples, occlusion culling is off\n\n";
+		occlusionCulling = false;
+	}
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	// same batches as cpu path, objects of one batch are next to each other
+	std::vector<const vu::Mesh *> batchMeshes;
+	std::vector<vu::GpuSceneObject> objects;
+	for (uint32_t i = 0; i < m_batches.size(); i++) {
+		const DrawBatch &batch = m_batches[i];
+		batchMeshes.push_back(batch.mesh);
 
-		vu::createBuffer(
-			m_physicalDevice,
-			m_allocator,
-			m_surface,
-			bufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VMA_MEMORY_USAGE_AUTO,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-			uniformBuffers[i], uniformAllocations[i], uniformAllocationInfos[i]
-		);
+		for (uint32_t instance = batch.firstInstance; instance < batch.firstInstance + batch.instanceCount; instance++) {
+			const DrawItem &item = m_drawList[m_instanceItems[instance]];
+			objects.push_back({item.entity, i, item.material->id, item.dynamic});
+		}
 	}
-}
 
-void Renderer::CreateMaterialslBuffers() {
-	VkDeviceSize bufferSize = sizeof(vu::MaterialUbo);
+	m_gpuScene.Build(m_scene, batchMeshes, objects);
+}
 
-	uniformBuffersMat1.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformAllocationsMat1.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformAllocationInfosMat1.resize(MAX_FRAMES_IN_FLIGHT);
+// object data binding of global sets, buffers of both paths exist only after draw list is built
+void Renderer::WriteObjectDescriptors() {
+	for (uint32_t i = 0; i < framesInFlight; i++) {
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = gpuDriven ? m_gpuScene.GetObjectBuffer(i) : m_objectAllocator.GetBuffer(i);
+		bufferInfo.offset = 0;
+		bufferInfo.range = gpuDriven ? m_gpuScene.GetObjectBufferSize() : m_objectAllocator.GetBytesPerFrame();
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSetsGlobal[i];
+		descriptorWrite.dstBinding = 1;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pBufferInfo = &bufferInfo;
 
-		vu::createBuffer(
-			m_physicalDevice,
-			m_allocator,
-			m_surface,
-			bufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VMA_MEMORY_USAGE_AUTO,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-			uniformBuffersMat1[i], uniformAllocationsMat1[i], uniformAllocationInfosMat1[i]
-		);
+		vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
 	}
+}
 
-	uniformBuffersMat2.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformAllocationsMat2.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformAllocationInfosMat2.resize(MAX_FRAMES_IN_FLIGHT);
+void Renderer::CreateUniformBuffers() {
+	// every uniform block of a frame is allocated from one buffer of that frame
+	m_uniformAllocator.Initialize(CreateRendererInfo(), framesInFlight, UNIFORM_BYTES_PER_FRAME);
+}
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+void Renderer::CreateMaterials() {
+	material1.ubo.ColDiffuse = glm::vec4(1.0, 0.0, 0.0, 1.0);
+	material1.ubo.ColSpecular = glm::vec4(1.0, 1.0, 0.0, 1.0);
+	material1.texture = image1;
+	material1.id = 0;
 
-		vu::createBuffer(
-			m_physicalDevice,
-			m_allocator,
-			m_surface,
-			bufferSize,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VMA_MEMORY_USAGE_AUTO,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-			uniformBuffersMat2[i], uniformAllocationsMat2[i], uniformAllocationInfosMat2[i]
-		);
-	}
+	material2.ubo.ColDiffuse = glm::vec4(0.0, 0.0, 1.0, 1.0);
+	material2.ubo.ColSpecular = glm::vec4(0.5, 0.8, 1.0, 1.0);
+	material2.texture = image2;
+	material2.id = 1;
 }
 
 void Renderer::CreateDescriptorSets() {
 	// allocate descriptor sets
-	std::vector<VkDescriptorSetLayout> layoutsGlobal{MAX_FRAMES_IN_FLIGHT, descriptorSetLayoutGlobal};
-	std::vector<VkDescriptorSetLayout> layoutsLocal{MAX_FRAMES_IN_FLIGHT, descriptorSetLayoutLocal};
+	std::vector<VkDescriptorSetLayout> layoutsGlobal{framesInFlight, descriptorSetLayoutGlobal};
+	std::vector<VkDescriptorSetLayout> layoutsLocal{framesInFlight, descriptorSetLayoutLocal};
 
 	// global
 	VkDescriptorSetAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(framesInFlight);
 	allocInfo.pSetLayouts = layoutsGlobal.data();
 
-	descriptorSetsGlobal.resize(MAX_FRAMES_IN_FLIGHT);
+	descriptorSetsGlobal.resize(framesInFlight);
 	if (vkAllocateDescriptorSets(m_device, &allocInfo, descriptorSetsGlobal.data()) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate descriptor sets!");
 	}
 
-	// material 1
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-	allocInfo.pSetLayouts = layoutsLocal.data();
+	// materials
+	std::array<vu::Material *, 2> materials = {&material1, &material2};
+	for (vu::Material *material : materials) {
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(framesInFlight);
+		allocInfo.pSetLayouts = layoutsLocal.data();
 
-	descriptorSetsMat1.resize(MAX_FRAMES_IN_FLIGHT);
-	if (vkAllocateDescriptorSets(m_device, &allocInfo, descriptorSetsMat1.data()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate descriptor sets!");
-	}
-
-	// material 2
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-	allocInfo.pSetLayouts = layoutsLocal.data();
-
-	descriptorSetsMat2.resize(MAX_FRAMES_IN_FLIGHT);
-	if (vkAllocateDescriptorSets(m_device, &allocInfo, descriptorSetsMat2.data()) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate descriptor sets!");
+		material->sets.resize(framesInFlight);
+		if (vkAllocateDescriptorSets(m_device, &allocInfo, material->sets.data()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate descriptor sets!");
+		}
 	}
 
 
 	// populate sets with data
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	// uniform bindings point at the start of the frame buffer, actual block is selected by dynamic offset when binding
+	for (uint32_t i = 0; i < framesInFlight; i++) {
 		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = uniformBuffers[i];
+		bufferInfo.buffer = m_uniformAllocator.GetBuffer(i);
 		bufferInfo.offset = 0;
 		bufferInfo.range = sizeof(vu::VPubo);
 
-		VkDescriptorImageInfo imageInfo1{};
-		imageInfo1.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo1.imageView = image1->GetImageView();
-		imageInfo1.sampler = textureSampler;
-
-		VkDescriptorImageInfo imageInfo2{};
-		imageInfo2.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo2.imageView = image2->GetImageView();
-		imageInfo2.sampler = textureSampler;
-
-		VkDescriptorBufferInfo bufferInfoMat1{};
-		bufferInfoMat1.buffer = uniformBuffersMat1[i];
-		bufferInfoMat1.offset = 0;
-		bufferInfoMat1.range = sizeof(vu::MaterialUbo);
-
-		VkDescriptorBufferInfo bufferInfoMat2{};
-		bufferInfoMat2.buffer = uniformBuffersMat2[i];
-		bufferInfoMat2.offset = 0;
-		bufferInfoMat2.range = sizeof(vu::MaterialUbo);
-
 		// global descriptor (VP matrix)
 		std::array<VkWriteDescriptorSet, 1> descriptorWritesGlobal{};
 		descriptorWritesGlobal[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		descriptorWritesGlobal[0].dstSet = descriptorSetsGlobal[i];
 		descriptorWritesGlobal[0].dstBinding = 0;
 		descriptorWritesGlobal[0].dstArrayElement = 0;
-		descriptorWritesGlobal[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWritesGlobal[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		descriptorWritesGlobal[0].descriptorCount = 1;
 		descriptorWritesGlobal[0].pBufferInfo = &bufferInfo;
 
 		vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWritesGlobal.size()), descriptorWritesGlobal.data(), 0, nullptr);
 
-		// local descriptor (images and such) material 1
-		std::array<VkWriteDescriptorSet, 2> descriptorWritesLocal1{};
-		descriptorWritesLocal1[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWritesLocal1[0].dstSet = descriptorSetsMat1[i];
-		descriptorWritesLocal1[0].dstBinding = 0;
-		descriptorWritesLocal1[0].dstArrayElement = 0;
-		descriptorWritesLocal1[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWritesLocal1[0].descriptorCount = 1;
-		descriptorWritesLocal1[0].pBufferInfo = &bufferInfoMat1;
-
-		descriptorWritesLocal1[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWritesLocal1[1].dstSet = descriptorSetsMat1[i];
-		descriptorWritesLocal1[1].dstBinding = 1;
-		descriptorWritesLocal1[1].dstArrayElement = 0;
-		descriptorWritesLocal1[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWritesLocal1[1].descriptorCount = 1;
-		descriptorWritesLocal1[1].pImageInfo = &imageInfo1;
-
-		vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWritesLocal1.size()), descriptorWritesLocal1.data(), 0, nullptr);
-
-		// local descriptor (images and such) material 1
-		std::array<VkWriteDescriptorSet, 2> descriptorWritesLocal2{};
-		descriptorWritesLocal2[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWritesLocal2[0].dstSet = descriptorSetsMat2[i];
-		descriptorWritesLocal2[0].dstBinding = 0;
-		descriptorWritesLocal2[0].dstArrayElement = 0;
-		descriptorWritesLocal2[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWritesLocal2[0].descriptorCount = 1;
-		descriptorWritesLocal2[0].pBufferInfo = &bufferInfoMat2;
-
-		descriptorWritesLocal2[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWritesLocal2[1].dstSet = descriptorSetsMat2[i];
-		descriptorWritesLocal2[1].dstBinding = 1;
-		descriptorWritesLocal2[1].dstArrayElement = 0;
-		descriptorWritesLocal2[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWritesLocal2[1].descriptorCount = 1;
-		descriptorWritesLocal2[1].pImageInfo = &imageInfo2;
-
-		vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWritesLocal2.size()), descriptorWritesLocal2.data(), 0, nullptr);
+		// local descriptors (material constants and texture)
+		for (vu::Material *material : materials) {
+			VkDescriptorBufferInfo bufferInfoMat{};
+			bufferInfoMat.buffer = m_uniformAllocator.GetBuffer(i);
+			bufferInfoMat.offset = 0;
+			bufferInfoMat.range = sizeof(vu::MaterialUbo);
+
+			VkDescriptorImageInfo imageInfo{};
+			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageInfo.imageView = material->texture->GetImageView();
+			imageInfo.sampler = textureSampler;
+
+			std::array<VkWriteDescriptorSet, 2> descriptorWritesLocal{};
+			descriptorWritesLocal[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWritesLocal[0].dstSet = material->sets[i];
+			descriptorWritesLocal[0].dstBinding = 0;
+			descriptorWritesLocal[0].dstArrayElement = 0;
+			descriptorWritesLocal[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			descriptorWritesLocal[0].descriptorCount = 1;
+			descriptorWritesLocal[0].pBufferInfo = &bufferInfoMat;
+
+			descriptorWritesLocal[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWritesLocal[1].dstSet = material->sets[i];
+			descriptorWritesLocal[1].dstBinding = 1;
+			descriptorWritesLocal[1].dstArrayElement = 0;
+			descriptorWritesLocal[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWritesLocal[1].descriptorCount = 1;
+			descriptorWritesLocal[1].pImageInfo = &imageInfo;
+
+			vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWritesLocal.size()), descriptorWritesLocal.data(), 0, nullptr);
+		}
 	}
 }
 
 
+// device must be idle
 void Renderer::CleanupSwapChain() {
-	for (auto framebuffer : swapChainFramebuffers) {
-		vkDestroyFramebuffer(m_device, framebuffer, nullptr);
-	}
+	// transient attachments have swap chain size
+	m_renderGraph.ReleaseTransients();
+
 	for (auto imageView : swapChainImageViews) {
 		vkDestroyImageView(m_device, imageView, nullptr);
 	}
 	vkDestroySwapchainKHR(m_device, m_swapChain, nullptr);
-
-	vkDestroyImageView(m_device, depthImageView, nullptr);
-	vmaDestroyImage(m_allocator, depthImage, depthImageAllocation);
-
-	vkDestroyImageView(m_device, colorImageView, nullptr);
-	vmaDestroyImage(m_allocator, colorImage, colorImageAllocation);
 }
 
 void Renderer::RecreateSwapChain() {
@@ -1336,15 +1751,21 @@ void Renderer::RecreateSwapChain() {
 		glfwWaitEvents();
 	}
 
-	vkDeviceWaitIdle(m_device);
-
-	CleanupSwapChain();
+	// no wait for idle, frames in flight finish with old swap chain while new frames use the new one
+	// transient attachments follow new extent by themselves, render graph retires old ones after frames in flight
+	// present has no completion signal, so old swap chain lives until frames submitted after its last present
+	// are done too (presentation engine has switched to new images by then)
+	uint64_t lastUse = m_graphicsTimeline.GetLastSubmitted() + framesInFlight;
+	for (VkImageView imageView : swapChainImageViews) {
+		m_deletionQueue.DestroyImageView(imageView, m_graphicsTimeline, lastUse);
+	}
+	m_deletionQueue.DestroySwapChain(m_swapChain, m_graphicsTimeline, lastUse);
 
-	CreateSwapChain();
+	CreateSwapChain(m_swapChain);
 	CreateImageViews();
-	CreateDepthResources();
-	CreateColorResources();
-	CreateFrameBuffers();
+
+	// new swap chain and transient images allocate for a few frames
+	m_allocationTracker.Restart(ALLOCATION_WARMUP_FRAMES);
 }
 
 void Renderer::CreateShaderModules() {
@@ -1354,19 +1775,63 @@ void Renderer::CreateShaderModules() {
 	vertShaderInfo.kind = shaderc_vertex_shader;
 	vertShaderInfo.options.SetOptimizationLevel(shaderc_optimization_level_performance);
 
+	vu::ShaderCompilationInfo depthVertShaderInfo{};
+	depthVertShaderInfo.fileName = "shaders/depth.vert";
+	depthVertShaderInfo.source = vu::readFile(depthVertShaderInfo.fileName);
+	depthVertShaderInfo.kind = shaderc_vertex_shader;
+	depthVertShaderInfo.options.SetOptimizationLevel(shaderc_optimization_level_performance);
+
 	vu::ShaderCompilationInfo fragShaderInfo{};
 	fragShaderInfo.fileName = "shaders/shader.frag";
 	fragShaderInfo.source = vu::readFile(fragShaderInfo.fileName);
 	fragShaderInfo.kind = shaderc_fragment_shader;
 	fragShaderInfo.options.SetOptimizationLevel(shaderc_optimization_level_performance);
 
+	vu::ShaderCompilationInfo fallbackFragShaderInfo{};
+	fallbackFragShaderInfo.fileName = "shaders/fallback.frag";
+	fallbackFragShaderInfo.source = vu::readFile(fallbackFragShaderInfo.fileName);
+	fallbackFragShaderInfo.kind = shaderc_fragment_shader;
+	fallbackFragShaderInfo.options.SetOptimizationLevel(shaderc_optimization_level_performance);
+
 	vertShaderModule = vu::createShaderModule(m_device, vertShaderInfo);
+	depthVertShaderModule = vu::createShaderModule(m_device, depthVertShaderInfo);
 	fragShaderModule = vu::createShaderModule(m_device, fragShaderInfo);
+	fallbackFragShaderModule = vu::createShaderModule(m_device, fallbackFragShaderInfo);
+
+	vu::ShaderCompilationInfo cullShaderInfo{};
+	cullShaderInfo.fileName = "shaders/cull.comp";
+	cullShaderInfo.source = vu::readFile(cullShaderInfo.fileName);
+	cullShaderInfo.kind = shaderc_compute_shader;
+	cullShaderInfo.options.SetOptimizationLevel(shaderc_optimization_level_performance);
+
+	cullShaderModule = vu::createShaderModule(m_device, cullShaderInfo);
+
+	// same reduction, level 0 of msaa variant reads every depth sample
+	vu::ShaderCompilationInfo hizShaderInfo{};
+	hizShaderInfo.fileName = "shaders/hiz.comp";
+	hizShaderInfo.source = vu::readFile(hizShaderInfo.fileName);
+	hizShaderInfo.kind = shaderc_compute_shader;
+	hizShaderInfo.options.SetOptimizationLevel(shaderc_optimization_level_performance);
+
+	vu::ShaderCompilationInfo hizMsaaShaderInfo{};
+	hizMsaaShaderInfo.fileName = "shaders/hiz.comp";
+	hizMsaaShaderInfo.source = hizShaderInfo.source;
+	hizMsaaShaderInfo.kind = shaderc_compute_shader;
+	hizMsaaShaderInfo.options.SetOptimizationLevel(shaderc_optimization_level_performance);
+	hizMsaaShaderInfo.options.AddMacroDefinition("MSAA");
+
+	hizShaderModule = vu::createShaderModule(m_device, hizShaderInfo);
+	hizMsaaShaderModule = vu::createShaderModule(m_device, hizMsaaShaderInfo);
 }
 
 void Renderer::destroyShaderModules() {
 	vkDestroyShaderModule(m_device, vertShaderModule, nullptr);
+	vkDestroyShaderModule(m_device, depthVertShaderModule, nullptr);
 	vkDestroyShaderModule(m_device, fragShaderModule, nullptr);
+	vkDestroyShaderModule(m_device, fallbackFragShaderModule, nullptr);
+	vkDestroyShaderModule(m_device, cullShaderModule, nullptr);
+	vkDestroyShaderModule(m_device, hizShaderModule, nullptr);
+	vkDestroyShaderModule(m_device, hizMsaaShaderModule, nullptr);
 }
 		
 
@@ -1383,22 +1848,25 @@ uint32_t Renderer::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags pro
 	}
 }
 
+// one timeline per queue, created before anything is uploaded
+void Renderer::CreateTimelines() {
+	m_graphicsTimeline.Initialize(m_device);
+	m_transferTimeline.Initialize(m_device);
+}
+
 void Renderer::CreateSyncObjects() {
-	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	// swap chain still needs binary semaphores for acquire and present,
+	// everything else waits on timeline values
+	imageAvailableSemaphores.resize(framesInFlight);
+	renderFinishedSemaphores.resize(framesInFlight);
+	frameTimelineValues.assign(framesInFlight, 0);
 
 	VkSemaphoreCreateInfo semaphoreInfo{};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+	for (size_t i = 0; i < framesInFlight; i++) {
 		if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(m_device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+			vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
 
 			throw std::runtime_error("failed to create synchronization objects for a frame!");
 		}
@@ -1437,73 +1905,6 @@ void Renderer::CreateTextureSampler() {
 	}
 }
 
-void Renderer::CreateDepthResources() {
-	// choose depth image format
-	VkFormat depthFormat = vu::findDepthFormat(m_physicalDevice);
-
-	// create depth image
-	VkImageCreateInfo imageInfo{};
-	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageInfo.extent.width = m_swapChainExtent.width;
-	imageInfo.extent.height = m_swapChainExtent.height;
-	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
-	imageInfo.arrayLayers = 1;
-	imageInfo.format = depthFormat;
-	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;  // linear if we need to access memory directly (for staging image)
-	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;  // preinitialized if we need to use this image as staging image
-	imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;  // used by one queue family (transfer)
-	imageInfo.samples = msaaSamples;  // for multisampling
-	imageInfo.flags = 0;
-
-	VmaAllocationCreateInfo allocInfo{};
-	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
-	allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-
-	vmaCreateImage(m_allocator, &imageInfo, &allocInfo, &depthImage, &depthImageAllocation, &depthImageAllocationInfo);
-
-	// create image view
-	vu::Image::CreateImageView(CreateRendererInfo(), depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, depthImageView);
-
-
-	// change layout so we can access image in shaders (here it is optional)
-	vu::Image::TransitionImageLayout(CreateRendererInfo(), depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-}
-
-// create special buffer for multisampled image
-// we need this for MSAA
-void Renderer::CreateColorResources() {
-	// choose color image format
-	VkFormat colorFormat = m_swapChainImageFormat;
-
-	// create color image
-	VkImageCreateInfo imageInfo{};
-	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageInfo.extent.width = m_swapChainExtent.width;
-	imageInfo.extent.height = m_swapChainExtent.height;
-	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
-	imageInfo.arrayLayers = 1;
-	imageInfo.format = colorFormat;
-	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;  // linear if we need to access memory directly (for staging image)
-	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;  // preinitialized if we need to use this image as staging image
-	imageInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;  // used by one queue family (transfer)
-	imageInfo.samples = msaaSamples;  // for multisampling
-	imageInfo.flags = 0;
-
-	VmaAllocationCreateInfo allocInfo{};
-	allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
-
-	vmaCreateImage(m_allocator, &imageInfo, &allocInfo, &colorImage, &colorImageAllocation, &colorImageAllocationInfo);
-
-	// create image view for this image
-	vu::Image::CreateImageView(CreateRendererInfo(), colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, colorImageView);
-}
-
 VkSampleCountFlagBits Renderer::GetMaxUsableSampleCount() {
 	VkPhysicalDeviceProperties physicalDeviceProperties;
 	vkGetPhysicalDeviceProperties(m_physicalDevice, &physicalDeviceProperties);
@@ -1530,12 +1931,32 @@ void Renderer::UpdateTime() {
 	lastFrameTime = currentFrameTime;
 }
 
+void Renderer::UpdateObjects() {
+	UniformAllocation allocation = m_objectAllocator.Allocate(m_instanceItems.size() * sizeof(vu::ObjectData));
+	objectOffset = allocation.offset;
+
+	// thousands of objects are worth splitting between threads, every range writes its own part of mapped memory
+	vu::ObjectData *objects = static_cast<vu::ObjectData *>(allocation.data);
+	m_jobSystem.ParallelFor(static_cast<uint32_t>(m_instanceItems.size()), 0, [this, objects](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; i++) {
+			const DrawItem &item = m_drawList[m_instanceItems[i]];
+			objects[i].model = m_scene.GetWorldMatrix(item.entity);
+			objects[i].prevModel = m_scene.GetPrevWorldMatrix(item.entity);
+			objects[i].normal = glm::mat3x4(m_scene.GetNormalMatrix(item.entity));
+			objects[i].materialIndex = item.material->id;
+		}
+	});
+}
+
 void Renderer::UpdateTransforms() {
-	transform1.SetRotation(glm::vec3(0.0f, currentFrameTime * glm::radians(90.0f) * 0.2f, 0.0f));
-	transform1.SetScale(glm::vec3(1.0f, glm::sin(currentFrameTime * 2.0) * 0.3 + 0.7, 1.0));
+	m_scene.SetRotation(entity1, glm::vec3(0.0f, currentFrameTime * glm::radians(90.0f) * 0.2f, 0.0f));
+	m_scene.SetScale(entity1, glm::vec3(1.0f, glm::sin(currentFrameTime * 2.0) * 0.3 + 0.7, 1.0));
+
+	// only dirty entities and their children recompute world matrices
+	m_scene.Update();
 }
 
-void Renderer::SetGlobalUniformBuffers(uint32_t currentImage) {
+void Renderer::SetGlobalUniformBuffers() {
 	glm::mat4 view = glm::lookAt(camTransform.GetPosition(), camTransform.GetPosition() + camTransform.GetForward(), glm::vec3(0.0f, 1.0f, 0.0f));
 	glm::mat4 proj = glm::perspective(glm::radians(60.0f), (float)m_swapChainExtent.width / (float)m_swapChainExtent.height, 0.1f, 100.0f);
 
@@ -1544,24 +1965,44 @@ void Renderer::SetGlobalUniformBuffers(uint32_t currentImage) {
 	ubo.proj = proj;
 	ubo.proj[1][1] *= -1;
 
-	memcpy(uniformAllocationInfos[currentImage].pMappedData, &ubo, sizeof(ubo));
+	viewProj = ubo.proj * ubo.view;
+
+	globalUniformOffset = m_uniformAllocator.Push(ubo).offset;
 }
 
-void Renderer::SetMaterialsBuffers() {
-	vu::MaterialUbo matUbo1;
-	matUbo1.ColDiffuse = glm::vec4(1.0, 0.0, 0.0, 1.0);
-	matUbo1.ColSpecular = glm::vec4(1.0, 1.0, 0.0, 1.0);
+void Renderer::SetMaterialUniformBuffers() {
+	// constants are copied every frame, so editing a material never touches memory gpu still reads
+	std::array<vu::Material *, 2> materials = {&material1, &material2};
+	for (vu::Material *material : materials) {
+		material->uniformOffset = m_uniformAllocator.Push(material->ubo).offset;
+	}
+}
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		memcpy(uniformAllocationInfosMat1[i].pMappedData, &matUbo1, sizeof(matUbo1));
+void Renderer::UpdateMaterialTextures() {
+	// set of current frame slot is not read by gpu anymore, so it can point at new views of moved textures
+	uint64_t generation = m_defragmenter.GetImageGeneration();
+	if (textureGenerations[currentFrame] == generation) {
+		return;
 	}
-	
-	vu::MaterialUbo matUbo2;
-	matUbo2.ColDiffuse = glm::vec4(0.0, 0.0, 1.0, 1.0);
-	matUbo2.ColSpecular = glm::vec4(0.5, 0.8, 1.0, 1.0);
+	textureGenerations[currentFrame] = generation;
+
+	std::array<vu::Material *, 2> materials = {&material1, &material2};
+	for (vu::Material *material : materials) {
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = material->texture->GetImageView();
+		imageInfo.sampler = textureSampler;
 
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		memcpy(uniformAllocationInfosMat2[i].pMappedData, &matUbo2, sizeof(matUbo2));
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = material->sets[currentFrame];
+		write.dstBinding = 1;
+		write.dstArrayElement = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo = &imageInfo;
+
+		vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
 	}
 }
 
@@ -1578,49 +2019,97 @@ void Renderer::SetGlobalPushConstants(VkCommandBuffer commandBuffer) {
 	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 64, 64, &pushConstants);
 }
 
-void Renderer::DrawFrame() {
-	vkWaitForFences(m_device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+bool Renderer::PrepareFrame(uint32_t &imageIndex) {
+	// frame that used this slot before must be finished before its command buffers and uniforms are reused
+	m_graphicsTimeline.Wait(frameTimelineValues[currentFrame]);
+	m_framePacer.BeginFrame(currentFrame);
+	m_pipelineStatistics.BeginFrame(currentFrame);
+	m_deletionQueue.Update();
 
 	// get image from swap chain
-	uint32_t imageIndex;
 	VkResult result = vkAcquireNextImageKHR(m_device, m_swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		RecreateSwapChain();
 		std::cout << "recreating swap chain\n\n";
+		return false;  // semaphore was not signaled, try again with new swap chain
 	} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
 
-	// reset fence only if we are submitting work
-	vkResetFences(m_device, 1, &inFlightFences[currentFrame]);
+	// low latency mode and frame limiter sleep here, right before input is sampled
+	m_framePacer.WaitForInput();
+	return true;
+}
+
+void Renderer::DrawFrame(uint32_t imageIndex) {
+	// uniform and instance memory and cpu arena of this frame slot are free again (frame value was waited)
+	m_frameArenas.BeginFrame(currentFrame);
+	m_uniformAllocator.BeginFrame(currentFrame);
+	m_objectAllocator.BeginFrame(currentFrame);
+	m_memoryStats.Update();
 
-	// update uniform buffers of materials
-	SetGlobalUniformBuffers(currentFrame);
+	// moves of last pass are finished or next pass starts, material sets of this slot follow moved textures
+	m_defragmenter.Update();
+	UpdateMaterialTextures();
+
+	// update uniform buffers of camera and materials
+	SetGlobalUniformBuffers();
+	SetMaterialUniformBuffers();
 
 	// update objects positions
 	UpdateTransforms();
+	CullFrustum();
+	CullOccluded();
+	BuildRenderQueue();
+	if (gpuDriven) {
+		m_gpuScene.BeginFrame(currentFrame);
+		m_depthPyramid.BeginFrame(currentFrame);
+	} else {
+		UpdateObjects();
+	}
 
 	// record commands to command buffer
 	vkResetCommandBuffer(graphicsCommandBuffers[currentFrame], 0);
 	RecordCommandBuffer(graphicsCommandBuffers[currentFrame], imageIndex);
 
 	// submit command buffer
-	VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-	VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-	VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+	// waits for swap chain image and for every upload submitted so far, signals present semaphore and frame value
+	uint64_t frameValue = m_graphicsTimeline.Next();
+
+	VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], m_transferTimeline.GetSemaphore()};
+	uint64_t waitValues[] = {0, m_transferTimeline.GetLastSubmitted()};  // binary semaphores ignore values
+	VkPipelineStageFlags waitStages[] = {
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+	};
+	VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame], m_graphicsTimeline.GetSemaphore()};
+	uint64_t signalValues[] = {0, frameValue};
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = 2;
+	timelineInfo.pWaitSemaphoreValues = waitValues;
+	timelineInfo.signalSemaphoreValueCount = 2;
+	timelineInfo.pSignalSemaphoreValues = signalValues;
+
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = 2;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &graphicsCommandBuffers[currentFrame];
-	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.signalSemaphoreCount = 2;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit draw command buffer!");
 	}
+	frameTimelineValues[currentFrame] = frameValue;
+	m_uniformAllocator.EndFrame(frameValue);
+	m_objectAllocator.EndFrame(frameValue);
+	m_framePacer.EndFrame();
 
 	// submitting result to swap chain
 	VkSwapchainKHR swapChains[] = {m_swapChain};
@@ -1633,7 +2122,7 @@ void Renderer::DrawFrame() {
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr; // Optional
 
-	result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	VkResult result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
 		framebufferResized = false;
 		RecreateSwapChain();
@@ -1643,5 +2132,5 @@ void Renderer::DrawFrame() {
 	}
 
 	// advance to the next frame
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	currentFrame = (currentFrame + 1) % framesInFlight;
 }
@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <chrono>
 #include <unordered_map>
+#include <map>
+#include <atomic>
 
 #define VK_LOD_CLAMP_NONE 15.0f  // max mipmap level for sampler
 #define GLFW_INCLUDE_VULKAN
@@ -29,7 +31,24 @@
 
 #include "mesh.h"
 #include "transform.h"
+#include "scene.h"
 #include "image.h"
+#include "pipeline.h"
+#include "render_graph.h"
+#include "command_recorder.h"
+#include "job_system.h"
+#include "memory_arena.h"
+#include "frame_pacer.h"
+#include "uniform_allocator.h"
+#include "gpu_scene.h"
+#include "render_queue.h"
+#include "memory_stats.h"
+#include "defragmenter.h"
+#include "deletion_queue.h"
+#include "pipeline_statistics.h"
+#include "software_occlusion.h"
+#include "frustum.h"
+#include "bvh.h"
 #include "vu.h"
 
 
@@ -39,7 +58,23 @@ const uint32_t HEIGHT = 600;
 const std::string TEXTURE_PATH1 = "textures/viking_room.png";
 const std::string TEXTURE_PATH2 = "textures/viking_room.png";
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// frames in flight are chosen at startup, this is only the upper bound
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+// uniform data of all blocks written in one frame
+const VkDeviceSize UNIFORM_BYTES_PER_FRAME = 64 * 1024;
+
+// upper bound of bytes copied by one defragmentation pass (one pass per frame)
+const VkDeviceSize DEFRAG_BYTES_PER_FRAME = 8 * 1024 * 1024;
+
+// first block of every frame arena, arenas grow to the biggest frame and keep that size
+const size_t FRAME_ARENA_BYTES = 256 * 1024;
+
+// frames after start or swap chain recreation that may allocate (pools, caches and arenas reach their size)
+const uint32_t ALLOCATION_WARMUP_FRAMES = 64;
+
+// frames averaged for every thread count when stress grid is enabled
+const uint32_t RECORD_TIMING_FRAMES = 256;
 
 // All standart layers are packed in this one
 const std::vector<const char*> validationLayers = {
@@ -60,10 +95,88 @@ const std::vector<const char*> deviceExtensions = {
 #endif
 
 namespace vu {
+
+	// texture and constants of a draw, constants are copied to uniform memory of the frame every frame
+	struct Material {
+		vu::MaterialUbo              ubo{};
+		vu::Image                   *texture = nullptr;
+		std::vector<VkDescriptorSet> sets;               // one per frame in flight, uniform binding is dynamic
+		uint32_t                     uniformOffset = 0;  // offset of ubo in uniform memory of current frame
+		uint32_t                     id = 0;             // material bits of sort key
+		bool                         transparent = false;  // alpha blended, drawn back to front after opaque draws
+	};
+
+	// one object of the main pass
+	struct DrawItem {
+		vu::Mesh            *mesh;
+		vu::Entity           entity;
+		const vu::Material  *material;
+		bool                 dynamic = false;  // transform changes every frame
+		uint32_t             meshId = 0;       // mesh bits of sort key
+		bool                 occluder = false; // rasterized by software occlusion
+	};
+
+	// frustum culling of cpu path, last frame
+	struct CullingStats {
+		uint32_t objects    = 0;
+		uint32_t candidates = 0;  // boxes reaching into frustum, found by scene bvh
+		uint32_t visible    = 0;
+	};
+
+	// neighbouring draw items with the same mesh and material, drawn as one instanced draw
+	struct DrawBatch {
+		vu::Mesh           *mesh;
+		const vu::Material *material;
+		uint32_t            firstInstance;  // into instance data of the frame
+		uint32_t            instanceCount;
+	};
+
 	class Renderer {
 	public:
 		void Run();
 
+		// adds size x size grid of trees and logs recording time for growing thread counts
+		void SetStressGridSize(uint32_t size) { stressGridSize = size; }
+
+		// cull and build draws in compute shader, falls back to cpu draws if device can't draw indirect
+		void SetGpuDriven(bool enabled) { gpuDriven = enabled; }
+
+		// frame pacing, set before Run
+		// more frames in flight hide cpu spikes, fewer frames keep input closer to the screen
+		void SetFramesInFlight(uint32_t count) { framesInFlight = std::clamp(count, 1u, MAX_FRAMES_IN_FLIGHT); }
+		void SetPresentMode(VkPresentModeKHR mode) { preferredPresentMode = mode; }  // falls back to FIFO when unsupported
+		void SetPacingMode(vu::PacingMode mode) { m_framePacer.SetMode(mode); }
+		void SetFrameLimit(float fps) { m_framePacer.SetFrameLimit(fps); }  // 0 - no limit
+
+		// memory heaps are logged every interval frames (0 - only at exit), json of vma is written at exit when path is set
+		void SetMemoryLogInterval(uint32_t frames) { memoryLogInterval = frames; }
+		void SetMemoryJsonPath(const std::string &path) { memoryJsonPath = path; }
+
+		// cpu time one defragmentation pass may take per frame, 0 - no defragmentation
+		void SetDefragmentationBudget(double ms) { defragBudgetMs = std::max(ms, 0.0); }
+
+		// depth only pass of opaque draws before main pass, main pass then shades only visible fragments (P toggles it)
+		void SetDepthPrepass(bool enabled) { depthPrepass = enabled; }
+
+		// gpu driven culling also tests objects against depth pyramid of previous frame (O toggles it)
+		void SetOcclusionCulling(bool enabled) { occlusionCulling = enabled; }
+
+		// cpu draws skip objects hidden behind occluder meshes rasterized on the cpu (not used by gpu driven path)
+		void SetSoftwareOcclusion(bool enabled) { softwareOcclusion = enabled; }
+
+		// draw items inside camera frustum, gpu driven path counts its own
+		const vu::CullingStats &GetCullingStats() const { return m_cullingStats; }
+
+		// world boxes of draw items (item is draw list index) for frustum, ray and sphere queries
+		// cpu path refits it every frame for culling, gpu driven path only when it's asked for
+		const vu::Bvh &GetSceneBvh();
+
+		// closest draw item box along camera forward (F prints it)
+		vu::BvhRayHit PickFromCamera();
+
+		// highest usable sample count up to this one, 0 - highest the device supports
+		void SetMsaaSamples(uint32_t samples) { requestedMsaaSamples = samples; }
+
 		// getters
 		VkInstance       GetInstance()             const { return m_instance; }
 		VkPhysicalDevice GetPhysicalDevice()       const { return m_physicalDevice; }
@@ -71,7 +184,6 @@ namespace vu {
 		VkFormat         GetSwapChainImageFormat() const { return m_swapChainImageFormat; }
 		VkExtent2D       GetSwapChainExtent()      const { return m_swapChainExtent; }
 		VkSurfaceKHR     GetSurface()              const { return m_surface; }
-		VkRenderPass     GetRenderPass()           const { return m_renderPass; }
 		VmaAllocator     GetAllocator()            const { return m_allocator;}
 		VkCommandPool    GetGraphicsCommandPool()  const { return m_graphicsCommandPool; }
 		VkCommandPool    GetTransferCommandPool()  const { return m_transferCommandPool; }
@@ -83,7 +195,8 @@ namespace vu {
 		void InitWindow();
 		void InitVulkan();
 		void MainLoop();
-		void DrawFrame();
+		bool PrepareFrame(uint32_t &imageIndex);
+		void DrawFrame(uint32_t imageIndex);
 		void Cleanup();
 
 		// input (should move it from here)
@@ -100,9 +213,6 @@ namespace vu {
 		bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
 		bool CheckValidationLayerSupport();
 		std::vector<const char*> GetRequiredExtensions();
-		void CreateRenderPass();
-		void CreateColorResources();
-		void CreateDepthResources();
 		RendererInfo CreateRendererInfo();
 		
 		// validation layers
@@ -118,7 +228,7 @@ namespace vu {
 		);
 
 		// swapchain
-		void CreateSwapChain();
+		void CreateSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
 		void CreateSurface();
 		void CreateImageViews();
 		vu::SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
@@ -126,7 +236,6 @@ namespace vu {
 		VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
 		VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 		static void FramebufferResizeCallback(GLFWwindow *window, int width, int height);
-		void CreateFrameBuffers();
 		void CleanupSwapChain();
 		void RecreateSwapChain();
 		
@@ -138,6 +247,18 @@ namespace vu {
 		void CreateCommandPool();
 		void CreateCommandBuffers();
 		void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+		void RecordDraws(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count);
+		void RecordDepthPrepass(VkCommandBuffer commandBuffer);
+		vu::SecondaryInheritance GetMainInheritance() const;
+		void BuildDrawList();
+		void BuildBatches();
+		void BuildRenderQueue();
+		void CreateSoftwareOcclusion();
+		void CullFrustum();
+		void CullOccluded();
+		void UpdateSceneBvh(bool changedOnly);
+		void LogRecordTiming();
+		void PrintAttachmentCosts();
 
 		// shaders
 		void CreateShaderModules();
@@ -147,8 +268,8 @@ namespace vu {
 		void CreateTextureImages();
 
 		// materials ubo creation (should be moved)
-		void CreateMaterialslBuffers();
-		void SetMaterialsBuffers();
+		void CreateMaterials();
+		void SetMaterialUniformBuffers();
 
 		// samplers
 		void CreateTextureSampler();
@@ -156,17 +277,24 @@ namespace vu {
 		// descriptors
 		void CreateDescriptorSetLayout();
 		void CreateGraphicsPipeline();
+		PipelineDesc CreatePipelineDesc(BlendMode blendMode);
 		void CreateDescriptorPool();
 		void CreateUniformBuffers();
+		void CreateObjectBuffers();
+		void CreateGpuScene();
+		void WriteObjectDescriptors();
 		void CreateDescriptorSets();
 		
 		// synchronization
+		void CreateTimelines();
 		void CreateSyncObjects();
 
 		// scene updated (should be moved)
 		void UpdateTime();
 		void UpdateTransforms();
-		void SetGlobalUniformBuffers(uint32_t currentImage);
+		void UpdateObjects();
+		void SetGlobalUniformBuffers();
+		void UpdateMaterialTextures();
 		void SetGlobalPushConstants(VkCommandBuffer commandBuffer);
 
 
@@ -177,7 +305,7 @@ namespace vu {
 		VkFormat                 m_swapChainImageFormat;
 		VkExtent2D               m_swapChainExtent;
 		VkSurfaceKHR             m_surface;
-		VkRenderPass             m_renderPass;
+		VkFormat                 m_depthFormat;
 		VmaAllocator             m_allocator;
 		VkDebugUtilsMessengerEXT m_debugMessenger;
 
@@ -191,63 +319,126 @@ namespace vu {
 		
 		std::vector<VkImage>       swapChainImages;
 		std::vector<VkImageView>   swapChainImageViews;
-		std::vector<VkFramebuffer> swapChainFramebuffers;
+
+		vu::RenderGraph            m_renderGraph;
 
 		VkCommandPool m_graphicsCommandPool;
 		VkCommandPool m_transferCommandPool;
 		std::vector<VkCommandBuffer> graphicsCommandBuffers;
 		std::vector<VkCommandBuffer> transferCommandBuffers;
+		vu::CommandRecorder          m_commandRecorder;
+		vu::JobSystem                m_jobSystem;
+		vu::FrameArenas              m_frameArenas;         // transient cpu data of each frame slot
+		vu::HeapAllocationTracker    m_allocationTracker;   // heap allocations of DrawFrame
 
 		std::vector<VkSemaphore> imageAvailableSemaphores;
 		std::vector<VkSemaphore> renderFinishedSemaphores;
-		std::vector<VkFence>     inFlightFences;
+		vu::Timeline             m_graphicsTimeline;     // signaled by every frame submission
+		vu::Timeline             m_transferTimeline;     // signaled by every upload
+		std::vector<uint64_t>    frameTimelineValues;    // graphics value of last submission of each frame slot
+		vu::FramePacer           m_framePacer;
+		vu::DeletionQueue        m_deletionQueue;        // objects destroyed once frames that used them finish
+		vu::PipelineStatistics   m_pipelineStatistics;   // fragment invocations with and without depth prepass
+
+		vu::MemoryStats                            m_memoryStats;
+		uint32_t                                   memoryLogInterval = 0;
+		std::string                                memoryJsonPath;
+		vu::Defragmenter                           m_defragmenter;
+		double                                     defragBudgetMs = 1.0;
+		std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> textureGenerations{};  // defragmenter image generation material sets of each slot point at
 
 		VkDescriptorSetLayout          descriptorSetLayoutGlobal;
 		VkDescriptorSetLayout          descriptorSetLayoutLocal;
 		VkPipelineLayout               pipelineLayout;
-		VkPipeline                     graphicsPipeline;
+		vu::PipelineCache              m_pipelineCache;
+		vu::PipelineDesc               opaquePipelineDesc;
+		vu::PipelineDesc               transparentPipelineDesc;
+		vu::PipelineDesc               depthPrepassPipelineDesc;
+		vu::PipelineDesc               opaqueEqualPipelineDesc;  // opaque after depth prepass (EQUAL, no depth writes)
+		VkPipeline                     fallbackPipeline;     // owned by m_pipelineCache
+		VkPipeline                     opaquePipeline;       // resolved at the start of every frame
+		VkPipeline                     transparentPipeline;  // resolved at the start of every frame
+		VkPipeline                     depthPrepassPipeline; // created up front, there is nothing to fall back to
 		VkDescriptorPool               descriptorPool;
-		std::vector<VkBuffer>          uniformBuffers;
-		std::vector<VmaAllocation>     uniformAllocations;
-		std::vector<VmaAllocationInfo> uniformAllocationInfos;
+		vu::UniformAllocator           m_uniformAllocator;
+		uint32_t                       globalUniformOffset = 0;  // view and projection of current frame
 		std::vector<VkDescriptorSet>   descriptorSetsGlobal;
-		std::vector<VkDescriptorSet>   descriptorSetsMat1;
-		std::vector<VkDescriptorSet>   descriptorSetsMat2;
 
 		VkShaderModule vertShaderModule;
+		VkShaderModule depthVertShaderModule;
 		VkShaderModule fragShaderModule;
+		VkShaderModule fallbackFragShaderModule;
+		VkShaderModule cullShaderModule;
+		VkShaderModule hizShaderModule;
+		VkShaderModule hizMsaaShaderModule;
+
+		vu::GpuScene     m_gpuScene;
+		vu::DepthPyramid m_depthPyramid;
+		bool         gpuDriven = false;
+		bool         supportsGpuDriven = false;          // multi draw indirect + first instance
+		bool         supportsDrawIndirectCount = false;
+		bool         supportsMemoryBudget = false;       // VK_EXT_memory_budget
+		bool         supportsPipelineStatistics = false; // pipeline statistics queries + inherited queries
+		bool         depthPrepass = false;
+		bool         prepassKeyDown = false;
+		bool         occlusionCulling = false;
+		bool         occlusionKeyDown = false;
+		bool         pickKeyDown = false;
+		glm::mat4    viewProj{1.0f};                     // camera of current frame, used for culling
 
 		vu::Mesh *mesh1;
 		vu::Mesh *mesh2;
 
-		vu::Transform transform1;
-		vu::Transform transform2;
+		vu::Scene  m_scene;
+		vu::Entity entity1;
+		vu::Entity entity2;
+		vu::Entity stressRoot;
+
+		std::vector<vu::DrawItem>  m_drawList;
+		std::vector<vu::DrawBatch> m_batches;          // recorded by command recorder, one draw each
+		uint32_t                   m_opaqueBatchCount = 0;  // opaque batches come first, transparent ones after them
+		std::vector<uint32_t>      m_instanceItems;    // draw list indices in instance order
+		vu::RenderQueue            m_renderQueue;      // cpu path sorts draw list every frame, batches are runs of equal state
+		vu::CullingStats           m_cullingStats;
+		glm::vec4                  m_frustumPlanes[6];  // of current frame
+		std::vector<uint32_t>      m_frustumCandidates; // draw items whose boxes reach into frustum (from scene bvh)
+		std::vector<uint8_t>       m_candidateVisible; // one per candidate
+		std::vector<float>         m_sphereX;          // world bounding spheres of candidates, culled 8 at a time
+		std::vector<float>         m_sphereY;
+		std::vector<float>         m_sphereZ;
+		std::vector<float>         m_sphereRadius;
+		std::vector<uint8_t>       m_visible;          // one per draw item, current frame
+		std::atomic<uint32_t>      m_visibleCount{0};
+		vu::SoftwareOcclusion      m_softwareOcclusion;
+		bool                       softwareOcclusion = false;
+		std::unordered_map<const vu::Mesh *, uint32_t> m_occluderMeshes;  // mesh ids of software occlusion
+		std::vector<vu::OccluderInstance> m_occluderInstances;
+		std::vector<vu::OcclusionQuery>   m_occlusionQueries;  // one per draw item
+		std::vector<uint8_t>              m_occluded;          // one per draw item, current frame
+		vu::Bvh                    m_sceneBvh;
+		std::vector<vu::Aabb>      m_itemBounds;       // world boxes of draw items
+		uint32_t                   bvhCheckRefits = 0; // sah cost of scene bvh is checked again after this many refitted nodes
+		bool                       sceneBvhStale = true; // world matrices changed in frames that didn't refit it
+		vu::UniformAllocator       m_objectAllocator;  // object data of cpu path in instance order
+		uint32_t                   objectOffset = 0;   // object data of current frame
+		uint32_t                   stressGridSize = 0;
+		double                     recordTimingMs = 0.0;
+		uint32_t                   recordTimingFrames = 0;
 
 		vu::Image *image1;
 		vu::Image *image2;
 
-		std::vector<VkBuffer>          uniformBuffersMat1;
-		std::vector<VmaAllocation>     uniformAllocationsMat1;
-		std::vector<VmaAllocationInfo> uniformAllocationInfosMat1;
-
-		std::vector<VkBuffer>          uniformBuffersMat2;
-		std::vector<VmaAllocation>     uniformAllocationsMat2;
-		std::vector<VmaAllocationInfo> uniformAllocationInfosMat2;
+		vu::Material material1;
+		vu::Material material2;
 
 		VkSampler textureSampler;
 
-		VkImage depthImage;
-		VmaAllocation depthImageAllocation;
-		VmaAllocationInfo depthImageAllocationInfo;
-		VkImageView depthImageView;
-
 		VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
-		VkImage colorImage;
-		VmaAllocation colorImageAllocation;
-		VmaAllocationInfo colorImageAllocationInfo;
-		VkImageView colorImageView;
+		uint32_t              requestedMsaaSamples = 0;
 
-		uint32_t currentFrame = 0;
+		uint32_t         currentFrame = 0;
+		uint32_t         framesInFlight = 2;
+		VkPresentModeKHR preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
 		float lastFrameTime = 0.0f;
 		float currentFrameTime = 0.0f;
 		float deltaTime = 0.0f;
@@ -257,6 +448,8 @@ namespace vu {
 		float sensitivity = 0.1f;
 
 		vu::Transform camTransform;
+		float camYaw = 0.0f;    // degrees
+		float camPitch = 0.0f;  // degrees
 		const float camSpeed = 2.0f;
 
 		bool framebufferResized = false;
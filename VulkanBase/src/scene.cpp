@@ -0,0 +1,250 @@
+#include "scene.h"
+
+using namespace vu;
+
+
+void Scene::Reserve(uint32_t count) {
+	m_positions.reserve(count);
+	m_rotations.reserve(count);
+	m_scales.reserve(count);
+	m_worldMatrices.reserve(count);
+	m_prevWorldMatrices.reserve(count);
+	m_normalMatrices.reserve(count);
+	m_parents.reserve(count);
+	m_dirty.reserve(count);
+	m_changed.reserve(count);
+	m_entities.reserve(count);
+	m_indices.reserve(count);
+}
+
+
+Entity Scene::CreateEntity(const glm::vec3 &position, Entity parent) {
+	Entity entity = static_cast<Entity>(m_indices.size());
+	uint32_t index = static_cast<uint32_t>(m_entities.size());
+
+	// appended after every existing entity, so it is after its parent too
+	m_positions.push_back(position);
+	m_rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	m_scales.push_back(glm::vec3(1.0f));
+	m_worldMatrices.push_back(glm::mat4(1.0f));
+	m_prevWorldMatrices.push_back(glm::mat4(1.0f));
+	m_normalMatrices.push_back(glm::mat3(1.0f));
+	m_parents.push_back(parent == NULL_ENTITY ? NO_PARENT : m_indices[parent]);
+	m_dirty.push_back(1);
+	m_changed.push_back(0);
+	m_entities.push_back(entity);
+	m_indices.push_back(index);
+
+	return entity;
+}
+
+
+void Scene::SetParent(Entity entity, Entity parent) {
+	// parent can't be inside subtree of entity
+	for (Entity ancestor = parent; ancestor != NULL_ENTITY; ancestor = GetParent(ancestor)) {
+		if (ancestor == entity) {
+			throw std::runtime_error("failed to set parent, hierarchy would have a cycle!");
+		}
+	}
+
+	uint32_t index = m_indices[entity];
+	m_parents[index] = parent == NULL_ENTITY ? NO_PARENT : m_indices[parent];
+	m_dirty[index] = 1;
+
+	if (parent != NULL_ENTITY && m_indices[parent] > index) {
+		m_hierarchyDirty = true;
+	}
+}
+
+
+Entity Scene::GetParent(Entity entity) const {
+	uint32_t parent = m_parents[m_indices[entity]];
+	return parent == NO_PARENT ? NULL_ENTITY : m_entities[parent];
+}
+
+
+void Scene::SetPosition(Entity entity, const glm::vec3 &position) {
+	m_positions[m_indices[entity]] = position;
+	MarkDirty(entity);
+}
+
+
+void Scene::SetRotation(Entity entity, const glm::quat &rotation) {
+	m_rotations[m_indices[entity]] = rotation;
+	MarkDirty(entity);
+}
+
+
+void Scene::SetRotation(Entity entity, const glm::vec3 &eulerRadians) {
+	glm::quat rotation = glm::angleAxis(eulerRadians.x, glm::vec3(1.0f, 0.0f, 0.0f)) *
+	                     glm::angleAxis(eulerRadians.y, glm::vec3(0.0f, 1.0f, 0.0f)) *
+	                     glm::angleAxis(eulerRadians.z, glm::vec3(0.0f, 0.0f, 1.0f));
+	SetRotation(entity, rotation);
+}
+
+
+void Scene::SetScale(Entity entity, const glm::vec3 &scale) {
+	m_scales[m_indices[entity]] = scale;
+	MarkDirty(entity);
+}
+
+
+glm::mat4 Scene::ComposeMatrix(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale) {
+	// same as T * R * S without two matrix multiplications
+	glm::mat4 matrix = glm::mat4_cast(rotation);
+	matrix[0] *= scale.x;
+	matrix[1] *= scale.y;
+	matrix[2] *= scale.z;
+	matrix[3] = glm::vec4(position, 1.0f);
+	return matrix;
+}
+
+
+glm::mat3 Scene::ComposeNormalMatrix(const glm::quat &rotation, const glm::vec3 &scale) {
+	// inverse transpose of R * S is R * S^-1
+	glm::mat3 matrix = glm::mat3_cast(rotation);
+	matrix[0] /= scale.x;
+	matrix[1] /= scale.y;
+	matrix[2] /= scale.z;
+	return matrix;
+}
+
+
+void Scene::Update() {
+	if (m_hierarchyDirty) {
+		SortHierarchy();
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// parent is always updated before its children, so its changed flag is final when children read it
+	uint32_t updated = 0;
+	uint32_t count = static_cast<uint32_t>(m_entities.size());
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t parent = m_parents[i];
+		bool dirty = m_dirty[i] || (parent != NO_PARENT && m_changed[parent]);
+
+		// entity that stopped moving has the same matrix in both frames from now on
+		if (!dirty) {
+			if (m_changed[i]) {
+				m_prevWorldMatrices[i] = m_worldMatrices[i];
+				m_changed[i] = 0;
+			}
+			continue;
+		}
+
+		// inverse transpose of a product is product of inverse transposes
+		glm::mat4 local = ComposeMatrix(m_positions[i], m_rotations[i], m_scales[i]);
+		glm::mat3 localNormal = ComposeNormalMatrix(m_rotations[i], m_scales[i]);
+
+		m_prevWorldMatrices[i] = m_worldMatrices[i];
+		m_worldMatrices[i] = parent == NO_PARENT ? local : m_worldMatrices[parent] * local;
+		m_normalMatrices[i] = parent == NO_PARENT ? localNormal : m_normalMatrices[parent] * localNormal;
+		m_changed[i] = 1;
+		m_dirty[i] = 0;
+		updated++;
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_updateMs = std::chrono::duration<double, std::milli>(end - start).count();
+	m_updatedEntities = updated;
+	m_totalUpdateMs += m_updateMs;
+	m_updates++;
+}
+
+
+void Scene::SortHierarchy() {
+	uint32_t count = static_cast<uint32_t>(m_entities.size());
+
+	// children lists, then depth first walk from roots, subtrees end up next to each other
+	std::vector<uint32_t> childStart(count + 1, 0);
+	for (uint32_t i = 0; i < count; i++) {
+		if (m_parents[i] != NO_PARENT) {
+			childStart[m_parents[i] + 1]++;
+		}
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		childStart[i + 1] += childStart[i];
+	}
+
+	std::vector<uint32_t> children(childStart[count]);
+	std::vector<uint32_t> childFill(childStart.begin(), childStart.end() - 1);
+	for (uint32_t i = 0; i < count; i++) {
+		if (m_parents[i] != NO_PARENT) {
+			children[childFill[m_parents[i]]++] = i;
+		}
+	}
+
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> stack;
+	order.reserve(count);
+	for (uint32_t root = 0; root < count; root++) {
+		if (m_parents[root] != NO_PARENT) {
+			continue;
+		}
+
+		stack.push_back(root);
+		while (!stack.empty()) {
+			uint32_t index = stack.back();
+			stack.pop_back();
+			order.push_back(index);
+
+			// reversed, so children keep their order
+			for (uint32_t child = childStart[index + 1]; child > childStart[index]; child--) {
+				stack.push_back(children[child - 1]);
+			}
+		}
+	}
+
+	// new index of every old index
+	std::vector<uint32_t> remap(count);
+	for (uint32_t i = 0; i < count; i++) {
+		remap[order[i]] = i;
+	}
+
+	auto permute = [&order](auto &array) {
+		std::remove_reference_t<decltype(array)> sorted(array.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			sorted[i] = array[order[i]];
+		}
+		array.swap(sorted);
+	};
+	permute(m_positions);
+	permute(m_rotations);
+	permute(m_scales);
+	permute(m_worldMatrices);
+	permute(m_prevWorldMatrices);
+	permute(m_normalMatrices);
+	permute(m_parents);
+	permute(m_dirty);
+	permute(m_changed);
+	permute(m_entities);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (m_parents[i] != NO_PARENT) {
+			m_parents[i] = remap[m_parents[i]];
+		}
+		m_indices[m_entities[i]] = i;
+	}
+
+	m_hierarchyDirty = false;
+}
+
+
+SceneStats Scene::GetStats() const {
+	SceneStats stats{};
+	stats.entities = GetEntityCount();
+	stats.updatedEntities = m_updatedEntities;
+	stats.updateMs = m_updateMs;
+	stats.averageUpdateMs = m_updates > 0 ? m_totalUpdateMs / m_updates : 0.0;
+	return stats;
+}
+
+
+void Scene::PrintStats() const {
+	SceneStats stats = GetStats();
+
+	std::cout << "scene:\n";
+	std::cout << "\t" << "entities: " << stats.entities << " (updated last frame: " << stats.updatedEntities << ")\n";
+	std::cout << "\t" << "update: " << stats.averageUpdateMs << " ms average\n\n";
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <limits>
+#include <type_traits>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace vu {
+
+	// handle of scene entity, stays valid when hierarchy is reordered
+	using Entity = uint32_t;
+	const Entity NULL_ENTITY = std::numeric_limits<uint32_t>::max();
+
+	struct SceneStats {
+		uint32_t entities        = 0;
+		uint32_t updatedEntities = 0;    // world matrices recomputed by last update
+		double   updateMs        = 0.0;  // last update
+		double   averageUpdateMs = 0.0;
+	};
+
+	// Transforms of all entities stored as separate arrays (structure of arrays)
+	// Arrays are ordered so every parent comes before its children, one pass from the start updates whole hierarchy
+	// Only entities whose local transform changed and their subtrees recompute world matrices
+	class Scene {
+	public:
+		void Reserve(uint32_t count);
+
+		Entity CreateEntity(const glm::vec3 &position = glm::vec3(0.0f), Entity parent = NULL_ENTITY);
+		void SetParent(Entity entity, Entity parent);  // local transform is kept, hierarchy is sorted in next update
+
+		// local transform, relative to parent
+		void SetPosition(Entity entity, const glm::vec3 &position);
+		void SetRotation(Entity entity, const glm::quat &rotation);
+		void SetRotation(Entity entity, const glm::vec3 &eulerRadians);  // x, then y, then z like vu::Transform
+		void SetScale(Entity entity, const glm::vec3 &scale);
+
+		glm::vec3 GetPosition(Entity entity) const { return m_positions[m_indices[entity]]; }
+		glm::quat GetRotation(Entity entity) const { return m_rotations[m_indices[entity]]; }
+		glm::vec3 GetScale(Entity entity)    const { return m_scales[m_indices[entity]]; }
+		Entity    GetParent(Entity entity)   const;
+
+		// valid after Update
+		const glm::mat4 &GetWorldMatrix(Entity entity)   const { return m_worldMatrices[m_indices[entity]]; }
+		const glm::mat4 &GetPrevWorldMatrix(Entity entity) const { return m_prevWorldMatrices[m_indices[entity]]; }  // before last update
+		const glm::mat3 &GetNormalMatrix(Entity entity)  const { return m_normalMatrices[m_indices[entity]]; }      // inverse transpose of world
+		glm::vec3        GetWorldPosition(Entity entity) const { return glm::vec3(m_worldMatrices[m_indices[entity]][3]); }
+		bool             WorldChanged(Entity entity)     const { return m_changed[m_indices[entity]] != 0; }
+
+		// sorts hierarchy if parents changed, then recomputes world matrices of dirty subtrees
+		void Update();
+
+		uint32_t   GetEntityCount() const { return static_cast<uint32_t>(m_entities.size()); }
+		SceneStats GetStats() const;
+		void PrintStats() const;
+
+	private:
+		static const uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+		static glm::mat4 ComposeMatrix(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale);
+		static glm::mat3 ComposeNormalMatrix(const glm::quat &rotation, const glm::vec3 &scale);
+		void SortHierarchy();
+		void MarkDirty(Entity entity) { m_dirty[m_indices[entity]] = 1; }
+
+		// by index, parents before children
+		std::vector<glm::vec3> m_positions;
+		std::vector<glm::quat> m_rotations;
+		std::vector<glm::vec3> m_scales;
+		std::vector<glm::mat4> m_worldMatrices;
+		std::vector<glm::mat4> m_prevWorldMatrices;
+		std::vector<glm::mat3> m_normalMatrices;
+		std::vector<uint32_t>  m_parents;   // index of parent or NO_PARENT
+		std::vector<uint8_t>   m_dirty;     // local transform changed since last update
+		std::vector<uint8_t>   m_changed;   // world matrix recomputed by last update
+		std::vector<Entity>    m_entities;  // entity at index
+
+		std::vector<uint32_t> m_indices;    // index of entity
+		bool                  m_hierarchyDirty = false;
+
+		uint32_t m_updatedEntities = 0;
+		double   m_updateMs = 0.0;
+		double   m_totalUpdateMs = 0.0;
+		uint64_t m_updates = 0;
+	};
+
+}
@@ -0,0 +1,59 @@
+#include "simd.h"
+
+#if defined(_MSC_VER) && VU_SIMD_X86
+	#include <intrin.h>
+#endif
+
+using namespace vu;
+
+
+static SimdLevel detectSimdLevel() {
+#if !VU_SIMD_X86
+	return SimdLevel::Scalar;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+
+	// os must save ymm registers on context switch
+	bool ymmEnabled = osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+
+	bool avx2 = false;
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+
+	if (ymmEnabled && avx2 && fma) {
+		return SimdLevel::Avx2;
+	}
+	return sse2 ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return SimdLevel::Avx2;
+	}
+	return __builtin_cpu_supports("sse2") ? SimdLevel::Sse2 : SimdLevel::Scalar;
+#endif
+}
+
+
+SimdLevel vu::getSimdLevel() {
+	static SimdLevel level = detectSimdLevel();
+	return level;
+}
+
+
+const char *vu::simdLevelName(SimdLevel level) {
+	switch (level) {
+		case SimdLevel::Avx2: return "avx2";
+		case SimdLevel::Sse2: return "sse2";
+		default:              return "scalar";
+	}
+}
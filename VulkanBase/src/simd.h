@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// x86 intrinsics, other architectures use scalar paths
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define VU_SIMD_X86 1
+	#include <immintrin.h>
+#else
+	#define VU_SIMD_X86 0
+#endif
+
+// functions with avx2 code are compiled for avx2 only where compiler needs it (msvc accepts intrinsics anywhere)
+// they must be called only when getSimdLevel() says cpu supports it
+#if VU_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+	#define VU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+	#define VU_TARGET_AVX2
+#endif
+
+namespace vu {
+
+	enum class SimdLevel {
+		Scalar = 0,
+		Sse2   = 1,
+		Avx2   = 2
+	};
+
+	// best level supported by cpu and os, detected once
+	SimdLevel getSimdLevel();
+
+	const char *simdLevelName(SimdLevel level);
+
+}
@@ -0,0 +1,390 @@
+#include "software_occlusion.h"
+
+using namespace vu;
+
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+
+void SoftwareOcclusion::Initialize(JobSystem *jobs, uint32_t width, uint32_t height, SimdLevel level) {
+	m_jobs = jobs;
+	m_level = level;
+
+	// avx2 rows are 8 pixels wide and never cross the end of a row
+	m_blocksX = std::max((width + BLOCK_SIZE - 1) / BLOCK_SIZE, 1u);
+	m_blocksY = std::max((height + BLOCK_SIZE - 1) / BLOCK_SIZE, 1u);
+	m_width = m_blocksX * BLOCK_SIZE;
+	m_height = m_blocksY * BLOCK_SIZE;
+
+	m_depth.assign(m_width * m_height, 1.0f);
+	m_blockMax.assign(m_blocksX * m_blocksY, 1.0f);
+	m_bandOffsets.assign(m_blocksY + 1, 0);
+}
+
+
+uint32_t SoftwareOcclusion::AddMesh(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices) {
+	Mesh mesh{};
+	mesh.firstPosition = static_cast<uint32_t>(m_positions.size());
+	mesh.positionCount = static_cast<uint32_t>(positions.size());
+	mesh.firstIndex = static_cast<uint32_t>(m_indices.size());
+	mesh.indexCount = static_cast<uint32_t>(indices.size() / 3 * 3);
+
+	m_positions.insert(m_positions.end(), positions.begin(), positions.end());
+	m_indices.insert(m_indices.end(), indices.begin(), indices.begin() + mesh.indexCount);
+	m_meshes.push_back(mesh);
+	return static_cast<uint32_t>(m_meshes.size() - 1);
+}
+
+
+void SoftwareOcclusion::ParallelFor(uint32_t count, uint32_t grainSize, const JobSystem::RangeFunction &function) {
+	if (m_jobs) {
+		m_jobs->ParallelFor(count, grainSize, function);
+	} else if (count > 0) {
+		function(0, count);
+	}
+}
+
+
+void SoftwareOcclusion::Render(const glm::mat4 &viewProj, const std::vector<OccluderInstance> &occluders) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	m_viewProj = viewProj;
+	m_occluders = &occluders;
+
+	// every occluder writes its own range of vertices and triangles
+	uint32_t vertexCount = 0;
+	uint32_t triangleCount = 0;
+	m_firstVertex.resize(occluders.size());
+	m_firstTriangle.resize(occluders.size());
+	for (uint32_t i = 0; i < occluders.size(); i++) {
+		const Mesh &mesh = m_meshes[occluders[i].mesh];
+		m_firstVertex[i] = vertexCount;
+		m_firstTriangle[i] = triangleCount;
+		vertexCount += mesh.positionCount;
+		triangleCount += mesh.indexCount / 3;
+	}
+	m_screenVertices.resize(vertexCount);
+	m_triangles.resize(triangleCount);
+
+	ParallelFor(static_cast<uint32_t>(occluders.size()), 1, [this](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; i++) {
+			SetupOccluder(i);
+		}
+	});
+
+	BinTriangles();
+
+	// bands don't share pixels, every one clears, rasterizes and reduces its own rows
+	ParallelFor(m_blocksY, 1, [this](uint32_t first, uint32_t count) {
+		for (uint32_t band = first; band < first + count; band++) {
+			RenderBand(band);
+			UpdateBlocks(band);
+		}
+	});
+
+	m_occluders = nullptr;
+
+	m_stats.occluders = static_cast<uint32_t>(occluders.size());
+	m_stats.rasterMs = elapsedMs(start);
+	m_totalMs += m_stats.rasterMs;
+	m_frames++;
+}
+
+
+void SoftwareOcclusion::SetupOccluder(uint32_t occluder) {
+	const OccluderInstance &instance = (*m_occluders)[occluder];
+	const Mesh &mesh = m_meshes[instance.mesh];
+	glm::mat4 mvp = m_viewProj * instance.model;
+
+	const float width = static_cast<float>(m_width);
+	const float height = static_cast<float>(m_height);
+
+	// vertices are shared by several triangles, project each once
+	glm::vec4 *vertices = m_screenVertices.data() + m_firstVertex[occluder];
+	for (uint32_t i = 0; i < mesh.positionCount; i++) {
+		glm::vec4 clip = mvp * glm::vec4(m_positions[mesh.firstPosition + i], 1.0f);
+		if (clip.w <= 0.0f || clip.z < 0.0f) {
+			vertices[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+			continue;
+		}
+		float invW = 1.0f / clip.w;
+		vertices[i] = glm::vec4((clip.x * invW * 0.5f + 0.5f) * width, (clip.y * invW * 0.5f + 0.5f) * height, clip.z * invW, 1.0f);
+	}
+
+	const uint32_t *indices = m_indices.data() + mesh.firstIndex;
+	Triangle *triangles = m_triangles.data() + m_firstTriangle[occluder];
+
+	for (uint32_t t = 0; t < mesh.indexCount / 3; t++) {
+		Triangle &triangle = triangles[t];
+		triangle.minY = 1;
+		triangle.maxY = 0;
+
+		// triangles crossing near plane are skipped, occluding less is always safe
+		glm::vec4 screen[3] = {vertices[indices[t * 3]], vertices[indices[t * 3 + 1]], vertices[indices[t * 3 + 2]]};
+		if (screen[0].w < 0.0f || screen[1].w < 0.0f || screen[2].w < 0.0f) {
+			continue;
+		}
+
+		// both windings are rasterized, occluders may be seen from inside
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+		if (std::abs(area) < 1.0e-6f) {
+			continue;
+		}
+		if (area < 0.0f) {
+			std::swap(screen[1], screen[2]);
+			area = -area;
+		}
+
+		float minX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+		float maxX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+		float minY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+		float maxY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+		if (maxX < 0.0f || maxY < 0.0f || minX > width || minY > height) {
+			continue;
+		}
+
+		// pixel is inside when its center is on the inner side of all three edges
+		for (uint32_t e = 0; e < 3; e++) {
+			const glm::vec4 &a = screen[(e + 1) % 3];
+			const glm::vec4 &b = screen[(e + 2) % 3];
+			triangle.edgeA[e] = a.y - b.y;
+			triangle.edgeB[e] = b.x - a.x;
+			triangle.edgeC[e] = a.x * b.y - a.y * b.x;
+		}
+
+		// ndc depth is linear in screen space
+		float dzdx = ((screen[1].z - screen[0].z) * (screen[2].y - screen[0].y) - (screen[2].z - screen[0].z) * (screen[1].y - screen[0].y)) / area;
+		float dzdy = ((screen[2].z - screen[0].z) * (screen[1].x - screen[0].x) - (screen[1].z - screen[0].z) * (screen[2].x - screen[0].x)) / area;
+		triangle.depthA = dzdx;
+		triangle.depthB = dzdy;
+		triangle.depthC = screen[0].z - dzdx * screen[0].x - dzdy * screen[0].y;
+
+		triangle.minX = std::max(static_cast<int>(std::floor(minX)), 0);
+		triangle.maxX = std::min(static_cast<int>(std::ceil(maxX)), static_cast<int>(m_width) - 1);
+		triangle.minY = std::max(static_cast<int>(std::floor(minY)), 0);
+		triangle.maxY = std::min(static_cast<int>(std::ceil(maxY)), static_cast<int>(m_height) - 1);
+		if (triangle.minX > triangle.maxX) {
+			triangle.minY = 1;
+			triangle.maxY = 0;
+		}
+	}
+}
+
+
+// band only walks triangles that touch it
+void SoftwareOcclusion::BinTriangles() {
+	std::fill(m_bandOffsets.begin(), m_bandOffsets.end(), 0);
+
+	m_stats.triangles = 0;
+	for (const Triangle &triangle : m_triangles) {
+		if (triangle.minY > triangle.maxY) {
+			continue;
+		}
+		for (uint32_t band = triangle.minY / BLOCK_SIZE; band <= triangle.maxY / BLOCK_SIZE; band++) {
+			m_bandOffsets[band + 1]++;
+		}
+		m_stats.triangles++;
+	}
+
+	for (uint32_t band = 0; band < m_blocksY; band++) {
+		m_bandOffsets[band + 1] += m_bandOffsets[band];
+	}
+	m_bandTriangles.resize(m_bandOffsets[m_blocksY]);
+
+	// offsets are used as write cursors and shifted back afterwards
+	for (uint32_t i = 0; i < m_triangles.size(); i++) {
+		const Triangle &triangle = m_triangles[i];
+		if (triangle.minY > triangle.maxY) {
+			continue;
+		}
+		for (uint32_t band = triangle.minY / BLOCK_SIZE; band <= triangle.maxY / BLOCK_SIZE; band++) {
+			m_bandTriangles[m_bandOffsets[band]++] = i;
+		}
+	}
+	for (uint32_t band = m_blocksY; band > 0; band--) {
+		m_bandOffsets[band] = m_bandOffsets[band - 1];
+	}
+	m_bandOffsets[0] = 0;
+}
+
+
+static void rasterizeScalar(float *row, int x0, int x1, float y, const float *edgeA, const float *edgeB, const float *edgeC,
+                            float depthA, float depthB, float depthC) {
+	for (int x = x0; x <= x1; x++) {
+		float px = x + 0.5f;
+		bool inside = true;
+		for (int e = 0; e < 3; e++) {
+			inside = inside && edgeA[e] * px + edgeB[e] * y + edgeC[e] >= 0.0f;
+		}
+		if (inside) {
+			row[x] = std::min(row[x], depthA * px + depthB * y + depthC);
+		}
+	}
+}
+
+
+#if VU_SIMD_X86
+
+// 8 pixels of a row per iteration, x0 is multiple of 8 and row length is too
+VU_TARGET_AVX2 static void rasterizeAvx2(float *row, int x0, int x1, float y, const float *edgeA, const float *edgeB, const float *edgeC,
+                                         float depthA, float depthB, float depthC) {
+	const __m256 centers = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+
+	// row constant part of every plane
+	__m256 a0 = _mm256_set1_ps(edgeA[0]), r0 = _mm256_set1_ps(edgeB[0] * y + edgeC[0]);
+	__m256 a1 = _mm256_set1_ps(edgeA[1]), r1 = _mm256_set1_ps(edgeB[1] * y + edgeC[1]);
+	__m256 a2 = _mm256_set1_ps(edgeA[2]), r2 = _mm256_set1_ps(edgeB[2] * y + edgeC[2]);
+	__m256 az = _mm256_set1_ps(depthA), rz = _mm256_set1_ps(depthB * y + depthC);
+
+	for (int x = x0; x <= x1; x += 8) {
+		__m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), centers);
+		__m256 e0 = _mm256_fmadd_ps(a0, px, r0);
+		__m256 e1 = _mm256_fmadd_ps(a1, px, r1);
+		__m256 e2 = _mm256_fmadd_ps(a2, px, r2);
+
+		// sign bit of any edge value - outside
+		__m256 outside = _mm256_or_ps(_mm256_or_ps(e0, e1), e2);
+		if (_mm256_movemask_ps(outside) == 0xFF) {
+			continue;
+		}
+
+		__m256 z = _mm256_fmadd_ps(az, px, rz);
+		__m256 depth = _mm256_loadu_ps(row + x);
+		_mm256_storeu_ps(row + x, _mm256_blendv_ps(_mm256_min_ps(depth, z), depth, outside));
+	}
+}
+
+#endif
+
+
+void SoftwareOcclusion::RenderBand(uint32_t band) {
+	int bandMinY = static_cast<int>(band * BLOCK_SIZE);
+	int bandMaxY = bandMinY + static_cast<int>(BLOCK_SIZE) - 1;
+
+	float *bandDepth = m_depth.data() + bandMinY * m_width;
+	std::fill(bandDepth, bandDepth + BLOCK_SIZE * m_width, 1.0f);
+
+	for (uint32_t i = m_bandOffsets[band]; i < m_bandOffsets[band + 1]; i++) {
+		const Triangle &triangle = m_triangles[m_bandTriangles[i]];
+		int minY = std::max(triangle.minY, bandMinY);
+		int maxY = std::min(triangle.maxY, bandMaxY);
+
+		for (int y = minY; y <= maxY; y++) {
+			float *row = m_depth.data() + y * m_width;
+			float py = y + 0.5f;
+#if VU_SIMD_X86
+			if (m_level == SimdLevel::Avx2) {
+				rasterizeAvx2(row, triangle.minX & ~7, triangle.maxX, py, triangle.edgeA, triangle.edgeB, triangle.edgeC,
+					triangle.depthA, triangle.depthB, triangle.depthC);
+				continue;
+			}
+#endif
+			rasterizeScalar(row, triangle.minX, triangle.maxX, py, triangle.edgeA, triangle.edgeB, triangle.edgeC,
+				triangle.depthA, triangle.depthB, triangle.depthC);
+		}
+	}
+}
+
+
+void SoftwareOcclusion::UpdateBlocks(uint32_t band) {
+	const float *bandDepth = m_depth.data() + band * BLOCK_SIZE * m_width;
+	float *blockMax = m_blockMax.data() + band * m_blocksX;
+
+	std::fill(blockMax, blockMax + m_blocksX, 0.0f);
+	for (uint32_t y = 0; y < BLOCK_SIZE; y++) {
+		const float *row = bandDepth + y * m_width;
+		for (uint32_t x = 0; x < m_width; x++) {
+			float &block = blockMax[x / BLOCK_SIZE];
+			block = std::max(block, row[x]);
+		}
+	}
+}
+
+
+bool SoftwareOcclusion::IsOccluded(const OcclusionQuery &query) const {
+	glm::mat4 mvp = m_viewProj * query.model;
+
+	// screen rect and nearest depth of the box
+	glm::vec2 rectMin(std::numeric_limits<float>::max());
+	glm::vec2 rectMax(std::numeric_limits<float>::lowest());
+	float nearestDepth = 1.0f;
+	for (uint32_t i = 0; i < 8; i++) {
+		glm::vec3 corner((i & 1) ? query.boundsMax.x : query.boundsMin.x, (i & 2) ? query.boundsMax.y : query.boundsMin.y, (i & 4) ? query.boundsMax.z : query.boundsMin.z);
+		glm::vec4 clip = mvp * glm::vec4(corner, 1.0f);
+
+		// crosses near plane, camera may be inside
+		if (clip.w <= 0.0f || clip.z < 0.0f) {
+			return false;
+		}
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		glm::vec2 pixel((ndc.x * 0.5f + 0.5f) * m_width, (ndc.y * 0.5f + 0.5f) * m_height);
+		rectMin = glm::min(rectMin, pixel);
+		rectMax = glm::max(rectMax, pixel);
+		nearestDepth = std::min(nearestDepth, ndc.z);
+	}
+
+	// off screen boxes are left to frustum culling
+	if (rectMax.x < 0.0f || rectMax.y < 0.0f || rectMin.x >= m_width || rectMin.y >= m_height) {
+		return false;
+	}
+
+	// every pixel the rect touches, not only covered centers
+	int x0 = std::max(static_cast<int>(std::floor(rectMin.x)), 0);
+	int y0 = std::max(static_cast<int>(std::floor(rectMin.y)), 0);
+	int x1 = std::min(static_cast<int>(std::floor(rectMax.x)), static_cast<int>(m_width) - 1);
+	int y1 = std::min(static_cast<int>(std::floor(rectMax.y)), static_cast<int>(m_height) - 1);
+
+	for (int by = y0 / static_cast<int>(BLOCK_SIZE); by <= y1 / static_cast<int>(BLOCK_SIZE); by++) {
+		for (int bx = x0 / static_cast<int>(BLOCK_SIZE); bx <= x1 / static_cast<int>(BLOCK_SIZE); bx++) {
+			if (m_blockMax[by * m_blocksX + bx] < nearestDepth) {
+				continue;  // whole block is in front of the box
+			}
+
+			// block is partly outside the rect or partly behind the box, check its pixels inside the rect
+			int px0 = std::max(x0, bx * static_cast<int>(BLOCK_SIZE)), px1 = std::min(x1, (bx + 1) * static_cast<int>(BLOCK_SIZE) - 1);
+			int py0 = std::max(y0, by * static_cast<int>(BLOCK_SIZE)), py1 = std::min(y1, (by + 1) * static_cast<int>(BLOCK_SIZE) - 1);
+			for (int y = py0; y <= py1; y++) {
+				const float *row = m_depth.data() + y * m_width;
+				for (int x = px0; x <= px1; x++) {
+					if (row[x] >= nearestDepth) {
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+
+void SoftwareOcclusion::Test(const OcclusionQuery *queries, uint32_t count, uint8_t *occluded) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ParallelFor(count, 0, [this, queries, occluded](uint32_t first, uint32_t rangeCount) {
+		for (uint32_t i = first; i < first + rangeCount; i++) {
+			occluded[i] = IsOccluded(queries[i]) ? 1 : 0;
+		}
+	});
+
+	m_stats.tested = count;
+	m_stats.culled = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		m_stats.culled += occluded[i];
+	}
+	m_stats.testMs = elapsedMs(start);
+	m_totalMs += m_stats.testMs;
+}
+
+
+void SoftwareOcclusion::PrintStats() const {
+	std::cout << "software occlusion:\n";
+	std::cout << "\t" << m_width << "x" << m_height << " depth, " << simdLevelName(m_level) << " rasterizer\n";
+	std::cout << "\t" << "last frame: " << m_stats.occluders << " occluders, " << m_stats.triangles << " triangles, "
+	          << m_stats.culled << " of " << m_stats.tested << " objects culled\n";
+	std::cout << "\t" << "last frame: " << m_stats.rasterMs << " ms raster, " << m_stats.testMs << " ms test, average total "
+	          << (m_frames > 0 ? m_totalMs / m_frames : 0.0) << " ms\n\n";
+}
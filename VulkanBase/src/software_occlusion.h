@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include "job_system.h"
+#include "simd.h"
+
+namespace vu {
+
+	// occluder mesh placed in the world for one frame
+	struct OccluderInstance {
+		uint32_t  mesh;   // returned by AddMesh
+		glm::mat4 model;
+	};
+
+	// object space box tested against occluders
+	struct OcclusionQuery {
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::mat4 model;
+	};
+
+	struct SoftwareOcclusionStats {
+		uint32_t occluders = 0;
+		uint32_t triangles = 0;  // set up for rasterization (in front of near plane, not degenerate, on screen)
+		uint32_t tested    = 0;
+		uint32_t culled    = 0;
+		double   rasterMs  = 0.0;
+		double   testMs    = 0.0;
+	};
+
+	// Cpu occlusion culling for when gpu culling isn't available
+	// A few big occluder meshes are rasterized into a small depth buffer (nearest depth, pixel centers), rows of
+	// 8 pixels at a time with avx2, bands of 8 rows in parallel on job system
+	// Every 8x8 block also keeps the farthest depth in it, so most boxes are decided by a few block reads, boxes
+	// that are in front of some block fall back to its pixels
+	// Not conservative at occluder edges: a pixel covered at its center counts as covered
+	class SoftwareOcclusion {
+	public:
+		// width and height are rounded up to multiple of block size, jobs can be null (everything on calling thread)
+		void Initialize(JobSystem *jobs, uint32_t width = 320, uint32_t height = 192, SimdLevel level = getSimdLevel());
+
+		// positions and triangle list indices are copied, returns mesh id for OccluderInstance
+		uint32_t AddMesh(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices);
+
+		// clears depth and rasterizes occluders seen with viewProj
+		void Render(const glm::mat4 &viewProj, const std::vector<OccluderInstance> &occluders);
+
+		// occluded[i] is 1 when box i is behind rendered occluders, thread safe between Render calls
+		void Test(const OcclusionQuery *queries, uint32_t count, uint8_t *occluded);
+		bool IsOccluded(const OcclusionQuery &query) const;
+
+		// depth buffer after Render, row major, 1 - nothing rendered
+		const float *GetDepth()  const { return m_depth.data(); }
+		uint32_t     GetWidth()  const { return m_width; }
+		uint32_t     GetHeight() const { return m_height; }
+
+		SimdLevel GetSimdLevel() const { return m_level; }
+		void      SetSimdLevel(SimdLevel level) { m_level = level; }
+
+		const SoftwareOcclusionStats &GetStats() const { return m_stats; }
+		void PrintStats() const;
+
+		static const uint32_t BLOCK_SIZE = 8;  // block is 8x8 pixels, band is one row of blocks
+
+	private:
+		struct Mesh {
+			uint32_t firstPosition;
+			uint32_t positionCount;
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+
+		// edge functions and depth plane in pixel coordinates: value = a * x + b * y + c
+		struct Triangle {
+			float edgeA[3];
+			float edgeB[3];
+			float edgeC[3];
+			float depthA;
+			float depthB;
+			float depthC;
+			int   minX;
+			int   maxX;
+			int   minY;
+			int   maxY;  // minY > maxY - nothing to rasterize
+		};
+
+		void SetupOccluder(uint32_t occluder);
+		void BinTriangles();
+		void RenderBand(uint32_t band);
+		void UpdateBlocks(uint32_t band);
+		void ParallelFor(uint32_t count, uint32_t grainSize, const JobSystem::RangeFunction &function);
+
+		JobSystem *m_jobs = nullptr;
+		SimdLevel  m_level = SimdLevel::Scalar;
+		uint32_t   m_width = 0;
+		uint32_t   m_height = 0;
+		uint32_t   m_blocksX = 0;
+		uint32_t   m_blocksY = 0;
+
+		// all meshes in one array each
+		std::vector<glm::vec3> m_positions;
+		std::vector<uint32_t>  m_indices;
+		std::vector<Mesh>      m_meshes;
+
+		// frame data, kept between frames so rendering doesn't allocate
+		glm::mat4                            m_viewProj{1.0f};
+		const std::vector<OccluderInstance> *m_occluders = nullptr;
+		std::vector<uint32_t>                m_firstVertex;    // per occluder, into m_screenVertices
+		std::vector<uint32_t>                m_firstTriangle;  // per occluder, into m_triangles
+		std::vector<glm::vec4>               m_screenVertices; // pixel x, y, ndc depth, w < 0 - behind near plane
+		std::vector<Triangle>                m_triangles;
+		std::vector<uint32_t>                m_bandOffsets;    // band b rasterizes m_bandTriangles[offsets[b], offsets[b + 1])
+		std::vector<uint32_t>                m_bandTriangles;
+		std::vector<float>                   m_depth;
+		std::vector<float>                   m_blockMax;       // farthest depth of every block
+
+		SoftwareOcclusionStats m_stats;
+		uint64_t               m_frames = 0;
+		double                 m_totalMs = 0.0;
+	};
+
+}
@@ -0,0 +1,68 @@
+#include "timeline.h"
+
+using namespace vu;
+
+
+void Timeline::Initialize(VkDevice device) {
+	m_device = device;
+
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_semaphore) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create timeline semaphore!");
+	}
+
+	m_lastSubmitted = 0;
+	m_completed = 0;
+}
+
+
+void Timeline::Destroy() {
+	vkDestroySemaphore(m_device, m_semaphore, nullptr);
+	m_semaphore = VK_NULL_HANDLE;
+}
+
+
+uint64_t Timeline::GetCompleted() {
+	if (m_completed.load() < m_lastSubmitted.load()) {
+		uint64_t value = 0;
+		if (vkGetSemaphoreCounterValue(m_device, m_semaphore, &value) != VK_SUCCESS) {
+			throw std::runtime_error("failed to get timeline semaphore value!");
+		}
+		m_completed = value;
+	}
+	return m_completed.load();
+}
+
+
+bool Timeline::IsComplete(uint64_t value) {
+	return value <= m_completed.load() || value <= GetCompleted();
+}
+
+
+void Timeline::Wait(uint64_t value) {
+	if (IsComplete(value)) {
+		return;
+	}
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_semaphore;
+	waitInfo.pValues = &value;
+
+	if (vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+		throw std::runtime_error("failed to wait for timeline semaphore!");
+	}
+
+	// other threads may have seen a bigger value already
+	uint64_t completed = m_completed.load();
+	while (completed < value && !m_completed.compare_exchange_weak(completed, value)) {}
+}
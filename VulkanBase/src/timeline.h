@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdexcept>
+#include <atomic>
+
+#include <vulkan/vulkan.h>
+
+namespace vu {
+
+	// Timeline semaphore of one queue
+	// Every submission to the queue signals the next value, so "is this work finished" is one integer compare
+	// and the same value works for cpu waits, waits of other queues and resource reuse checks
+	class Timeline {
+	public:
+		void Initialize(VkDevice device);
+		void Destroy();
+
+		// value that next submission signals, call once per submission while holding the queue
+		// (values must reach the queue in increasing order)
+		uint64_t Next() { return ++m_lastSubmitted; }
+
+		uint64_t GetLastSubmitted() const { return m_lastSubmitted.load(); }
+
+		// asks driver only when cached value is behind
+		uint64_t GetCompleted();
+		bool IsComplete(uint64_t value);
+
+		// blocks until gpu reaches value
+		void Wait(uint64_t value);
+
+		VkSemaphore GetSemaphore() const { return m_semaphore; }
+
+	private:
+		VkDevice              m_device    = VK_NULL_HANDLE;
+		VkSemaphore           m_semaphore = VK_NULL_HANDLE;
+		std::atomic<uint64_t> m_lastSubmitted{0};
+		std::atomic<uint64_t> m_completed{0};
+	};
+
+}
@@ -5,87 +5,262 @@ using namespace vu;
 
 void Transform::SetPosition(glm::vec3 position) {
 	m_position = position;
+	m_modelMatrix[3] = glm::vec4(m_position, 1.0f);
 }
 
 
 void Transform::SetScale(glm::vec3 scale) {
 	m_scale = scale;
+	UpdateMatrix();
 }
 
 
-void Transform::SetRotation(glm::vec3 rotation) {
-	m_rotation = rotation;
+void Transform::SetRotation(glm::quat rotation) {
+	m_rotation = glm::normalize(rotation);
+	UpdateBasis();
+}
+
+
+void Transform::SetRotation(glm::vec3 eulerRadians) {
+	SetRotation(glm::angleAxis(eulerRadians.x, glm::vec3(1.0f, 0.0f, 0.0f)) *
+	            glm::angleAxis(eulerRadians.y, glm::vec3(0.0f, 1.0f, 0.0f)) *
+	            glm::angleAxis(eulerRadians.z, glm::vec3(0.0f, 0.0f, 1.0f)));
+}
+
+
+void Transform::Rotate(glm::quat rotation) {
+	SetRotation(m_rotation * rotation);
 }
 
 
 void Transform::RotateX(float radians) {
-	m_rotation.x += radians;
+	Rotate(glm::angleAxis(radians, glm::vec3(1.0f, 0.0f, 0.0f)));
 }
 
 
 void Transform::RotateY(float radians) {
-	m_rotation.y += radians;
+	Rotate(glm::angleAxis(radians, glm::vec3(0.0f, 1.0f, 0.0f)));
 }
 
 
 void Transform::RotateZ(float radians) {
-	m_rotation.z += radians;
+	Rotate(glm::angleAxis(radians, glm::vec3(0.0f, 0.0f, 1.0f)));
 }
 
 
-glm::vec3 Transform::GetPosition() const {
-	return m_position;
+void Transform::UpdateBasis() {
+	glm::mat3 rotation = glm::mat3_cast(m_rotation);
+	m_forward = rotation[0];
+	m_up = rotation[1];
+	m_right = rotation[2];
+
+	UpdateMatrix();
 }
 
 
-glm::vec3 Transform::GetScale() const {
-	return m_scale;
+void Transform::UpdateMatrix() {
+	// T * R * S, columns of rotation scaled and translation as last column
+	m_modelMatrix[0] = glm::vec4(m_forward * m_scale.x, 0.0f);
+	m_modelMatrix[1] = glm::vec4(m_up * m_scale.y, 0.0f);
+	m_modelMatrix[2] = glm::vec4(m_right * m_scale.z, 0.0f);
+	m_modelMatrix[3] = glm::vec4(m_position, 1.0f);
 }
 
 
-glm::vec3 Transform::GetRotation() const {
-	return m_rotation;
+// batch kernels write 16 floats per model and 12 per normal matrix (column major)
+static const uint32_t MODEL_FLOATS = 16;
+static const uint32_t NORMAL_FLOATS = 12;
+
+
+static void computeTransformMatricesScalar(const TransformStreams &t, uint32_t first, float *models, float *normals) {
+	for (uint32_t i = first; i < t.count; i++) {
+		glm::quat rotation(t.rotationW[i], t.rotationX[i], t.rotationY[i], t.rotationZ[i]);
+		glm::mat3 r = glm::mat3_cast(rotation);
+		glm::vec3 scale(t.scaleX[i], t.scaleY[i], t.scaleZ[i]);
+
+		glm::mat4 model(
+			glm::vec4(r[0] * scale.x, 0.0f),
+			glm::vec4(r[1] * scale.y, 0.0f),
+			glm::vec4(r[2] * scale.z, 0.0f),
+			glm::vec4(t.positionX[i], t.positionY[i], t.positionZ[i], 1.0f)
+		);
+		memcpy(models + i * MODEL_FLOATS, &model, sizeof(model));
+
+		if (normals) {
+			glm::mat3x4 normal(
+				glm::vec4(r[0] / scale.x, 0.0f),
+				glm::vec4(r[1] / scale.y, 0.0f),
+				glm::vec4(r[2] / scale.z, 0.0f)
+			);
+			memcpy(normals + i * NORMAL_FLOATS, &normal, sizeof(normal));
+		}
+	}
 }
 
 
-glm::mat4 Transform::GetModelMatrix() const {
-	glm::mat4 T = glm::translate(glm::mat4(1.0f), m_position);
-	glm::mat4 R = glm::rotate(glm::mat4(1.0), m_rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
-	R = glm::rotate(R, m_rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
-	R = glm::rotate(R, m_rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
-	glm::mat4 S = glm::scale(glm::mat4(1.0), m_scale);
+#if VU_SIMD_X86
 
-	return T * R * S;
+// x, y, z, w of one column for 4 transforms -> that column of 4 matrices
+static inline void storeColumnsSse2(float *out, uint32_t stride, uint32_t column, __m128 x, __m128 y, __m128 z, __m128 w) {
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(out + 0 * stride + column * 4, x);
+	_mm_storeu_ps(out + 1 * stride + column * 4, y);
+	_mm_storeu_ps(out + 2 * stride + column * 4, z);
+	_mm_storeu_ps(out + 3 * stride + column * 4, w);
 }
 
 
-glm::vec3 Transform::GetForward() const {
-	glm::vec3 forward;
-	forward.x = cos(glm::radians(m_rotation.y)) * cos(glm::radians(m_rotation.x));
-	forward.y = sin(glm::radians(m_rotation.x));
-	forward.z = sin(glm::radians(m_rotation.y)) * cos(glm::radians(m_rotation.x));
-	forward = glm::normalize(forward);
-	return forward;
+// 4 transforms per iteration, every lane is one transform, returns number of processed transforms
+static uint32_t computeTransformMatricesSse2(const TransformStreams &t, float *models, float *normals) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	uint32_t count = t.count & ~3u;
+	for (uint32_t i = 0; i < count; i += 4) {
+		__m128 qx = _mm_loadu_ps(t.rotationX + i);
+		__m128 qy = _mm_loadu_ps(t.rotationY + i);
+		__m128 qz = _mm_loadu_ps(t.rotationZ + i);
+		__m128 qw = _mm_loadu_ps(t.rotationW + i);
+
+		// rotation matrix from quaternion, same terms as glm::mat3_cast
+		__m128 x2 = _mm_add_ps(qx, qx);
+		__m128 y2 = _mm_add_ps(qy, qy);
+		__m128 z2 = _mm_add_ps(qz, qz);
+		__m128 xx = _mm_mul_ps(qx, x2);
+		__m128 yy = _mm_mul_ps(qy, y2);
+		__m128 zz = _mm_mul_ps(qz, z2);
+		__m128 xy = _mm_mul_ps(qx, y2);
+		__m128 xz = _mm_mul_ps(qx, z2);
+		__m128 yz = _mm_mul_ps(qy, z2);
+		__m128 wx = _mm_mul_ps(qw, x2);
+		__m128 wy = _mm_mul_ps(qw, y2);
+		__m128 wz = _mm_mul_ps(qw, z2);
+
+		__m128 r00 = _mm_sub_ps(one, _mm_add_ps(yy, zz));
+		__m128 r01 = _mm_add_ps(xy, wz);
+		__m128 r02 = _mm_sub_ps(xz, wy);
+		__m128 r10 = _mm_sub_ps(xy, wz);
+		__m128 r11 = _mm_sub_ps(one, _mm_add_ps(xx, zz));
+		__m128 r12 = _mm_add_ps(yz, wx);
+		__m128 r20 = _mm_add_ps(xz, wy);
+		__m128 r21 = _mm_sub_ps(yz, wx);
+		__m128 r22 = _mm_sub_ps(one, _mm_add_ps(xx, yy));
+
+		__m128 sx = _mm_loadu_ps(t.scaleX + i);
+		__m128 sy = _mm_loadu_ps(t.scaleY + i);
+		__m128 sz = _mm_loadu_ps(t.scaleZ + i);
+
+		float *model = models + i * MODEL_FLOATS;
+		storeColumnsSse2(model, MODEL_FLOATS, 0, _mm_mul_ps(r00, sx), _mm_mul_ps(r01, sx), _mm_mul_ps(r02, sx), zero);
+		storeColumnsSse2(model, MODEL_FLOATS, 1, _mm_mul_ps(r10, sy), _mm_mul_ps(r11, sy), _mm_mul_ps(r12, sy), zero);
+		storeColumnsSse2(model, MODEL_FLOATS, 2, _mm_mul_ps(r20, sz), _mm_mul_ps(r21, sz), _mm_mul_ps(r22, sz), zero);
+		storeColumnsSse2(model, MODEL_FLOATS, 3, _mm_loadu_ps(t.positionX + i), _mm_loadu_ps(t.positionY + i), _mm_loadu_ps(t.positionZ + i), one);
+
+		if (normals) {
+			float *normal = normals + i * NORMAL_FLOATS;
+			storeColumnsSse2(normal, NORMAL_FLOATS, 0, _mm_div_ps(r00, sx), _mm_div_ps(r01, sx), _mm_div_ps(r02, sx), zero);
+			storeColumnsSse2(normal, NORMAL_FLOATS, 1, _mm_div_ps(r10, sy), _mm_div_ps(r11, sy), _mm_div_ps(r12, sy), zero);
+			storeColumnsSse2(normal, NORMAL_FLOATS, 2, _mm_div_ps(r20, sz), _mm_div_ps(r21, sz), _mm_div_ps(r22, sz), zero);
+		}
+	}
+	return count;
 }
 
 
-glm::vec3 Transform::GetUp() const {
-	glm::vec3 up = glm::normalize(glm::cross(GetForward(), GetRight()));
-	return up;
+// x, y, z, w of one column for 8 transforms -> that column of 8 matrices
+VU_TARGET_AVX2 static inline void storeColumnsAvx2(float *out, uint32_t stride, uint32_t column, __m256 x, __m256 y, __m256 z, __m256 w) {
+	__m128 x0 = _mm256_castps256_ps128(x), x1 = _mm256_extractf128_ps(x, 1);
+	__m128 y0 = _mm256_castps256_ps128(y), y1 = _mm256_extractf128_ps(y, 1);
+	__m128 z0 = _mm256_castps256_ps128(z), z1 = _mm256_extractf128_ps(z, 1);
+	__m128 w0 = _mm256_castps256_ps128(w), w1 = _mm256_extractf128_ps(w, 1);
+
+	_MM_TRANSPOSE4_PS(x0, y0, z0, w0);
+	_MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+
+	_mm_storeu_ps(out + 0 * stride + column * 4, x0);
+	_mm_storeu_ps(out + 1 * stride + column * 4, y0);
+	_mm_storeu_ps(out + 2 * stride + column * 4, z0);
+	_mm_storeu_ps(out + 3 * stride + column * 4, w0);
+	_mm_storeu_ps(out + 4 * stride + column * 4, x1);
+	_mm_storeu_ps(out + 5 * stride + column * 4, y1);
+	_mm_storeu_ps(out + 6 * stride + column * 4, z1);
+	_mm_storeu_ps(out + 7 * stride + column * 4, w1);
 }
 
-glm::vec3 Transform::GetRight() const {
-	glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
-	glm::vec3 right = glm::normalize(glm::cross(GetForward(), up));
-	return right;
+
+// 8 transforms per iteration, same math as sse2 version
+VU_TARGET_AVX2 static uint32_t computeTransformMatricesAvx2(const TransformStreams &t, float *models, float *normals) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	uint32_t count = t.count & ~7u;
+	for (uint32_t i = 0; i < count; i += 8) {
+		__m256 qx = _mm256_loadu_ps(t.rotationX + i);
+		__m256 qy = _mm256_loadu_ps(t.rotationY + i);
+		__m256 qz = _mm256_loadu_ps(t.rotationZ + i);
+		__m256 qw = _mm256_loadu_ps(t.rotationW + i);
+
+		__m256 x2 = _mm256_add_ps(qx, qx);
+		__m256 y2 = _mm256_add_ps(qy, qy);
+		__m256 z2 = _mm256_add_ps(qz, qz);
+		__m256 xx = _mm256_mul_ps(qx, x2);
+		__m256 yy = _mm256_mul_ps(qy, y2);
+		__m256 zz = _mm256_mul_ps(qz, z2);
+		__m256 xy = _mm256_mul_ps(qx, y2);
+		__m256 xz = _mm256_mul_ps(qx, z2);
+		__m256 yz = _mm256_mul_ps(qy, z2);
+		__m256 wx = _mm256_mul_ps(qw, x2);
+		__m256 wy = _mm256_mul_ps(qw, y2);
+		__m256 wz = _mm256_mul_ps(qw, z2);
+
+		__m256 r00 = _mm256_sub_ps(one, _mm256_add_ps(yy, zz));
+		__m256 r01 = _mm256_add_ps(xy, wz);
+		__m256 r02 = _mm256_sub_ps(xz, wy);
+		__m256 r10 = _mm256_sub_ps(xy, wz);
+		__m256 r11 = _mm256_sub_ps(one, _mm256_add_ps(xx, zz));
+		__m256 r12 = _mm256_add_ps(yz, wx);
+		__m256 r20 = _mm256_add_ps(xz, wy);
+		__m256 r21 = _mm256_sub_ps(yz, wx);
+		__m256 r22 = _mm256_sub_ps(one, _mm256_add_ps(xx, yy));
+
+		__m256 sx = _mm256_loadu_ps(t.scaleX + i);
+		__m256 sy = _mm256_loadu_ps(t.scaleY + i);
+		__m256 sz = _mm256_loadu_ps(t.scaleZ + i);
+
+		float *model = models + i * MODEL_FLOATS;
+		storeColumnsAvx2(model, MODEL_FLOATS, 0, _mm256_mul_ps(r00, sx), _mm256_mul_ps(r01, sx), _mm256_mul_ps(r02, sx), zero);
+		storeColumnsAvx2(model, MODEL_FLOATS, 1, _mm256_mul_ps(r10, sy), _mm256_mul_ps(r11, sy), _mm256_mul_ps(r12, sy), zero);
+		storeColumnsAvx2(model, MODEL_FLOATS, 2, _mm256_mul_ps(r20, sz), _mm256_mul_ps(r21, sz), _mm256_mul_ps(r22, sz), zero);
+		storeColumnsAvx2(model, MODEL_FLOATS, 3, _mm256_loadu_ps(t.positionX + i), _mm256_loadu_ps(t.positionY + i), _mm256_loadu_ps(t.positionZ + i), one);
+
+		if (normals) {
+			float *normal = normals + i * NORMAL_FLOATS;
+			storeColumnsAvx2(normal, NORMAL_FLOATS, 0, _mm256_div_ps(r00, sx), _mm256_div_ps(r01, sx), _mm256_div_ps(r02, sx), zero);
+			storeColumnsAvx2(normal, NORMAL_FLOATS, 1, _mm256_div_ps(r10, sy), _mm256_div_ps(r11, sy), _mm256_div_ps(r12, sy), zero);
+			storeColumnsAvx2(normal, NORMAL_FLOATS, 2, _mm256_div_ps(r20, sz), _mm256_div_ps(r21, sz), _mm256_div_ps(r22, sz), zero);
+		}
+	}
+	return count;
 }
 
+#endif
 
-void Transform::BindModelMatrix(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
-	// update global push constants
-	vu::PushConstantsLocal pushConstants{};
-	pushConstants.model = GetModelMatrix();
 
-	// bind global push constants
-	vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, 64, &pushConstants);
-}
\ No newline at end of file
+void vu::computeTransformMatrices(const TransformStreams &transforms, glm::mat4 *models, glm::mat3x4 *normals, SimdLevel level) {
+	static_assert(sizeof(glm::mat4) == MODEL_FLOATS * sizeof(float), "model matrix must be tightly packed");
+	static_assert(sizeof(glm::mat3x4) == NORMAL_FLOATS * sizeof(float), "normal matrix must be tightly packed");
+
+	float *modelData = reinterpret_cast<float *>(models);
+	float *normalData = reinterpret_cast<float *>(normals);
+
+	// wide kernels stop at multiple of their width, the rest is done by scalar code
+	uint32_t done = 0;
+#if VU_SIMD_X86
+	if (level == SimdLevel::Avx2) {
+		done = computeTransformMatricesAvx2(transforms, modelData, normalData);
+	} else if (level == SimdLevel::Sse2) {
+		done = computeTransformMatricesSse2(transforms, modelData, normalData);
+	}
+#endif
+	computeTransformMatricesScalar(transforms, done, modelData, normalData);
+}
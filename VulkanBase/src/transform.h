@@ -1,53 +1,85 @@
 #pragma once
 
+#include <cstring>
+
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/hash.hpp>
 
+#include "simd.h"
 #include "vu.h"
 
 namespace vu {
+
+	// Position, rotation and scale of one object
+	// Model matrix and basis vectors are rebuilt when transform changes, getters only read them
+	// Local axes: forward is +X, up is +Y, right is +Z
 	class Transform {
 	public:
-		Transform() : 
-			m_position(0.0f), 
-			m_scale(1.0f), 
-			m_rotation(0.0f) {};
+		Transform() : Transform(glm::vec3(0.0f)) {};
 
-		Transform(glm::vec3 position) :
-			m_position(position),
-			m_scale(1.0f),
-			m_rotation(0.0f) {};
+		Transform(glm::vec3 position) : Transform(position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f)) {};
 
-		Transform(glm::vec3 position, glm::mat4 rotation, glm::vec3 scale) : 
-			m_position(position), 
-			m_scale(scale), 
-			m_rotation(0.0f) {};
+		Transform(glm::vec3 position, glm::quat rotation, glm::vec3 scale) :
+			m_position(position),
+			m_scale(scale),
+			m_rotation(rotation) {
+			UpdateBasis();
+		};
 
 		void SetPosition(glm::vec3 position);
 		void SetScale(glm::vec3 scale);
-		void SetRotation(glm::vec3 rotation);
+		void SetRotation(glm::quat rotation);
+		void SetRotation(glm::vec3 eulerRadians);  // x, then y, then z
 
+		// around local axes
+		void Rotate(glm::quat rotation);
 		void RotateX(float radians);
 		void RotateY(float radians);
 		void RotateZ(float radians);
 
-		glm::vec3 GetPosition()    const;
-		glm::vec3 GetScale()       const;
-		glm::vec3 GetRotation()    const;
-		glm::mat4 GetModelMatrix() const;
-		glm::vec3 GetForward()     const;
-		glm::vec3 GetUp()          const;
-		glm::vec3 GetRight()       const;
-
-		void BindModelMatrix(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+		glm::vec3        GetPosition()    const { return m_position; }
+		glm::vec3        GetScale()       const { return m_scale; }
+		glm::quat        GetRotation()    const { return m_rotation; }
+		const glm::mat4 &GetModelMatrix() const { return m_modelMatrix; }
+		glm::vec3        GetForward()     const { return m_forward; }
+		glm::vec3        GetUp()          const { return m_up; }
+		glm::vec3        GetRight()       const { return m_right; }
 
 	private:
+		void UpdateBasis();   // rotation changed
+		void UpdateMatrix();  // position or scale changed
+
 		glm::vec3 m_position;
 		glm::vec3 m_scale;
-		glm::vec3 m_rotation;
+		glm::quat m_rotation;
+
+		glm::mat4 m_modelMatrix{1.0f};
+		glm::vec3 m_forward{1.0f, 0.0f, 0.0f};
+		glm::vec3 m_up{0.0f, 1.0f, 0.0f};
+		glm::vec3 m_right{0.0f, 0.0f, 1.0f};
 	};
-}
 
+	// transforms as separate float arrays, one element per transform in every array
+	struct TransformStreams {
+		const float *positionX;
+		const float *positionY;
+		const float *positionZ;
+		const float *rotationX;  // unit quaternions
+		const float *rotationY;
+		const float *rotationZ;
+		const float *rotationW;
+		const float *scaleX;
+		const float *scaleY;
+		const float *scaleZ;
+		uint32_t     count;
+	};
+
+	// Model matrices (T * R * S) of all transforms in one call, 8 (avx2) or 4 (sse2) transforms at a time
+	// normals are inverse transpose of upper 3x3 (R * S^-1), columns padded to vec4 like mat3 in std430, can be null
+	void computeTransformMatrices(const TransformStreams &transforms, glm::mat4 *models, glm::mat3x4 *normals, SimdLevel level = getSimdLevel());
+
+}
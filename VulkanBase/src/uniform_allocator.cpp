@@ -0,0 +1,88 @@
+#include "uniform_allocator.h"
+
+using namespace vu;
+
+
+void UniformAllocator::Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, VkDeviceSize bytesPerFrame, VkBufferUsageFlags usage) {
+	m_rendererInfo = rendererInfo;
+	m_bytesPerFrame = bytesPerFrame;
+
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(m_rendererInfo.physicalDevice, &properties);
+	m_alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+		m_alignment = std::max(m_alignment, properties.limits.minStorageBufferOffsetAlignment);
+	}
+
+	// written by cpu once per frame and read by gpu once, sequential write into mapped memory is enough
+	m_frames.resize(framesInFlight);
+	for (Frame &frame : m_frames) {
+		vu::createBuffer(
+			m_rendererInfo.physicalDevice,
+			m_rendererInfo.allocator,
+			m_rendererInfo.surface,
+			m_bytesPerFrame,
+			usage,
+			VMA_MEMORY_USAGE_AUTO,
+			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+			frame.buffer, frame.allocation, frame.allocationInfo,
+			MemoryCategory::Uniform
+		);
+	}
+}
+
+
+void UniformAllocator::Destroy() {
+	for (Frame &frame : m_frames) {
+		vu::destroyBuffer(m_rendererInfo.allocator, frame.buffer, frame.allocation);
+	}
+	m_frames.clear();
+}
+
+
+void UniformAllocator::BeginFrame(uint32_t frameIndex) {
+	m_frameIndex = frameIndex;
+
+	// normally already reached, frame slot waits for the same value before recording
+	Frame &frame = m_frames[m_frameIndex];
+	m_rendererInfo.graphicsTimeline->Wait(frame.timelineValue);
+
+	frame.used = 0;
+	m_offset = 0;
+}
+
+
+void UniformAllocator::EndFrame(uint64_t timelineValue) {
+	Frame &frame = m_frames[m_frameIndex];
+	frame.timelineValue = timelineValue;
+	frame.used = std::min(m_offset.load(), m_bytesPerFrame);
+	m_peakBytes = std::max(m_peakBytes, frame.used);
+}
+
+
+UniformAllocation UniformAllocator::Allocate(VkDeviceSize size) {
+	VkDeviceSize alignedSize = (size + m_alignment - 1) & ~(m_alignment - 1);
+	VkDeviceSize offset = m_offset.fetch_add(alignedSize);
+
+	// padding after the block only matters for the next allocation
+	if (offset + size > m_bytesPerFrame) {
+		throw std::runtime_error("failed to allocate uniform data, frame buffer is full!");
+	}
+
+	Frame &frame = m_frames[m_frameIndex];
+
+	UniformAllocation allocation{};
+	allocation.data = static_cast<char *>(frame.allocationInfo.pMappedData) + offset;
+	allocation.offset = static_cast<uint32_t>(offset);
+	return allocation;
+}
+
+
+void UniformAllocator::PrintStats() const {
+	std::cout << "uniform allocator:\n";
+	std::cout << "\t" << "frames: " << m_frames.size() << " x " << m_bytesPerFrame << " bytes (alignment: " << m_alignment << ")\n";
+	for (size_t i = 0; i < m_frames.size(); i++) {
+		std::cout << "\t" << "frame " << i << ": " << m_frames[i].used << " bytes used\n";
+	}
+	std::cout << "\t" << "peak: " << m_peakBytes << " bytes\n\n";
+}
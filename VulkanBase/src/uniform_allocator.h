@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan.h>
+#include <VMA/vk_mem_alloc.h>
+
+#include "vu.h"
+
+namespace vu {
+
+	// uniform data written this frame
+	struct UniformAllocation {
+		void    *data   = nullptr;  // mapped pointer
+		uint32_t offset = 0;        // dynamic offset for vkCmdBindDescriptorSets
+	};
+
+	// Linear allocator for uniform data that changes every frame
+	// Every frame in flight owns one persistently mapped buffer, allocations just bump an offset and descriptors
+	// point at the start of the buffer with UNIFORM_BUFFER_DYNAMIC, so any number of uniform blocks needs
+	// one descriptor set per layout instead of one buffer and one set per block and frame
+	// Whole buffer of a frame is reclaimed at once, after graphics timeline reaches value of its last submission
+	class UniformAllocator {
+	public:
+		// usage - other per frame data (instance vertex data) can use the same scheme
+		void Initialize(const RendererInfo &rendererInfo, uint32_t framesInFlight, VkDeviceSize bytesPerFrame,
+			VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+		void Destroy();
+
+		// waits for last submission that used this frame's buffer and starts allocating from its beginning
+		void BeginFrame(uint32_t frameIndex);
+
+		// graphics timeline value of submission that reads allocations of current frame
+		void EndFrame(uint64_t timelineValue);
+
+		// aligned to minUniformBufferOffsetAlignment (and storage alignment for storage buffers), safe to call from several threads
+		UniformAllocation Allocate(VkDeviceSize size);
+
+		template<typename T>
+		UniformAllocation Push(const T &data) {
+			UniformAllocation allocation = Allocate(sizeof(T));
+			memcpy(allocation.data, &data, sizeof(T));
+			return allocation;
+		}
+
+		VkBuffer     GetBuffer(uint32_t frameIndex) const { return m_frames[frameIndex].buffer; }
+		VkDeviceSize GetUsedBytes(uint32_t frameIndex) const { return m_frames[frameIndex].used; }
+		VkDeviceSize GetPeakBytes() const { return m_peakBytes; }
+		VkDeviceSize GetBytesPerFrame() const { return m_bytesPerFrame; }
+
+		void PrintStats() const;
+
+	private:
+		struct Frame {
+			VkBuffer          buffer = VK_NULL_HANDLE;
+			VmaAllocation     allocation = VK_NULL_HANDLE;
+			VmaAllocationInfo allocationInfo{};
+			VkDeviceSize      used = 0;            // bytes allocated last time frame was recorded
+			uint64_t          timelineValue = 0;   // submission that reads this buffer
+		};
+
+		RendererInfo m_rendererInfo;
+
+		std::vector<Frame>        m_frames;
+		uint32_t                  m_frameIndex = 0;
+		std::atomic<VkDeviceSize> m_offset{0};
+		VkDeviceSize              m_bytesPerFrame = 0;
+		VkDeviceSize              m_alignment = 1;
+		VkDeviceSize              m_peakBytes = 0;
+	};
+
+}
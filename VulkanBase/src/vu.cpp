@@ -1,20 +1,10 @@
 #include "vu.h"
 
 
-void vu::createBuffer(
-		VkPhysicalDevice         physicalDevice,
-		VmaAllocator             allocator,
-		VkSurfaceKHR             surface,
-		VkDeviceSize             size,
-		VkBufferUsageFlags       bufferUsage,
-		VmaMemoryUsage           allocationUsage,
-		VmaAllocationCreateFlags allocationFlags,
-		VkBuffer                 &buffer,
-		VmaAllocation            &allocation,
-		VmaAllocationInfo        &allocationInfo) {
-
+VkBufferCreateInfo vu::makeBufferCreateInfo(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkDeviceSize size, VkBufferUsageFlags bufferUsage, uint32_t (&queueFamilyIndices)[2]) {
 	vu::QueueFamilyIndices indices = vu::findQueueFamilies(physicalDevice, surface);
-	uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.transferFamily.value()};
+	queueFamilyIndices[0] = indices.graphicsFamily.value();
+	queueFamilyIndices[1] = indices.transferFamily.value();
 
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -29,6 +19,26 @@ void vu::createBuffer(
 		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;  // owned by one queue family or multiple at the same time
 	}
 
+	return bufferInfo;
+}
+
+
+void vu::createBuffer(
+		VkPhysicalDevice         physicalDevice,
+		VmaAllocator             allocator,
+		VkSurfaceKHR             surface,
+		VkDeviceSize             size,
+		VkBufferUsageFlags       bufferUsage,
+		VmaMemoryUsage           allocationUsage,
+		VmaAllocationCreateFlags allocationFlags,
+		VkBuffer                 &buffer,
+		VmaAllocation            &allocation,
+		VmaAllocationInfo        &allocationInfo,
+		MemoryCategory           category) {
+
+	uint32_t queueFamilyIndices[2];
+	VkBufferCreateInfo bufferInfo = vu::makeBufferCreateInfo(physicalDevice, surface, size, bufferUsage, queueFamilyIndices);
+
 	VmaAllocationCreateInfo allocInfo{};
 	allocInfo.usage = allocationUsage;
 	allocInfo.flags = allocationFlags;
@@ -36,6 +46,14 @@ void vu::createBuffer(
 	if (vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer, &allocation, &allocationInfo) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create buffer!");
 	}
+
+	vu::tagAllocation(allocator, allocation, category);
+}
+
+
+void vu::destroyBuffer(VmaAllocator allocator, VkBuffer buffer, VmaAllocation allocation) {
+	vu::untagAllocation(allocator, allocation);
+	vmaDestroyBuffer(allocator, buffer, allocation);
 }
 
 
@@ -85,7 +103,7 @@ vu::QueueFamilyIndices vu::findQueueFamilies(VkPhysicalDevice physicalDevice, Vk
 }
 
 
-void vu::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDevice device, VkCommandPool commandPool, VkQueue submitQueue) {
+void vu::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDevice device, VkCommandPool commandPool, VkQueue submitQueue, Timeline &timeline) {
 	VkCommandBuffer commandBuffer = vu::beginSingleTimeCommands(commandPool, device);
 
 	// copy buffers
@@ -96,7 +114,7 @@ void vu::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, V
 
 	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
-	vu::endSingleTimeCommands(commandBuffer, commandPool, device, submitQueue);
+	vu::endSingleTimeCommands(commandBuffer, commandPool, device, submitQueue, timeline);
 }
 
 
@@ -122,18 +140,31 @@ VkCommandBuffer vu::beginSingleTimeCommands(VkCommandPool commandPool, VkDevice
 }
 
 
-void vu::endSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool commandPool, VkDevice device, VkQueue submitQueue) {
+void vu::endSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool commandPool, VkDevice device, VkQueue submitQueue, Timeline &timeline) {
 	// stop recording
 	vkEndCommandBuffer(commandBuffer);
 
-	// submit command buffer to queue
+	// submit command buffer to queue, it signals next value of queue timeline
+	uint64_t signalValue = timeline.Next();
+	VkSemaphore signalSemaphore = timeline.GetSemaphore();
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &signalValue;
+
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &signalSemaphore;
 
 	vkQueueSubmit(submitQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(submitQueue);
+
+	// wait only for this submission, not for frames in flight on the same queue
+	timeline.Wait(signalValue);
 
 	// free command buffer
 	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
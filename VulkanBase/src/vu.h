@@ -18,8 +18,14 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/hash.hpp>
 
+#include "timeline.h"
+#include "memory_stats.h"
+
 namespace vu {
 
+	class Defragmenter;
+	class DeletionQueue;
+
 	struct RendererInfo {
 		VkInstance               instance;
 		VkPhysicalDevice         physicalDevice;
@@ -28,7 +34,6 @@ namespace vu {
 		VkFormat                 swapChainImageFormat;
 		VkExtent2D               swapChainExtent;
 		VkSurfaceKHR             surface;
-		VkRenderPass             renderPass;
 		VmaAllocator             allocator;
 		VkDebugUtilsMessengerEXT debugMessenger;
 		VkCommandPool			 graphicsCommandPool;
@@ -36,6 +41,10 @@ namespace vu {
 		VkQueue					 graphicsQueue;
 		VkQueue					 presentQueue;
 		VkQueue					 transferQueue;
+		Timeline                *graphicsTimeline;
+		Timeline                *transferTimeline;
+		Defragmenter            *defragmenter;      // meshes and textures register their allocations to be movable
+		DeletionQueue           *deletionQueue;     // objects gpu may still use are destroyed through it
 	};
 
 	// Need this struct to check if our surface is compatible with swap-chain
@@ -52,10 +61,6 @@ namespace vu {
 		glm::vec4 data4;
 	};
 
-	struct PushConstantsLocal {
-		glm::mat4 model;
-	};
-
 	struct MaterialUbo {
 		glm::vec4 ColDiffuse;
 		glm::vec4 ColSpecular;
@@ -105,11 +110,41 @@ namespace vu {
 			return attributeDescriptions;
 		}
 
+		// position only stream (depth prepass), positions are copied into their own buffer so the pass reads 12 bytes per vertex instead of 32
+		static VkVertexInputBindingDescription getPositionBindingDescription() {
+			VkVertexInputBindingDescription bindingDescription{};
+			bindingDescription.binding = 0;
+			bindingDescription.stride = sizeof(glm::vec3);
+			bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+			return bindingDescription;
+		}
+
+		static VkVertexInputAttributeDescription getPositionAttributeDescription() {
+			VkVertexInputAttributeDescription attributeDescription{};
+			attributeDescription.binding = 0;
+			attributeDescription.location = 0;
+			attributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
+			attributeDescription.offset = 0;
+
+			return attributeDescription;
+		}
+
 		bool operator==(const Vertex& other) const {
 			return pos == other.pos && normal == other.normal && texCoord == other.texCoord;
 		}
 	};
 
+	// Per object data in storage buffer, vertex shader indexes it with gl_InstanceIndex
+	// layout matches ObjectData in shaders (std430, mat3 columns are padded to vec4)
+	struct ObjectData {
+		glm::mat4   model;
+		glm::mat4   prevModel;      // model matrix of previous frame, for motion vectors
+		glm::mat3x4 normal;         // inverse transpose of model, computed on cpu instead of per vertex
+		uint32_t    materialIndex;
+		uint32_t    pad[3];
+	};
+
 	// Need this struct to store information about shaders to compile them
 	struct ShaderCompilationInfo {
 		const char             *fileName;
@@ -128,6 +163,9 @@ namespace vu {
 		}
 	};
 
+	// buffer shared by graphics and transfer queue families, queueFamilyIndices must outlive returned info
+	VkBufferCreateInfo makeBufferCreateInfo(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkDeviceSize size, VkBufferUsageFlags bufferUsage, uint32_t (&queueFamilyIndices)[2]);
+
 	void createBuffer(
 		VkPhysicalDevice         physicalDevice,
 		VmaAllocator             allocator,
@@ -138,13 +176,18 @@ namespace vu {
 		VmaAllocationCreateFlags allocationFlags,
 		VkBuffer                 &buffer,
 		VmaAllocation            &allocation,
-		VmaAllocationInfo        &allocationInfo
+		VmaAllocationInfo        &allocationInfo,
+		MemoryCategory           category
 	);
 
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDevice device, VkCommandPool commandPool, VkQueue submitQueue);
+	// untags allocation before vmaDestroyBuffer
+	void destroyBuffer(VmaAllocator allocator, VkBuffer buffer, VmaAllocation allocation);
+
+	// timeline must belong to submitQueue
+	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDevice device, VkCommandPool commandPool, VkQueue submitQueue, Timeline &timeline);
 
 	VkCommandBuffer beginSingleTimeCommands(VkCommandPool commandPool, VkDevice device);
-	void endSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool commandPool, VkDevice device, VkQueue submitQueue);
+	void endSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool commandPool, VkDevice device, VkQueue submitQueue, Timeline &timeline);
 
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface);
 
@@ -158,6 +201,30 @@ namespace vu {
 	// === FORMATS ===
 	VkFormat findDepthFormat(VkPhysicalDevice physicalDevice);
 	VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features, VkPhysicalDevice physicalDevice);
+
+	// === HASHING ===
+	// FNV-1a, same input always gives same hash (used as cache keys)
+	const uint64_t HASH_SEED = 14695981039346656037ull;
+
+	inline void hashBytes(uint64_t &hash, const void *data, size_t size) {
+		const uint8_t *bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	// hash values one by one, so struct padding never ends up in the hash
+	template<typename T>
+	inline void hashValue(uint64_t &hash, const T &value) {
+		hashBytes(hash, &value, sizeof(value));
+	}
+
+	// -0.0f == 0.0f, so both must hash the same (NaN never compares equal, it doesn't matter)
+	inline void hashValue(uint64_t &hash, float value) {
+		float normalized = value == 0.0f ? 0.0f : value;
+		hashBytes(hash, &normalized, sizeof(normalized));
+	}
 }
 
 namespace std {